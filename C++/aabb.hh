@@ -0,0 +1,202 @@
+/* aabb.hh */
+#ifndef AABB_HH
+#define AABB_HH
+
+#include <limits>
+#include "vector.hh"
+
+/* Axis aligned bounding box over Vector<N, T>
+ * The bounds are inclusive. A default constructed box is empty, its lower
+ * corner above its upper one, so that expanding it by anything yields
+ * exactly that thing.
+ */
+template <int N, class T>
+class AABB
+{
+public:
+    typedef T scalar;
+    static constexpr int size = N;
+
+    constexpr AABB(void);
+    constexpr AABB(const Vector<N, T>&);
+    constexpr AABB(const Vector<N, T>&, const Vector<N, T>&);
+
+    constexpr const Vector<N, T>& lower(void) const;
+    constexpr const Vector<N, T>& upper(void) const;
+    constexpr bool                empty(void) const;
+    constexpr Vector<N, T>        center(void) const;
+    constexpr Vector<N, T>        extent(void) const;
+    constexpr int                 widest(void) const;
+    constexpr bool                contains(const Vector<N, T>&) const;
+    constexpr bool                contains(const AABB&) const;
+    constexpr bool                overlaps(const AABB&) const;
+    constexpr T                   quadrance(const Vector<N, T>&) const;
+
+    constexpr AABB& expand(const Vector<N, T>&);
+    constexpr AABB& expand(const AABB&);
+
+    constexpr inline bool operator ==(const AABB&) const;
+    constexpr inline bool operator !=(const AABB&) const;
+private:
+    Vector<N, T> _lower;
+    Vector<N, T> _upper;
+};
+
+template <int N, class T>
+constexpr AABB<N, T>::AABB(void)
+{
+    for(int i = 0; i < N; ++i)
+    {
+        this->_lower[i] = std::numeric_limits<T>::max();
+        this->_upper[i] = std::numeric_limits<T>::lowest();
+    }
+}
+
+template <int N, class T>
+constexpr AABB<N, T>::AABB(const Vector<N, T>& p)
+    : _lower(p), _upper(p)
+{
+}
+
+template <int N, class T>
+constexpr AABB<N, T>::AABB(const Vector<N, T>& lower, const Vector<N, T>& upper)
+    : _lower(lower), _upper(upper)
+{
+}
+
+template <int N, class T>
+constexpr const Vector<N, T>& AABB<N, T>::lower(void) const
+{
+    return this->_lower;
+}
+
+template <int N, class T>
+constexpr const Vector<N, T>& AABB<N, T>::upper(void) const
+{
+    return this->_upper;
+}
+
+template <int N, class T>
+constexpr bool AABB<N, T>::empty(void) const
+{
+    for(int i = 0; i < N; ++i)
+    {
+        if(this->_upper[i] < this->_lower[i])
+            return true;
+    }
+    return false;
+}
+
+template <int N, class T>
+constexpr Vector<N, T> AABB<N, T>::center(void) const
+{
+    return (this->_lower + this->_upper) / T(2);
+}
+
+template <int N, class T>
+constexpr Vector<N, T> AABB<N, T>::extent(void) const
+{
+    return this->_upper - this->_lower;
+}
+
+/* Axis along which the box is longest, the first one on ties
+ */
+template <int N, class T>
+constexpr int AABB<N, T>::widest(void) const
+{
+    int axis = 0;
+    for(int i = 1; i < N; ++i)
+    {
+        if(this->_upper[axis] - this->_lower[axis] < this->_upper[i] - this->_lower[i])
+            axis = i;
+    }
+    return axis;
+}
+
+template <int N, class T>
+constexpr bool AABB<N, T>::contains(const Vector<N, T>& p) const
+{
+    for(int i = 0; i < N; ++i)
+    {
+        if(p[i] < this->_lower[i] || this->_upper[i] < p[i])
+            return false;
+    }
+    return true;
+}
+
+template <int N, class T>
+constexpr bool AABB<N, T>::contains(const AABB<N, T>& b) const
+{
+    for(int i = 0; i < N; ++i)
+    {
+        if(b._lower[i] < this->_lower[i] || this->_upper[i] < b._upper[i])
+            return false;
+    }
+    return true;
+}
+
+template <int N, class T>
+constexpr bool AABB<N, T>::overlaps(const AABB<N, T>& b) const
+{
+    for(int i = 0; i < N; ++i)
+    {
+        if(b._upper[i] < this->_lower[i] || this->_upper[i] < b._lower[i])
+            return false;
+    }
+    return true;
+}
+
+/* Squared distance from p to the closest point of the box, zero inside
+ */
+template <int N, class T>
+constexpr T AABB<N, T>::quadrance(const Vector<N, T>& p) const
+{
+    T q = T();
+    for(int i = 0; i < N; ++i)
+    {
+        const T d = p[i] < this->_lower[i] ? this->_lower[i] - p[i] : (this->_upper[i] < p[i] ? p[i] - this->_upper[i] : T());
+        q += d * d;
+    }
+    return q;
+}
+
+template <int N, class T>
+constexpr AABB<N, T>& AABB<N, T>::expand(const Vector<N, T>& p)
+{
+    for(int i = 0; i < N; ++i)
+    {
+        this->_lower[i] = p[i] < this->_lower[i] ? p[i] : this->_lower[i];
+        this->_upper[i] = this->_upper[i] < p[i] ? p[i] : this->_upper[i];
+    }
+    return (*this);
+}
+
+template <int N, class T>
+constexpr AABB<N, T>& AABB<N, T>::expand(const AABB<N, T>& b)
+{
+    for(int i = 0; i < N; ++i)
+    {
+        this->_lower[i] = b._lower[i] < this->_lower[i] ? b._lower[i] : this->_lower[i];
+        this->_upper[i] = this->_upper[i] < b._upper[i] ? b._upper[i] : this->_upper[i];
+    }
+    return (*this);
+}
+
+template <int N, class T>
+constexpr inline bool AABB<N, T>::operator ==(const AABB<N, T>& b) const
+{
+    return this->_lower == b._lower && this->_upper == b._upper;
+}
+
+template <int N, class T>
+constexpr inline bool AABB<N, T>::operator !=(const AABB<N, T>& b) const
+{
+    return !(*this == b);
+}
+
+typedef AABB<2, float>  AABB2f;
+typedef AABB<3, float>  AABB3f;
+typedef AABB<2, double> AABB2lf;
+typedef AABB<3, double> AABB3lf;
+
+#endif /* AABB_HH */
@@ -0,0 +1,271 @@
+/* arena.hh */
+#ifndef ARENA_HH
+#define ARENA_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+
+/* Bump pointer memory resource
+ * Allocation advances a cursor through blocks taken from upstream,
+ * deallocation does nothing and reset() rewinds to the first block in O(1),
+ * keeping every block for reuse. Memory goes back upstream in release()
+ * or on destruction. An Arena is not thread safe, the intent is one per
+ * thread or per request.
+ */
+class Arena : public std::pmr::memory_resource
+{
+public:
+	explicit Arena(size_t block = 64 * 1024, std::pmr::memory_resource *upstream = std::pmr::get_default_resource())
+	{
+		this->_upstream = upstream;
+		this->_head     = nullptr;
+		this->_current  = nullptr;
+		this->_buffer   = nullptr;
+		this->_size     = 0;
+		this->_block    = block > sizeof(Block) ? block : sizeof(Block) + 1;
+		this->_cursor   = nullptr;
+		this->_end      = nullptr;
+	}
+
+	/* Allocates from buffer, which the arena does not own, before going upstream
+	 */
+	Arena(void *buffer, size_t size, size_t block = 64 * 1024,
+	      std::pmr::memory_resource *upstream = std::pmr::get_default_resource())
+		: Arena(block, upstream)
+	{
+		this->_buffer = static_cast<char *>(buffer);
+		this->_size   = size;
+		this->_cursor = this->_buffer;
+		this->_end    = this->_buffer + size;
+	}
+
+	Arena(const Arena &) = delete;
+	Arena &operator =(const Arena &) = delete;
+
+	~Arena(void)
+	{
+		this->release();
+	}
+
+	/* Invalidates everything allocated so far
+	 */
+	void reset(void)
+	{
+		this->_current = nullptr;
+		if(this->_buffer != nullptr || this->_head == nullptr)
+		{
+			this->_cursor = this->_buffer;
+			this->_end    = this->_buffer + this->_size;
+			return;
+		}
+		this->_current = this->_head;
+		this->_cursor  = this->_head->begin();
+		this->_end     = this->_head->end();
+	}
+
+	void release(void)
+	{
+		while(this->_head != nullptr)
+		{
+			Block *next = this->_head->next;
+			this->_upstream->deallocate(this->_head, this->_head->size, alignof(std::max_align_t));
+			this->_head = next;
+		}
+		this->_current = nullptr;
+		this->_cursor  = this->_buffer;
+		this->_end     = this->_buffer + this->_size;
+	}
+
+	std::pmr::memory_resource *upstream(void) const
+	{
+		return this->_upstream;
+	}
+protected:
+	void *do_allocate(size_t bytes, size_t alignment) override
+	{
+		/* Aligning can carry p past the end of a nearly full block */
+		char *p = Arena::align(this->_cursor, alignment);
+		if(p == nullptr || p > this->_end || bytes > (size_t)(this->_end - p))
+		{
+			this->next(bytes + alignment);
+			p = Arena::align(this->_cursor, alignment);
+		}
+		this->_cursor = p + bytes;
+		return p;
+	}
+
+	void do_deallocate(void *, size_t, size_t) override
+	{
+	}
+
+	bool do_is_equal(const std::pmr::memory_resource &resource) const noexcept override
+	{
+		return this == &resource;
+	}
+private:
+	/* Header at the start of every upstream block
+	 */
+	struct alignas(std::max_align_t) Block
+	{
+		Block *next;
+		size_t size;
+
+		char *begin(void)
+		{
+			return reinterpret_cast<char *>(this + 1);
+		}
+
+		char *end(void)
+		{
+			return reinterpret_cast<char *>(this) + this->size;
+		}
+	};
+
+	std::pmr::memory_resource *_upstream;
+	Block *_head;
+	Block *_current;
+	char *_buffer;
+	size_t _size;
+	size_t _block;
+	char *_cursor;
+	char *_end;
+
+	static char *align(char *p, size_t alignment)
+	{
+		if(p == nullptr)
+			return nullptr;
+		const uintptr_t a = reinterpret_cast<uintptr_t>(p);
+		return p + ((alignment - a % alignment) % alignment);
+	}
+
+	/* Moves on to the block after the current one, reusing it when it is
+	 * large enough and linking in a new one otherwise
+	 */
+	void next(size_t bytes)
+	{
+		Block *after = this->_current != nullptr ? this->_current->next : this->_head;
+		if(after == nullptr || (size_t)(after->end() - after->begin()) < bytes)
+		{
+			const size_t size = sizeof(Block) + (bytes > this->_block - sizeof(Block) ? bytes : this->_block - sizeof(Block));
+			Block *block = static_cast<Block *>(this->_upstream->allocate(size, alignof(std::max_align_t)));
+			block->next = after;
+			block->size = size;
+			if(this->_current != nullptr)
+				this->_current->next = block;
+			else
+				this->_head = block;
+			after = block;
+		}
+		this->_current = after;
+		this->_cursor  = after->begin();
+		this->_end     = after->end();
+	}
+};
+
+/* Pool of fixed size blocks
+ * Requests of at most block() bytes are served from a free list refilled
+ * count blocks at a time, larger ones go straight upstream. Like Arena it is
+ * not thread safe.
+ */
+class FixedPool : public std::pmr::memory_resource
+{
+public:
+	explicit FixedPool(size_t block, size_t count = 64, std::pmr::memory_resource *upstream = std::pmr::get_default_resource())
+	{
+		const size_t a = alignof(std::max_align_t);
+		this->_upstream = upstream;
+		this->_block    = ((block > sizeof(Node) ? block : sizeof(Node)) + a - 1) / a * a;
+		this->_count    = count > 0 ? count : 1;
+		this->_free     = nullptr;
+		this->_chunks   = nullptr;
+	}
+
+	FixedPool(const FixedPool &) = delete;
+	FixedPool &operator =(const FixedPool &) = delete;
+
+	~FixedPool(void)
+	{
+		this->release();
+	}
+
+	inline size_t block(void) const
+	{
+		return this->_block;
+	}
+
+	/* Returns every chunk upstream, including blocks still in use
+	 */
+	void release(void)
+	{
+		while(this->_chunks != nullptr)
+		{
+			Node *next = this->_chunks->next;
+			this->_upstream->deallocate(this->_chunks, this->chunk(), alignof(std::max_align_t));
+			this->_chunks = next;
+		}
+		this->_free = nullptr;
+	}
+protected:
+	void *do_allocate(size_t bytes, size_t alignment) override
+	{
+		if(bytes > this->_block || alignment > alignof(std::max_align_t))
+			return this->_upstream->allocate(bytes, alignment);
+		if(this->_free == nullptr)
+			this->refill();
+		Node *node  = this->_free;
+		this->_free = node->next;
+		return node;
+	}
+
+	void do_deallocate(void *p, size_t bytes, size_t alignment) override
+	{
+		if(bytes > this->_block || alignment > alignof(std::max_align_t))
+		{
+			this->_upstream->deallocate(p, bytes, alignment);
+			return;
+		}
+		Node *node  = static_cast<Node *>(p);
+		node->next  = this->_free;
+		this->_free = node;
+	}
+
+	bool do_is_equal(const std::pmr::memory_resource &resource) const noexcept override
+	{
+		return this == &resource;
+	}
+private:
+	struct Node
+	{
+		Node *next;
+	};
+
+	std::pmr::memory_resource *_upstream;
+	size_t _block;
+	size_t _count;
+	Node *_free;
+	Node *_chunks;
+
+	/* Chunks start with a block sized header linking them together
+	 */
+	inline size_t chunk(void) const
+	{
+		return (this->_count + 1) * this->_block;
+	}
+
+	void refill(void)
+	{
+		char *memory = static_cast<char *>(this->_upstream->allocate(this->chunk(), alignof(std::max_align_t)));
+		Node *header = reinterpret_cast<Node *>(memory);
+		header->next  = this->_chunks;
+		this->_chunks = header;
+		for(size_t i = this->_count; i > 0; --i)
+		{
+			Node *node  = reinterpret_cast<Node *>(memory + i * this->_block);
+			node->next  = this->_free;
+			this->_free = node;
+		}
+	}
+};
+
+#endif /* ARENA_HH */
@@ -0,0 +1,768 @@
+/* binary.hh */
+#ifndef BINARY_HH
+#define BINARY_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "complex.hh"
+#include "complexarray.hh"
+#include "dynmatrix.hh"
+#include "matrix.hh"
+#include "vector.hh"
+
+#if defined(__unix__) || defined(__APPLE__)
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#   define BINARY_MMAP 1
+#endif
+
+/* Binary files of matrices, vectors and complex buffers
+ * A file is a 64 byte header followed by records, each a 64 byte record
+ * header and a payload padded to a multiple of 64 bytes, so that every
+ * payload starts on a cache line of the file and of any mapping of it.
+ * A payload is the in-memory storage of what was written, padding and
+ * leading dimension included, which makes Reader one read per record and
+ * Mapping no work at all beyond mapping the file.
+ * Values keep the byte order of the writer, which the header records.
+ * Reader swaps the bytes of files from the other order, Mapping refuses
+ * them. I/O failures and malformed files throw std::runtime_error, asking
+ * for a record as the wrong type throws std::invalid_argument.
+ */
+namespace binary
+{
+
+inline constexpr uint32_t version   = 1;
+inline constexpr size_t   alignment = 64;
+inline constexpr uint32_t native    = 0x01020304;
+
+enum class Scalar : uint32_t
+{
+	Float32 = 1,
+	Float64 = 2,
+	Int32   = 3,
+	Int64   = 4,
+	UInt32  = 5,
+	UInt64  = 6
+};
+
+enum class Kind : uint32_t
+{
+	Matrix  = 1,
+	Complex = 2
+};
+
+/* Tag of the scalar type T
+ */
+template <class T>
+constexpr Scalar scalar(void)
+{
+	static_assert(std::is_arithmetic<T>::value && !std::is_same<T, bool>::value && (sizeof(T) == 4 || sizeof(T) == 8),
+	              "Only 32 and 64 bit arithmetic types can be stored");
+	if(std::is_floating_point<T>::value)
+		return sizeof(T) == 4 ? Scalar::Float32 : Scalar::Float64;
+	if(std::is_signed<T>::value)
+		return sizeof(T) == 4 ? Scalar::Int32 : Scalar::Int64;
+	return sizeof(T) == 4 ? Scalar::UInt32 : Scalar::UInt64;
+}
+
+struct Header
+{
+	char     magic[8];  /* "CONTBIN" */
+	uint32_t version;
+	uint32_t order;     /* native as seen by the writer */
+	uint64_t records;
+	uint8_t  reserved[40];
+};
+
+/* A matrix record holds count matrices of rows x columns, element (i, j)
+ * of matrix k being at (k * rows + i) * ld + j in row-major order, and at
+ * j * ld + i for a single column-major matrix. Arrays of Vector<N, T> are
+ * stored as count x N row-major matrices whose ld is the padded Vector.
+ * A complex record holds rows elements, as (re, im) pairs when interleaved
+ * and as rows real parts followed by rows imaginary parts from element ld
+ * on when split.
+ */
+struct Record
+{
+	uint32_t kind;
+	uint32_t scalar;
+	uint32_t layout;    /* MatrixOrder or ComplexLayout */
+	uint32_t reserved;
+	uint64_t count;
+	uint64_t rows;
+	uint64_t columns;
+	uint64_t ld;
+	uint64_t bytes;     /* payload before padding */
+	uint64_t offset;    /* of the payload from the start of the file, filled in when read */
+};
+
+static_assert(sizeof(Header) == alignment && sizeof(Record) == alignment, "Headers take one cache line");
+
+inline uint64_t padded(uint64_t bytes)
+{
+	return (bytes + alignment - 1) / alignment * alignment;
+}
+
+inline size_t width(uint32_t s)
+{
+	return s == (uint32_t)Scalar::Float32 || s == (uint32_t)Scalar::Int32 || s == (uint32_t)Scalar::UInt32 ? 4 : 8;
+}
+
+template <class T>
+inline void swap(T *p, size_t n)
+{
+	unsigned char *b = reinterpret_cast<unsigned char *>(p);
+	for(size_t i = 0; i < n; ++i, b += sizeof(T))
+	{
+		for(size_t k = 0; k < sizeof(T) / 2; ++k)
+		{
+			std::swap(b[k], b[sizeof(T) - 1 - k]);
+		}
+	}
+}
+
+inline uint32_t swapped(uint32_t x)
+{
+	binary::swap(&x, 1);
+	return x;
+}
+
+/* Checks the file header, returning whether it was written in the other
+ * byte order
+ */
+inline bool foreign(const Header &h)
+{
+	if(std::memcmp(h.magic, "CONTBIN", 8) != 0)
+		throw std::runtime_error("Not a binary container file");
+	const bool other = h.order != native;
+	if(other && h.order != binary::swapped(native))
+		throw std::runtime_error("Unknown byte order");
+	if((other ? binary::swapped(h.version) : h.version) > version)
+		throw std::runtime_error("Binary container file from a newer version");
+	return other;
+}
+
+/* Swaps a record header read in the other byte order
+ */
+inline void swap(Record &r)
+{
+	binary::swap(&r.kind, 4);
+	binary::swap(&r.count, 5);
+}
+
+/* Elements the payload of r spans, checked against its bytes and the file
+ * length
+ */
+inline uint64_t elements(const Record &r, uint64_t length)
+{
+	const uint64_t most = std::numeric_limits<uint64_t>::max() / 16;
+	uint64_t n = 0;
+	if(r.kind == (uint32_t)Kind::Matrix)
+	{
+		const bool rows = r.layout == (uint32_t)MatrixOrder::RowMajor;
+		if(!rows && (r.layout != (uint32_t)MatrixOrder::ColumnMajor || r.count > 1))
+			throw std::runtime_error("Malformed matrix record");
+		if(r.count > most || r.rows > most || r.columns > most || r.ld > most)
+			throw std::runtime_error("Malformed matrix record");
+		const uint64_t outer = rows ? r.count * r.rows : r.columns;
+		const uint64_t inner = rows ? r.columns : r.rows;
+		if(r.ld < inner || (outer != 0 && r.ld != 0 && outer - 1 > most / r.ld))
+			throw std::runtime_error("Malformed matrix record");
+		n = outer == 0 || inner == 0 ? 0 : (outer - 1) * r.ld + inner;
+	}
+	else if(r.kind == (uint32_t)Kind::Complex)
+	{
+		const bool split = r.layout == (uint32_t)ComplexLayout::Split;
+		if((!split && r.layout != (uint32_t)ComplexLayout::Interleaved) || r.rows > most || r.ld > most || (split && r.ld < r.rows))
+			throw std::runtime_error("Malformed complex record");
+		n = split ? (r.rows == 0 ? 0 : r.ld + r.rows) : 2 * r.rows;
+	}
+	else
+	{
+		throw std::runtime_error("Unknown record kind");
+	}
+	if(r.scalar < (uint32_t)Scalar::Float32 || r.scalar > (uint32_t)Scalar::UInt64 || n * binary::width(r.scalar) != r.bytes)
+		throw std::runtime_error("Malformed record");
+	if(r.offset > length || r.bytes > length - r.offset)
+		throw std::runtime_error("Truncated binary container file");
+	return n;
+}
+
+/* Checks that record r of a file holds T in kind k
+ */
+template <class T>
+inline void expect(const Record &r, Kind k)
+{
+	if(r.kind != (uint32_t)k)
+		throw std::invalid_argument("Record holds another kind of object");
+	if(r.scalar != (uint32_t)binary::scalar<T>())
+		throw std::invalid_argument("Record holds another scalar type");
+}
+
+/* Appends records to a new file, the header being completed by close()
+ */
+class Writer
+{
+public:
+	explicit Writer(const std::string &path)
+	{
+		this->_records = 0;
+		this->_file    = std::fopen(path.c_str(), "wb");
+		if(this->_file == nullptr)
+			throw std::runtime_error("Cannot create " + path);
+		Header h{};
+		std::memcpy(h.magic, "CONTBIN", 8);
+		h.version = version;
+		h.order   = native;
+		this->put(&h, sizeof(h));
+	}
+
+	Writer(const Writer &) = delete;
+	Writer &operator =(const Writer &) = delete;
+
+	/* Closes the file when close() was not called, ignoring errors
+	 */
+	~Writer(void)
+	{
+		if(this->_file == nullptr)
+			return;
+		try
+		{
+			this->close();
+		}
+		catch(const std::runtime_error &)
+		{
+		}
+	}
+
+	inline size_t size(void) const
+	{
+		return (size_t)this->_records;
+	}
+
+	template <unsigned R, unsigned C, typename T>
+	void write(const Matrix<R, C, T> *m, size_t count)
+	{
+		static_assert(sizeof(Matrix<R, C, T>) == R * C * sizeof(T), "Matrix<R, C, T> has to be its elements");
+		Record r = Writer::describe<T>(Kind::Matrix, (uint32_t)MatrixOrder::RowMajor, count, R, C, C);
+		r.bytes = (uint64_t)count * sizeof(Matrix<R, C, T>);
+		this->record(r, m);
+	}
+
+	template <unsigned R, unsigned C, typename T>
+	inline void write(const Matrix<R, C, T> &m)
+	{
+		this->write(&m, 1);
+	}
+
+	/* The storage of a as is, leading dimension and order included
+	 */
+	template <typename T>
+	void write(const DynMatrix<T> &a)
+	{
+		Record r = Writer::describe<T>(Kind::Matrix, (uint32_t)a.order(), 1, a.rows(), a.columns(), a.ld());
+		const size_t outer = a.order() == MatrixOrder::RowMajor ? a.rows() : a.columns();
+		const size_t inner = a.order() == MatrixOrder::RowMajor ? a.columns() : a.rows();
+		r.bytes = (outer == 0 || inner == 0 ? 0 : (uint64_t)(outer - 1) * a.ld() + inner) * sizeof(T);
+		this->record(r, a.data());
+	}
+
+	template <int N, class T>
+	void write(const Vector<N, T> *v, size_t count)
+	{
+		static_assert(sizeof(Vector<N, T>) % sizeof(T) == 0, "Vector<N, T> has to be its padded elements");
+		const size_t ld = sizeof(Vector<N, T>) / sizeof(T);
+		Record r = Writer::describe<T>(Kind::Matrix, (uint32_t)MatrixOrder::RowMajor, 1, count, N, ld);
+		r.bytes = (count == 0 ? 0 : (uint64_t)(count - 1) * ld + N) * sizeof(T);
+		this->record(r, v);
+	}
+
+	template <class T>
+	void write(const Complex<T> *values, size_t count)
+	{
+		Record r = Writer::describe<T>(Kind::Complex, (uint32_t)ComplexLayout::Interleaved, 1, count, 1, 0);
+		r.bytes = 2 * (uint64_t)count * sizeof(T);
+		this->record(r, values);
+	}
+
+	/* Split arrays are written with their imaginary parts on the next
+	 * cache line after the real parts, whatever they were borrowed from
+	 */
+	template <class T>
+	void write(const ComplexArray<T> &a)
+	{
+		if(a.interleaved())
+		{
+			this->write(reinterpret_cast<const Complex<T> *>(a.real()), a.size());
+			return;
+		}
+		const size_t ld = a.size() == 0 ? 0 : (size_t)binary::padded(a.size() * sizeof(T)) / sizeof(T);
+		Record r = Writer::describe<T>(Kind::Complex, (uint32_t)ComplexLayout::Split, 1, a.size(), 1, ld);
+		r.bytes = (a.size() == 0 ? 0 : (uint64_t)(ld + a.size())) * sizeof(T);
+		this->put(&r, sizeof(r));
+		this->put(a.real(), a.size() * sizeof(T));
+		this->pad((ld - a.size()) * sizeof(T));
+		this->put(a.imag(), a.size() * sizeof(T));
+		this->pad((size_t)(binary::padded(r.bytes) - r.bytes));
+		++this->_records;
+	}
+
+	/* Writes the record count and closes the file
+	 */
+	void close(void)
+	{
+		std::FILE *file = this->_file;
+		this->_file = nullptr;
+		const bool ok = std::fseek(file, (long)offsetof(Header, records), SEEK_SET) == 0 &&
+		                std::fwrite(&this->_records, sizeof(this->_records), 1, file) == 1;
+		if(std::fclose(file) != 0 || !ok)
+			throw std::runtime_error("Cannot complete binary container file");
+	}
+private:
+	std::FILE *_file;
+	uint64_t _records;
+
+	template <class T>
+	static Record describe(Kind kind, uint32_t layout, size_t count, size_t rows, size_t columns, size_t ld)
+	{
+		Record r{};
+		r.kind    = (uint32_t)kind;
+		r.scalar  = (uint32_t)binary::scalar<T>();
+		r.layout  = layout;
+		r.count   = count;
+		r.rows    = rows;
+		r.columns = columns;
+		r.ld      = ld;
+		return r;
+	}
+
+	void record(const Record &r, const void *data)
+	{
+		this->put(&r, sizeof(r));
+		this->put(data, (size_t)r.bytes);
+		this->pad((size_t)(binary::padded(r.bytes) - r.bytes));
+		++this->_records;
+	}
+
+	void put(const void *data, size_t bytes)
+	{
+		if(this->_file == nullptr)
+			throw std::runtime_error("Binary container file already closed");
+		if(bytes != 0 && std::fwrite(data, 1, bytes, this->_file) != bytes)
+			throw std::runtime_error("Cannot write binary container file");
+	}
+
+	void pad(size_t bytes)
+	{
+		static const unsigned char zero[alignment] = {};
+		this->put(zero, bytes);
+	}
+};
+
+/* Loads records into containers of their own
+ */
+class Reader
+{
+public:
+	explicit Reader(const std::string &path)
+	{
+		this->_file = std::fopen(path.c_str(), "rb");
+		if(this->_file == nullptr)
+			throw std::runtime_error("Cannot open " + path);
+		try
+		{
+			this->index();
+		}
+		catch(...)
+		{
+			std::fclose(this->_file);
+			throw;
+		}
+	}
+
+	Reader(const Reader &) = delete;
+	Reader &operator =(const Reader &) = delete;
+
+	~Reader(void)
+	{
+		std::fclose(this->_file);
+	}
+
+	inline size_t size(void) const
+	{
+		return this->_records.size();
+	}
+
+	inline const Record &record(size_t i) const
+	{
+		return this->_records.at(i);
+	}
+
+	/* Matrix record i, a batch reading as its matrices stacked vertically
+	 */
+	template <typename T>
+	DynMatrix<T> matrix(size_t i)
+	{
+		const Record &r = this->record(i);
+		binary::expect<T>(r, Kind::Matrix);
+		const MatrixOrder order = (MatrixOrder)r.layout;
+		DynMatrix<T> a((size_t)(r.count * r.rows), (size_t)r.columns, (size_t)r.ld, order);
+		this->read(r.offset, a.data(), (size_t)(r.bytes / sizeof(T)));
+		return a;
+	}
+
+	template <unsigned R, unsigned C, typename T>
+	std::vector<Matrix<R, C, T>> matrices(size_t i)
+	{
+		const Record &r = this->record(i);
+		binary::expect<T>(r, Kind::Matrix);
+		if(r.rows != R || r.columns != C || r.layout != (uint32_t)MatrixOrder::RowMajor)
+			throw std::invalid_argument("Record holds matrices of another size");
+
+		std::vector<Matrix<R, C, T>> m((size_t)r.count);
+		if(r.ld == C)
+		{
+			this->read(r.offset, reinterpret_cast<T *>(m.data()), m.size() * R * C);
+			return m;
+		}
+		std::vector<T> row(C);
+		for(size_t k = 0; k < m.size(); ++k)
+		{
+			for(unsigned j = 0; j < R; ++j)
+			{
+				this->read(r.offset + ((k * R + j) * r.ld) * sizeof(T), row.data(), C);
+				std::memcpy(m[k].data() + j * C, row.data(), C * sizeof(T));
+			}
+		}
+		return m;
+	}
+
+	template <int N, class T>
+	std::vector<Vector<N, T>> vectors(size_t i)
+	{
+		const Record &r = this->record(i);
+		binary::expect<T>(r, Kind::Matrix);
+		if(r.columns != (uint64_t)N || r.count != 1 || r.layout != (uint32_t)MatrixOrder::RowMajor)
+			throw std::invalid_argument("Record holds vectors of another size");
+
+		std::vector<Vector<N, T>> v((size_t)r.rows);
+		if(r.ld * sizeof(T) == sizeof(Vector<N, T>) && !v.empty())
+		{
+			this->read(r.offset, &v[0][0], (size_t)(r.bytes / sizeof(T)));
+			return v;
+		}
+		std::vector<T> row(N);
+		for(size_t k = 0; k < v.size(); ++k)
+		{
+			this->read(r.offset + k * r.ld * sizeof(T), row.data(), N);
+			for(int j = 0; j < N; ++j)
+			{
+				v[k][j] = row[j];
+			}
+		}
+		return v;
+	}
+
+	/* Complex record i in the layout it was written in
+	 */
+	template <class T>
+	ComplexArray<T> complex(size_t i)
+	{
+		const Record &r = this->record(i);
+		binary::expect<T>(r, Kind::Complex);
+		const ComplexLayout layout = (ComplexLayout)r.layout;
+		ComplexArray<T> a((size_t)r.rows, layout);
+		if(layout == ComplexLayout::Interleaved)
+		{
+			this->read(r.offset, a.real(), 2 * a.size());
+			return a;
+		}
+		this->read(r.offset, a.real(), a.size());
+		this->read(r.offset + r.ld * sizeof(T), a.imag(), a.size());
+		return a;
+	}
+private:
+	std::FILE *_file;
+	std::vector<Record> _records;
+	bool _foreign;
+
+	void seek(uint64_t offset)
+	{
+#if defined(BINARY_MMAP)
+		const bool ok = ::fseeko(this->_file, (off_t)offset, SEEK_SET) == 0;
+#elif defined(_WIN32)
+		const bool ok = ::_fseeki64(this->_file, (long long)offset, SEEK_SET) == 0;
+#else
+		const bool ok = offset <= (uint64_t)std::numeric_limits<long>::max() && std::fseek(this->_file, (long)offset, SEEK_SET) == 0;
+#endif
+		if(!ok)
+			throw std::runtime_error("Cannot seek in binary container file");
+	}
+
+	void get(uint64_t offset, void *data, size_t bytes)
+	{
+		this->seek(offset);
+		if(bytes != 0 && std::fread(data, 1, bytes, this->_file) != bytes)
+			throw std::runtime_error("Cannot read binary container file");
+	}
+
+	template <class T>
+	void read(uint64_t offset, T *data, size_t n)
+	{
+		this->get(offset, data, n * sizeof(T));
+		if(this->_foreign)
+			binary::swap(data, n);
+	}
+
+	uint64_t length(void)
+	{
+#if defined(BINARY_MMAP)
+		if(::fseeko(this->_file, 0, SEEK_END) != 0)
+			throw std::runtime_error("Cannot seek in binary container file");
+		return (uint64_t)::ftello(this->_file);
+#elif defined(_WIN32)
+		if(::_fseeki64(this->_file, 0, SEEK_END) != 0)
+			throw std::runtime_error("Cannot seek in binary container file");
+		return (uint64_t)::_ftelli64(this->_file);
+#else
+		if(std::fseek(this->_file, 0, SEEK_END) != 0)
+			throw std::runtime_error("Cannot seek in binary container file");
+		return (uint64_t)std::ftell(this->_file);
+#endif
+	}
+
+	void index(void)
+	{
+		const uint64_t length = this->length();
+		Header h;
+		this->get(0, &h, sizeof(h));
+		this->_foreign = binary::foreign(h);
+		if(this->_foreign)
+			binary::swap(&h.records, 1);
+
+		uint64_t offset = sizeof(Header);
+		for(uint64_t k = 0; k < h.records; ++k)
+		{
+			if(offset > length || length - offset < sizeof(Record))
+				throw std::runtime_error("Truncated binary container file");
+			Record r;
+			this->get(offset, &r, sizeof(r));
+			if(this->_foreign)
+				binary::swap(r);
+			r.offset = offset + sizeof(Record);
+			binary::elements(r, length);
+			this->_records.push_back(r);
+			offset = r.offset + binary::padded(r.bytes);
+		}
+	}
+};
+
+/* A read only mapping of a whole file, handing out its records as
+ * containers borrowing the mapped payloads
+ * The pages are mapped copy on write, so writing through a view changes
+ * the view and never the file. The views are valid while the Mapping
+ * lives. Without mmap the file is read into one aligned buffer instead.
+ */
+class Mapping
+{
+public:
+	explicit Mapping(const std::string &path)
+	{
+		this->_base   = nullptr;
+		this->_length = 0;
+		this->open(path);
+		try
+		{
+			this->index();
+		}
+		catch(...)
+		{
+			this->release();
+			throw;
+		}
+	}
+
+	Mapping(Mapping &&m)
+		: _records(std::move(m._records))
+	{
+		this->_base   = m._base;
+		this->_length = m._length;
+		m._base   = nullptr;
+		m._length = 0;
+	}
+
+	Mapping(const Mapping &) = delete;
+	Mapping &operator =(const Mapping &) = delete;
+
+	~Mapping(void)
+	{
+		this->release();
+	}
+
+	inline size_t size(void) const
+	{
+		return this->_records.size();
+	}
+
+	inline const Record &record(size_t i) const
+	{
+		return this->_records.at(i);
+	}
+
+	/* Payload of record i, aligned to 64 bytes
+	 */
+	inline void *data(size_t i) const
+	{
+		return this->_base + this->record(i).offset;
+	}
+
+	/* Matrix record i as a borrowed DynMatrix, a batch as its matrices
+	 * stacked vertically
+	 */
+	template <typename T>
+	DynMatrix<T> matrix(size_t i) const
+	{
+		const Record &r = this->record(i);
+		binary::expect<T>(r, Kind::Matrix);
+		return DynMatrix<T>(static_cast<T *>(this->data(i)), (size_t)(r.count * r.rows), (size_t)r.columns, (size_t)r.ld, (MatrixOrder)r.layout);
+	}
+
+	/* The record(i).count matrices of a batch written from Matrix<R, C, T>
+	 */
+	template <unsigned R, unsigned C, typename T>
+	const Matrix<R, C, T> *matrices(size_t i) const
+	{
+		static_assert(sizeof(Matrix<R, C, T>) == R * C * sizeof(T), "Matrix<R, C, T> has to be its elements");
+		const Record &r = this->record(i);
+		binary::expect<T>(r, Kind::Matrix);
+		if(r.rows != R || r.columns != C || r.ld != C || r.layout != (uint32_t)MatrixOrder::RowMajor)
+			throw std::invalid_argument("Record holds matrices of another size");
+		return static_cast<const Matrix<R, C, T> *>(this->data(i));
+	}
+
+	/* The record(i).rows vectors of a record written from Vector<N, T>,
+	 * with the padding of this build
+	 */
+	template <int N, class T>
+	const Vector<N, T> *vectors(size_t i) const
+	{
+		const Record &r = this->record(i);
+		binary::expect<T>(r, Kind::Matrix);
+		if(r.columns != (uint64_t)N || r.count != 1 || r.ld * sizeof(T) != sizeof(Vector<N, T>) || r.layout != (uint32_t)MatrixOrder::RowMajor)
+			throw std::invalid_argument("Record holds vectors of another size or padding");
+		return static_cast<const Vector<N, T> *>(this->data(i));
+	}
+
+	/* Complex record i as a borrowed ComplexArray
+	 */
+	template <class T>
+	ComplexArray<T> complex(size_t i) const
+	{
+		const Record &r = this->record(i);
+		binary::expect<T>(r, Kind::Complex);
+		T *p = static_cast<T *>(this->data(i));
+		if(r.layout == (uint32_t)ComplexLayout::Interleaved)
+			return ComplexArray<T>(reinterpret_cast<Complex<T> *>(p), (size_t)r.rows);
+		return ComplexArray<T>(p, p + r.ld, (size_t)r.rows);
+	}
+private:
+	unsigned char *_base;
+	size_t _length;
+	std::vector<Record> _records;
+
+#if defined(BINARY_MMAP)
+	void open(const std::string &path)
+	{
+		const int fd = ::open(path.c_str(), O_RDONLY);
+		if(fd < 0)
+			throw std::runtime_error("Cannot open " + path);
+		struct stat s;
+		if(::fstat(fd, &s) != 0)
+		{
+			::close(fd);
+			throw std::runtime_error("Cannot stat " + path);
+		}
+		this->_length = (size_t)s.st_size;
+		void *base = this->_length == 0 ? nullptr : ::mmap(nullptr, this->_length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if(base == MAP_FAILED)
+			throw std::runtime_error("Cannot map " + path);
+		this->_base = static_cast<unsigned char *>(base);
+	}
+
+	void release(void)
+	{
+		if(this->_base != nullptr)
+			::munmap(this->_base, this->_length);
+		this->_base = nullptr;
+	}
+#else
+	void open(const std::string &path)
+	{
+		std::FILE *file = std::fopen(path.c_str(), "rb");
+		if(file == nullptr)
+			throw std::runtime_error("Cannot open " + path);
+		std::vector<unsigned char> chunk(1 << 20);
+		std::vector<unsigned char> contents;
+		for(size_t n; (n = std::fread(chunk.data(), 1, chunk.size(), file)) != 0; )
+		{
+			contents.insert(contents.end(), chunk.data(), chunk.data() + n);
+		}
+		const bool ok = std::ferror(file) == 0;
+		std::fclose(file);
+		if(!ok)
+			throw std::runtime_error("Cannot read " + path);
+		this->_length = contents.size();
+		if(this->_length != 0)
+		{
+			this->_base = static_cast<unsigned char *>(::operator new(this->_length, std::align_val_t(alignment)));
+			std::memcpy(this->_base, contents.data(), this->_length);
+		}
+	}
+
+	void release(void)
+	{
+		if(this->_base != nullptr)
+			::operator delete(this->_base, std::align_val_t(alignment));
+		this->_base = nullptr;
+	}
+#endif
+
+	void index(void)
+	{
+		if(this->_length < sizeof(Header))
+			throw std::runtime_error("Truncated binary container file");
+		Header h;
+		std::memcpy(&h, this->_base, sizeof(h));
+		if(binary::foreign(h))
+			throw std::runtime_error("Binary container file in the other byte order cannot be mapped");
+
+		uint64_t offset = sizeof(Header);
+		for(uint64_t k = 0; k < h.records; ++k)
+		{
+			if(offset > this->_length || this->_length - offset < sizeof(Record))
+				throw std::runtime_error("Truncated binary container file");
+			Record r;
+			std::memcpy(&r, this->_base + offset, sizeof(r));
+			r.offset = offset + sizeof(Record);
+			binary::elements(r, this->_length);
+			this->_records.push_back(r);
+			offset = r.offset + binary::padded(r.bytes);
+		}
+	}
+};
+
+} /* namespace binary */
+
+#endif /* BINARY_HH */
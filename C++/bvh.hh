@@ -0,0 +1,244 @@
+/* bvh.hh */
+#ifndef BVH_HH
+#define BVH_HH
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+#include "aabb.hh"
+#include "inlinestack.hh"
+#include "parallel.hh"
+#include "spatial.hh"
+
+/* Bounding volume hierarchy over AABB<N, T> boxes
+ * Every tree is laid out by spatial::Tree, each node holding the box around
+ * everything below it, with the boxes themselves in leaf order. Nodes split
+ * at the median box centre along the widest axis of the centres. Boxes
+ * inserted after a build are collected into further trees by
+ * spatial::Forest.
+ * Distances are those of AABB::quadrance, zero for a point inside a box.
+ */
+template <int N, class T>
+class BVH
+{
+public:
+	typedef spatial::Neighbour<T> Neighbour;
+
+	static constexpr size_t leaf = 4;
+	static constexpr size_t npos = spatial::npos;
+
+	BVH(void) = default;
+
+	BVH(const AABB<N, T> *boxes, size_t size, const parallel::Policy &policy = parallel::seq)
+	{
+		this->build(boxes, size, policy);
+	}
+
+	/* Replaces the contents with boxes[0 .. size), box i getting index i
+	 */
+	void build(const AABB<N, T> *boxes, size_t size, const parallel::Policy &policy = parallel::seq)
+	{
+		std::vector<Entry> entries(size);
+		for(size_t i = 0; i < size; ++i)
+		{
+			entries[i] = Entry{boxes[i], boxes[i].center(), i};
+		}
+		this->_forest.build(entries, policy);
+	}
+
+	/* Adds box and returns its index
+	 */
+	size_t insert(const AABB<N, T> &box)
+	{
+		return this->_forest.insert(Entry{box, box.center(), this->size()});
+	}
+
+	void clear(void)
+	{
+		this->_forest.clear();
+	}
+
+	inline size_t size(void) const
+	{
+		return this->_forest.size();
+	}
+
+	/* Indices of the boxes overlapping box into out, in no particular order
+	 */
+	void overlap(const AABB<N, T> &box, std::vector<size_t> &out) const
+	{
+		out.clear();
+		for(const Tree &tree : this->_forest.trees())
+		{
+			tree.overlap(box, out);
+		}
+		for(const Entry &e : this->_forest.pending())
+		{
+			if(e.box.overlaps(box))
+				out.push_back(e.index);
+		}
+	}
+
+	/* Box closest to q, index npos when the hierarchy is empty
+	 */
+	Neighbour nearest(const Vector<N, T> &q) const
+	{
+		spatial::Closest<T> s;
+		this->_forest.search(q, s);
+		return s.best;
+	}
+
+	/* The min(k, size()) boxes closest to q into out, nearest first
+	 */
+	void nearest(const Vector<N, T> &q, size_t k, std::vector<Neighbour> &out) const
+	{
+		out.clear();
+		if(k == 0)
+			return;
+		out.reserve(k < this->size() ? k : this->size());
+		spatial::Nearest<T> s{k, out};
+		this->_forest.search(q, s);
+		s.finish();
+	}
+
+	/* Every box within distance r of q into out, in no particular order
+	 */
+	void radius(const Vector<N, T> &q, T r, std::vector<Neighbour> &out) const
+	{
+		out.clear();
+		spatial::Radius<T> s{r * r, out};
+		this->_forest.search(q, s);
+	}
+private:
+	struct Entry
+	{
+		AABB<N, T> box;
+		Vector<N, T> center;
+		size_t index;
+
+		inline T quadrance(const Vector<N, T> &q) const
+		{
+			return this->box.quadrance(q);
+		}
+	};
+
+	struct Node
+	{
+		AABB<N, T> box;
+		unsigned link;   /* right child, or the first box of a leaf */
+		unsigned count;  /* boxes in a leaf, 0 for an inner node */
+	};
+
+	struct Visit
+	{
+		size_t node;
+		T quadrance;     /* distance to the box of node */
+	};
+
+	struct Tree : spatial::Tree<Tree, Entry, Node, leaf>
+	{
+		std::vector<AABB<N, T>> boxes;
+
+		void allocate(size_t n)
+		{
+			this->boxes.resize(n);
+		}
+
+		void fill(const Entry *e, size_t node, size_t begin, size_t end)
+		{
+			AABB<N, T> box;
+			for(size_t i = begin; i < end; ++i)
+			{
+				box.expand(e[i].box);
+				this->boxes[i] = e[i].box;
+			}
+			this->nodes[node] = Node{box, (unsigned)begin, (unsigned)(end - begin)};
+		}
+
+		/* Splits at the median centre along the widest axis of the centres
+		 */
+		void divide(Entry *e, size_t node, size_t begin, size_t mid, size_t end, size_t right)
+		{
+			AABB<N, T> box, centers;
+			for(size_t i = begin; i < end; ++i)
+			{
+				box.expand(e[i].box);
+				centers.expand(e[i].center);
+			}
+			this->nodes[node] = Node{box, (unsigned)right, 0};
+
+			const int axis = centers.widest();
+			std::nth_element(e + begin, e + mid, e + end, [axis](const Entry &a, const Entry &b) {
+				return a.center[axis] < b.center[axis];
+			});
+		}
+
+		inline Entry entry(size_t i) const
+		{
+			return Entry{this->boxes[i], this->boxes[i].center(), this->index[i]};
+		}
+
+		void overlap(const AABB<N, T> &box, std::vector<size_t> &out) const
+		{
+			InlineStack<size_t, 64> stack;
+			stack.push(0);
+			while(stack.size() != 0)
+			{
+				const size_t i = stack.pop_unsafe();
+				const Node &node = this->nodes[i];
+				if(!node.box.overlaps(box))
+					continue;
+				if(node.count == 0)
+				{
+					stack.push(node.link);
+					stack.push(i + 1);
+					continue;
+				}
+				for(unsigned j = node.link; j < node.link + node.count; ++j)
+				{
+					if(this->boxes[j].overlaps(box))
+						out.push_back(this->index[j]);
+				}
+			}
+		}
+
+		/* Hands every box that may lie within s.bound() of q to s.take(),
+		 * the nearer child first
+		 */
+		template <class S>
+		void search(const Vector<N, T> &q, S &s) const
+		{
+			InlineStack<Visit, 64> stack;
+			stack.push(Visit{0, this->nodes[0].box.quadrance(q)});
+			while(stack.size() != 0)
+			{
+				const Visit v = stack.pop_unsafe();
+				if(s.bound() < v.quadrance)
+					continue;
+
+				const Node &node = this->nodes[v.node];
+				if(node.count != 0)
+				{
+					for(unsigned i = node.link; i < node.link + node.count; ++i)
+					{
+						s.take(this->index[i], this->boxes[i].quadrance(q));
+					}
+					continue;
+				}
+				const Visit l{v.node + 1, this->nodes[v.node + 1].box.quadrance(q)};
+				const Visit r{node.link, this->nodes[node.link].box.quadrance(q)};
+				stack.push(r.quadrance < l.quadrance ? l : r);
+				stack.push(r.quadrance < l.quadrance ? r : l);
+			}
+		}
+	};
+
+	spatial::Forest<Tree, Entry, 16 * leaf> _forest;
+};
+
+typedef BVH<2, float>  BVH2f;
+typedef BVH<3, float>  BVH3f;
+typedef BVH<2, double> BVH2lf;
+typedef BVH<3, double> BVH3lf;
+
+#endif /* BVH_HH */
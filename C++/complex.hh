@@ -3,62 +3,74 @@
 #define COMPLEX_HH
 
 #include <cmath>
+#include <type_traits>
+#include "simd.hh"
 
 template <class T>
 class Complex
 {
 public:
-    Complex(const T& = T(), const T& = T());
+    constexpr Complex(const T& = T(), const T& = T());
     template <class U>
-    operator Complex<U>(void) const;
-    explicit operator T(void) const;
-    inline void set(const T&, const T&);
-    inline const T& real(void) const;
-    inline const T& imag(void) const;
-    inline T& real(void);
-    inline T& imag(void);
-
-    Complex reciprocal(void) const;
-    Complex conjugate(void) const;
-    Complex square(void) const;
+    constexpr operator Complex<U>(void) const;
+    constexpr explicit operator T(void) const;
+    constexpr inline void set(const T&, const T&);
+    constexpr inline const T& real(void) const;
+    constexpr inline const T& imag(void) const;
+    constexpr inline T& real(void);
+    constexpr inline T& imag(void);
+
+    constexpr Complex reciprocal(void) const;
+    constexpr Complex conjugate(void) const;
+    constexpr Complex square(void) const;
     Complex pow(const Complex&) const;
     Complex pow(const T&) const;
     Complex sqrt(void) const;
     Complex exp(void) const;
     Complex log(void) const;
-    T       norm(void) const;
+    constexpr T norm(void) const;
     auto    modulus(void) const;
     auto    argument(void) const;
 
-    inline Complex operator +(void) const;
-    inline Complex operator -(void) const;
-    inline Complex operator +(const Complex&) const;
-    inline Complex operator -(const Complex&) const;
-    inline Complex operator *(const Complex&) const;
-    inline Complex operator *(const T&) const;
-    inline Complex operator /(const Complex&) const;
-    inline Complex operator /(const T&) const;
-    inline bool operator ==(const Complex&) const;
-    inline bool operator !=(const Complex&) const;
-    Complex operator +=(const Complex&);
-    Complex operator -=(const Complex&);
-    Complex operator *=(const Complex&);
-    Complex operator *=(const T&);
-    Complex operator /=(const Complex&);
-    Complex operator /=(const T&);
+    /* r (cos phi + i sin phi), the cosine and sine sharing one sincos call
+     */
+    static Complex polar(const T&, const T&);
+
+    constexpr inline Complex operator +(void) const;
+    constexpr inline Complex operator -(void) const;
+    constexpr inline Complex operator +(const Complex&) const;
+    constexpr inline Complex operator -(const Complex&) const;
+    constexpr inline Complex operator *(const Complex&) const;
+    constexpr inline Complex operator *(const T&) const;
+    constexpr inline Complex operator /(const Complex&) const;
+    constexpr inline Complex operator /(const T&) const;
+    constexpr inline bool operator ==(const Complex&) const;
+    constexpr inline bool operator !=(const Complex&) const;
+    constexpr inline Complex& operator +=(const Complex&);
+    constexpr inline Complex& operator -=(const Complex&);
+    constexpr inline Complex& operator *=(const Complex&);
+    constexpr inline Complex& operator *=(const T&);
+    constexpr inline Complex& operator /=(const Complex&);
+    constexpr inline Complex& operator /=(const T&);
+
+    /* x * y + z, as one fused instruction when the target has it
+     */
+    static constexpr inline T madd(const T&, const T&, const T&);
  private:
+    static inline void sincos(const T&, T&, T&);
+
     T _real;
     T _imag;
 };
 
 template <class T>
-Complex<T>::Complex(const T& real, const T& imag)
+constexpr Complex<T>::Complex(const T& real, const T& imag)
+    : _real(real), _imag(imag)
 {
-    this->set(real, imag);
 }
 
 template <class T>
-inline void Complex<T>::set(const T& real, const T& imag)
+constexpr inline void Complex<T>::set(const T& real, const T& imag)
 {
     this->_real = real;
     this->_imag = imag;
@@ -66,57 +78,57 @@ inline void Complex<T>::set(const T& real, const T& imag)
 
 template <class T>
 template <class U>
-Complex<T>::operator Complex<U>(void) const
+constexpr Complex<T>::operator Complex<U>(void) const
 {
     return {static_cast<U>(this->real()), static_cast<U>(this->imag())};
 }
 
 template <class T>
-Complex<T>::operator T(void) const
+constexpr Complex<T>::operator T(void) const
 {
     return this->real();
 }
 
 
 template <class T>
-inline const T& Complex<T>::real(void) const
+constexpr inline const T& Complex<T>::real(void) const
 {
     return this->_real;
 }
 
 template <class T>
-inline const T& Complex<T>::imag(void) const
+constexpr inline const T& Complex<T>::imag(void) const
 {
     return this->_imag;
 }
 
 template <class T>
-inline T& Complex<T>::real(void)
+constexpr inline T& Complex<T>::real(void)
 {
     return this->_real;
 }
 
 template <class T>
-inline T& Complex<T>::imag(void)
+constexpr inline T& Complex<T>::imag(void)
 {
     return this->_imag;
 }
 
 template <class T>
-Complex<T> Complex<T>::reciprocal(void) const
+constexpr Complex<T> Complex<T>::reciprocal(void) const
 {
     return this->conjugate() / this->norm();
 }
 
 template <class T>
-Complex<T> Complex<T>::conjugate(void) const
+constexpr Complex<T> Complex<T>::conjugate(void) const
 {
     return {this->real(), -this->imag()};
 }
 
 
 template <class T>
-Complex<T> Complex<T>::square(void) const
+constexpr Complex<T> Complex<T>::square(void) const
 {
     Complex<T> z{};
     z.real()  = this->real() * this->real() - this->imag() * this->imag();
@@ -124,51 +136,50 @@ Complex<T> Complex<T>::square(void) const
     return z;
 }
 
+/* z^w = exp(w log z), log |z| and arg z being computed once
+ */
 template <class T>
 Complex<T> Complex<T>::pow(const Complex<T>& z) const
 {
-    Complex<T> w{};
-    const T phi = z.imag() * std::log(this->modulus()) + z.real() * this->argument();
-    const T mod = std::exp(z.real() * std::log(this->modulus()) - z.imag() * this->argument());
-    w.set(std::cos(phi), std::sin(phi));
-    return w * mod;
+    const T l = std::log(this->norm()) / 2;
+    const T a = this->argument();
+    return Complex<T>::polar(std::exp(z.real() * l - z.imag() * a), z.imag() * l + z.real() * a);
 }
 
 template <class T>
 Complex<T> Complex<T>::pow(const T& c) const
 {
-    Complex<T> z{};
-    z.real() = std::cos(this->argument() * c);
-    z.imag() = std::sin(this->argument() * c);
-    return z * std::pow(this->norm(), c / 2);
+    return Complex<T>::polar(std::pow(this->norm(), c / 2), this->argument() * c);
 }
 
+/* Principal root without trigonometry: t = sqrt((|z| + |re|) / 2) is the
+ * larger part of the root and im / 2t the other, which avoids cancellation
+ */
 template <class T>
 Complex<T> Complex<T>::sqrt(void) const
 {
-    Complex z{};
-    z.real() = std::cos(this->argument() / 2);
-    z.imag() = std::sin(this->argument() / 2);
-    return z * std::sqrt(this->modulus());
+    const T t = std::sqrt((this->modulus() + std::abs(this->real())) / 2);
+    if(t == T())
+        return {};
+    if(this->real() >= T())
+        return {t, this->imag() / (2 * t)};
+    return {std::abs(this->imag()) / (2 * t), this->imag() < T() ? -t : t};
 }
 
 template <class T>
 Complex<T> Complex<T>::exp(void) const
 {
-    Complex<T> z{};
-    z.real() = std::cos(this->imag());
-    z.imag() = std::sin(this->imag());
-    return z * std::exp(this->real());
+    return Complex<T>::polar(std::exp(this->real()), this->imag());
 }
 
 template <class T>
 Complex<T> Complex<T>::log(void) const
 {
-    return {std::log(this->modulus()), this->argument()};
+    return {std::log(this->norm()) / 2, this->argument()};
 }
 
 template <class T>
-T Complex<T>::norm(void) const
+constexpr T Complex<T>::norm(void) const
 {
     return this->real() * this->real() + this->imag() * this->imag();
 }
@@ -180,73 +191,102 @@ auto Complex<T>::modulus(void) const
 }
 
 
+/* In (-pi, pi], atan(im / re) would lose the quadrant for re < 0
+ */
 template <class T>
 auto Complex<T>::argument(void) const
 {
-    return std::atan(this->imag() / this->real());
+    return std::atan2(this->imag(), this->real());
+}
+
+template <class T>
+Complex<T> Complex<T>::polar(const T& r, const T& phi)
+{
+    T s, c;
+    Complex<T>::sincos(phi, s, c);
+    return {r * c, r * s};
 }
 
+/* sin and cos of phi from the C library's sincos where it has one (glibc),
+ * separate std::sin and std::cos calls elsewhere
+ */
 template <class T>
-inline Complex<T> Complex<T>::operator +(void) const
+inline void Complex<T>::sincos(const T& phi, T& s, T& c)
+{
+#if defined(__GLIBC__) && defined(_GNU_SOURCE)
+    if constexpr(std::is_same<T, float>::value)
+        return ::sincosf(phi, &s, &c);
+    if constexpr(std::is_same<T, double>::value)
+        return ::sincos(phi, &s, &c);
+    if constexpr(std::is_same<T, long double>::value)
+        return ::sincosl(phi, &s, &c);
+#endif
+    s = std::sin(phi);
+    c = std::cos(phi);
+}
+
+template <class T>
+constexpr inline Complex<T> Complex<T>::operator +(void) const
 {
     return (*this);
 }
 
 template <class T>
-inline Complex<T> Complex<T>::operator -(void) const
+constexpr inline Complex<T> Complex<T>::operator -(void) const
 {
     return {-this->real(), -this->imag()};
 }
 
 template <class T>
-inline Complex<T> Complex<T>::operator +(const Complex<T> &z) const
+constexpr inline Complex<T> Complex<T>::operator +(const Complex<T> &z) const
 {
     return Complex<T>(*this) += z;
 }
 
 template <class T>
-inline Complex<T> Complex<T>::operator -(const Complex<T> &z) const
+constexpr inline Complex<T> Complex<T>::operator -(const Complex<T> &z) const
 {
     return Complex<T>(*this) -= z;
 }
 
 template <class T>
-inline Complex<T> Complex<T>::operator *(const Complex<T> &z) const
+constexpr inline Complex<T> Complex<T>::operator *(const Complex<T> &z) const
 {
-    return Complex<T>(*this) * z;
+    return Complex<T>(*this) *= z;
 }
 
 template <class T>
-inline Complex<T> Complex<T>::operator *(const T &c) const
+constexpr inline Complex<T> Complex<T>::operator *(const T &c) const
 {
-    return Complex<T>(*this) * c;
+    return Complex<T>(*this) *= c;
 }
 
 template <class T>
-inline Complex<T> Complex<T>::operator /(const Complex<T> &z) const
+constexpr inline Complex<T> Complex<T>::operator /(const Complex<T> &z) const
 {
-    return Complex<T>(*this) / z;
+    return Complex<T>(*this) /= z;
 }
 
 template <class T>
-inline Complex<T> Complex<T>::operator /(const T &c) const
+constexpr inline Complex<T> Complex<T>::operator /(const T &c) const
 {
-    return Complex<T>(*this) / c;
+    return Complex<T>(*this) /= c;
 }
+
 template <class T>
-inline bool Complex<T>::operator ==(const Complex<T> &z) const
+constexpr inline bool Complex<T>::operator ==(const Complex<T> &z) const
 {
     return this->real() == z.real() && this->imag() == z.imag();
 }
 
 template <class T>
-inline bool Complex<T>::operator !=(const Complex<T> &z) const
+constexpr inline bool Complex<T>::operator !=(const Complex<T> &z) const
 {
     return this->real() != z.real() || this->imag() != z.imag();
 }
 
 template <class T>
-Complex<T> Complex<T>::operator +=(const Complex<T> &z)
+constexpr inline Complex<T>& Complex<T>::operator +=(const Complex<T> &z)
 {
     this->real() += z.real();
     this->imag() += z.imag();
@@ -254,7 +294,7 @@ Complex<T> Complex<T>::operator +=(const Complex<T> &z)
 }
 
 template <class T>
-Complex<T> Complex<T>::operator -=(const Complex<T> &z)
+constexpr inline Complex<T>& Complex<T>::operator -=(const Complex<T> &z)
 {
     this->real() -= z.real();
     this->imag() -= z.imag();
@@ -262,18 +302,17 @@ Complex<T> Complex<T>::operator -=(const Complex<T> &z)
 }
 
 template <class T>
-Complex<T> Complex<T>::operator *=(const Complex &z)
+constexpr inline Complex<T>& Complex<T>::operator *=(const Complex &z)
 {
     this->set(
         this->real() * z.real() - this->imag() * z.imag(),
         this->real() * z.imag() + this->imag() * z.real()
     );
     return (*this);
-
 }
 
 template <class T>
-Complex<T> Complex<T>::operator *=(const T &c)
+constexpr inline Complex<T>& Complex<T>::operator *=(const T &c)
 {
     this->real() *= c;
     this->imag() *= c;
@@ -281,24 +320,68 @@ Complex<T> Complex<T>::operator *=(const T &c)
 }
 
 template <class T>
-Complex<T> Complex<T>::operator /=(const Complex &z)
+constexpr inline Complex<T>& Complex<T>::operator /=(const Complex &z)
 {
+    const T norm = z.norm();
     this->set(
-        this->real() * z.real() + this->imag() * z.imag(),
-        this->imag() * z.real() - this->real() * z.imag()
+        (this->real() * z.real() + this->imag() * z.imag()) / norm,
+        (this->imag() * z.real() - this->real() * z.imag()) / norm
     );
-    (*this) /= z.norm();
     return (*this);
 }
 
 template <class T>
-Complex<T> Complex<T>::operator /=(const T &c)
+constexpr inline Complex<T>& Complex<T>::operator /=(const T &c)
 {
     this->real() /= c;
     this->imag() /= c;
     return (*this);
 }
 
+/* std::fma is not constexpr, constant expressions round twice instead
+ */
+template <class T>
+constexpr inline T Complex<T>::madd(const T &x, const T &y, const T &z)
+{
+    if(simd::constant())
+        return x * y + z;
+#if defined(FP_FAST_FMAF)
+    if constexpr(std::is_same<T, float>::value)
+        return std::fma(x, y, z);
+#endif
+#if defined(FP_FAST_FMA)
+    if constexpr(std::is_same<T, double>::value)
+        return std::fma(x, y, z);
+#endif
+#if defined(FP_FAST_FMAL)
+    if constexpr(std::is_same<T, long double>::value)
+        return std::fma(x, y, z);
+#endif
+    return x * y + z;
+}
+
+/* a * b + c without temporaries, four fused multiply-adds where available
+ */
+template <class T>
+constexpr inline Complex<T> fma(const Complex<T> &a, const Complex<T> &b, const Complex<T> &c)
+{
+    return {
+        Complex<T>::madd(a.real(), b.real(), Complex<T>::madd(-a.imag(), b.imag(), c.real())),
+        Complex<T>::madd(a.real(), b.imag(), Complex<T>::madd(a.imag(), b.real(), c.imag()))
+    };
+}
+
+/* a * conj(b), the correlation product
+ */
+template <class T>
+constexpr inline Complex<T> mul_conj(const Complex<T> &a, const Complex<T> &b)
+{
+    return {
+        Complex<T>::madd(a.real(), b.real(), a.imag() * b.imag()),
+        Complex<T>::madd(a.imag(), b.real(), -(a.real() * b.imag()))
+    };
+}
+
 typedef Complex<float>       Complexf;
 typedef Complex<double>      Complexlf;
 typedef Complex<long double> ComplexLf;
@@ -0,0 +1,735 @@
+/* complexarray.hh */
+#ifndef COMPLEXARRAY_HH
+#define COMPLEXARRAY_HH
+
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include "complex.hh"
+#include "fastmath.hh"
+#include "simd.hh"
+
+enum class ComplexLayout
+{
+	Interleaved,
+	Split
+};
+
+/* Buffer of complex numbers for bulk arithmetic
+ * Interleaved arrays hold (re, im) pairs like an array of Complex<T>, split
+ * arrays hold all real parts followed by all imaginary parts, each on its
+ * own cache line. Either way the real part of element i is real()[i * stride()]
+ * and the imaginary part imag()[i * stride()]. An array constructed over
+ * external buffers borrows them and never frees them.
+ * The kernels run over whole SIMD registers, split arrays needing no
+ * shuffles at all. Binary kernels need operands of the same layout and
+ * size, and throw std::invalid_argument otherwise; out may alias an input.
+ */
+template <class T>
+class ComplexArray
+{
+	static_assert(sizeof(Complex<T>) == 2 * sizeof(T), "Complex<T> has to be a plain (re, im) pair");
+public:
+	static constexpr size_t alignment = 64;
+
+	ComplexArray(size_t size = 0, ComplexLayout layout = ComplexLayout::Interleaved)
+	{
+		const size_t stride = ComplexArray::round(size);
+		this->_size   = size;
+		this->_layout = layout;
+		this->_owner  = true;
+		this->_data   = nullptr;
+		this->_imag   = nullptr;
+		if(size > 0)
+		{
+			this->_data = static_cast<T *>(::operator new(2 * stride * sizeof(T), std::align_val_t(alignment)));
+			this->_imag = this->_data + (layout == ComplexLayout::Interleaved ? 1 : stride);
+			std::memset(this->_data, 0, 2 * stride * sizeof(T));
+		}
+	}
+
+	ComplexArray(const Complex<T> *values, size_t size, ComplexLayout layout)
+		: ComplexArray(size, layout)
+	{
+		this->load(values, size);
+	}
+
+	/* Borrows data as an interleaved array, data has to outlive it
+	 */
+	ComplexArray(Complex<T> *data, size_t size)
+	{
+		this->_data   = reinterpret_cast<T *>(data);
+		this->_imag   = this->_data + 1;
+		this->_size   = size;
+		this->_layout = ComplexLayout::Interleaved;
+		this->_owner  = false;
+	}
+
+	/* Borrows real and imag as a split array
+	 */
+	ComplexArray(T *real, T *imag, size_t size)
+	{
+		this->_data   = real;
+		this->_imag   = imag;
+		this->_size   = size;
+		this->_layout = ComplexLayout::Split;
+		this->_owner  = false;
+	}
+
+	/* Copy of a converted to layout
+	 */
+	ComplexArray(const ComplexArray &a, ComplexLayout layout)
+		: ComplexArray(a.size(), layout)
+	{
+		this->assign(a);
+	}
+
+	ComplexArray(const ComplexArray &a)
+		: ComplexArray(a, a.layout())
+	{
+	}
+
+	ComplexArray(ComplexArray &&a)
+	{
+		this->_data = nullptr;
+		this->take(a);
+	}
+
+	/* Assigning to a borrowed array writes through to the borrowed buffers
+	 */
+	ComplexArray &operator =(const ComplexArray &a)
+	{
+		if(this == &a)
+			return (*this);
+		if(!this->_owner)
+		{
+			this->check(a.size());
+			this->assign(a);
+			return (*this);
+		}
+		ComplexArray copy(a);
+		this->release();
+		this->take(copy);
+		return (*this);
+	}
+
+	ComplexArray &operator =(ComplexArray &&a)
+	{
+		if(this == &a)
+			return (*this);
+		if(!this->_owner)
+		{
+			this->check(a.size());
+			this->assign(a);
+			return (*this);
+		}
+		this->release();
+		this->take(a);
+		return (*this);
+	}
+
+	~ComplexArray(void)
+	{
+		this->release();
+	}
+
+	/* Copies values[0 .. size) in, size must not exceed size()
+	 */
+	void load(const Complex<T> *values, size_t size)
+	{
+		if(this->interleaved())
+		{
+			if(size > 0)
+				std::memcpy((void *)this->_data, (const void *)values, size * sizeof(Complex<T>));
+			return;
+		}
+		for(size_t i = 0; i < size; ++i)
+		{
+			this->_data[i] = values[i].real();
+			this->_imag[i] = values[i].imag();
+		}
+	}
+
+	/* Copies the array out to values, which holds at least size() elements
+	 */
+	void store(Complex<T> *values) const
+	{
+		if(this->interleaved())
+		{
+			if(this->size() > 0)
+				std::memcpy((void *)values, (const void *)this->_data, this->size() * sizeof(Complex<T>));
+			return;
+		}
+		for(size_t i = 0; i < this->size(); ++i)
+		{
+			values[i].set(this->_data[i], this->_imag[i]);
+		}
+	}
+
+	inline size_t size(void) const
+	{
+		return this->_size;
+	}
+
+	inline ComplexLayout layout(void) const
+	{
+		return this->_layout;
+	}
+
+	inline bool interleaved(void) const
+	{
+		return this->_layout == ComplexLayout::Interleaved;
+	}
+
+	/* Distance in elements of T between consecutive real (or imaginary) parts
+	 */
+	inline size_t stride(void) const
+	{
+		return this->interleaved() ? 2 : 1;
+	}
+
+	inline const T *real(void) const
+	{
+		return this->_data;
+	}
+
+	inline T *real(void)
+	{
+		return this->_data;
+	}
+
+	inline const T *imag(void) const
+	{
+		return this->_imag;
+	}
+
+	inline T *imag(void)
+	{
+		return this->_imag;
+	}
+
+	/* No bounds checking is done on the element accessor functions
+	 */
+	inline Complex<T> get(size_t i) const
+	{
+		const size_t k = i * this->stride();
+		return {this->_data[k], this->_imag[k]};
+	}
+
+	inline void set(size_t i, const Complex<T> &z)
+	{
+		const size_t k = i * this->stride();
+		this->_data[k] = z.real();
+		this->_imag[k] = z.imag();
+	}
+
+	inline Complex<T> operator [](size_t i) const
+	{
+		return this->get(i);
+	}
+
+	/* out[i] = this[i] * b[i]
+	 */
+	void multiply(const ComplexArray &b, ComplexArray &out) const
+	{
+		this->check(b);
+		this->check(out);
+		this->product<false>(b, out);
+	}
+
+	/* out[i] = this[i] * conj(b[i])
+	 */
+	void multiply_conj(const ComplexArray &b, ComplexArray &out) const
+	{
+		this->check(b);
+		this->check(out);
+		this->product<true>(b, out);
+	}
+
+	/* this[i] += a[i] * b[i], the inner loop of a filter bank
+	 */
+	void multiply_add(const ComplexArray &a, const ComplexArray &b)
+	{
+		typedef typename simd::Widest<T>::type Pack;
+		constexpr size_t W = simd::Widest<T>::width;
+
+		this->check(a);
+		this->check(b);
+		const size_t n = this->size();
+		size_t i = 0;
+		if(this->interleaved())
+		{
+			T *z = this->_data;
+			const T *x = a._data, *y = b._data;
+			if constexpr(Pack::enabled)
+			{
+				for(; 2 * i + W <= 2 * n; i += W / 2)
+				{
+					Pack::storeu(z + 2 * i, Pack::add(Pack::loadu(z + 2 * i), Pack::cmul(Pack::loadu(x + 2 * i), Pack::loadu(y + 2 * i))));
+				}
+			}
+		}
+		else
+		{
+			if constexpr(Pack::enabled)
+			{
+				for(; i + W <= n; i += W)
+				{
+					const auto ar = Pack::loadu(a._data + i), ai = Pack::loadu(a._imag + i);
+					const auto br = Pack::loadu(b._data + i), bi = Pack::loadu(b._imag + i);
+					const auto zr = Pack::loadu(this->_data + i), zi = Pack::loadu(this->_imag + i);
+					Pack::storeu(this->_data + i, Pack::sub(Pack::madd(ar, br, zr), Pack::mul(ai, bi)));
+					Pack::storeu(this->_imag + i, Pack::madd(ar, bi, Pack::madd(ai, br, zi)));
+				}
+			}
+		}
+		for(; i < n; ++i)
+		{
+			this->set(i, fma(a.get(i), b.get(i), this->get(i)));
+		}
+	}
+
+	/* this[i] *= c
+	 */
+	void scale(const T &c)
+	{
+		if(this->interleaved())
+		{
+			ComplexArray::scale(this->_data, 2 * this->size(), c);
+			return;
+		}
+		ComplexArray::scale(this->_data, this->size(), c);
+		ComplexArray::scale(this->_imag, this->size(), c);
+	}
+
+	/* this[i] *= c, a rotation when |c| = 1
+	 */
+	void scale(const Complex<T> &c)
+	{
+		typedef typename simd::Widest<T>::type Pack;
+		constexpr size_t W = simd::Widest<T>::width;
+
+		const size_t n = this->size();
+		size_t i = 0;
+		if constexpr(Pack::enabled)
+		{
+			if(this->interleaved())
+			{
+				const auto w = ComplexArray::template repeat<Pack>(c.real(), c.imag());
+				for(; 2 * i + W <= 2 * n; i += W / 2)
+				{
+					Pack::storeu(this->_data + 2 * i, Pack::cmul(Pack::loadu(this->_data + 2 * i), w));
+				}
+			}
+			else
+			{
+				const auto cr = Pack::set1(c.real()), ci = Pack::set1(c.imag());
+				for(; i + W <= n; i += W)
+				{
+					const auto ar = Pack::loadu(this->_data + i), ai = Pack::loadu(this->_imag + i);
+					Pack::storeu(this->_data + i, Pack::sub(Pack::mul(ar, cr), Pack::mul(ai, ci)));
+					Pack::storeu(this->_imag + i, Pack::madd(ar, ci, Pack::mul(ai, cr)));
+				}
+			}
+		}
+		for(; i < n; ++i)
+		{
+			this->set(i, this->get(i) * c);
+		}
+	}
+
+	void conjugate(void)
+	{
+		typedef typename simd::Widest<T>::type Pack;
+		constexpr size_t W = simd::Widest<T>::width;
+
+		if(!this->interleaved())
+		{
+			ComplexArray::scale(this->_imag, this->size(), T(-1));
+			return;
+		}
+		const size_t n = this->size();
+		size_t i = 0;
+		if constexpr(Pack::enabled)
+		{
+			const auto s = ComplexArray::template repeat<Pack>(T(1), T(-1));
+			for(; 2 * i + W <= 2 * n; i += W / 2)
+			{
+				Pack::storeu(this->_data + 2 * i, Pack::mul(Pack::loadu(this->_data + 2 * i), s));
+			}
+		}
+		for(; i < n; ++i)
+		{
+			this->_imag[2 * i] = -this->_imag[2 * i];
+		}
+	}
+
+	/* out[i] = |this[i]|^2
+	 */
+	void norm(T *out) const
+	{
+		this->norms<false>(out);
+	}
+
+	/* out[i] = |this[i]|
+	 */
+	void magnitude(T *out) const
+	{
+		this->norms<true>(out);
+	}
+
+	/* out[i] = arg(this[i]) in (-pi, pi], see simd::atan2() for the fast error bounds
+	 */
+	void phase(T *out, Precision precision = Precision::Precise) const
+	{
+		typedef typename simd::Widest<T>::type Pack;
+		constexpr size_t W = simd::Widest<T>::width;
+
+		const size_t n = this->size(), s = this->stride();
+		size_t i = 0;
+		if constexpr(std::is_floating_point<T>::value)
+		{
+			if(precision == Precision::Fast)
+			{
+				if constexpr(Pack::enabled)
+				{
+					for(const size_t m = n - n % W; i < m; i += W)
+					{
+						typename Pack::type x, y;
+						this->lanes<Pack>(i, x, y);
+						Pack::storeu(out + i, simd::atan2<T, Pack>(y, x));
+					}
+				}
+				for(; i < n; ++i)
+				{
+					out[i] = simd::atan2<T, simd::Scalar<T>>(this->_imag[i * s], this->_data[i * s]);
+				}
+				return;
+			}
+		}
+		for(; i < n; ++i)
+		{
+			out[i] = std::atan2(this->_imag[i * s], this->_data[i * s]);
+		}
+	}
+
+	/* this[i] *= exp(i phi[i]), see simd::sincos() for the fast error bounds
+	 */
+	void rotate(const T *phi, Precision precision = Precision::Precise)
+	{
+		typedef typename simd::Widest<T>::type Pack;
+		constexpr size_t W = simd::Widest<T>::width;
+
+		const size_t n = this->size();
+		size_t i = 0;
+		if constexpr(std::is_floating_point<T>::value)
+		{
+			if(precision == Precision::Fast)
+			{
+				if constexpr(Pack::enabled)
+				{
+					for(const size_t m = n - n % W; i < m; i += W)
+					{
+						typename Pack::type x, y, s, c;
+						this->lanes<Pack>(i, x, y);
+						simd::sincos<T, Pack>(Pack::loadu(phi + i), s, c);
+						this->assign<Pack>(i, Pack::sub(Pack::mul(x, c), Pack::mul(y, s)), Pack::madd(x, s, Pack::mul(y, c)));
+					}
+				}
+				for(; i < n; ++i)
+				{
+					T s, c;
+					simd::sincos<T, simd::Scalar<T>>(phi[i], s, c);
+					this->set(i, this->get(i) * Complex<T>(c, s));
+				}
+				return;
+			}
+		}
+		for(; i < n; ++i)
+		{
+			this->set(i, this->get(i) * Complex<T>::polar(T(1), phi[i]));
+		}
+	}
+
+	/* this[i] = exp(this[i]), only the angle being approximated in fast mode
+	 */
+	void exp(Precision precision = Precision::Precise)
+	{
+		typedef typename simd::Widest<T>::type Pack;
+		constexpr size_t W = simd::Widest<T>::width;
+
+		const size_t n = this->size();
+		size_t i = 0;
+		if constexpr(std::is_floating_point<T>::value)
+		{
+			if(precision == Precision::Fast)
+			{
+				if constexpr(Pack::enabled)
+				{
+					alignas(alignment) T r[W];
+					for(const size_t m = n - n % W; i < m; i += W)
+					{
+						typename Pack::type x, y, s, c;
+						this->lanes<Pack>(i, x, y);
+						Pack::store(r, x);
+						for(size_t k = 0; k < W; ++k)
+						{
+							r[k] = std::exp(r[k]);
+						}
+						simd::sincos<T, Pack>(y, s, c);
+						const auto e = Pack::load(r);
+						this->assign<Pack>(i, Pack::mul(e, c), Pack::mul(e, s));
+					}
+				}
+				for(; i < n; ++i)
+				{
+					const Complex<T> z = this->get(i);
+					T s, c;
+					simd::sincos<T, simd::Scalar<T>>(z.imag(), s, c);
+					this->set(i, Complex<T>(c, s) * std::exp(z.real()));
+				}
+				return;
+			}
+		}
+		for(; i < n; ++i)
+		{
+			this->set(i, this->get(i).exp());
+		}
+	}
+private:
+	T *_data;
+	T *_imag;
+	size_t _size;
+	ComplexLayout _layout;
+	bool _owner;
+
+	static inline size_t round(size_t size)
+	{
+		const size_t block = alignment / sizeof(T) > 0 ? alignment / sizeof(T) : 1;
+		return (size + block - 1) / block * block;
+	}
+
+	/* Register of (x, y) pairs for the interleaved kernels
+	 */
+	template <class Pack>
+	static inline typename Pack::type repeat(const T &x, const T &y)
+	{
+		constexpr size_t W = simd::Widest<T>::width;
+
+		alignas(alignment) T v[W];
+		for(size_t k = 0; k < W; k += 2)
+		{
+			v[k]     = x;
+			v[k + 1] = y;
+		}
+		return Pack::load(v);
+	}
+
+	/* Real and imaginary parts of elements [i, i + W) as two registers
+	 */
+	template <class Pack>
+	inline void lanes(size_t i, typename Pack::type &x, typename Pack::type &y) const
+	{
+		constexpr size_t W = simd::Widest<T>::width;
+
+		if(!this->interleaved())
+		{
+			x = Pack::loadu(this->_data + i);
+			y = Pack::loadu(this->_imag + i);
+			return;
+		}
+		alignas(alignment) T re[W], im[W];
+		for(size_t k = 0; k < W; ++k)
+		{
+			re[k] = this->_data[2 * (i + k)];
+			im[k] = this->_data[2 * (i + k) + 1];
+		}
+		x = Pack::load(re);
+		y = Pack::load(im);
+	}
+
+	template <class Pack>
+	inline void assign(size_t i, typename Pack::type x, typename Pack::type y)
+	{
+		constexpr size_t W = simd::Widest<T>::width;
+
+		if(!this->interleaved())
+		{
+			Pack::storeu(this->_data + i, x);
+			Pack::storeu(this->_imag + i, y);
+			return;
+		}
+		alignas(alignment) T re[W], im[W];
+		Pack::store(re, x);
+		Pack::store(im, y);
+		for(size_t k = 0; k < W; ++k)
+		{
+			this->_data[2 * (i + k)]     = re[k];
+			this->_data[2 * (i + k) + 1] = im[k];
+		}
+	}
+
+	static void scale(T *a, size_t size, const T &c)
+	{
+		typedef typename simd::Widest<T>::type Pack;
+		constexpr size_t W = simd::Widest<T>::width;
+
+		size_t i = 0;
+		if constexpr(Pack::enabled)
+		{
+			const auto p = Pack::set1(c);
+			for(; i + W <= size; i += W)
+			{
+				Pack::storeu(a + i, Pack::mul(Pack::loadu(a + i), p));
+			}
+		}
+		for(; i < size; ++i)
+		{
+			a[i] *= c;
+		}
+	}
+
+	template <bool Conjugate>
+	void product(const ComplexArray &b, ComplexArray &out) const
+	{
+		typedef typename simd::Widest<T>::type Pack;
+		constexpr size_t W = simd::Widest<T>::width;
+
+		const size_t n = this->size();
+		size_t i = 0;
+		if constexpr(Pack::enabled)
+		{
+			if(this->interleaved())
+			{
+				const T *x = this->_data, *y = b._data;
+				T *z = out._data;
+				for(; 2 * i + W <= 2 * n; i += W / 2)
+				{
+					const auto p = Pack::loadu(x + 2 * i), q = Pack::loadu(y + 2 * i);
+					Pack::storeu(z + 2 * i, Conjugate ? Pack::cmulc(p, q) : Pack::cmul(p, q));
+				}
+			}
+			else
+			{
+				for(; i + W <= n; i += W)
+				{
+					const auto ar = Pack::loadu(this->_data + i), ai = Pack::loadu(this->_imag + i);
+					const auto br = Pack::loadu(b._data + i), bi = Pack::loadu(b._imag + i);
+					if constexpr(Conjugate)
+					{
+						Pack::storeu(out._data + i, Pack::madd(ar, br, Pack::mul(ai, bi)));
+						Pack::storeu(out._imag + i, Pack::sub(Pack::mul(ai, br), Pack::mul(ar, bi)));
+					}
+					else
+					{
+						Pack::storeu(out._data + i, Pack::sub(Pack::mul(ar, br), Pack::mul(ai, bi)));
+						Pack::storeu(out._imag + i, Pack::madd(ar, bi, Pack::mul(ai, br)));
+					}
+				}
+			}
+		}
+		for(; i < n; ++i)
+		{
+			out.set(i, Conjugate ? mul_conj(this->get(i), b.get(i)) : this->get(i) * b.get(i));
+		}
+	}
+
+	template <bool Root>
+	void norms(T *out) const
+	{
+		typedef typename simd::Widest<T>::type Pack;
+		constexpr size_t W = simd::Widest<T>::width;
+
+		const size_t n = this->size();
+		size_t i = 0;
+		if constexpr(Pack::enabled)
+		{
+			for(; i + W <= n; i += W)
+			{
+				typename Pack::type p;
+				if(this->interleaved())
+				{
+					const auto a = Pack::loadu(this->_data + 2 * i), b = Pack::loadu(this->_data + 2 * i + W);
+					p = Pack::pairsum(Pack::mul(a, a), Pack::mul(b, b));
+				}
+				else
+				{
+					const auto a = Pack::loadu(this->_data + i), b = Pack::loadu(this->_imag + i);
+					p = Pack::madd(a, a, Pack::mul(b, b));
+				}
+				Pack::storeu(out + i, Root ? Pack::sqrt(p) : p);
+			}
+		}
+		for(; i < n; ++i)
+		{
+			const T p = this->get(i).norm();
+			out[i] = Root ? (T)std::sqrt(p) : p;
+		}
+	}
+
+	void release(void)
+	{
+		if(this->_owner && this->_data != nullptr)
+			::operator delete(this->_data, std::align_val_t(alignment));
+		this->_data = nullptr;
+	}
+
+	void take(ComplexArray &a)
+	{
+		this->_data   = a._data;
+		this->_imag   = a._imag;
+		this->_size   = a._size;
+		this->_layout = a._layout;
+		this->_owner  = a._owner;
+		a._data  = nullptr;
+		a._imag  = nullptr;
+		a._size  = 0;
+		a._owner = true;
+	}
+
+	void check(size_t size) const
+	{
+		if(this->size() != size)
+			throw std::invalid_argument("Array sizes do not match");
+	}
+
+	void check(const ComplexArray &a) const
+	{
+		this->check(a.size());
+		if(this->layout() != a.layout())
+			throw std::invalid_argument("Array layouts do not match");
+	}
+
+	/* Copies the elements of a, which has the same size, in either layout
+	 */
+	void assign(const ComplexArray &a)
+	{
+		if(this->layout() == a.layout() && this->interleaved())
+		{
+			if(this->size() > 0)
+				std::memmove(this->_data, a._data, 2 * this->size() * sizeof(T));
+			return;
+		}
+		if(this->layout() == a.layout())
+		{
+			if(this->size() > 0)
+			{
+				std::memmove(this->_data, a._data, this->size() * sizeof(T));
+				std::memmove(this->_imag, a._imag, this->size() * sizeof(T));
+			}
+			return;
+		}
+		for(size_t i = 0; i < this->size(); ++i)
+		{
+			this->set(i, a.get(i));
+		}
+	}
+};
+
+typedef ComplexArray<float>  ComplexArrayf;
+typedef ComplexArray<double> ComplexArraylf;
+
+#endif /* COMPLEXARRAY_HH */
@@ -0,0 +1,301 @@
+/* concurrentstack.hh */
+#ifndef CONCURRENTSTACK_HH
+#define CONCURRENTSTACK_HH
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+#if defined(__SSE2__) || defined(_M_X64)
+#   include <immintrin.h>
+#endif
+
+/* Lock-free (Treiber) stack for sharing work between threads
+ * The top of the stack is a pointer packed with a version tag that every
+ * successful update increments, so a compare-and-swap against a top that
+ * has been popped and pushed back in the meantime fails (ABA). Nodes are
+ * recycled through an equally tagged free list and only deleted with the
+ * stack, which keeps reading the next pointer of a stale top safe.
+ * A push or pop that loses its compare-and-swap tries to meet an opposite
+ * operation in a small elimination array before retrying, so that under
+ * heavy contention pairs of operations cancel out without touching the top.
+ * Pointers are packed into 64 bits, leaving a 16 bit tag on 64 bit targets.
+ */
+template <typename T>
+class ConcurrentStack
+{
+public:
+	/* Elimination slots, and how long a push waits in one for a pop
+	 */
+	static constexpr size_t slots = 16;
+	static constexpr unsigned patience = 128;
+
+	ConcurrentStack(void)
+	{
+		this->_top.store(0, std::memory_order_relaxed);
+		this->_free.store(0, std::memory_order_relaxed);
+		for(size_t i = 0; i < slots; ++i)
+		{
+			this->_slots[i].value.store(0, std::memory_order_relaxed);
+		}
+	}
+
+	ConcurrentStack(const ConcurrentStack &) = delete;
+	ConcurrentStack &operator =(const ConcurrentStack &) = delete;
+
+	/* Must not race with any other operation
+	 */
+	~ConcurrentStack(void)
+	{
+		for(Node *n = ConcurrentStack::pointer(this->_top.load(std::memory_order_acquire)); n != nullptr;)
+		{
+			Node *next = n->next.load(std::memory_order_relaxed);
+			n->value()->~T();
+			delete n;
+			n = next;
+		}
+		for(Node *n = ConcurrentStack::pointer(this->_free.load(std::memory_order_acquire)); n != nullptr;)
+		{
+			Node *next = n->next.load(std::memory_order_relaxed);
+			delete n;
+			n = next;
+		}
+	}
+
+	void push(const T &x)
+	{
+		this->emplace(x);
+	}
+
+	void push(T &&x)
+	{
+		this->emplace(std::move(x));
+	}
+
+	template <class... Args>
+	void emplace(Args &&...args)
+	{
+		Node *n = this->make(std::forward<Args>(args)...);
+		this->link(n, n);
+	}
+
+	/* Pushes [first, last) with a single compare-and-swap, *(last - 1) ending
+	 * up on top
+	 */
+	template <class It>
+	void push_range(It first, It last)
+	{
+		Node *head = nullptr, *tail = nullptr;
+		for(; first != last; ++first)
+		{
+			Node *n = this->make(*first);
+			n->next.store(head, std::memory_order_relaxed);
+			if(tail == nullptr)
+				tail = n;
+			head = n;
+		}
+		if(head != nullptr)
+			this->link(head, tail);
+	}
+
+	/* Moves the top into x, returns false without waiting if the stack is empty
+	 */
+	bool try_pop(T &x)
+	{
+		Node *n = this->unlink();
+		if(n == nullptr)
+			return false;
+		x = std::move(*n->value());
+		n->value()->~T();
+		this->recycle(n);
+		return true;
+	}
+
+	/* Detaches the whole stack at once and moves it to out, top first
+	 */
+	template <class Out>
+	Out pop_all(Out out)
+	{
+		std::uint64_t t = this->_top.load(std::memory_order_relaxed);
+		while(!this->_top.compare_exchange_weak(t, ConcurrentStack::pack(nullptr, t), std::memory_order_acquire, std::memory_order_relaxed))
+			;
+		for(Node *n = ConcurrentStack::pointer(t); n != nullptr;)
+		{
+			Node *next = n->next.load(std::memory_order_relaxed);
+			*out = std::move(*n->value());
+			++out;
+			n->value()->~T();
+			this->recycle(n);
+			n = next;
+		}
+		return out;
+	}
+
+	/* Only a snapshot while other threads are pushing or popping
+	 */
+	bool empty(void) const
+	{
+		return ConcurrentStack::pointer(this->_top.load(std::memory_order_acquire)) == nullptr;
+	}
+private:
+	struct Node
+	{
+		std::atomic<Node *> next;
+		alignas(T) unsigned char storage[sizeof(T)];
+
+		inline T *value(void)
+		{
+			return std::launder(reinterpret_cast<T *>(this->storage));
+		}
+	};
+
+	struct alignas(64) Slot
+	{
+		std::atomic<std::uint64_t> value;
+	};
+
+	static_assert(sizeof(void *) <= 8, "Tagged pointers need pointers of at most 64 bits");
+
+	static constexpr unsigned      shift = sizeof(void *) == 8 ? 48 : 32;
+	static constexpr std::uint64_t mask  = (std::uint64_t(1) << shift) - 1;
+
+	alignas(64) std::atomic<std::uint64_t> _top;
+	alignas(64) std::atomic<std::uint64_t> _free;
+	Slot _slots[slots];
+
+	static inline Node *pointer(std::uint64_t t)
+	{
+		return reinterpret_cast<Node *>((std::uintptr_t)(t & mask));
+	}
+
+	/* p tagged with one more than the tag of t
+	 */
+	static inline std::uint64_t pack(Node *p, std::uint64_t t)
+	{
+		return (std::uint64_t)(std::uintptr_t)p | (((t >> shift) + 1) << shift);
+	}
+
+	static inline void pause(void)
+	{
+#if defined(__SSE2__) || defined(_M_X64)
+		_mm_pause();
+#endif
+	}
+
+	/* Per thread xorshift picking the elimination slot
+	 */
+	inline Slot &pick(void)
+	{
+		thread_local std::uint32_t seed = (std::uint32_t)(std::uintptr_t)&seed | 1;
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		return this->_slots[seed % slots];
+	}
+
+	template <class... Args>
+	Node *make(Args &&...args)
+	{
+		Node *n = this->acquire();
+		try
+		{
+			::new((void *)n->storage) T(std::forward<Args>(args)...);
+		}
+		catch(...)
+		{
+			this->recycle(n);
+			throw;
+		}
+		return n;
+	}
+
+	/* Pushes the chain head .. tail, a single node trying elimination on contention
+	 */
+	void link(Node *head, Node *tail)
+	{
+		std::uint64_t t = this->_top.load(std::memory_order_relaxed);
+		for(;;)
+		{
+			tail->next.store(ConcurrentStack::pointer(t), std::memory_order_relaxed);
+			if(this->_top.compare_exchange_weak(t, ConcurrentStack::pack(head, t), std::memory_order_release, std::memory_order_relaxed))
+				return;
+			if(head == tail && this->offer(head))
+				return;
+		}
+	}
+
+	Node *unlink(void)
+	{
+		std::uint64_t t = this->_top.load(std::memory_order_acquire);
+		for(;;)
+		{
+			Node *n = ConcurrentStack::pointer(t);
+			if(n == nullptr)
+				return nullptr;
+			Node *next = n->next.load(std::memory_order_relaxed);
+			if(this->_top.compare_exchange_weak(t, ConcurrentStack::pack(next, t), std::memory_order_acquire, std::memory_order_acquire))
+				return n;
+			if((n = this->take()) != nullptr)
+				return n;
+		}
+	}
+
+	/* Parks n in a free slot until a pop takes it, returns false if it was
+	 * withdrawn again (or never parked)
+	 */
+	bool offer(Node *n)
+	{
+		std::atomic<std::uint64_t> &slot = this->pick().value;
+		std::uint64_t s = slot.load(std::memory_order_relaxed);
+		if(ConcurrentStack::pointer(s) != nullptr)
+			return false;
+		const std::uint64_t mine = ConcurrentStack::pack(n, s);
+		if(!slot.compare_exchange_strong(s, mine, std::memory_order_release, std::memory_order_relaxed))
+			return false;
+		for(unsigned i = 0; i < patience; ++i)
+		{
+			if(slot.load(std::memory_order_relaxed) != mine)
+				return true;
+			ConcurrentStack::pause();
+		}
+		s = mine;
+		return !slot.compare_exchange_strong(s, ConcurrentStack::pack(nullptr, mine), std::memory_order_relaxed, std::memory_order_relaxed);
+	}
+
+	Node *take(void)
+	{
+		std::atomic<std::uint64_t> &slot = this->pick().value;
+		std::uint64_t s = slot.load(std::memory_order_relaxed);
+		Node *n = ConcurrentStack::pointer(s);
+		if(n == nullptr)
+			return nullptr;
+		if(slot.compare_exchange_strong(s, ConcurrentStack::pack(nullptr, s), std::memory_order_acquire, std::memory_order_relaxed))
+			return n;
+		return nullptr;
+	}
+
+	Node *acquire(void)
+	{
+		std::uint64_t t = this->_free.load(std::memory_order_acquire);
+		while(Node *n = ConcurrentStack::pointer(t))
+		{
+			Node *next = n->next.load(std::memory_order_relaxed);
+			if(this->_free.compare_exchange_weak(t, ConcurrentStack::pack(next, t), std::memory_order_acquire, std::memory_order_acquire))
+				return n;
+		}
+		return new Node;
+	}
+
+	void recycle(Node *n)
+	{
+		std::uint64_t t = this->_free.load(std::memory_order_relaxed);
+		do
+		{
+			n->next.store(ConcurrentStack::pointer(t), std::memory_order_relaxed);
+		}
+		while(!this->_free.compare_exchange_weak(t, ConcurrentStack::pack(n, t), std::memory_order_release, std::memory_order_relaxed));
+	}
+};
+
+#endif /* CONCURRENTSTACK_HH */
@@ -0,0 +1,630 @@
+/* dynmatrix.hh */
+#ifndef DYNMATRIX_HH
+#define DYNMATRIX_HH
+
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "gemm.hh"
+#include "instrument.hh"
+#include "lu.hh"
+#include "matrix.hh"
+#include "parallel.hh"
+#include "transpose.hh"
+
+enum class MatrixOrder
+{
+	RowMajor,
+	ColumnMajor
+};
+
+/* Runtime sized matrix on 64 byte aligned heap storage
+ * Element (i, j) lives at data()[i * ld() + j] in row-major order and at
+ * data()[j * ld() + i] in column-major order, ld() being padded to whole
+ * cache lines unless given explicitly. A DynMatrix constructed over an
+ * external buffer borrows it and never frees it.
+ * Mismatched dimensions throw std::invalid_argument.
+ * The elementwise operations, products and transposes take an optional
+ * parallel::Policy, running on the calling thread by default.
+ */
+template <typename T>
+class DynMatrix
+{
+public:
+	static constexpr size_t alignment = 64;
+
+	DynMatrix(size_t rows = 0, size_t columns = 0, MatrixOrder order = MatrixOrder::RowMajor)
+		: DynMatrix(rows, columns, DynMatrix::pad(order == MatrixOrder::RowMajor ? columns : rows), order)
+	{
+	}
+
+	DynMatrix(size_t rows, size_t columns, size_t ld, MatrixOrder order)
+	{
+		if(ld < (order == MatrixOrder::RowMajor ? columns : rows))
+			throw std::invalid_argument("Leading dimension smaller than the matrix");
+		this->_rows    = rows;
+		this->_columns = columns;
+		this->_ld      = ld;
+		this->_order   = order;
+		this->_owner   = true;
+		this->_data    = DynMatrix::allocate(this->extent());
+		if(this->_data != nullptr)
+			std::memset(this->_data, 0, this->extent() * sizeof(T));
+	}
+
+	/* Borrows data, which has to outlive the matrix
+	 */
+	DynMatrix(T *data, size_t rows, size_t columns, size_t ld, MatrixOrder order = MatrixOrder::RowMajor)
+	{
+		this->_rows    = rows;
+		this->_columns = columns;
+		this->_ld      = ld;
+		this->_order   = order;
+		this->_owner   = false;
+		this->_data    = data;
+	}
+
+	/* Row-major with ld = C, so the whole matrix is one block copy
+	 */
+	template <unsigned R, unsigned C>
+	DynMatrix(const Matrix<R, C, T> &a)
+		: DynMatrix(R, C, C, MatrixOrder::RowMajor)
+	{
+		std::memcpy(this->_data, a.data(), R * C * sizeof(T));
+	}
+
+	/* Same dimensions and order as a with the elements converted by
+	 * convert(), Half and BFloat16 widening to float a register at a time
+	 */
+	template <typename S>
+	explicit DynMatrix(const DynMatrix<S> &a, const parallel::Policy &policy = parallel::seq)
+		: DynMatrix(a.rows(), a.columns(), a.order())
+	{
+		const size_t outer = this->_order == MatrixOrder::RowMajor ? this->_rows : this->_columns;
+		const size_t inner = this->_order == MatrixOrder::RowMajor ? this->_columns : this->_rows;
+		policy.range(outer, DynMatrix::grain(inner), [&](size_t begin, size_t end) {
+			for(size_t o = begin; o < end; ++o)
+			{
+				convert(a.data() + o * a.ld(), this->_data + o * this->_ld, inner);
+			}
+		});
+	}
+
+	DynMatrix(const DynMatrix &a)
+		: DynMatrix(a.rows(), a.columns(), a.ld(), a.order())
+	{
+		instrument::count(instrument::Counter::Temporaries);
+		this->assign(a);
+	}
+
+	DynMatrix(DynMatrix &&a) noexcept
+	{
+		this->_data = nullptr;
+		this->take(a);
+	}
+
+	/* Assigning to a borrowed matrix writes through to the borrowed buffer
+	 */
+	DynMatrix &operator =(const DynMatrix &a)
+	{
+		if(this == &a)
+			return (*this);
+		if(!this->_owner)
+		{
+			this->check(a);
+			this->assign(a);
+			return (*this);
+		}
+		DynMatrix copy(a);
+		this->release();
+		this->take(copy);
+		return (*this);
+	}
+
+	/* Writes through like the copy when this is borrowed, where a dimension
+	 * mismatch ends in std::terminate since the move cannot throw
+	 */
+	DynMatrix &operator =(DynMatrix &&a) noexcept
+	{
+		if(this == &a)
+			return (*this);
+		if(!this->_owner)
+		{
+			this->check(a);
+			this->assign(a);
+			return (*this);
+		}
+		this->release();
+		this->take(a);
+		return (*this);
+	}
+
+	~DynMatrix(void)
+	{
+		this->release();
+	}
+
+	static DynMatrix identity(size_t n, MatrixOrder order = MatrixOrder::RowMajor)
+	{
+		DynMatrix a(n, n, order);
+		for(size_t i = 0; i < n; ++i)
+		{
+			a(i, i) = T(1);
+		}
+		return a;
+	}
+
+	inline size_t rows(void) const
+	{
+		return this->_rows;
+	}
+
+	inline size_t columns(void) const
+	{
+		return this->_columns;
+	}
+
+	inline size_t ld(void) const
+	{
+		return this->_ld;
+	}
+
+	inline MatrixOrder order(void) const
+	{
+		return this->_order;
+	}
+
+	inline const T *data(void) const
+	{
+		return this->_data;
+	}
+
+	inline T *data(void)
+	{
+		return this->_data;
+	}
+
+	/* Distance between consecutive elements of a row and of a column
+	 */
+	inline size_t column_stride(void) const
+	{
+		return this->_order == MatrixOrder::RowMajor ? 1 : this->_ld;
+	}
+
+	inline size_t row_stride(void) const
+	{
+		return this->_order == MatrixOrder::RowMajor ? this->_ld : 1;
+	}
+
+	/* No bounds checking is done on the element accessor functions
+	 */
+	inline T elem(size_t i, size_t j) const
+	{
+		return this->_data[i * this->row_stride() + j * this->column_stride()];
+	}
+
+	inline T &operator ()(size_t i, size_t j)
+	{
+		return this->_data[i * this->row_stride() + j * this->column_stride()];
+	}
+
+	inline const T &operator ()(size_t i, size_t j) const
+	{
+		return this->_data[i * this->row_stride() + j * this->column_stride()];
+	}
+
+	/* Block copy when this is row-major with ld = C, elementwise otherwise
+	 */
+	template <unsigned R, unsigned C>
+	operator Matrix<R, C, T>(void) const
+	{
+		if(this->rows() != R || this->columns() != C)
+			throw std::invalid_argument("Matrix dimensions do not match");
+
+		Matrix<R, C, T> a{};
+		if(this->order() == MatrixOrder::RowMajor && this->ld() == C)
+		{
+			std::memcpy(a.data(), this->data(), R * C * sizeof(T));
+			return a;
+		}
+		for(unsigned i = 0; i < R; ++i)
+		{
+			for(unsigned j = 0; j < C; ++j)
+			{
+				a[i][j] = this->elem(i, j);
+			}
+		}
+		return a;
+	}
+
+	DynMatrix &add(const DynMatrix &a, const parallel::Policy &policy = parallel::seq)
+	{
+		this->check(a);
+		this->apply(a, [](T &x, const T &y) { x += y; }, policy);
+		return (*this);
+	}
+
+	DynMatrix &subtract(const DynMatrix &a, const parallel::Policy &policy = parallel::seq)
+	{
+		this->check(a);
+		this->apply(a, [](T &x, const T &y) { x -= y; }, policy);
+		return (*this);
+	}
+
+	DynMatrix &multiply(const T &c, const parallel::Policy &policy = parallel::seq)
+	{
+		this->apply([c](T &x) { x *= c; }, policy);
+		return (*this);
+	}
+
+	DynMatrix &divide(const T &c, const parallel::Policy &policy = parallel::seq)
+	{
+		this->apply([c](T &x) { x /= c; }, policy);
+		return (*this);
+	}
+
+	/* Shares the blocked kernel of Matrix::multiply, the result takes the
+	 * order of this
+	 */
+	DynMatrix multiply(const DynMatrix &a, const parallel::Policy &policy = parallel::seq) const
+	{
+		if(this->columns() != a.rows())
+			throw std::invalid_argument("Multiplication between RxC and NxM matrices is only defined for C == N");
+
+		DynMatrix b(this->rows(), a.columns(), this->order());
+		DynMatrix::multiply(*this, a, b, policy);
+		return b;
+	}
+
+	/* c += a * b, for any combination of orders
+	 */
+	static void multiply(const DynMatrix &a, const DynMatrix &b, DynMatrix &c,
+	                     const parallel::Policy &policy = parallel::seq)
+	{
+		DynMatrix::multiply<T>(a, b, c, policy);
+	}
+
+	/* As above with a and b stored as S, Half or BFloat16 for a float c,
+	 * the packing widening them so the product accumulates in T at half the
+	 * memory traffic of float operands
+	 */
+	template <typename S>
+	static void multiply(const DynMatrix<S> &a, const DynMatrix<S> &b, DynMatrix &c,
+	                     const parallel::Policy &policy = parallel::seq)
+	{
+		if(a.columns() != b.rows() || c.rows() != a.rows() || c.columns() != b.columns())
+			throw std::invalid_argument("Matrix dimensions do not match");
+
+		const instrument::Scope scope(instrument::Kernel::DynMatrixMultiply, 2 * (uint64_t)a.rows() * b.columns() * a.columns());
+
+		if(c.order() == MatrixOrder::RowMajor)
+		{
+			kernel::Gemm<T>::multiply(
+				a.rows(), b.columns(), a.columns(),
+				a.data(), a.row_stride(), a.column_stride(),
+				b.data(), b.row_stride(), b.column_stride(),
+				c.data(), c.ld(),
+				policy
+			);
+		}
+		else
+		{
+			/* c^T = b^T a^T, and c^T is row-major */
+			kernel::Gemm<T>::multiply(
+				b.columns(), a.rows(), a.columns(),
+				b.data(), b.column_stride(), b.row_stride(),
+				a.data(), a.column_stride(), a.row_stride(),
+				c.data(), c.ld(),
+				policy
+			);
+		}
+	}
+
+	DynMatrix transpose(const parallel::Policy &policy = parallel::seq) const
+	{
+		DynMatrix a(this->columns(), this->rows(), this->order());
+		if(this->order() == MatrixOrder::RowMajor)
+			DynMatrix::transpose(this->rows(), this->columns(), this->data(), this->ld(), a.data(), a.ld(), policy);
+		else
+			DynMatrix::transpose(this->columns(), this->rows(), this->data(), this->ld(), a.data(), a.ld(), policy);
+		return a;
+	}
+
+	/* Square matrices only, the order is kept
+	 */
+	DynMatrix &transpose_in_place(void)
+	{
+		if(this->rows() != this->columns())
+			throw std::invalid_argument("In place transpose is only defined for square matrices");
+
+		kernel::transpose(this->rows(), this->data(), this->ld());
+		return (*this);
+	}
+
+	T determinant(void) const
+	{
+		if(this->rows() != this->columns())
+			throw std::invalid_argument("Determinant is only defined for square matrices");
+
+		if constexpr(std::is_integral<T>::value)
+		{
+			DynMatrix<long long> b(this->rows(), this->columns());
+			for(size_t i = 0; i < this->rows(); ++i)
+			{
+				for(size_t j = 0; j < this->columns(); ++j)
+				{
+					b(i, j) = (long long)this->elem(i, j);
+				}
+			}
+			return (T)kernel::bareiss<long long>(b.rows(), b.data(), b.ld());
+		}
+		else
+		{
+			/* det(a^T) = det(a), so the storage is factored in whichever order it is in */
+			DynMatrix a(*this);
+			std::vector<size_t> pivot(a.rows());
+			const int parity = kernel::LU<T>::factor(a.rows(), a.data(), a.ld(), pivot.data());
+			return kernel::LU<T>::determinant(a.rows(), a.data(), a.ld(), parity);
+		}
+	}
+
+	/* Solves this * x = b for every column of b
+	 */
+	DynMatrix solve(const DynMatrix &b) const
+	{
+		static_assert(!std::is_integral<T>::value, "LU decomposition requires a field type");
+
+		if(this->rows() != this->columns() || b.rows() != this->rows())
+			throw std::invalid_argument("Solve is only defined for square matrices and matching right hand sides");
+
+		DynMatrix a = this->reorder(MatrixOrder::RowMajor);
+		DynMatrix x = b.reorder(MatrixOrder::RowMajor);
+		std::vector<size_t> pivot(a.rows());
+		kernel::LU<T>::factor(a.rows(), a.data(), a.ld(), pivot.data());
+		kernel::LU<T>::solve(a.rows(), a.data(), a.ld(), pivot.data(), x.data(), x.columns(), x.ld());
+		if(b.order() != MatrixOrder::RowMajor)
+			return x.reorder(b.order());
+		return x;
+	}
+
+	DynMatrix reciprocal(void) const
+	{
+		return this->solve(DynMatrix::identity(this->rows(), this->order()));
+	}
+
+	/* Copy of this stored in the given order
+	 */
+	DynMatrix reorder(MatrixOrder order) const
+	{
+		if(order == this->order())
+			return (*this);
+		DynMatrix a(this->rows(), this->columns(), order);
+		if(order == MatrixOrder::RowMajor)
+			kernel::transpose(this->columns(), this->rows(), this->data(), this->ld(), a.data(), a.ld());
+		else
+			kernel::transpose(this->rows(), this->columns(), this->data(), this->ld(), a.data(), a.ld());
+		return a;
+	}
+
+	bool equals(const DynMatrix &a) const
+	{
+		if(this->rows() != a.rows() || this->columns() != a.columns())
+			return false;
+		for(size_t i = 0; i < this->rows(); ++i)
+		{
+			for(size_t j = 0; j < this->columns(); ++j)
+			{
+				if(this->elem(i, j) != a.elem(i, j))
+					return false;
+			}
+		}
+		return true;
+	}
+
+	inline DynMatrix operator +(void) const
+	{
+		return (*this);
+	}
+
+	inline DynMatrix operator -(void) const
+	{
+		return DynMatrix(*this).multiply(T(-1));
+	}
+
+	inline DynMatrix operator +(const DynMatrix &a) const
+	{
+		return DynMatrix(*this).add(a);
+	}
+
+	inline DynMatrix operator -(const DynMatrix &a) const
+	{
+		return DynMatrix(*this).subtract(a);
+	}
+
+	inline DynMatrix operator *(const T &c) const
+	{
+		return DynMatrix(*this).multiply(c);
+	}
+
+	inline DynMatrix operator /(const T &c) const
+	{
+		return DynMatrix(*this).divide(c);
+	}
+
+	inline DynMatrix operator *(const DynMatrix &a) const
+	{
+		return this->multiply(a);
+	}
+
+	inline DynMatrix operator ~(void) const
+	{
+		return this->reciprocal();
+	}
+
+	inline bool operator ==(const DynMatrix &a) const
+	{
+		return this->equals(a);
+	}
+
+	inline bool operator !=(const DynMatrix &a) const
+	{
+		return !this->equals(a);
+	}
+
+	inline DynMatrix &operator +=(const DynMatrix &a)
+	{
+		return this->add(a);
+	}
+
+	inline DynMatrix &operator -=(const DynMatrix &a)
+	{
+		return this->subtract(a);
+	}
+
+	inline DynMatrix &operator *=(const T &c)
+	{
+		return this->multiply(c);
+	}
+
+	inline DynMatrix &operator *=(const DynMatrix &a)
+	{
+		return (*this) = this->multiply(a);
+	}
+
+	inline DynMatrix &operator /=(const T &c)
+	{
+		return this->divide(c);
+	}
+private:
+	T *_data;
+	size_t _rows;
+	size_t _columns;
+	size_t _ld;
+	MatrixOrder _order;
+	bool _owner;
+
+	static size_t pad(size_t n)
+	{
+		const size_t block = alignment / sizeof(T) > 0 ? alignment / sizeof(T) : 1;
+		return (n + block - 1) / block * block;
+	}
+
+	static T *allocate(size_t size)
+	{
+		if(size == 0)
+			return nullptr;
+		instrument::count(instrument::Counter::Allocations);
+		instrument::count(instrument::Counter::AllocatedBytes, size * sizeof(T));
+		return static_cast<T *>(::operator new(size * sizeof(T), std::align_val_t(alignment)));
+	}
+
+	/* Elements spanned by the storage, ld per row (or column) except the last
+	 */
+	size_t extent(void) const
+	{
+		const size_t outer = this->_order == MatrixOrder::RowMajor ? this->_rows : this->_columns;
+		const size_t inner = this->_order == MatrixOrder::RowMajor ? this->_columns : this->_rows;
+		return outer == 0 ? 0 : (outer - 1) * this->_ld + inner;
+	}
+
+	void release(void)
+	{
+		if(this->_owner && this->_data != nullptr)
+			::operator delete(this->_data, std::align_val_t(alignment));
+		this->_data = nullptr;
+	}
+
+	void take(DynMatrix &a)
+	{
+		this->_data    = a._data;
+		this->_rows    = a._rows;
+		this->_columns = a._columns;
+		this->_ld      = a._ld;
+		this->_order   = a._order;
+		this->_owner   = a._owner;
+		a._data    = nullptr;
+		a._rows    = 0;
+		a._columns = 0;
+		a._owner   = true;
+	}
+
+	void check(const DynMatrix &a) const
+	{
+		if(this->rows() != a.rows() || this->columns() != a.columns())
+			throw std::invalid_argument("Matrix dimensions do not match");
+	}
+
+	/* Copies the elements of a, which has the same dimensions
+	 */
+	void assign(const DynMatrix &a)
+	{
+		instrument::count(instrument::Counter::CopiedBytes, a.rows() * a.columns() * sizeof(T));
+		this->apply(a, [](T &x, const T &y) { x = y; });
+	}
+
+	/* Rows (or columns) per task, so that a task touches at least 16k elements
+	 */
+	static size_t grain(size_t inner)
+	{
+		return inner < 16384 ? 16384 / (inner + 1) + 1 : 1;
+	}
+
+	/* b = a^T for a of size m x n, in bands of a's rows
+	 */
+	static void transpose(size_t m, size_t n, const T *a, size_t lda, T *b, size_t ldb, const parallel::Policy &policy)
+	{
+		policy.range(m, DynMatrix::grain(n), [=](size_t begin, size_t end) {
+			kernel::transpose(end - begin, n, a + begin * lda, lda, b + begin, ldb);
+		});
+	}
+
+	/* Calls f(this(i, j), a(i, j)) walking both matrices in the storage order of this
+	 */
+	template <class F>
+	void apply(const DynMatrix &a, F f, const parallel::Policy &policy = parallel::seq)
+	{
+		const size_t outer = this->_order == MatrixOrder::RowMajor ? this->_rows : this->_columns;
+		const size_t inner = this->_order == MatrixOrder::RowMajor ? this->_columns : this->_rows;
+		const size_t ao    = this->_order == a._order ? a._ld : 1;
+		const size_t ai    = this->_order == a._order ? 1 : a._ld;
+		policy.range(outer, DynMatrix::grain(inner), [&](size_t begin, size_t end) {
+			for(size_t o = begin; o < end; ++o)
+			{
+				T       *x = this->_data + o * this->_ld;
+				const T *y = a._data + o * ao;
+				for(size_t i = 0; i < inner; ++i)
+				{
+					f(x[i], y[i * ai]);
+				}
+			}
+		});
+	}
+
+	template <class F>
+	void apply(F f, const parallel::Policy &policy = parallel::seq)
+	{
+		const size_t outer = this->_order == MatrixOrder::RowMajor ? this->_rows : this->_columns;
+		const size_t inner = this->_order == MatrixOrder::RowMajor ? this->_columns : this->_rows;
+		policy.range(outer, DynMatrix::grain(inner), [&](size_t begin, size_t end) {
+			for(size_t o = begin; o < end; ++o)
+			{
+				T *x = this->_data + o * this->_ld;
+				for(size_t i = 0; i < inner; ++i)
+				{
+					f(x[i]);
+				}
+			}
+		});
+	}
+};
+
+typedef DynMatrix<float>    DynMatrixf;
+typedef DynMatrix<double>   DynMatrixlf;
+typedef DynMatrix<Half>     DynMatrixh;
+typedef DynMatrix<BFloat16> DynMatrixbf;
+
+#endif /* DYNMATRIX_HH */
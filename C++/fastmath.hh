@@ -0,0 +1,193 @@
+/* fastmath.hh */
+#ifndef FASTMATH_HH
+#define FASTMATH_HH
+
+#include <cmath>
+#include <limits>
+#include "simd.hh"
+
+/* Implementation picked by the bulk transcendental kernels
+ * Precise calls the C library element by element; Fast evaluates the
+ * polynomial approximations below a register at a time.
+ */
+enum class Precision
+{
+    Precise,
+    Fast
+};
+
+namespace simd
+{
+
+/* Pack interface over a single element, so the scalar tails of the array
+ * kernels round exactly like the vector bodies
+ */
+template <class T>
+struct Scalar
+{
+    static constexpr bool enabled = true;
+    typedef T type;
+
+    static inline type load(const T *p)              { return *p; }
+    static inline void store(T *p, type a)           { *p = a; }
+    static inline type loadu(const T *p)             { return *p; }
+    static inline void storeu(T *p, type a)          { *p = a; }
+    static inline type set1(T c)                     { return c; }
+    static inline type add(type a, type b)           { return a + b; }
+    static inline type sub(type a, type b)           { return a - b; }
+    static inline type mul(type a, type b)           { return a * b; }
+    static inline type div(type a, type b)           { return a / b; }
+    static inline type sqrt(type a)                  { return std::sqrt(a); }
+    static inline type rsqrt(type a)                 { return T(1) / std::sqrt(a); }
+    static inline type madd(type a, type b, type c)  { return a * b + c; }
+    /* b when either is NaN, like minps and maxps
+     */
+    static inline type min(type a, type b)           { return a < b ? a : b; }
+    static inline type max(type a, type b)           { return b < a ? a : b; }
+    static inline type less(type a, type b)          { return a < b ? T(1) : T(0); }
+    static inline type blend(type m, type a, type b) { return m != T(0) ? b : a; }
+    static inline unsigned bits(type m)              { return m != T(0) ? 1u : 0u; }
+};
+
+/* Minimax coefficients (Cephes) and reduction constants per precision
+ */
+template <class T>
+struct Approximation;
+
+template <>
+struct Approximation<float>
+{
+    static constexpr float magic       = 12582912.0f;
+    static constexpr float pi          = 3.14159265358979f;
+    static constexpr float two_over_pi = 0.636619772367581f;
+    static constexpr float pio2[3]     = {1.5703125f, 4.837512969970703125e-4f, 7.54978995489188216e-8f};
+    static constexpr float sine[3]     = {-1.9515295891e-4f, 8.3321608736e-3f, -1.6666654611e-1f};
+    static constexpr float cosine[3]   = {2.443315711809948e-5f, -1.388731625493765e-3f, 4.166664568298827e-2f};
+    static constexpr float split       = 0.4142135623730950f;
+    static constexpr float atan_p[4]   = {8.05374449538e-2f, -1.38776856032e-1f, 1.99777106478e-1f, -3.33329491539e-1f};
+    static constexpr float atan_q[1]   = {0.0f};
+    static constexpr int   rational    = 0;
+};
+
+template <>
+struct Approximation<double>
+{
+    static constexpr double magic       = 6755399441055744.0;
+    static constexpr double pi          = 3.14159265358979323846;
+    static constexpr double two_over_pi = 0.636619772367581343076;
+    static constexpr double pio2[3]     = {1.57079625129699707031, 7.54978941586159635336e-8, 5.39030285815811905290e-15};
+    static constexpr double sine[6]     = {
+        1.58962301576546568060e-10, -2.50507477628578072866e-8, 2.75573136213857245213e-6,
+        -1.98412698295895385996e-4, 8.33333333332211858878e-3, -1.66666666666666307295e-1
+    };
+    static constexpr double cosine[6]   = {
+        -1.13585365213876817300e-11, 2.08757008419747316778e-9, -2.75573141792967388112e-7,
+        2.48015872888517045348e-5, -1.38888888888730564116e-3, 4.16666666666665929218e-2
+    };
+    static constexpr double split       = 0.66;
+    static constexpr double atan_p[5]   = {
+        -8.750608600031904122785e-1, -1.615753718733365076637e1, -7.500855792314704667340e1,
+        -1.228866684490136173410e2, -6.485021904942025371773e1
+    };
+    static constexpr double atan_q[5]   = {
+        2.485846490142306297962e1, 1.650270098316988542046e2, 4.328810604912902668951e2,
+        4.853903996359136964868e2, 1.945506571482613964425e2
+    };
+    static constexpr int    rational    = 1;
+};
+
+/* c[0] z^(n-1) + .. + c[n-1], with an implicit leading 1 when monic
+ */
+template <class T, class P, int N>
+inline typename P::type horner(typename P::type z, const T (&c)[N], bool monic = false)
+{
+    typename P::type y = monic ? P::add(z, P::set1(c[0])) : P::set1(c[0]);
+    for(int k = 1; k < N; ++k)
+    {
+        y = P::madd(y, z, P::set1(c[k]));
+    }
+    return y;
+}
+
+/* Nearest integer, exact for |a| < 2^22 (float) or 2^51 (double)
+ */
+template <class T, class P>
+inline typename P::type round(typename P::type a)
+{
+    const auto m = P::set1(Approximation<T>::magic);
+    return P::sub(P::add(a, m), m);
+}
+
+/* sin(x) and cos(x) of every lane
+ * x is reduced by the nearest multiple of pi / 2, held in three parts,
+ * and a minimax polynomial evaluated on [-pi / 4, pi / 4]. Up to
+ * |x| = 8192 the absolute error is below 2e-16 for double and 1e-7 for
+ * float. The three part reduction loses relative accuracy close to the
+ * zeros of sin and cos (7 ulp at +-pi, thousands of ulp near larger
+ * multiples of pi / 2 in double), so only on [-pi / 4, pi / 4] do both
+ * results stay within 2 ulp.
+ */
+template <class T, class P>
+inline void sincos(typename P::type x, typename P::type &s, typename P::type &c)
+{
+    typedef Approximation<T> A;
+
+    const auto one = P::set1(T(1));
+    const auto k = simd::round<T, P>(P::mul(x, P::set1(A::two_over_pi)));
+    auto r = P::madd(k, P::set1(-A::pio2[0]), x);
+    r = P::madd(k, P::set1(-A::pio2[1]), r);
+    r = P::madd(k, P::set1(-A::pio2[2]), r);
+
+    const auto z  = P::mul(r, r);
+    const auto sr = P::madd(P::mul(r, z), simd::horner<T, P>(z, A::sine), r);
+    const auto cr = P::madd(P::mul(z, z), simd::horner<T, P>(z, A::cosine), P::madd(z, P::set1(T(-0.5)), one));
+
+    /* Quadrant k mod 4 as odd + 2 * half, both 0 or 1, through exact roundings
+     */
+    const auto f    = simd::round<T, P>(P::madd(k, P::set1(T(0.25)), P::set1(T(-0.375))));
+    const auto q    = P::madd(f, P::set1(T(-4)), k);
+    const auto half = simd::round<T, P>(P::madd(q, P::set1(T(0.5)), P::set1(T(-0.25))));
+    const auto odd  = P::madd(half, P::set1(T(-2)), q);
+    const auto swap = P::less(P::set1(T(0.5)), odd);
+    const auto flip = P::sub(P::add(odd, half), P::mul(P::add(odd, odd), half));
+
+    s = P::mul(P::blend(swap, sr, cr), P::madd(half, P::set1(T(-2)), one));
+    c = P::mul(P::blend(swap, cr, sr), P::madd(flip, P::set1(T(-2)), one));
+}
+
+/* atan2(y, x) of every lane, in [-pi, pi]
+ * The ratio of the smaller to the larger magnitude is reduced below
+ * tan(pi / 8) (float) or 0.66 (double) and the octant restored afterwards.
+ * Within 4 ulp for float and 2 ulp for double; atan2(-0, x < 0) gives pi
+ * rather than -pi, and NaNs are not propagated.
+ */
+template <class T, class P>
+inline typename P::type atan2(typename P::type y, typename P::type x)
+{
+    typedef Approximation<T> A;
+
+    const auto zero = P::set1(T());
+    const auto one  = P::set1(T(1));
+    const auto ax = P::max(x, P::sub(zero, x));
+    const auto ay = P::max(y, P::sub(zero, y));
+    const auto mx = P::max(P::max(ax, ay), P::set1(std::numeric_limits<T>::min()));
+
+    auto t = P::div(P::min(ax, ay), mx);
+    const auto big = P::less(P::set1(A::split), t);
+    t = P::blend(big, t, P::div(P::sub(t, one), P::add(t, one)));
+
+    const auto z = P::mul(t, t);
+    auto p = simd::horner<T, P>(z, A::atan_p);
+    if constexpr(A::rational != 0)
+        p = P::div(p, simd::horner<T, P>(z, A::atan_q, true));
+    auto r = P::madd(P::mul(t, z), p, t);
+
+    r = P::add(r, P::blend(big, zero, P::set1(T(A::pi / 4))));
+    r = P::blend(P::less(ax, ay), r, P::sub(P::set1(T(A::pi / 2)), r));
+    r = P::blend(P::less(x, zero), r, P::sub(P::set1(A::pi), r));
+    return P::blend(P::less(y, zero), r, P::sub(zero, r));
+}
+
+} /* namespace simd */
+
+#endif /* FASTMATH_HH */
@@ -0,0 +1,573 @@
+/* fft.hh */
+#ifndef FFT_HH
+#define FFT_HH
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "complex.hh"
+#include "complexarray.hh"
+#include "matrix.hh"
+#include "parallel.hh"
+#include "transpose.hh"
+
+enum class FFTDirection
+{
+	Forward,
+	Inverse
+};
+
+/* Discrete Fourier transform plan for one size
+ * Power of two sizes run as an in-place decimation in time: a bit reversal
+ * permutation, a radix-2 pass when log2(size) is odd, then radix-4 passes
+ * reading their twiddle factors from one contiguous table per pass. Any
+ * other size becomes a power of two circular convolution (Bluestein), the
+ * chirp and the transformed convolution kernel being computed with the plan.
+ * forward() computes X[k] = sum x[j] exp(-2 pi i jk / n) and inverse()
+ * undoes it, including the 1 / n scaling. A plan is immutable once built,
+ * so any number of threads may run it at once. Transforms of at least
+ * threshold points spread each pass over the threads of the given policy,
+ * batches spread whole transforms.
+ */
+template <class T>
+class FFT
+{
+public:
+	static constexpr size_t threshold = 1 << 15;
+
+	/* const.h is not included, its E macro clashes with template parameters
+	 */
+	static constexpr long double pi = 3.141592653589793238L;
+
+	explicit FFT(size_t size)
+	{
+		if(size == 0)
+			throw std::invalid_argument("FFT size must be positive");
+		this->_size = size;
+		if((size & (size - 1)) == 0)
+		{
+			this->plan(size);
+			return;
+		}
+
+		size_t m = 1;
+		while(m < 2 * size - 1)
+			m <<= 1;
+		this->plan(m);
+
+		/* c[k] = exp(-pi i k^2 / n), k^2 reduced mod 2n to keep the angle exact
+		 */
+		this->_chirp.resize(size);
+		for(size_t k = 0; k < size; ++k)
+		{
+			const long double phi = -pi * (long double)(((std::uint64_t)k * k) % (2 * size)) / (long double)size;
+			this->_chirp[k] = {(T)std::cos(phi), (T)std::sin(phi)};
+		}
+		for(int d = 0; d < 2; ++d)
+		{
+			std::vector<Complex<T>> &b = this->_kernel[d];
+			b.assign(m, Complex<T>());
+			for(size_t k = 0; k < size; ++k)
+			{
+				const Complex<T> c = d == 0 ? this->_chirp[k].conjugate() : this->_chirp[k];
+				b[k] = c;
+				if(k > 0)
+					b[m - k] = c;
+			}
+			this->radix(b.data(), false, parallel::seq);
+			for(Complex<T> &z : b)
+			{
+				z *= T(1) / (T)m;
+			}
+		}
+	}
+
+	inline size_t size(void) const
+	{
+		return this->_size;
+	}
+
+	/* Whether the size is not a power of two and goes through a convolution
+	 */
+	inline bool bluestein(void) const
+	{
+		return !this->_chirp.empty();
+	}
+
+	void transform(Complex<T> *x, FFTDirection direction, const parallel::Policy &policy = parallel::seq) const
+	{
+		const bool inverse = direction == FFTDirection::Inverse;
+		if(this->bluestein())
+			this->convolve(x, inverse, policy);
+		else
+			this->radix(x, inverse, policy);
+		if(inverse)
+		{
+			const T c = T(1) / (T)this->_size;
+			for(size_t k = 0; k < this->_size; ++k)
+			{
+				x[k] *= c;
+			}
+		}
+	}
+
+	/* x[0 .. size()) in place
+	 */
+	void forward(Complex<T> *x, const parallel::Policy &policy = parallel::seq) const
+	{
+		this->transform(x, FFTDirection::Forward, policy);
+	}
+
+	void inverse(Complex<T> *x, const parallel::Policy &policy = parallel::seq) const
+	{
+		this->transform(x, FFTDirection::Inverse, policy);
+	}
+
+	/* count transforms, the k-th of x + k * distance
+	 */
+	void transform(Complex<T> *x, size_t count, size_t distance, FFTDirection direction, const parallel::Policy &policy = parallel::seq) const
+	{
+		policy.range(count, 1, [this, x, distance, direction](size_t begin, size_t end) {
+			for(size_t k = begin; k < end; ++k)
+			{
+				this->transform(x + k * distance, direction);
+			}
+		});
+	}
+
+	void forward(Complex<T> *x, size_t count, size_t distance, const parallel::Policy &policy = parallel::seq) const
+	{
+		this->transform(x, count, distance, FFTDirection::Forward, policy);
+	}
+
+	void inverse(Complex<T> *x, size_t count, size_t distance, const parallel::Policy &policy = parallel::seq) const
+	{
+		this->transform(x, count, distance, FFTDirection::Inverse, policy);
+	}
+
+	/* Interleaved arrays are transformed in place, split ones through a copy
+	 */
+	void transform(ComplexArray<T> &a, FFTDirection direction, const parallel::Policy &policy = parallel::seq) const
+	{
+		if(a.size() != this->_size)
+			throw std::invalid_argument("Array size does not match the FFT size");
+		if(a.interleaved())
+		{
+			this->transform(reinterpret_cast<Complex<T> *>(a.real()), direction, policy);
+			return;
+		}
+		std::vector<Complex<T>> x(this->_size);
+		a.store(x.data());
+		this->transform(x.data(), direction, policy);
+		a.load(x.data(), x.size());
+	}
+
+	void forward(ComplexArray<T> &a, const parallel::Policy &policy = parallel::seq) const
+	{
+		this->transform(a, FFTDirection::Forward, policy);
+	}
+
+	void inverse(ComplexArray<T> &a, const parallel::Policy &policy = parallel::seq) const
+	{
+		this->transform(a, FFTDirection::Inverse, policy);
+	}
+private:
+	size_t _size;
+	size_t _length;
+	unsigned _log;
+	std::vector<std::uint32_t> _swaps;
+	std::vector<Complex<T>> _twiddles;
+	std::vector<Complex<T>> _chirp;
+	std::vector<Complex<T>> _kernel[2];
+
+	/* Tables for the power of two transform of m points
+	 */
+	void plan(size_t m)
+	{
+		this->_length = m;
+		this->_log    = 0;
+		while(((size_t)1 << this->_log) < m)
+			++this->_log;
+
+		for(size_t i = 0; i < m; ++i)
+		{
+			size_t r = 0;
+			for(unsigned b = 0; b < this->_log; ++b)
+			{
+				r |= ((i >> b) & 1) << (this->_log - 1 - b);
+			}
+			if(i < r)
+			{
+				this->_swaps.push_back((std::uint32_t)i);
+				this->_swaps.push_back((std::uint32_t)r);
+			}
+		}
+
+		/* v^p for p = 1, 2, 3 and j < h, v = exp(-2 pi i j / 4h), each power
+		 * contiguous so that consecutive butterflies load them as a vector
+		 */
+		for(size_t h = this->_log % 2 == 1 ? 2 : 1; h < m; h *= 4)
+		{
+			for(size_t p = 1; p <= 3; ++p)
+			{
+				for(size_t j = 0; j < h; ++j)
+				{
+					const long double phi = -2 * pi * (long double)(p * j) / (long double)(4 * h);
+					this->_twiddles.push_back({(T)std::cos(phi), (T)std::sin(phi)});
+				}
+			}
+		}
+	}
+
+	/* Unscaled power of two transform of _length points
+	 */
+	void radix(Complex<T> *x, bool inverse, const parallel::Policy &policy) const
+	{
+		const size_t m = this->_length;
+		const bool threads = m >= threshold && policy.concurrency() > 1;
+		const size_t grain = threshold / 4;
+
+		const std::uint32_t *s = this->_swaps.data();
+		auto permute = [x, s](size_t begin, size_t end) {
+			for(size_t k = begin; k < end; ++k)
+			{
+				std::swap(x[s[2 * k]], x[s[2 * k + 1]]);
+			}
+		};
+		if(threads)
+			policy.range(this->_swaps.size() / 2, grain, permute);
+		else
+			permute(0, this->_swaps.size() / 2);
+
+		size_t h = 1;
+		if(this->_log % 2 == 1)
+		{
+			for(size_t k = 0; k < m; k += 2)
+			{
+				const Complex<T> u = x[k];
+				x[k]     = u + x[k + 1];
+				x[k + 1] = u - x[k + 1];
+			}
+			h = 2;
+		}
+
+		const Complex<T> *w = this->_twiddles.data();
+		for(; h < m; h *= 4)
+		{
+			auto pass = [x, h, w, inverse](size_t begin, size_t end) {
+				if(inverse)
+					FFT::butterflies<true>(x, h, w, begin, end);
+				else
+					FFT::butterflies<false>(x, h, w, begin, end);
+			};
+			if(threads)
+				policy.range(m / 4, grain, pass);
+			else
+				pass(0, m / 4);
+			w += 3 * h;
+		}
+	}
+
+	/* Radix-4 butterflies [begin, end) of the pass merging blocks of h
+	 * points, butterfly b working on block b / h at offset b % h
+	 * Once h spans a whole register, G consecutive butterflies run at once.
+	 */
+	template <bool Inverse>
+	static void butterflies(Complex<T> *x, size_t h, const Complex<T> *w, size_t begin, size_t end)
+	{
+		typedef typename simd::Widest<T>::type Pack;
+		constexpr size_t W = simd::Widest<T>::width, G = W / 2;
+
+		size_t j = begin % h;
+		Complex<T> *p = x + begin / h * 4 * h;
+		for(size_t b = begin; b < end;)
+		{
+			if constexpr(Pack::enabled)
+			{
+				if(h % G == 0 && j % G == 0 && b + G <= end)
+				{
+					/* -i going forward, i going back, as (re, im) pairs */
+					alignas(64) T rotation[W];
+					for(size_t k = 0; k < W; k += 2)
+					{
+						rotation[k]     = T();
+						rotation[k + 1] = Inverse ? T(1) : T(-1);
+					}
+					const auto i = Pack::load(rotation);
+					for(; j < h && b + G <= end; j += G, b += G)
+					{
+						T *q = reinterpret_cast<T *>(p + j);
+						const T *v = reinterpret_cast<const T *>(w + j);
+						const auto a0 = Pack::loadu(q);
+						const auto a1 = FFT::twiddle<Inverse, Pack>(Pack::loadu(q + 2 * h), Pack::loadu(v + 2 * h));
+						const auto a2 = FFT::twiddle<Inverse, Pack>(Pack::loadu(q + 4 * h), Pack::loadu(v));
+						const auto a3 = FFT::twiddle<Inverse, Pack>(Pack::loadu(q + 6 * h), Pack::loadu(v + 4 * h));
+						const auto s = Pack::add(a2, a3), r = Pack::cmul(Pack::sub(a2, a3), i);
+						const auto e = Pack::add(a0, a1), f = Pack::sub(a0, a1);
+						Pack::storeu(q,         Pack::add(e, s));
+						Pack::storeu(q + 2 * h, Pack::add(f, r));
+						Pack::storeu(q + 4 * h, Pack::sub(e, s));
+						Pack::storeu(q + 6 * h, Pack::sub(f, r));
+					}
+					if(j == h)
+					{
+						j = 0;
+						p += 4 * h;
+					}
+					continue;
+				}
+			}
+
+			const Complex<T> a0 = p[j];
+			const Complex<T> a1 = Inverse ? mul_conj(p[j + h], w[h + j])         : p[j + h] * w[h + j];
+			const Complex<T> a2 = Inverse ? mul_conj(p[j + 2 * h], w[j])         : p[j + 2 * h] * w[j];
+			const Complex<T> a3 = Inverse ? mul_conj(p[j + 3 * h], w[2 * h + j]) : p[j + 3 * h] * w[2 * h + j];
+			const Complex<T> s = a2 + a3, d = a2 - a3;
+			const Complex<T> e = a0 + a1, f = a0 - a1;
+			/* -i d going forward, i d going back */
+			const Complex<T> r = Inverse ? Complex<T>(-d.imag(), d.real()) : Complex<T>(d.imag(), -d.real());
+			p[j]         = e + s;
+			p[j + h]     = f + r;
+			p[j + 2 * h] = e - s;
+			p[j + 3 * h] = f - r;
+			++b;
+			if(++j == h)
+			{
+				j = 0;
+				p += 4 * h;
+			}
+		}
+	}
+
+	template <bool Inverse, class Pack>
+	static inline typename Pack::type twiddle(typename Pack::type a, typename Pack::type v)
+	{
+		return Inverse ? Pack::cmulc(a, v) : Pack::cmul(a, v);
+	}
+
+	/* Bluestein: X = c * ((x * c) (*) conj(c)), the convolution done with
+	 * the power of two transform and the kernel pretransformed (and scaled)
+	 */
+	void convolve(Complex<T> *x, bool inverse, const parallel::Policy &policy) const
+	{
+		const size_t n = this->_size, m = this->_length;
+		const std::vector<Complex<T>> &b = this->_kernel[inverse ? 1 : 0];
+		std::vector<Complex<T>> a(m);
+		for(size_t k = 0; k < n; ++k)
+		{
+			a[k] = inverse ? mul_conj(x[k], this->_chirp[k]) : x[k] * this->_chirp[k];
+		}
+		this->radix(a.data(), false, policy);
+		for(size_t k = 0; k < m; ++k)
+		{
+			a[k] *= b[k];
+		}
+		this->radix(a.data(), true, policy);
+		for(size_t k = 0; k < n; ++k)
+		{
+			x[k] = inverse ? mul_conj(a[k], this->_chirp[k]) : a[k] * this->_chirp[k];
+		}
+	}
+};
+
+/* Transform of n real samples to the n / 2 + 1 non-redundant bins
+ * Even sizes pack the samples into n / 2 complex ones, transform those and
+ * untangle the even and odd halves, odd sizes go through a full transform.
+ */
+template <class T>
+class RealFFT
+{
+public:
+	explicit RealFFT(size_t size)
+		: _fft(size % 2 == 0 ? size / 2 : size)
+	{
+		this->_size = size;
+		if(size % 2 != 0)
+			return;
+		const size_t h = size / 2;
+		this->_twiddles.resize(h);
+		for(size_t k = 0; k < h; ++k)
+		{
+			const long double phi = -2 * FFT<T>::pi * (long double)k / (long double)size;
+			this->_twiddles[k] = {(T)std::cos(phi), (T)std::sin(phi)};
+		}
+	}
+
+	inline size_t size(void) const
+	{
+		return this->_size;
+	}
+
+	inline size_t bins(void) const
+	{
+		return this->_size / 2 + 1;
+	}
+
+	/* out[0 .. bins()) from x[0 .. size())
+	 */
+	void forward(const T *x, Complex<T> *out) const
+	{
+		const size_t n = this->_size;
+		if(n % 2 != 0)
+		{
+			std::vector<Complex<T>> z(n);
+			for(size_t k = 0; k < n; ++k)
+			{
+				z[k] = Complex<T>(x[k]);
+			}
+			this->_fft.forward(z.data());
+			for(size_t k = 0; k < this->bins(); ++k)
+			{
+				out[k] = z[k];
+			}
+			return;
+		}
+
+		const size_t h = n / 2;
+		for(size_t k = 0; k < h; ++k)
+		{
+			out[k] = {x[2 * k], x[2 * k + 1]};
+		}
+		this->_fft.forward(out);
+
+		const Complex<T> z0 = out[0];
+		out[0] = {z0.real() + z0.imag(), T()};
+		out[h] = {z0.real() - z0.imag(), T()};
+		for(size_t k = 1; 2 * k <= h; ++k)
+		{
+			/* E = (Z[k] + conj(Z[h - k])) / 2, W^k O = W^k (Z[k] - conj(Z[h - k])) / 2i
+			 */
+			const Complex<T> z = out[k], y = out[h - k].conjugate();
+			const Complex<T> e = (z + y) * T(0.5);
+			const Complex<T> d = (z - y) * T(0.5);
+			const Complex<T> o = this->_twiddles[k] * Complex<T>(d.imag(), -d.real());
+			out[k]     = e + o;
+			out[h - k] = (e - o).conjugate();
+		}
+	}
+
+	/* x[0 .. size()) from in[0 .. bins()), scaled so it undoes forward()
+	 * The imaginary parts of in[0] (and of in[size() / 2] for even sizes) are ignored.
+	 */
+	void inverse(const Complex<T> *in, T *x) const
+	{
+		const size_t n = this->_size;
+		if(n % 2 != 0)
+		{
+			std::vector<Complex<T>> z(n);
+			z[0] = Complex<T>(in[0].real());
+			for(size_t k = 1; k < this->bins(); ++k)
+			{
+				z[k]     = in[k];
+				z[n - k] = in[k].conjugate();
+			}
+			this->_fft.inverse(z.data());
+			for(size_t k = 0; k < n; ++k)
+			{
+				x[k] = z[k].real();
+			}
+			return;
+		}
+
+		const size_t h = n / 2;
+		/* Samples 2j and 2j + 1 are the real and imaginary parts of z[j]
+		 */
+		Complex<T> *z = reinterpret_cast<Complex<T> *>(x);
+		const T r0 = in[0].real(), rh = in[h].real();
+		const Complex<T> z0 = {(r0 + rh) * T(0.5), (r0 - rh) * T(0.5)};
+		for(size_t k = 1; 2 * k <= h; ++k)
+		{
+			/* E = (X[k] + conj(X[h - k])) / 2, O = conj(W^k) (X[k] - conj(X[h - k])) / 2, Z = E + i O
+			 */
+			const Complex<T> a = in[k], b = in[h - k].conjugate();
+			const Complex<T> e = (a + b) * T(0.5);
+			const Complex<T> o = mul_conj((a - b) * T(0.5), this->_twiddles[k]);
+			const Complex<T> io = {-o.imag(), o.real()};
+			z[k]     = e + io;
+			z[h - k] = (e - io).conjugate();
+		}
+		z[0] = z0;
+		this->_fft.inverse(z);
+	}
+private:
+	size_t _size;
+	FFT<T> _fft;
+	std::vector<Complex<T>> _twiddles;
+};
+
+/* Separable 2D transform of a rows x columns row-major array, the rows in
+ * place and the columns through a transposed copy
+ */
+template <class T>
+class FFT2
+{
+public:
+	FFT2(size_t rows, size_t columns)
+		: _row(columns), _column(rows)
+	{
+		this->_rows    = rows;
+		this->_columns = columns;
+	}
+
+	inline size_t rows(void) const
+	{
+		return this->_rows;
+	}
+
+	inline size_t columns(void) const
+	{
+		return this->_columns;
+	}
+
+	/* Rows of a are ld elements apart
+	 */
+	void transform(Complex<T> *a, size_t ld, FFTDirection direction, const parallel::Policy &policy = parallel::seq) const
+	{
+		const size_t m = this->_rows, n = this->_columns;
+		this->_row.transform(a, m, ld, direction, policy);
+		std::vector<Complex<T>> t(m * n);
+		kernel::transpose(m, n, a, ld, t.data(), m);
+		this->_column.transform(t.data(), n, m, direction, policy);
+		kernel::transpose(n, m, t.data(), m, a, ld);
+	}
+
+	void forward(Complex<T> *a, size_t ld, const parallel::Policy &policy = parallel::seq) const
+	{
+		this->transform(a, ld, FFTDirection::Forward, policy);
+	}
+
+	void inverse(Complex<T> *a, size_t ld, const parallel::Policy &policy = parallel::seq) const
+	{
+		this->transform(a, ld, FFTDirection::Inverse, policy);
+	}
+
+	template <unsigned R, unsigned C>
+	void forward(Matrix<R, C, Complex<T>> &a, const parallel::Policy &policy = parallel::seq) const
+	{
+		this->check(R, C);
+		this->transform(a.data(), C, FFTDirection::Forward, policy);
+	}
+
+	template <unsigned R, unsigned C>
+	void inverse(Matrix<R, C, Complex<T>> &a, const parallel::Policy &policy = parallel::seq) const
+	{
+		this->check(R, C);
+		this->transform(a.data(), C, FFTDirection::Inverse, policy);
+	}
+private:
+	size_t _rows;
+	size_t _columns;
+	FFT<T> _row;
+	FFT<T> _column;
+
+	void check(size_t rows, size_t columns) const
+	{
+		if(rows != this->_rows || columns != this->_columns)
+			throw std::invalid_argument("Matrix dimensions do not match the FFT size");
+	}
+};
+
+#endif /* FFT_HH */
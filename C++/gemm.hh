@@ -0,0 +1,382 @@
+/* gemm.hh */
+#ifndef GEMM_HH
+#define GEMM_HH
+
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include "half.hh"
+#include "instrument.hh"
+#include "parallel.hh"
+#include "simd.hh"
+
+namespace kernel
+{
+
+/* Cache blocked general matrix multiplication over row-major storage
+ * B is packed into KC x NR column panels and A into MC x KC row panels,
+ * the micro-kernel then keeps an MR x NR tile of C in registers while
+ * streaming through both panels with unit stride.
+ */
+template <class T>
+struct Gemm
+{
+    typedef typename simd::Widest<T>::type Pack;
+
+    static constexpr size_t W  = simd::Widest<T>::width;
+    static constexpr size_t MR = 6;
+    static constexpr size_t NR = Pack::enabled ? 2 * W : 8;
+    static constexpr size_t KC = 256;
+    static constexpr size_t MC = 72;
+    static constexpr size_t NC = 1024;
+
+    /* Below this many multiply-adds the packing costs more than it saves
+     */
+    static constexpr bool blocked(size_t m, size_t n, size_t k)
+    {
+        return m >= MR && n >= NR && m * n * k >= 32 * 32 * 32;
+    }
+
+    /* c[m x n] += a[m x k] * b[k x n], rows being lda, ldb and ldc elements apart
+     */
+    static void multiply(size_t m, size_t n, size_t k,
+                         const T *a, size_t lda,
+                         const T *b, size_t ldb,
+                         T *c, size_t ldc)
+    {
+        Gemm::multiply(m, n, k, a, lda, 1, b, ldb, 1, c, ldc);
+    }
+
+    /* As above with A and B given by their row and column strides, which covers
+     * column-major and transposed operands, only the packing depends on them.
+     * A and B may be stored as S, Half or BFloat16 against float, the packing
+     * then widens them so the product accumulates in T.
+     */
+    template <class S>
+    static void multiply(size_t m, size_t n, size_t k,
+                         const S *a, size_t rsa, size_t csa,
+                         const S *b, size_t rsb, size_t csb,
+                         T *c, size_t ldc)
+    {
+        const instrument::Scope scope(instrument::Kernel::Gemm, 2 * (uint64_t)m * n * k);
+        Gemm::product(m, n, k, a, rsa, csa, b, rsb, csb, c, ldc);
+    }
+
+    /* As above with the output split into MC row by NR aligned column tiles,
+     * enough for a few per thread, every tile being an independent product
+     * with its own packing buffers
+     */
+    template <class S>
+    static void multiply(size_t m, size_t n, size_t k,
+                         const S *a, size_t rsa, size_t csa,
+                         const S *b, size_t rsb, size_t csb,
+                         T *c, size_t ldc,
+                         const parallel::Policy &policy)
+    {
+        if(policy.concurrency() == 1 || !Gemm::blocked(m, n, k))
+        {
+            Gemm::multiply(m, n, k, a, rsa, csa, b, rsb, csb, c, ldc);
+            return;
+        }
+
+        const instrument::Scope scope(instrument::Kernel::Gemm, 2 * (uint64_t)m * n * k);
+        const size_t rows = (m + MC - 1) / MC;
+        const size_t want = 4 * (size_t)policy.concurrency();
+        const size_t span = (want + rows - 1) / rows;
+        size_t tn = Gemm::round((n + span - 1) / span, NR);
+        tn = tn < 4 * NR ? 4 * NR : (tn > NC ? NC : tn);
+        const size_t cols = (n + tn - 1) / tn;
+
+        policy.run(rows * cols, [=](size_t t) {
+            const size_t i0 = (t / cols) * MC;
+            const size_t j0 = (t % cols) * tn;
+            Gemm::product(
+                (m - i0 < MC) ? m - i0 : MC,
+                (n - j0 < tn) ? n - j0 : tn,
+                k,
+                a + i0 * rsa, rsa, csa,
+                b + j0 * csb, rsb, csb,
+                c + i0 * ldc + j0, ldc
+            );
+        });
+    }
+private:
+    template <class S>
+    static void product(size_t m, size_t n, size_t k,
+                        const S *a, size_t rsa, size_t csa,
+                        const S *b, size_t rsb, size_t csb,
+                        T *c, size_t ldc)
+    {
+        if(m == 0 || n == 0 || k == 0)
+            return;
+
+        const size_t nc = Gemm::round(n < NC ? n : NC, NR);
+        const size_t kc = k < KC ? k : KC;
+        const size_t mc = Gemm::round(m < MC ? m : MC, MR);
+        Buffer bp(kc * nc);
+        Buffer ap(mc * kc);
+
+        for(size_t jc = 0; jc < n; jc += NC)
+        {
+            const size_t nb = (n - jc < NC) ? n - jc : NC;
+            for(size_t pc = 0; pc < k; pc += KC)
+            {
+                const size_t kb = (k - pc < KC) ? k - pc : KC;
+                Gemm::pack_b(kb, nb, b + pc * rsb + jc * csb, rsb, csb, bp.data);
+                for(size_t ic = 0; ic < m; ic += MC)
+                {
+                    const size_t mb = (m - ic < MC) ? m - ic : MC;
+                    Gemm::pack_a(mb, kb, a + ic * rsa + pc * csa, rsa, csa, ap.data);
+                    for(size_t jr = 0; jr < nb; jr += NR)
+                    {
+                        for(size_t ir = 0; ir < mb; ir += MR)
+                        {
+                            Gemm::micro(
+                                kb,
+                                ap.data + ir * kb,
+                                bp.data + jr * kb,
+                                c + (ic + ir) * ldc + jc + jr, ldc,
+                                (mb - ir < MR) ? mb - ir : MR,
+                                (nb - jr < NR) ? nb - jr : NR
+                            );
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    struct Buffer
+    {
+        Buffer(size_t size)
+        {
+            this->data = static_cast<T *>(::operator new(size * sizeof(T), std::align_val_t(64)));
+            instrument::count(instrument::Counter::Allocations);
+            instrument::count(instrument::Counter::AllocatedBytes, size * sizeof(T));
+        }
+
+        ~Buffer(void)
+        {
+            ::operator delete(this->data, std::align_val_t(64));
+        }
+
+        T *data;
+    };
+
+    static constexpr size_t round(size_t n, size_t block)
+    {
+        return (n + block - 1) / block * block;
+    }
+
+    /* Panel p holds rows [p * MR, p * MR + MR) as kc consecutive groups of MR,
+     * rows past m are zero
+     */
+    template <class S>
+    static void pack_a(size_t m, size_t kc, const S *a, size_t rs, size_t cs, T *ap)
+    {
+        for(size_t i0 = 0; i0 < m; i0 += MR)
+        {
+            for(size_t p = 0; p < kc; ++p)
+            {
+                for(size_t i = 0; i < MR; ++i)
+                {
+                    *(ap++) = (i0 + i < m) ? static_cast<T>(a[(i0 + i) * rs + p * cs]) : T();
+                }
+            }
+        }
+    }
+
+    /* Panel p holds columns [p * NR, p * NR + NR) as kc consecutive rows of NR,
+     * columns past n are zero. Unit stride rows of another type are widened
+     * by convert(), a register at a time.
+     */
+    template <class S>
+    static void pack_b(size_t kc, size_t n, const S *b, size_t rs, size_t cs, T *bp)
+    {
+        for(size_t j0 = 0; j0 < n; j0 += NR)
+        {
+            const size_t nr = (n - j0 < NR) ? n - j0 : NR;
+            for(size_t p = 0; p < kc; ++p)
+            {
+                const S *row = b + p * rs + j0 * cs;
+                size_t j = 0;
+                if(!std::is_same<S, T>::value && cs == 1)
+                {
+                    convert(row, bp, nr);
+                    j = nr;
+                }
+                for(; j < nr; ++j)
+                {
+                    bp[j] = static_cast<T>(row[j * cs]);
+                }
+                for(; j < NR; ++j)
+                {
+                    bp[j] = T();
+                }
+                bp += NR;
+            }
+        }
+    }
+
+    static inline void micro(size_t kc, const T *ap, const T *bp, T *c, size_t ldc, size_t mr, size_t nr)
+    {
+        alignas(64) T tile[MR][NR];
+
+        if constexpr(Pack::enabled)
+        {
+            typename Pack::type acc[MR][2];
+            for(size_t i = 0; i < MR; ++i)
+            {
+                acc[i][0] = Pack::set1(T());
+                acc[i][1] = Pack::set1(T());
+            }
+            for(size_t p = 0; p < kc; ++p)
+            {
+                const auto b0 = Pack::load(bp);
+                const auto b1 = Pack::load(bp + W);
+                for(size_t i = 0; i < MR; ++i)
+                {
+                    const auto a = Pack::set1(ap[i]);
+                    acc[i][0] = Pack::madd(a, b0, acc[i][0]);
+                    acc[i][1] = Pack::madd(a, b1, acc[i][1]);
+                }
+                ap += MR;
+                bp += NR;
+            }
+            if(mr == MR && nr == NR)
+            {
+                for(size_t i = 0; i < MR; ++i)
+                {
+                    T *row = c + i * ldc;
+                    Pack::storeu(row,     Pack::add(Pack::loadu(row),     acc[i][0]));
+                    Pack::storeu(row + W, Pack::add(Pack::loadu(row + W), acc[i][1]));
+                }
+                return;
+            }
+            for(size_t i = 0; i < MR; ++i)
+            {
+                Pack::store(tile[i],     acc[i][0]);
+                Pack::store(tile[i] + W, acc[i][1]);
+            }
+        }
+        else
+        {
+            std::memset(tile, 0, sizeof(tile));
+            for(size_t p = 0; p < kc; ++p)
+            {
+                for(size_t i = 0; i < MR; ++i)
+                {
+                    for(size_t j = 0; j < NR; ++j)
+                    {
+                        tile[i][j] += ap[i] * bp[j];
+                    }
+                }
+                ap += MR;
+                bp += NR;
+            }
+        }
+
+        for(size_t i = 0; i < mr; ++i)
+        {
+            for(size_t j = 0; j < nr; ++j)
+            {
+                c[i * ldc + j] += tile[i][j];
+            }
+        }
+    }
+};
+
+/* Register resident products for 3x3 and 4x4 float/double matrices
+ * Rows are read straight from row-major storage, 3 element rows being
+ * padded with a zero lane, so a 4x4 product is 16 broadcast multiply-adds
+ * and a matrix-vector product 4 once the columns are in registers.
+ */
+template <unsigned N, class T>
+struct Small
+{
+    typedef simd::Pack<T, 4> Pack;
+
+    static constexpr bool enabled = (N == 3 || N == 4) && Pack::enabled;
+
+    template <class P>
+    struct Columns
+    {
+        typename P::type c[4];
+    };
+
+    /* c = a * b
+     */
+    static inline void multiply(const T *a, const T *b, T *c)
+    {
+        const auto b0 = Small::row(b);
+        const auto b1 = Small::row(b + N);
+        const auto b2 = Small::row(b + 2 * N);
+        const auto b3 = (N == 4) ? Small::row(b + 3 * N) : Pack::set1(T());
+        for(unsigned i = 0; i < N; ++i)
+        {
+            const T *r = a + i * N;
+            auto p = Pack::mul(Pack::set1(r[0]), b0);
+            p = Pack::madd(Pack::set1(r[1]), b1, p);
+            p = Pack::madd(Pack::set1(r[2]), b2, p);
+            if constexpr(N == 4)
+                p = Pack::madd(Pack::set1(r[3]), b3, p);
+            Small::store(c + i * N, p);
+        }
+    }
+
+    /* Transposes a into registers for repeated calls to transform()
+     */
+    static inline Columns<Pack> columns(const T *a)
+    {
+        Columns<Pack> k;
+        k.c[0] = Small::row(a);
+        k.c[1] = Small::row(a + N);
+        k.c[2] = Small::row(a + 2 * N);
+        k.c[3] = (N == 4) ? Small::row(a + 3 * N) : Pack::set1(T());
+        Pack::transpose(k.c[0], k.c[1], k.c[2], k.c[3]);
+        return k;
+    }
+
+    /* out[0 .. 4) = a * v, lane 3 being zero when N = 3
+     */
+    template <class K>
+    static inline void transform(const K &k, const T *v, T *out)
+    {
+        auto p = Pack::mul(k.c[0], Pack::set1(v[0]));
+        p = Pack::madd(k.c[1], Pack::set1(v[1]), p);
+        p = Pack::madd(k.c[2], Pack::set1(v[2]), p);
+        if constexpr(N == 4)
+            p = Pack::madd(k.c[3], Pack::set1(v[3]), p);
+        Pack::store(out, p);
+    }
+private:
+    static inline auto row(const T *a)
+    {
+        if constexpr(N == 4)
+            return Pack::loadu(a);
+        else
+            return Pack::set(a[0], a[1], a[2], T());
+    }
+
+    template <class P>
+    static inline void store(T *c, const P &p)
+    {
+        if constexpr(N == 4)
+        {
+            Pack::storeu(c, p);
+        }
+        else
+        {
+            alignas(64) T t[4];
+            Pack::store(t, p);
+            c[0] = t[0];
+            c[1] = t[1];
+            c[2] = t[2];
+        }
+    }
+};
+
+} /* namespace kernel */
+
+#endif /* GEMM_HH */
@@ -0,0 +1,499 @@
+/* geometry.hh */
+#ifndef GEOMETRY_HH
+#define GEOMETRY_HH
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include "aabb.hh"
+#include "fastmath.hh"
+#include "matrix.hh"
+#include "simd.hh"
+#include "vectorarray.hh"
+
+/* Ray and culling tests over Vector<3, T>
+ * Single rays go through the free functions, batches through Rays and
+ * Frustum, which test packets of W rays or points held in VectorArray
+ * lanes against one broadcast primitive. A batch answers with hit masks,
+ * bit i % 64 of word i / 64 set when ray or point i passes, masks(size)
+ * words that are overwritten. W is 4, 8 or 16; a width without a native
+ * register runs the same kernels one lane at a time.
+ * Ray hits are open at both ends, 0 < t < distance, and a triangle or
+ * sphere hit shortens the distance to it, so testing a batch against a
+ * list of primitives leaves every ray at its closest hit and each mask
+ * tells which rays that primitive took.
+ */
+namespace geometry
+{
+
+typedef uint64_t Mask;
+
+inline size_t masks(size_t size)
+{
+	return (size + 63) / 64;
+}
+
+inline bool test(const Mask *mask, size_t i)
+{
+	return (mask[i / 64] >> (i % 64) & 1) != 0;
+}
+
+/* A full cache line of lanes when the target has such registers, the
+ * array kernel width otherwise
+ */
+template <class T>
+struct Width
+{
+	static constexpr int value = simd::Pack<T, 64 / sizeof(T)>::enabled ? 64 / sizeof(T) : simd::Widest<T>::width;
+};
+
+/* Möller and Trumbore, hit when the ray meets the triangle closer than t,
+ * which is then updated. Degenerate triangles and rays in their plane miss.
+ */
+template <class T>
+inline bool triangle(const Vector<3, T> &origin, const Vector<3, T> &direction,
+                     const Vector<3, T> &a, const Vector<3, T> &b, const Vector<3, T> &c, T &t)
+{
+	const Vector<3, T> e1 = b - a, e2 = c - a;
+	const Vector<3, T> p = direction.cross(e2);
+	const T det = e1.dot(p);
+	if(!(std::abs(det) > T(0)))
+		return false;
+
+	const T inv = T(1) / det;
+	const Vector<3, T> s = origin - a;
+	const T u = s.dot(p) * inv;
+	if(u < T(0) || u > T(1))
+		return false;
+
+	const Vector<3, T> q = s.cross(e1);
+	const T v = direction.dot(q) * inv;
+	if(v < T(0) || u + v > T(1))
+		return false;
+
+	const T d = e2.dot(q) * inv;
+	if(!(d > T(0) && d < t))
+		return false;
+	t = d;
+	return true;
+}
+
+/* Nearest intersection in front of the origin, the far one when the
+ * origin is inside the sphere
+ */
+template <class T>
+inline bool sphere(const Vector<3, T> &origin, const Vector<3, T> &direction,
+                   const Vector<3, T> &center, T radius, T &t)
+{
+	const Vector<3, T> o = origin - center;
+	const T a = direction.dot(direction), b = o.dot(direction), c = o.dot(o) - radius * radius;
+	const T disc = b * b - a * c;
+	if(disc < T(0))
+		return false;
+
+	const T s = std::sqrt(disc);
+	const T n = (-b - s) / a, f = (-b + s) / a;
+	const T d = n > T(0) ? n : f;
+	if(!(d > T(0) && d < t))
+		return false;
+	t = d;
+	return true;
+}
+
+/* Slab test against the reciprocal direction, hit when the ray overlaps
+ * the box anywhere in [0, t]. Conservative: a ray lying in a face plane
+ * counts as hitting. The face it enters and leaves through is picked by
+ * the sign of the reciprocal, so the 0 * inf = NaN such a ray gives lands
+ * in one candidate, which the comparisons then drop in favour of near and
+ * far.
+ */
+template <class T>
+inline bool box(const Vector<3, T> &origin, const Vector<3, T> &inverse, const AABB<3, T> &box, T t)
+{
+	T near = T(0), far = t;
+	for(int j = 0; j < 3; ++j)
+	{
+		const bool negative = inverse[j] < T(0);
+		const T t0 = ((negative ? box.upper()[j] : box.lower()[j]) - origin[j]) * inverse[j];
+		const T t1 = ((negative ? box.lower()[j] : box.upper()[j]) - origin[j]) * inverse[j];
+		if(near < t0)
+			near = t0;
+		if(t1 < far)
+			far = t1;
+	}
+	return !(far < near);
+}
+
+namespace detail
+{
+
+/* The register of W lanes of T, or the one lane stand in without it
+ */
+template <class T, int W>
+struct Packet
+{
+	static_assert(W == 4 || W == 8 || W == 16, "packets are 4, 8 or 16 lanes");
+
+	static constexpr bool enabled = simd::Pack<T, W>::enabled;
+	static constexpr int  width   = enabled ? W : 1;
+	typedef typename std::conditional<enabled, simd::Pack<T, W>, simd::Scalar<T>>::type pack;
+};
+
+/* Fills masks[0 .. masks(size)) with the lane bits f(i) returns for the
+ * packets starting at i, dropping those of the zero padding past size
+ */
+template <int W, class F>
+inline void sweep(size_t size, Mask *out, F f)
+{
+	std::memset(out, 0, masks(size) * sizeof(Mask));
+	for(size_t i = 0; i < size; i += W)
+	{
+		Mask m = f(i);
+		if(size - i < (size_t)W)
+			m &= (Mask(1) << (size - i)) - 1;
+		out[i / 64] |= m << (i % 64);
+	}
+}
+
+} /* namespace detail */
+
+/* Batch of rays, stored as origin, direction and reciprocal direction
+ * lanes next to the distance each ray is tested to
+ * Every lane is zero padded to a whole number of packets, so the kernels
+ * run aligned loads over whole packets with no scalar tail.
+ */
+template <class T>
+class Rays
+{
+public:
+	Rays(size_t size = 0)
+		: _origin(size), _direction(size), _inverse(size), _distance(size)
+	{
+		this->reset();
+	}
+
+	Rays(const Vector<3, T> *origins, const Vector<3, T> *directions, size_t size,
+	     T distance = std::numeric_limits<T>::infinity())
+		: Rays(size)
+	{
+		for(size_t i = 0; i < size; ++i)
+		{
+			this->set(i, origins[i], directions[i], distance);
+		}
+	}
+
+	inline size_t size(void) const
+	{
+		return this->_origin.size();
+	}
+
+	/* No bounds checking is done on the element accessor functions
+	 */
+	void set(size_t i, const Vector<3, T> &origin, const Vector<3, T> &direction,
+	         T distance = std::numeric_limits<T>::infinity())
+	{
+		this->_origin.set(i, origin);
+		this->_direction.set(i, direction);
+		for(int j = 0; j < 3; ++j)
+		{
+			this->_inverse.lane(j)[i] = T(1) / direction[j];
+		}
+		this->_distance.lane(0)[i] = distance;
+	}
+
+	inline Vector<3, T> origin(size_t i) const
+	{
+		return this->_origin.get(i);
+	}
+
+	inline Vector<3, T> direction(size_t i) const
+	{
+		return this->_direction.get(i);
+	}
+
+	inline T distance(size_t i) const
+	{
+		return this->_distance.lane(0)[i];
+	}
+
+	inline const VectorArray<3, T> &origins(void) const
+	{
+		return this->_origin;
+	}
+
+	inline const VectorArray<3, T> &directions(void) const
+	{
+		return this->_direction;
+	}
+
+	/* The distance of every ray, its closest hit so far
+	 */
+	inline const T *distances(void) const
+	{
+		return this->_distance.lane(0);
+	}
+
+	inline T *distances(void)
+	{
+		return this->_distance.lane(0);
+	}
+
+	void reset(T distance = std::numeric_limits<T>::infinity())
+	{
+		T *d = this->_distance.lane(0);
+		for(size_t i = 0; i < this->size(); ++i)
+		{
+			d[i] = distance;
+		}
+	}
+
+	/* Rays hitting triangle (a, b, c) closer than their distance, which
+	 * becomes that of the hit
+	 */
+	template <int W = Width<T>::value>
+	void triangle(const Vector<3, T> &a, const Vector<3, T> &b, const Vector<3, T> &c, Mask *hits)
+	{
+		typedef detail::Packet<T, W> Packet;
+		typedef typename Packet::pack P;
+		typedef typename P::type R;
+
+		const Vector<3, T> e1 = b - a, e2 = c - a;
+		const R zero = P::set1(T(0)), one = P::set1(T(1));
+		const R ax = P::set1(a[0]), ay = P::set1(a[1]), az = P::set1(a[2]);
+		const R e1x = P::set1(e1[0]), e1y = P::set1(e1[1]), e1z = P::set1(e1[2]);
+		const R e2x = P::set1(e2[0]), e2y = P::set1(e2[1]), e2z = P::set1(e2[2]);
+
+		detail::sweep<Packet::width>(this->size(), hits, [&](size_t i) {
+			const R dx = P::load(this->_direction.lane(0) + i);
+			const R dy = P::load(this->_direction.lane(1) + i);
+			const R dz = P::load(this->_direction.lane(2) + i);
+			const R sx = P::sub(P::load(this->_origin.lane(0) + i), ax);
+			const R sy = P::sub(P::load(this->_origin.lane(1) + i), ay);
+			const R sz = P::sub(P::load(this->_origin.lane(2) + i), az);
+
+			const R px = P::sub(P::mul(dy, e2z), P::mul(dz, e2y));
+			const R py = P::sub(P::mul(dz, e2x), P::mul(dx, e2z));
+			const R pz = P::sub(P::mul(dx, e2y), P::mul(dy, e2x));
+			const R det = P::madd(e1x, px, P::madd(e1y, py, P::mul(e1z, pz)));
+			const R inv = P::div(one, det);
+			const R u = P::mul(P::madd(sx, px, P::madd(sy, py, P::mul(sz, pz))), inv);
+
+			const R qx = P::sub(P::mul(sy, e1z), P::mul(sz, e1y));
+			const R qy = P::sub(P::mul(sz, e1x), P::mul(sx, e1z));
+			const R qz = P::sub(P::mul(sx, e1y), P::mul(sy, e1x));
+			const R v = P::mul(P::madd(dx, qx, P::madd(dy, qy, P::mul(dz, qz))), inv);
+			const R t = P::mul(P::madd(e2x, qx, P::madd(e2y, qy, P::mul(e2z, qz))), inv);
+
+			/* Every test phrased so that the NaNs of a zero determinant fail */
+			T *d = this->_distance.lane(0) + i;
+			const R far = P::load(d);
+			R m = P::less(zero, P::max(det, P::sub(zero, det)));
+			m = P::blend(P::less(u, zero), m, zero);
+			m = P::blend(P::less(v, zero), m, zero);
+			m = P::blend(P::less(one, P::add(u, v)), m, zero);
+			m = P::blend(m, zero, P::less(zero, t));
+			m = P::blend(m, zero, P::less(t, far));
+			P::store(d, P::blend(m, far, t));
+			return (Mask)P::bits(m);
+		});
+	}
+
+	/* Rays hitting the sphere closer than their distance, which becomes
+	 * that of the hit
+	 */
+	template <int W = Width<T>::value>
+	void sphere(const Vector<3, T> &center, T radius, Mask *hits)
+	{
+		typedef detail::Packet<T, W> Packet;
+		typedef typename Packet::pack P;
+		typedef typename P::type R;
+
+		const R zero = P::set1(T(0));
+		const R cx = P::set1(center[0]), cy = P::set1(center[1]), cz = P::set1(center[2]);
+		const R r2 = P::set1(radius * radius);
+
+		detail::sweep<Packet::width>(this->size(), hits, [&](size_t i) {
+			const R dx = P::load(this->_direction.lane(0) + i);
+			const R dy = P::load(this->_direction.lane(1) + i);
+			const R dz = P::load(this->_direction.lane(2) + i);
+			const R ox = P::sub(P::load(this->_origin.lane(0) + i), cx);
+			const R oy = P::sub(P::load(this->_origin.lane(1) + i), cy);
+			const R oz = P::sub(P::load(this->_origin.lane(2) + i), cz);
+
+			const R a = P::madd(dx, dx, P::madd(dy, dy, P::mul(dz, dz)));
+			const R b = P::madd(ox, dx, P::madd(oy, dy, P::mul(oz, dz)));
+			const R c = P::sub(P::madd(ox, ox, P::madd(oy, oy, P::mul(oz, oz))), r2);
+			const R disc = P::sub(P::mul(b, b), P::mul(a, c));
+			const R s = P::sqrt(P::max(disc, zero));
+			const R n = P::div(P::sub(P::sub(zero, b), s), a);
+			const R f = P::div(P::sub(s, b), a);
+			const R t = P::blend(P::less(zero, n), f, n);
+
+			T *d = this->_distance.lane(0) + i;
+			const R far = P::load(d);
+			R m = P::blend(P::less(zero, t), zero, P::less(t, far));
+			m = P::blend(P::less(disc, zero), m, zero);
+			P::store(d, P::blend(m, far, t));
+			return (Mask)P::bits(m);
+		});
+	}
+
+	/* Rays overlapping box within their distance, the distances left as
+	 * they are; conservative like geometry::box
+	 */
+	template <int W = Width<T>::value>
+	void box(const AABB<3, T> &box, Mask *hits) const
+	{
+		typedef detail::Packet<T, W> Packet;
+		typedef typename Packet::pack P;
+		typedef typename P::type R;
+
+		const R zero = P::set1(T(0)), all = P::less(zero, P::set1(T(1)));
+		R lower[3], upper[3];
+		for(int j = 0; j < 3; ++j)
+		{
+			lower[j] = P::set1(box.lower()[j]);
+			upper[j] = P::set1(box.upper()[j]);
+		}
+
+		/* Blends on less() rather than min and max, which order NaN
+		 * differently from one instruction set to the next
+		 */
+		detail::sweep<Packet::width>(this->size(), hits, [&](size_t i) {
+			R near = zero, far = P::load(this->_distance.lane(0) + i);
+			for(int j = 0; j < 3; ++j)
+			{
+				const R o = P::load(this->_origin.lane(j) + i), inv = P::load(this->_inverse.lane(j) + i);
+				const R negative = P::less(inv, zero);
+				const R t0 = P::mul(P::sub(P::blend(negative, lower[j], upper[j]), o), inv);
+				const R t1 = P::mul(P::sub(P::blend(negative, upper[j], lower[j]), o), inv);
+				near = P::blend(P::less(near, t0), near, t0);
+				far  = P::blend(P::less(t1, far), far, t1);
+			}
+			return (Mask)P::bits(P::blend(P::less(far, near), all, zero));
+		});
+	}
+private:
+	VectorArray<3, T> _origin;
+	VectorArray<3, T> _direction;
+	VectorArray<3, T> _inverse;
+	VectorArray<1, T> _distance;
+};
+
+/* View frustum as six inward facing unit planes (n, d), n . p + d >= 0
+ * inside, in the order left, right, bottom, top, near, far
+ * Extracted from a projection or view-projection matrix taking column
+ * vectors, clip = m * (p, 1), with the OpenGL depth range -w <= z <= w
+ * (Gribb and Hartmann).
+ */
+template <class T>
+class Frustum
+{
+public:
+	Frustum(const Matrix<4, 4, T> &m)
+	{
+		for(int i = 0; i < 3; ++i)
+		{
+			for(int s = 0; s < 2; ++s)
+			{
+				const T sign = s == 0 ? T(1) : T(-1);
+				Vector<4, T> &p = this->_plane[2 * i + s];
+				for(int j = 0; j < 4; ++j)
+				{
+					p[j] = m[3][j] + sign * m[i][j];
+				}
+				const T n = std::sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+				for(int j = 0; j < 4; ++j)
+				{
+					p[j] /= n;
+				}
+			}
+		}
+	}
+
+	inline const Vector<4, T> &plane(int i) const
+	{
+		return this->_plane[i];
+	}
+
+	bool contains(const Vector<3, T> &p) const
+	{
+		return this->contains(p, T(0));
+	}
+
+	/* Whether the sphere is at least partly inside, conservative near the
+	 * edges and corners
+	 */
+	bool contains(const Vector<3, T> &center, T radius) const
+	{
+		for(const Vector<4, T> &p : this->_plane)
+		{
+			if(p[0] * center[0] + p[1] * center[1] + p[2] * center[2] + p[3] < -radius)
+				return false;
+		}
+		return true;
+	}
+
+	/* Whether the box is at least partly inside, testing the corner
+	 * furthest along each plane normal; conservative like the spheres
+	 */
+	bool overlaps(const AABB<3, T> &box) const
+	{
+		for(const Vector<4, T> &p : this->_plane)
+		{
+			T s = p[3];
+			for(int j = 0; j < 3; ++j)
+			{
+				s += p[j] * (p[j] < T(0) ? box.lower()[j] : box.upper()[j]);
+			}
+			if(s < T(0))
+				return false;
+		}
+		return true;
+	}
+
+	/* Points inside the frustum, boundary included
+	 */
+	template <int W = Width<T>::value>
+	void contains(const VectorArray<3, T> &points, Mask *hits) const
+	{
+		typedef detail::Packet<T, W> Packet;
+		typedef typename Packet::pack P;
+		typedef typename P::type R;
+
+		const R zero = P::set1(T(0)), all = P::less(zero, P::set1(T(1)));
+		R plane[6][4];
+		for(int k = 0; k < 6; ++k)
+		{
+			for(int j = 0; j < 4; ++j)
+			{
+				plane[k][j] = P::set1(this->_plane[k][j]);
+			}
+		}
+
+		detail::sweep<Packet::width>(points.size(), hits, [&](size_t i) {
+			const R x = P::load(points.lane(0) + i), y = P::load(points.lane(1) + i), z = P::load(points.lane(2) + i);
+			R m = all;
+			for(int k = 0; k < 6; ++k)
+			{
+				const R s = P::madd(plane[k][0], x, P::madd(plane[k][1], y, P::madd(plane[k][2], z, plane[k][3])));
+				m = P::blend(P::less(s, zero), m, zero);
+			}
+			return (Mask)P::bits(m);
+		});
+	}
+private:
+	Vector<4, T> _plane[6];
+};
+
+} /* namespace geometry */
+
+typedef geometry::Rays<float>     Raysf;
+typedef geometry::Rays<double>    Rayslf;
+typedef geometry::Frustum<float>  Frustumf;
+typedef geometry::Frustum<double> Frustumlf;
+
+#endif /* GEOMETRY_HH */
@@ -0,0 +1,428 @@
+/* half.hh */
+#ifndef HALF_HH
+#define HALF_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include "parallel.hh"
+#include "simd.hh"
+
+/* Bit layout of a Float16
+ * Binary16 is IEEE half precision, 5 exponent and 10 mantissa bits.
+ * BFloat16 is the upper half of a float, 8 exponent and 7 mantissa bits,
+ * keeping the range of float at a third of its precision.
+ */
+enum class Float16Format
+{
+    Binary16,
+    BFloat16
+};
+
+/* 16 bit storage scalar, trivial like float so value initialization gives +0
+ * Values convert to and from float rounding to nearest even, NaN staying
+ * NaN; doubles go through float and can round twice. Arithmetic is done
+ * in float and rounded back after every operation, so the kernels that
+ * care about precision convert whole rows to float instead, see convert()
+ * and kernel::Gemm.
+ */
+template <Float16Format F>
+class Float16
+{
+public:
+    Float16(void) = default;
+    Float16(float);
+    template <class U, typename std::enable_if<std::is_arithmetic<U>::value, int>::type = 0>
+    Float16(U);
+    template <class U, typename std::enable_if<std::is_arithmetic<U>::value, int>::type = 0>
+    explicit operator U(void) const;
+
+    static constexpr inline Float16 from_bits(uint16_t);
+    constexpr inline uint16_t bits(void) const;
+
+    inline Float16  operator +(void) const;
+    inline Float16  operator -(void) const;
+    inline Float16  operator +(const Float16&) const;
+    inline Float16  operator -(const Float16&) const;
+    inline Float16  operator *(const Float16&) const;
+    inline Float16  operator /(const Float16&) const;
+    inline Float16& operator +=(const Float16&);
+    inline Float16& operator -=(const Float16&);
+    inline Float16& operator *=(const Float16&);
+    inline Float16& operator /=(const Float16&);
+    inline bool     operator ==(const Float16&) const;
+    inline bool     operator !=(const Float16&) const;
+    inline bool     operator <(const Float16&) const;
+    inline bool     operator <=(const Float16&) const;
+    inline bool     operator >(const Float16&) const;
+    inline bool     operator >=(const Float16&) const;
+private:
+    static inline uint16_t encode(float);
+    static inline float    decode(uint16_t);
+
+    uint16_t _bits;
+};
+
+typedef Float16<Float16Format::Binary16> Half;
+typedef Float16<Float16Format::BFloat16> BFloat16;
+
+template <Float16Format F>
+Float16<F>::Float16(float x)
+    : _bits(Float16::encode(x))
+{
+}
+
+template <Float16Format F>
+template <class U, typename std::enable_if<std::is_arithmetic<U>::value, int>::type>
+Float16<F>::Float16(U x)
+    : _bits(Float16::encode(static_cast<float>(x)))
+{
+}
+
+template <Float16Format F>
+template <class U, typename std::enable_if<std::is_arithmetic<U>::value, int>::type>
+Float16<F>::operator U(void) const
+{
+    return static_cast<U>(Float16::decode(this->_bits));
+}
+
+template <Float16Format F>
+constexpr inline Float16<F> Float16<F>::from_bits(uint16_t bits)
+{
+    Float16 h{};
+    h._bits = bits;
+    return h;
+}
+
+template <Float16Format F>
+constexpr inline uint16_t Float16<F>::bits(void) const
+{
+    return this->_bits;
+}
+
+template <Float16Format F>
+inline Float16<F> Float16<F>::operator +(void) const
+{
+    return (*this);
+}
+
+/* Flips the sign bit, exact for every value including NaN and zero
+ */
+template <Float16Format F>
+inline Float16<F> Float16<F>::operator -(void) const
+{
+    return Float16::from_bits(this->_bits ^ 0x8000u);
+}
+
+template <Float16Format F>
+inline Float16<F> Float16<F>::operator +(const Float16<F>& b) const
+{
+    return Float16(float(*this) + float(b));
+}
+
+template <Float16Format F>
+inline Float16<F> Float16<F>::operator -(const Float16<F>& b) const
+{
+    return Float16(float(*this) - float(b));
+}
+
+template <Float16Format F>
+inline Float16<F> Float16<F>::operator *(const Float16<F>& b) const
+{
+    return Float16(float(*this) * float(b));
+}
+
+template <Float16Format F>
+inline Float16<F> Float16<F>::operator /(const Float16<F>& b) const
+{
+    return Float16(float(*this) / float(b));
+}
+
+template <Float16Format F>
+inline Float16<F>& Float16<F>::operator +=(const Float16<F>& b)
+{
+    return (*this) = (*this) + b;
+}
+
+template <Float16Format F>
+inline Float16<F>& Float16<F>::operator -=(const Float16<F>& b)
+{
+    return (*this) = (*this) - b;
+}
+
+template <Float16Format F>
+inline Float16<F>& Float16<F>::operator *=(const Float16<F>& b)
+{
+    return (*this) = (*this) * b;
+}
+
+template <Float16Format F>
+inline Float16<F>& Float16<F>::operator /=(const Float16<F>& b)
+{
+    return (*this) = (*this) / b;
+}
+
+template <Float16Format F>
+inline bool Float16<F>::operator ==(const Float16<F>& b) const
+{
+    return float(*this) == float(b);
+}
+
+template <Float16Format F>
+inline bool Float16<F>::operator !=(const Float16<F>& b) const
+{
+    return float(*this) != float(b);
+}
+
+template <Float16Format F>
+inline bool Float16<F>::operator <(const Float16<F>& b) const
+{
+    return float(*this) < float(b);
+}
+
+template <Float16Format F>
+inline bool Float16<F>::operator <=(const Float16<F>& b) const
+{
+    return float(*this) <= float(b);
+}
+
+template <Float16Format F>
+inline bool Float16<F>::operator >(const Float16<F>& b) const
+{
+    return float(*this) > float(b);
+}
+
+template <Float16Format F>
+inline bool Float16<F>::operator >=(const Float16<F>& b) const
+{
+    return float(*this) >= float(b);
+}
+
+/* F16C has single value conversions; without it binary16 is rebased in the
+ * integer domain, values below 2^-14 being rounded by the float adder
+ * against 0.5f, whose mantissa then holds the subnormal half. BFloat16
+ * rounds the discarded low half of the float to nearest even.
+ */
+template <Float16Format F>
+inline uint16_t Float16<F>::encode(float x)
+{
+    if constexpr(F == Float16Format::Binary16)
+    {
+#if defined(SIMD_F16C)
+        return (uint16_t)_cvtss_sh(x, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+#else
+        uint32_t u;
+        std::memcpy(&u, &x, sizeof(u));
+        const uint32_t sign = (u >> 16) & 0x8000u;
+        u &= 0x7fffffffu;
+        if(u >= 0x7f800000u)
+            return (uint16_t)(sign | (u > 0x7f800000u ? 0x7e00u | ((u >> 13) & 0x3ffu) : 0x7c00u));
+        if(u >= 0x477ff000u)
+            return (uint16_t)(sign | 0x7c00u);
+        if(u < 0x38800000u)
+        {
+            float f;
+            std::memcpy(&f, &u, sizeof(f));
+            f += 0.5f;
+            std::memcpy(&u, &f, sizeof(u));
+            return (uint16_t)(sign | (u - 0x3f000000u));
+        }
+        u += 0xc8000fffu + ((u >> 13) & 1u);
+        return (uint16_t)(sign | (u >> 13));
+#endif
+    }
+    else
+    {
+        uint32_t u;
+        std::memcpy(&u, &x, sizeof(u));
+        if((u & 0x7fffffffu) > 0x7f800000u)
+            return (uint16_t)((u >> 16) | 0x40u);
+        return (uint16_t)((u + 0x7fffu + ((u >> 16) & 1u)) >> 16);
+    }
+}
+
+template <Float16Format F>
+inline float Float16<F>::decode(uint16_t h)
+{
+    uint32_t u;
+    if constexpr(F == Float16Format::Binary16)
+    {
+#if defined(SIMD_F16C)
+        return _cvtsh_ss(h);
+#else
+        const uint32_t sign = (uint32_t)(h & 0x8000u) << 16;
+        const uint32_t em   = h & 0x7fffu;
+        if(em < 0x0400u)
+        {
+            const float f = (float)em * 5.9604644775390625e-8f;
+            return sign ? -f : f;
+        }
+        u = sign | (em >= 0x7c00u ? 0x7f800000u | ((em & 0x3ffu) << 13) : (em << 13) + 0x38000000u);
+#endif
+    }
+    else
+    {
+        u = (uint32_t)h << 16;
+    }
+    float x;
+    std::memcpy(&x, &u, sizeof(x));
+    return x;
+}
+
+namespace simd
+{
+
+/* Convert<S> widens width values of S into a float register and narrows
+ * one back to S, rounding to nearest even. enabled is false when the
+ * target has no such conversion, convert() then takes its scalar loop.
+ * BFloat16 narrows with the same integer rounding as the scalar encode(),
+ * not the AVX-512 BF16 instruction, which flushes subnormals to zero, so
+ * results do not depend on the target.
+ */
+template <class S>
+struct Convert
+{
+    static constexpr bool enabled = false;
+    static constexpr int  width   = 1;
+};
+
+#if defined(SIMD_F16C)
+template <>
+struct Convert<Half>
+{
+    static constexpr bool enabled = true;
+    static constexpr int  width   = 8;
+    typedef Pack<float, 8> pack;
+
+    static inline pack::type load(const Half *p)
+    {
+        return _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+    }
+
+    static inline void store(Half *p, pack::type a)
+    {
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(p), _mm256_cvtps_ph(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+    }
+};
+#elif defined(SIMD_NEON64)
+template <>
+struct Convert<Half>
+{
+    static constexpr bool enabled = true;
+    static constexpr int  width   = 4;
+    typedef Pack<float, 4> pack;
+
+    static inline pack::type load(const Half *p)
+    {
+        return vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(reinterpret_cast<const uint16_t *>(p))));
+    }
+
+    static inline void store(Half *p, pack::type a)
+    {
+        vst1_u16(reinterpret_cast<uint16_t *>(p), vreinterpret_u16_f16(vcvt_f16_f32(a)));
+    }
+};
+#endif
+
+#if defined(SIMD_AVX2)
+template <>
+struct Convert<BFloat16>
+{
+    static constexpr bool enabled = true;
+    static constexpr int  width   = 8;
+    typedef Pack<float, 8> pack;
+
+    static inline pack::type load(const BFloat16 *p)
+    {
+        const __m256i h = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+        return _mm256_castsi256_ps(_mm256_slli_epi32(h, 16));
+    }
+
+    static inline void store(BFloat16 *p, pack::type a)
+    {
+        const __m256i u = _mm256_castps_si256(a);
+        const __m256i odd = _mm256_and_si256(_mm256_srli_epi32(u, 16), _mm256_set1_epi32(1));
+        __m256i r = _mm256_srli_epi32(_mm256_add_epi32(u, _mm256_add_epi32(odd, _mm256_set1_epi32(0x7fff))), 16);
+        const __m256i nan = _mm256_castps_si256(_mm256_cmp_ps(a, a, _CMP_UNORD_Q));
+        r = _mm256_blendv_epi8(r, _mm256_or_si256(_mm256_srli_epi32(u, 16), _mm256_set1_epi32(0x40)), nan);
+        /* packus works within 128 bit lanes, the permute joins the halves */
+        const __m128i h = _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packus_epi32(r, r), 0x08));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(p), h);
+    }
+};
+#elif defined(SIMD_NEON64)
+template <>
+struct Convert<BFloat16>
+{
+    static constexpr bool enabled = true;
+    static constexpr int  width   = 4;
+    typedef Pack<float, 4> pack;
+
+    static inline pack::type load(const BFloat16 *p)
+    {
+        return vreinterpretq_f32_u32(vshll_n_u16(vld1_u16(reinterpret_cast<const uint16_t *>(p)), 16));
+    }
+
+    static inline void store(BFloat16 *p, pack::type a)
+    {
+        const uint32x4_t u   = vreinterpretq_u32_f32(a);
+        const uint32x4_t odd = vandq_u32(vshrq_n_u32(u, 16), vdupq_n_u32(1));
+        const uint32x4_t r   = vaddq_u32(u, vaddq_u32(odd, vdupq_n_u32(0x7fff)));
+        const uint32x4_t q   = vorrq_u32(u, vdupq_n_u32(0x400000));
+        vst1_u16(reinterpret_cast<uint16_t *>(p), vshrn_n_u32(vbslq_u32(vceqq_f32(a, a), r, q), 16));
+    }
+};
+#endif
+
+} /* namespace simd */
+
+/* out[i] = in[i] for i < count, spread over the threads of policy
+ * Float16 to and from float goes a register at a time, the tail through a
+ * padded register so it rounds like the body; other pairs are converted
+ * by static_cast.
+ */
+template <class S, class D>
+void convert(const S *in, D *out, size_t count, const parallel::Policy &policy = parallel::seq)
+{
+    constexpr bool widen  = std::is_same<D, float>::value && simd::Convert<S>::enabled;
+    constexpr bool narrow = std::is_same<S, float>::value && simd::Convert<D>::enabled;
+
+    policy.range(count, 1 << 16, [in, out](size_t begin, size_t end) {
+        if constexpr(widen || narrow)
+        {
+            typedef simd::Convert<typename std::conditional<widen, S, D>::type> C;
+            typedef typename C::pack P;
+            constexpr size_t W = C::width;
+
+            size_t i = begin;
+            for(; i + W <= end; i += W)
+            {
+                if constexpr(widen)
+                    P::storeu(out + i, C::load(in + i));
+                else
+                    C::store(out + i, P::loadu(in + i));
+            }
+            if(i < end)
+            {
+                S s[W] = {};
+                D d[W];
+                std::memcpy(s, in + i, (end - i) * sizeof(S));
+                if constexpr(widen)
+                    P::storeu(d, C::load(s));
+                else
+                    C::store(d, P::loadu(s));
+                std::memcpy(out + i, d, (end - i) * sizeof(D));
+            }
+        }
+        else
+        {
+            for(size_t i = begin; i < end; ++i)
+            {
+                out[i] = static_cast<D>(in[i]);
+            }
+        }
+    });
+}
+
+#endif /* HALF_HH */
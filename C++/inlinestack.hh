@@ -0,0 +1,186 @@
+/* inlinestack.hh */
+#ifndef INLINESTACK_HH
+#define INLINESTACK_HH
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include "instrument.hh"
+#include "stack.hh"
+
+/* Stack keeping its first N elements inside the object
+ * The heap is only touched once the stack holds more than N elements, after
+ * which it behaves like Stack<T>. Up to N elements every operation is a
+ * bounds check and an access to the inline array.
+ */
+template <typename T, size_t N = 32>
+class InlineStack : public StackWords<InlineStack<T, N>, T>
+{
+	static_assert(N > 0, "InlineStack needs room for atleast one element");
+
+	typedef StackWords<InlineStack<T, N>, T> Words;
+
+	friend Words;
+public:
+	InlineStack(size_t size = 0, StackOverflow overflow = StackOverflow::Grow, double growth = 2.0)
+		: Words(reinterpret_cast<T *>(this->_storage), N, overflow, growth)
+	{
+		this->reserve(size);
+	}
+
+	InlineStack(const InlineStack &stack)
+		: InlineStack(stack.capacity(), stack._overflow, stack._growth)
+	{
+		this->append(stack._base, stack._pointer);
+	}
+
+	/* Inline elements are moved one by one, so this only cannot throw when
+	 * T's move constructor cannot
+	 */
+	InlineStack(InlineStack &&stack) noexcept(std::is_nothrow_move_constructible<T>::value)
+		: InlineStack(0, stack._overflow, stack._growth)
+	{
+		this->take(stack);
+	}
+
+	InlineStack &operator =(const InlineStack &stack)
+	{
+		if(this != &stack)
+		{
+			this->clear();
+			this->_overflow = stack._overflow;
+			this->_growth   = stack._growth;
+			this->reserve(stack.size());
+			this->append(stack._base, stack._pointer);
+		}
+		return (*this);
+	}
+
+	InlineStack &operator =(InlineStack &&stack) noexcept(std::is_nothrow_move_constructible<T>::value)
+	{
+		if(this != &stack)
+		{
+			this->release();
+			this->_overflow = stack._overflow;
+			this->_growth   = stack._growth;
+			this->take(stack);
+		}
+		return (*this);
+	}
+
+	~InlineStack(void)
+	{
+		this->release();
+	}
+
+	/* Constructs a new stack with identical capacity and data
+	 */
+	InlineStack copy(void) const
+	{
+		return InlineStack(*this);
+	}
+
+	/* Resizes the storage to max(size, N) elements, keeping the data from the
+	 * bottom of the stack up to the new size
+	 */
+	void allocate(size_t size)
+	{
+		const size_t capacity = size > N ? size : N;
+		const size_t count    = this->size() < size ? this->size() : size;
+		T *memory = capacity == N ? this->buffer() : static_cast<T *>(::operator new(capacity * sizeof(T), std::align_val_t(alignof(T))));
+		if(memory == this->_base)
+		{
+			this->destroy(this->_base + count, this->_pointer);
+			this->_pointer = this->_base + count;
+			return;
+		}
+
+		if(capacity != N)
+		{
+			instrument::count(instrument::Counter::Allocations);
+			instrument::count(instrument::Counter::AllocatedBytes, capacity * sizeof(T));
+		}
+		instrument::count(instrument::Counter::Reallocations);
+		instrument::count(instrument::Counter::CopiedBytes, count * sizeof(T));
+		try
+		{
+			this->relocate(this->_base, count, memory);
+		}
+		catch(...)
+		{
+			if(capacity != N)
+				::operator delete(memory, std::align_val_t(alignof(T)));
+			throw;
+		}
+		this->destroy(this->_base, this->_pointer);
+		this->dispose();
+		this->_base     = memory;
+		this->_pointer  = memory + count;
+		this->_capacity = capacity;
+	}
+
+	/* Whether the elements still live inside the object
+	 */
+	bool local(void) const
+	{
+		return this->_base == reinterpret_cast<const T *>(this->_storage);
+	}
+private:
+	alignas(T) unsigned char _storage[N * sizeof(T)];
+
+	inline T *buffer(void)
+	{
+		return reinterpret_cast<T *>(this->_storage);
+	}
+
+	template <class... Args>
+	inline void construct(T *p, Args &&...args)
+	{
+		::new((void *)p) T(std::forward<Args>(args)...);
+	}
+
+	inline void destruct(T *p)
+	{
+		p->~T();
+	}
+
+	/* Frees heap storage, if any, without touching the elements
+	 */
+	void dispose(void)
+	{
+		if(!this->local())
+			::operator delete(this->_base, std::align_val_t(alignof(T)));
+	}
+
+	void release(void)
+	{
+		this->destroy(this->_base, this->_pointer);
+		this->dispose();
+		this->_base     = this->buffer();
+		this->_pointer  = this->_base;
+		this->_capacity = N;
+	}
+
+	/* Steals heap storage, inline elements have to be moved over one by one,
+	 * this being empty and inline
+	 */
+	void take(InlineStack &stack)
+	{
+		if(stack.local())
+		{
+			this->relocate(stack._base, stack.size(), this->_base);
+			this->_pointer = this->_base + stack.size();
+			stack.clear();
+			return;
+		}
+		this->_base     = stack._base;
+		this->_pointer  = stack._pointer;
+		this->_capacity = stack._capacity;
+		stack._base     = stack.buffer();
+		stack._pointer  = stack._base;
+		stack._capacity = N;
+	}
+};
+
+#endif /* INLINESTACK_HH */
@@ -0,0 +1,328 @@
+/* instrument.hh */
+#ifndef INSTRUMENT_HH
+#define INSTRUMENT_HH
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#if defined(INSTRUMENT) && defined(INSTRUMENT_ITT)
+#   include <ittnotify.h>
+#endif
+
+/* Opt-in counters and timeline markers for the hot paths of the library
+ * Compiled in when INSTRUMENT is defined (the INSTRUMENT CMake option),
+ * otherwise every function below and Scope compile to nothing, leaving
+ * the instrumented code as it was without them.
+ * Every thread counts into its own cache line aligned block with plain
+ * relaxed stores, snapshot() sums the blocks without locking. Counts are
+ * inclusive, a DynMatrix product also shows up as the Gemm it runs.
+ */
+namespace instrument
+{
+
+#if defined(INSTRUMENT)
+constexpr bool enabled = true;
+#else
+constexpr bool enabled = false;
+#endif
+
+/* Entry points counted by call and floating point operations
+ */
+enum class Kernel
+{
+    MatrixMultiply,
+    DynMatrixMultiply,
+    Gemm,
+    LU,
+    SparseMultiply,
+    SparseSolve,
+    count
+};
+
+/* Events summed over the threads, except StackHighWater which is the
+ * deepest any stack has been
+ */
+enum class Counter
+{
+    Allocations,
+    AllocatedBytes,
+    CopiedBytes,
+    Temporaries,
+    Reallocations,
+    Overflows,
+    Underflows,
+    StackHighWater,
+    count
+};
+
+constexpr size_t kernels  = (size_t)Kernel::count;
+constexpr size_t counters = (size_t)Counter::count;
+
+inline const char *name(Kernel kernel)
+{
+    static const char *const names[kernels] = {
+        "Matrix::multiply", "DynMatrix::multiply", "kernel::Gemm", "kernel::LU",
+        "SparseMatrix::multiply", "SparseMatrix::solve"
+    };
+    return names[(size_t)kernel];
+}
+
+inline const char *name(Counter counter)
+{
+    static const char *const names[counters] = {
+        "allocations", "allocated bytes", "copied bytes", "temporaries",
+        "reallocations", "overflows", "underflows", "stack high water"
+    };
+    return names[(size_t)counter];
+}
+
+/* Totals at one point in time, the difference of two snapshots being what
+ * happened in between (the high water mark is kept as is)
+ */
+struct Snapshot
+{
+    uint64_t calls[kernels]   = {};
+    uint64_t flops[kernels]   = {};
+    uint64_t value[counters]  = {};
+
+    inline uint64_t operator [](Counter counter) const
+    {
+        return this->value[(size_t)counter];
+    }
+
+    Snapshot operator -(const Snapshot &b) const
+    {
+        Snapshot d;
+        for(size_t i = 0; i < kernels; ++i)
+        {
+            d.calls[i] = this->calls[i] - b.calls[i];
+            d.flops[i] = this->flops[i] - b.flops[i];
+        }
+        for(size_t i = 0; i < counters; ++i)
+        {
+            d.value[i] = i == (size_t)Counter::StackHighWater ? this->value[i] : this->value[i] - b.value[i];
+        }
+        return d;
+    }
+};
+
+/* Timeline markers, called with the kernel name around every Scope
+ * Either may be null. Markers for perf, Tracy or any other profiler are
+ * forwarded from here; building with INSTRUMENT_ITT also emits ITT tasks
+ * for VTune.
+ */
+struct Hooks
+{
+    void (*begin)(const char *) = nullptr;
+    void (*end)(const char *)   = nullptr;
+};
+
+namespace detail
+{
+
+/* Counters of one thread, written by it alone and read by snapshot()
+ * A block outlives its thread and is handed to the next thread started,
+ * so the totals survive the threads and the blocks stay bounded by the
+ * most threads alive at once.
+ */
+struct alignas(64) Block
+{
+    std::atomic<uint64_t> calls[kernels];
+    std::atomic<uint64_t> flops[kernels];
+    std::atomic<uint64_t> value[counters];
+    std::atomic<bool>     used;
+    Block                *next;
+};
+
+inline std::atomic<Block *> blocks{nullptr};
+inline std::atomic<void (*)(const char *)> begin{nullptr};
+inline std::atomic<void (*)(const char *)> end{nullptr};
+
+struct Owner
+{
+    Owner(void)
+    {
+        for(Block *b = blocks.load(std::memory_order_acquire); b != nullptr; b = b->next)
+        {
+            bool used = false;
+            if(!b->used.load(std::memory_order_relaxed) && b->used.compare_exchange_strong(used, true, std::memory_order_acquire))
+            {
+                this->block = b;
+                return;
+            }
+        }
+        this->block = new Block();
+        this->block->used.store(true, std::memory_order_relaxed);
+        this->block->next = blocks.load(std::memory_order_relaxed);
+        while(!blocks.compare_exchange_weak(this->block->next, this->block, std::memory_order_release, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    ~Owner(void)
+    {
+        this->block->used.store(false, std::memory_order_release);
+    }
+
+    Block *block;
+};
+
+inline Block &local(void)
+{
+    thread_local Owner owner;
+    return *owner.block;
+}
+
+inline void add(std::atomic<uint64_t> &c, uint64_t n)
+{
+    c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+} /* namespace detail */
+
+/* One call of kernel doing flops floating point operations
+ */
+inline void call(Kernel kernel, uint64_t flops = 0)
+{
+    if constexpr(enabled)
+    {
+        detail::Block &b = detail::local();
+        detail::add(b.calls[(size_t)kernel], 1);
+        detail::add(b.flops[(size_t)kernel], flops);
+    }
+    else
+    {
+        (void)kernel;
+        (void)flops;
+    }
+}
+
+inline void count(Counter counter, uint64_t n = 1)
+{
+    if constexpr(enabled)
+    {
+        detail::add(detail::local().value[(size_t)counter], n);
+    }
+    else
+    {
+        (void)counter;
+        (void)n;
+    }
+}
+
+/* Raises counter to n if it is below, for the high water marks
+ */
+inline void maximum(Counter counter, uint64_t n)
+{
+    if constexpr(enabled)
+    {
+        std::atomic<uint64_t> &c = detail::local().value[(size_t)counter];
+        if(n > c.load(std::memory_order_relaxed))
+            c.store(n, std::memory_order_relaxed);
+    }
+    else
+    {
+        (void)counter;
+        (void)n;
+    }
+}
+
+/* Counts a kernel call and brackets it with the timeline markers
+ */
+class Scope
+{
+public:
+    explicit Scope(Kernel kernel, uint64_t flops = 0)
+        : _kernel(kernel)
+    {
+        if constexpr(enabled)
+        {
+            call(kernel, flops);
+            if(auto f = detail::begin.load(std::memory_order_acquire))
+                f(name(kernel));
+#if defined(INSTRUMENT) && defined(INSTRUMENT_ITT)
+            __itt_task_begin(Scope::domain(), __itt_null, __itt_null, Scope::handle(kernel));
+#endif
+        }
+        else
+        {
+            (void)flops;
+        }
+    }
+
+    ~Scope(void)
+    {
+        if constexpr(enabled)
+        {
+#if defined(INSTRUMENT) && defined(INSTRUMENT_ITT)
+            __itt_task_end(Scope::domain());
+#endif
+            if(auto f = detail::end.load(std::memory_order_acquire))
+                f(name(this->_kernel));
+        }
+    }
+
+    Scope(const Scope &) = delete;
+    Scope &operator =(const Scope &) = delete;
+private:
+    Kernel _kernel;
+#if defined(INSTRUMENT) && defined(INSTRUMENT_ITT)
+    static __itt_domain *domain(void)
+    {
+        static __itt_domain *const d = __itt_domain_create("containers");
+        return d;
+    }
+
+    static __itt_string_handle *handle(Kernel kernel)
+    {
+        static __itt_string_handle *const h[kernels] = {
+            __itt_string_handle_create(name(Kernel::MatrixMultiply)),
+            __itt_string_handle_create(name(Kernel::DynMatrixMultiply)),
+            __itt_string_handle_create(name(Kernel::Gemm)),
+            __itt_string_handle_create(name(Kernel::LU)),
+            __itt_string_handle_create(name(Kernel::SparseMultiply)),
+            __itt_string_handle_create(name(Kernel::SparseSolve))
+        };
+        return h[(size_t)kernel];
+    }
+#endif
+};
+
+inline void hooks(const Hooks &h)
+{
+    detail::begin.store(h.begin, std::memory_order_release);
+    detail::end.store(h.end, std::memory_order_release);
+}
+
+/* Sums the blocks of every thread that has counted, the counts of threads
+ * still running being read as they were at some recent point. Empty when
+ * instrumentation is compiled out.
+ */
+inline Snapshot snapshot(void)
+{
+    Snapshot s;
+    if constexpr(enabled)
+    {
+        for(detail::Block *b = detail::blocks.load(std::memory_order_acquire); b != nullptr; b = b->next)
+        {
+            for(size_t i = 0; i < kernels; ++i)
+            {
+                s.calls[i] += b->calls[i].load(std::memory_order_relaxed);
+                s.flops[i] += b->flops[i].load(std::memory_order_relaxed);
+            }
+            for(size_t i = 0; i < counters; ++i)
+            {
+                const uint64_t v = b->value[i].load(std::memory_order_relaxed);
+                if(i == (size_t)Counter::StackHighWater)
+                    s.value[i] = v > s.value[i] ? v : s.value[i];
+                else
+                    s.value[i] += v;
+            }
+        }
+    }
+    return s;
+}
+
+} /* namespace instrument */
+
+#endif /* INSTRUMENT_HH */
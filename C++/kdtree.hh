@@ -0,0 +1,218 @@
+/* kdtree.hh */
+#ifndef KDTREE_HH
+#define KDTREE_HH
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+#include "aabb.hh"
+#include "inlinestack.hh"
+#include "parallel.hh"
+#include "spatial.hh"
+#include "vectorarray.hh"
+
+/* k-d tree over Vector<N, T> points for nearest neighbour and radius queries
+ * Every tree is flattened into one array of nodes in depth first order, a
+ * left child directly following its parent, and its points are kept in leaf
+ * order in a VectorArray so that a leaf is tested with one batched
+ * quadrance over at most leaf points. Splits are at the median of the
+ * widest axis, in the layout of spatial::Tree, and points inserted after a
+ * build are collected into further trees by spatial::Forest.
+ * The index of a point is its position in the array the tree was built
+ * from, inserted points being numbered on from there.
+ */
+template <int N, class T>
+class KdTree
+{
+public:
+	typedef spatial::Neighbour<T> Neighbour;
+
+	static constexpr size_t leaf = 16;
+	static constexpr size_t npos = spatial::npos;
+
+	KdTree(void) = default;
+
+	KdTree(const Vector<N, T> *points, size_t size, const parallel::Policy &policy = parallel::seq)
+	{
+		this->build(points, size, policy);
+	}
+
+	/* Replaces the contents with points[0 .. size), point i getting index i
+	 */
+	void build(const Vector<N, T> *points, size_t size, const parallel::Policy &policy = parallel::seq)
+	{
+		std::vector<Entry> entries(size);
+		for(size_t i = 0; i < size; ++i)
+		{
+			entries[i] = Entry{points[i], i};
+		}
+		this->_forest.build(entries, policy);
+	}
+
+	/* Adds p and returns its index
+	 */
+	size_t insert(const Vector<N, T> &p)
+	{
+		return this->_forest.insert(Entry{p, this->size()});
+	}
+
+	void clear(void)
+	{
+		this->_forest.clear();
+	}
+
+	inline size_t size(void) const
+	{
+		return this->_forest.size();
+	}
+
+	/* Closest point to q, index npos when the tree is empty
+	 */
+	Neighbour nearest(const Vector<N, T> &q) const
+	{
+		spatial::Closest<T> s;
+		this->_forest.search(q, s);
+		return s.best;
+	}
+
+	/* The min(k, size()) points closest to q into out, nearest first
+	 */
+	void nearest(const Vector<N, T> &q, size_t k, std::vector<Neighbour> &out) const
+	{
+		out.clear();
+		if(k == 0)
+			return;
+		out.reserve(k < this->size() ? k : this->size());
+		spatial::Nearest<T> s{k, out};
+		this->_forest.search(q, s);
+		s.finish();
+	}
+
+	/* Every point within distance r of q into out, in no particular order
+	 */
+	void radius(const Vector<N, T> &q, T r, std::vector<Neighbour> &out) const
+	{
+		out.clear();
+		spatial::Radius<T> s{r * r, out};
+		this->_forest.search(q, s);
+	}
+
+	/* out[i] = nearest(q[i]) for i in [0, count)
+	 */
+	void nearest(const Vector<N, T> *q, size_t count, Neighbour *out, const parallel::Policy &policy = parallel::seq) const
+	{
+		policy.range(count, 256, [this, q, out](size_t begin, size_t end) {
+			for(size_t i = begin; i < end; ++i)
+			{
+				out[i] = this->nearest(q[i]);
+			}
+		});
+	}
+private:
+	struct Entry
+	{
+		Vector<N, T> point;
+		size_t index;
+
+		inline T quadrance(const Vector<N, T> &q) const
+		{
+			return this->point.quadrance(q);
+		}
+	};
+
+	struct Node
+	{
+		T split;
+		unsigned axis;   /* N for a leaf */
+		unsigned link;   /* right child, or the first point of a leaf */
+		unsigned count;  /* points in a leaf */
+	};
+
+	struct Visit
+	{
+		size_t node;
+		T quadrance;     /* lower bound for every point below node */
+	};
+
+	struct Tree : spatial::Tree<Tree, Entry, Node, leaf>
+	{
+		VectorArray<N, T> points;
+
+		void allocate(size_t n)
+		{
+			this->points.allocate(n);
+		}
+
+		void fill(const Entry *e, size_t node, size_t begin, size_t end)
+		{
+			this->nodes[node] = Node{T(), N, (unsigned)begin, (unsigned)(end - begin)};
+			for(size_t i = begin; i < end; ++i)
+			{
+				this->points.set(i, e[i].point);
+			}
+		}
+
+		/* Splits at the median of the widest axis
+		 */
+		void divide(Entry *e, size_t node, size_t begin, size_t mid, size_t end, size_t right)
+		{
+			AABB<N, T> box;
+			for(size_t i = begin; i < end; ++i)
+			{
+				box.expand(e[i].point);
+			}
+			const int axis = box.widest();
+			std::nth_element(e + begin, e + mid, e + end, [axis](const Entry &a, const Entry &b) {
+				return a.point[axis] < b.point[axis];
+			});
+			this->nodes[node] = Node{e[mid].point[axis], (unsigned)axis, (unsigned)right, 0};
+		}
+
+		inline Entry entry(size_t i) const
+		{
+			return Entry{this->points.get(i), this->index[i]};
+		}
+
+		/* Hands the points of every leaf that may hold one within s.bound()
+		 * of q to s.take(), the nearer child first
+		 */
+		template <class S>
+		void search(const Vector<N, T> &q, S &s) const
+		{
+			InlineStack<Visit, 64> stack;
+			stack.push(Visit{0, T()});
+			while(stack.size() != 0)
+			{
+				const Visit v = stack.pop_unsafe();
+				if(s.bound() < v.quadrance)
+					continue;
+
+				const Node &node = this->nodes[v.node];
+				if(node.axis == N)
+				{
+					T d[leaf];
+					this->points.quadrance(q, node.link, node.link + node.count, d);
+					for(unsigned i = 0; i < node.count; ++i)
+					{
+						s.take(this->index[node.link + i], d[i]);
+					}
+					continue;
+				}
+				const T d = q[node.axis] - node.split;
+				const T far = v.quadrance < d * d ? d * d : v.quadrance;
+				stack.push(Visit{d < T() ? (size_t)node.link : v.node + 1, far});
+				stack.push(Visit{d < T() ? v.node + 1 : (size_t)node.link, v.quadrance});
+			}
+		}
+	};
+
+	spatial::Forest<Tree, Entry, 4 * leaf> _forest;
+};
+
+typedef KdTree<2, float>  KdTree2f;
+typedef KdTree<3, float>  KdTree3f;
+typedef KdTree<2, double> KdTree2lf;
+typedef KdTree<3, double> KdTree3lf;
+
+#endif /* KDTREE_HH */
@@ -0,0 +1,180 @@
+/* lu.hh */
+#ifndef LU_HH
+#define LU_HH
+
+#include <cmath>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include "instrument.hh"
+
+namespace kernel
+{
+
+/* Partially pivoted LU factorization over row-major storage
+ * After factor() the strictly lower part of a holds L (with an implicit
+ * unit diagonal) and the upper part U, such that P a = L U where P swaps
+ * row k with row pivot[k] for k = 0, 1, ..., n - 1 in turn.
+ */
+template <class T>
+struct LU
+{
+    /* Returns the parity of P (1 or -1), or 0 if a is singular
+     * A singular matrix is still factored, but solving against it divides by zero
+     */
+    static int factor(size_t n, T *a, size_t lda, size_t *pivot)
+    {
+        const instrument::Scope scope(instrument::Kernel::LU, 2 * (uint64_t)n * n * n / 3);
+        int parity = 1;
+        for(size_t k = 0; k < n; ++k)
+        {
+            size_t p = k;
+            auto   m = std::abs(a[k * lda + k]);
+            for(size_t i = k + 1; i < n; ++i)
+            {
+                const auto x = std::abs(a[i * lda + k]);
+                if(x > m)
+                {
+                    m = x;
+                    p = i;
+                }
+            }
+
+            pivot[k] = p;
+            if(p != k)
+            {
+                for(size_t j = 0; j < n; ++j)
+                {
+                    std::swap(a[k * lda + j], a[p * lda + j]);
+                }
+                parity = -parity;
+            }
+
+            const T d = a[k * lda + k];
+            if(d == T())
+            {
+                parity = 0;
+                continue;
+            }
+
+            const T *u = a + k * lda;
+            for(size_t i = k + 1; i < n; ++i)
+            {
+                T      *r = a + i * lda;
+                const T l = (r[k] /= d);
+                for(size_t j = k + 1; j < n; ++j)
+                {
+                    r[j] -= l * u[j];
+                }
+            }
+        }
+        return parity;
+    }
+
+    /* Overwrites b (n x m, rows ldb apart) with the solution of a x = b
+     */
+    static void solve(size_t n, const T *lu, size_t lda, const size_t *pivot, T *b, size_t m, size_t ldb)
+    {
+        const instrument::Scope scope(instrument::Kernel::LU, 2 * (uint64_t)n * n * m);
+        for(size_t k = 0; k < n; ++k)
+        {
+            if(pivot[k] != k)
+            {
+                for(size_t j = 0; j < m; ++j)
+                {
+                    std::swap(b[k * ldb + j], b[pivot[k] * ldb + j]);
+                }
+            }
+        }
+
+        for(size_t i = 1; i < n; ++i)
+        {
+            T *x = b + i * ldb;
+            for(size_t k = 0; k < i; ++k)
+            {
+                const T  l = lu[i * lda + k];
+                const T *y = b + k * ldb;
+                for(size_t j = 0; j < m; ++j)
+                {
+                    x[j] -= l * y[j];
+                }
+            }
+        }
+
+        for(size_t i = n; i-- > 0;)
+        {
+            T *x = b + i * ldb;
+            for(size_t k = i + 1; k < n; ++k)
+            {
+                const T  u = lu[i * lda + k];
+                const T *y = b + k * ldb;
+                for(size_t j = 0; j < m; ++j)
+                {
+                    x[j] -= u * y[j];
+                }
+            }
+            const T d = lu[i * lda + i];
+            for(size_t j = 0; j < m; ++j)
+            {
+                x[j] /= d;
+            }
+        }
+    }
+
+    static T determinant(size_t n, const T *lu, size_t lda, int parity)
+    {
+        T det = T(parity);
+        for(size_t k = 0; k < n; ++k)
+        {
+            det *= lu[k * lda + k];
+        }
+        return det;
+    }
+};
+
+/* Fraction free (Bareiss) elimination, exact for integral types
+ * a is overwritten, every division in the loop is exact
+ */
+template <class T>
+constexpr T bareiss(size_t n, T *a, size_t lda)
+{
+    static_assert(std::is_integral<T>::value && std::is_signed<T>::value, "Bareiss elimination is meant for signed integers");
+
+    if(n == 0)
+        return T(1);
+
+    T sign = 1, prev = 1;
+    for(size_t k = 0; k + 1 < n; ++k)
+    {
+        if(a[k * lda + k] == 0)
+        {
+            size_t p = k + 1;
+            while(p < n && a[p * lda + k] == 0)
+                ++p;
+            if(p == n)
+                return T(0);
+            for(size_t j = 0; j < n; ++j)
+            {
+                const T t = a[k * lda + j];
+                a[k * lda + j] = a[p * lda + j];
+                a[p * lda + j] = t;
+            }
+            sign = -sign;
+        }
+
+        const T d = a[k * lda + k];
+        for(size_t i = k + 1; i < n; ++i)
+        {
+            for(size_t j = k + 1; j < n; ++j)
+            {
+                a[i * lda + j] = (a[i * lda + j] * d - a[i * lda + k] * a[k * lda + j]) / prev;
+            }
+        }
+        prev = d;
+    }
+    return sign * a[(n - 1) * lda + (n - 1)];
+}
+
+} /* namespace kernel */
+
+#endif /* LU_HH */
@@ -3,54 +3,199 @@
 #define MATRIX_HH
 
 #include <cmath>
-#include <cstring>
 #include <initializer_list>
+#include <type_traits>
+#include "gemm.hh"
+#include "instrument.hh"
+#include "lu.hh"
+#include "parallel.hh"
+#include "transpose.hh"
 #include "vector.hh"
 
+template <unsigned R, unsigned C, typename T>
+class Matrix;
+
+template <unsigned N, typename T>
+class LUDecomposition;
+
+/* Base of the lazily evaluated elementwise matrix expressions
+ * An expression E provides scalar, rows, columns, leaf and elem(i, j).
+ * Sums, differences and scalings are only computed once assigned to a
+ * Matrix, in a single pass over the elements. As for vectors, expressions
+ * reference their Matrix operands and should not outlive the statement.
+ */
+template <class E>
+struct MatrixExpression
+{
+	constexpr inline const E &self(void) const
+	{
+		return static_cast<const E &>(*this);
+	}
+
+	/* Evaluates into a Matrix, Matrix itself hides this with a reference to itself
+	 */
+	constexpr inline auto eval(void) const
+	{
+		return Matrix<E::rows, E::columns, typename E::scalar>(*this);
+	}
+
+	/* The read-only Matrix members, each evaluating the expression once, so
+	 * that (A + B).determinant() and the like still compile
+	 */
+	template <class A> constexpr auto multiply(const A &a) const  { return this->eval().multiply(a); }
+	template <class V> constexpr auto transform(const V &v) const { return this->eval().transform(v); }
+	template <class B> auto           solve(const B &b) const     { return this->eval().solve(b); }
+	template <class A> constexpr auto equals(const A &a) const    { return this->eval().equals(a); }
+	constexpr auto transpose(void) const   { return this->eval().transpose(); }
+	constexpr auto determinant(void) const { return this->eval().determinant(); }
+	constexpr auto reciprocal(void) const  { return this->eval().reciprocal(); }
+	constexpr auto adjugate(void) const    { return this->eval().adjugate(); }
+};
+
+/* Matrices are held by reference, intermediate nodes by value
+ */
+template <class E>
+using MatrixOperand = typename std::conditional<E::leaf, const E &, const E>::type;
+
+template <class L, class Rhs>
+struct MatrixSum : public MatrixExpression<MatrixSum<L, Rhs>>
+{
+	static_assert(L::rows == Rhs::rows && L::columns == Rhs::columns, "Matrix expressions need to have the same dimensions");
+
+	typedef typename L::scalar scalar;
+	static constexpr unsigned rows    = L::rows;
+	static constexpr unsigned columns = L::columns;
+	static constexpr bool     leaf    = false;
+
+	constexpr MatrixSum(const L &l, const Rhs &r) : l(l), r(r) {}
+
+	constexpr inline scalar elem(unsigned i, unsigned j) const
+	{
+		return this->l.elem(i, j) + this->r.elem(i, j);
+	}
+
+	MatrixOperand<L>   l;
+	MatrixOperand<Rhs> r;
+};
+
+template <class L, class Rhs>
+struct MatrixDifference : public MatrixExpression<MatrixDifference<L, Rhs>>
+{
+	static_assert(L::rows == Rhs::rows && L::columns == Rhs::columns, "Matrix expressions need to have the same dimensions");
+
+	typedef typename L::scalar scalar;
+	static constexpr unsigned rows    = L::rows;
+	static constexpr unsigned columns = L::columns;
+	static constexpr bool     leaf    = false;
+
+	constexpr MatrixDifference(const L &l, const Rhs &r) : l(l), r(r) {}
+
+	constexpr inline scalar elem(unsigned i, unsigned j) const
+	{
+		return this->l.elem(i, j) - this->r.elem(i, j);
+	}
+
+	MatrixOperand<L>   l;
+	MatrixOperand<Rhs> r;
+};
+
+template <class E>
+struct MatrixScale : public MatrixExpression<MatrixScale<E>>
+{
+	typedef typename E::scalar scalar;
+	static constexpr unsigned rows    = E::rows;
+	static constexpr unsigned columns = E::columns;
+	static constexpr bool     leaf    = false;
+
+	constexpr MatrixScale(const E &e, const scalar &c) : e(e), c(c) {}
+
+	constexpr inline scalar elem(unsigned i, unsigned j) const
+	{
+		return this->e.elem(i, j) * this->c;
+	}
+
+	MatrixOperand<E> e;
+	scalar c;
+};
+
+template <class E>
+struct MatrixQuotient : public MatrixExpression<MatrixQuotient<E>>
+{
+	typedef typename E::scalar scalar;
+	static constexpr unsigned rows    = E::rows;
+	static constexpr unsigned columns = E::columns;
+	static constexpr bool     leaf    = false;
+
+	constexpr MatrixQuotient(const E &e, const scalar &c) : e(e), c(c) {}
+
+	constexpr inline scalar elem(unsigned i, unsigned j) const
+	{
+		return this->e.elem(i, j) / this->c;
+	}
+
+	MatrixOperand<E> e;
+	scalar c;
+};
+
 /* Rows, Columns, Scalar type
  * Uses row-column notation
  */
 template <unsigned R, unsigned C, typename T>
-class Matrix
+class Matrix : public MatrixExpression<Matrix<R, C, T>>
 {
 public:
-	Matrix(void)
+	typedef T scalar;
+	static constexpr unsigned rows    = R;
+	static constexpr unsigned columns = C;
+	static constexpr bool     leaf    = true;
+
+	constexpr Matrix(void)
+		: _elem{}
 	{
-		std::memset(this->_elem, (T)0, R * C * sizeof(T));
 	}
 
-	Matrix(const T matrix[R][C])
+	constexpr Matrix(const T matrix[R][C])
+		: _elem{}
 	{
-		std::memcpy(this->_elem, matrix, R * C * sizeof(T));
+		for(unsigned i = 0; i < R; ++i)
+		{
+			for(unsigned j = 0; j < C; ++j)
+			{
+				this->_elem[i][j] = matrix[i][j];
+			}
+		}
 	}
 
-	Matrix(const Vector<R, T> &v)
+	constexpr Matrix(const Vector<R, T> &v)
+		: _elem{}
 	{
 		static_assert(C == 1, "Vector cannot be casted to a matrix of width larger than 1");
 		
 		for(unsigned i = 0; i < R; ++i)
 		{
-			(*this)[i][0] = v.elem(i);
+			(*this)[i][0] = v[i];
 		}
 	}
 
-	Matrix(const std::initializer_list<Vector<R, T>> &aggregate)
+	/* One vector per row, missing rows are zero
+	 */
+	constexpr Matrix(const std::initializer_list<Vector<C, T>> &aggregate)
+		: _elem{}
 	{
 		auto iter = aggregate.begin();
-		for(unsigned i = 0; i < R; ++i)
+		for(unsigned i = 0; i < R && iter != aggregate.end(); ++i, ++iter)
 		{
 			for(unsigned j = 0; j < C; ++j)
 			{
-				(*this)[i][j] = (*iter).elem(j);
+				this->_elem[i][j] = (*iter)[j];
 			}
-			if(++iter == aggregate.end())
-				return;
 		}
 	}
 	
 	/* Assumes there are atleast C elements in the array
 	 */
-	Matrix(const Vector<R, T> vectors[C])
+	constexpr Matrix(const Vector<R, T> vectors[C])
+		: _elem{}
 	{
 		for(unsigned i = 0; i < R; ++i)
 		{
@@ -61,7 +206,38 @@ public:
 		}
 	}
 
-	Matrix add(const Matrix &a)
+	template <class E>
+	constexpr Matrix(const MatrixExpression<E> &expression)
+		: _elem{}
+	{
+		(*this) = expression;
+	}
+
+	/* Elements are only read at the position being written, so the
+	 * expression may reference this matrix
+	 */
+	template <class E>
+	constexpr Matrix &operator =(const MatrixExpression<E> &expression)
+	{
+		static_assert(E::rows == R && E::columns == C, "Matrix expressions need to have the same dimensions");
+
+		const E &e = expression.self();
+		for(unsigned i = 0; i < R; ++i)
+		{
+			for(unsigned j = 0; j < C; ++j)
+			{
+				this->_elem[i][j] = e.elem(i, j);
+			}
+		}
+		return (*this);
+	}
+
+	constexpr inline const Matrix &eval(void) const
+	{
+		return (*this);
+	}
+
+	constexpr Matrix &add(const Matrix &a)
 	{
 		for(unsigned i = 0; i < R; ++i)
 		{
@@ -73,12 +249,19 @@ public:
 		return (*this);
 	}
 
-	Matrix subtract(const Matrix &a)
+	constexpr Matrix &subtract(const Matrix &a)
 	{
-		return this->add(-a);
+		for(unsigned i = 0; i < R; ++i)
+		{
+			for(unsigned j = 0; j < C; ++j)
+			{
+				(*this)[i][j] -= a.elem(i, j);
+			}
+		}
+		return (*this);
 	}
 
-	Matrix multiply(const T &c)
+	constexpr Matrix &multiply(const T &c)
 	{
 		for(unsigned i = 0; i < R; ++i)
 		{
@@ -90,7 +273,7 @@ public:
 		return (*this);
 	}
 
-	Matrix divide(const T &c)
+	constexpr Matrix &divide(const T &c)
 	{
 		for(unsigned i = 0; i < R; ++i)
 		{
@@ -103,11 +286,25 @@ public:
 	}
 	
 	template <unsigned N, unsigned M>
-	Matrix<R, M, T> multiply(const Matrix<N, M, T> &a) const
+	constexpr Matrix<R, M, T> multiply(const Matrix<N, M, T> &a) const
 	{
 		static_assert(C == N, "Multiplication between RxC and NxM matrices is only defined for C == N");
 
 		Matrix<R, M, T> b{};
+		if(!simd::constant())
+		{
+			instrument::call(instrument::Kernel::MatrixMultiply, 2 * (uint64_t)R * M * C);
+			if constexpr(R == C && C == M && kernel::Small<R, T>::enabled)
+			{
+				kernel::Small<R, T>::multiply(this->data(), a.data(), b.data());
+				return b;
+			}
+			if constexpr(kernel::Gemm<T>::blocked(R, M, C))
+			{
+				kernel::Gemm<T>::multiply(R, M, C, this->data(), C, a.data(), M, b.data(), M);
+				return b;
+			}
+		}
 		for(unsigned i = 0; i < R; ++i)
 		{
 			for(unsigned j = 0; j < M; ++j)
@@ -121,64 +318,232 @@ public:
 		return b;
 	}
 
-	Matrix<C, R, T> transpose(void) const
+	/* Large products are split into tiles over the threads of policy,
+	 * anything below the blocking threshold is computed on the calling thread
+	 */
+	template <unsigned N, unsigned M>
+	Matrix<R, M, T> multiply(const Matrix<N, M, T> &a, const parallel::Policy &policy) const
+	{
+		static_assert(C == N, "Multiplication between RxC and NxM matrices is only defined for C == N");
+
+		if constexpr(kernel::Gemm<T>::blocked(R, M, C))
+		{
+			Matrix<R, M, T> b{};
+			instrument::call(instrument::Kernel::MatrixMultiply, 2 * (uint64_t)R * M * C);
+			kernel::Gemm<T>::multiply(R, M, C, this->data(), C, 1, a.data(), M, 1, b.data(), M, policy);
+			return b;
+		}
+		return this->multiply(a);
+	}
+
+	/* Matrix-vector product without going through a C x 1 matrix
+	 */
+	constexpr Vector<R, T> transform(const Vector<C, T> &v) const
+	{
+		if constexpr(R == C && kernel::Small<R, T>::enabled)
+		{
+			if(!simd::constant())
+			{
+				alignas(64) T out[4] = {};
+				kernel::Small<R, T>::transform(kernel::Small<R, T>::columns(this->data()), &v[0], out);
+				return Vector<R, T>(out);
+			}
+		}
+		Vector<R, T> u{};
+		for(unsigned i = 0; i < R; ++i)
+		{
+			T p = T();
+			for(unsigned j = 0; j < C; ++j)
+			{
+				p += this->elem(i, j) * v[j];
+			}
+			u[i] = p;
+		}
+		return u;
+	}
+
+	/* out[i] = this * in[i] for i < count, out may be in
+	 */
+	void transform(const Vector<C, T> *in, Vector<R, T> *out, size_t count) const
+	{
+		if constexpr(R == C && kernel::Small<R, T>::enabled)
+		{
+			const auto k = kernel::Small<R, T>::columns(this->data());
+			for(size_t i = 0; i < count; ++i)
+			{
+				alignas(64) T u[4];
+				kernel::Small<R, T>::transform(k, &in[i][0], u);
+				out[i] = Vector<R, T>(u);
+			}
+			return;
+		}
+		for(size_t i = 0; i < count; ++i)
+		{
+			out[i] = this->transform(in[i]);
+		}
+	}
+
+	constexpr Matrix<C, R, T> transpose(void) const
 	{
 		Matrix<C, R, T> a{};
+		if(!simd::constant())
+		{
+			kernel::transpose(R, C, this->data(), C, a.data(), R);
+			return a;
+		}
 		for(unsigned i = 0; i < R; ++i)
 		{
 			for(unsigned j = 0; j < C; ++j)
 			{
-				a[j][i] = this->elem(i, j);
+				a[j][i] = this->_elem[i][j];
 			}
 		}
 		return a;
 	}
 
-	T determinant(void) const
+	/* Square matrices only, without going through a second matrix
+	 */
+	constexpr Matrix &transpose_in_place(void)
+	{
+		static_assert(R == C, "In place transpose is only defined for square matrices");
+
+		if(!simd::constant())
+		{
+			kernel::transpose(R, this->data(), C);
+			return (*this);
+		}
+		for(unsigned i = 0; i < R; ++i)
+		{
+			for(unsigned j = i + 1; j < C; ++j)
+			{
+				const T t = this->_elem[i][j];
+				this->_elem[i][j] = this->_elem[j][i];
+				this->_elem[j][i] = t;
+			}
+		}
+		return (*this);
+	}
+
+	static constexpr Matrix identity(void)
+	{
+		static_assert(C == R, "Identity is only defined for square matrices");
+
+		Matrix a{};
+		for(unsigned i = 0; i < R; ++i)
+		{
+			a[i][i] = T(1);
+		}
+		return a;
+	}
+
+	/* Closed form up to 4x4, fraction free elimination for larger integral
+	 * matrices and LU decomposition otherwise
+	 */
+	constexpr T determinant(void) const
 	{
 		static_assert(C == R, "Determinant is only defined for square matrices");
 
 		return Matrix::determinant(*this);
 	}
 
-	
-	Matrix reciprocal(void) const
+	/* Inverse matrix, singular matrices yield infinities or NaN
+	 */
+	constexpr Matrix reciprocal(void) const
 	{
 		static_assert(C == R, "Reciprocal is only defined for square matrices");
 
-		return (*this); // Not implemented
+		if constexpr(R <= 4 || std::is_integral<T>::value)
+			return this->adjugate() / this->determinant();
+		else
+			return LUDecomposition<R, T>(*this).reciprocal();
 	}
 
-	Matrix adjugate(void) const
+	/* Transposed cofactor matrix, also defined for singular matrices
+	 */
+	constexpr Matrix adjugate(void) const
 	{
 		static_assert(C == R, "Adjugate is only defined for square matrices");
 
-		return (*this); // Not implemented
+		return Matrix::adjugate(*this);
+	}
+
+	/* Solves this * x = b, factor once with LUDecomposition when solving
+	 * repeatedly against the same matrix
+	 */
+	Vector<R, T> solve(const Vector<R, T> &b) const
+	{
+		static_assert(C == R, "Solve is only defined for square matrices");
+
+		return LUDecomposition<R, T>(*this).solve(b);
+	}
+
+	template <unsigned M>
+	Matrix<R, M, T> solve(const Matrix<R, M, T> &b) const
+	{
+		static_assert(C == R, "Solve is only defined for square matrices");
+
+		return LUDecomposition<R, T>(*this).solve(b);
 	}
 
-	bool equals(const Matrix &a) const
+	/* Elementwise ==, so -0 equals 0 and NaN equals nothing
+	 */
+	constexpr bool equals(const Matrix &a) const
 	{
-		return !std::memcmp(this->_elem, a._elem, R * C * sizeof(T));
+		for(unsigned i = 0; i < R; ++i)
+		{
+			for(unsigned j = 0; j < C; ++j)
+			{
+				if(!(this->_elem[i][j] == a._elem[i][j]))
+					return false;
+			}
+		}
+		return true;
 	}
 
 	/* No bounds checking is done on the element accessor functions
 	 */
-	inline T elem(unsigned i, unsigned j) const
+	constexpr inline T elem(unsigned i, unsigned j) const
 	{
 		return this->_elem[i][j];
 	}
 
-	inline T *operator [](unsigned i)
+	constexpr inline T *operator [](unsigned i)
+	{
+		return this->_elem[i];
+	}
+
+	constexpr inline const T *operator [](unsigned i) const
 	{
 		return this->_elem[i];
 	}
 
-	/* Casting to different type is done implicitly
+	/* Row-major storage, row i starts at data() + i * C
+	 */
+	constexpr inline const T *data(void) const
+	{
+		return &this->_elem[0][0];
+	}
+
+	constexpr inline T *data(void)
+	{
+		return &this->_elem[0][0];
+	}
+
+	/* Casting to different type is done implicitly, a row at a time
+	 * through convert() outside constant expressions
 	 */
 	template <typename S>
-	operator Matrix<R, C, S>(void) const
+	constexpr operator Matrix<R, C, S>(void) const
 	{
 		Matrix<R, C, S> a{};
+		if(!simd::constant())
+		{
+			for(unsigned i = 0; i < R; ++i)
+			{
+				convert(&this->_elem[i][0], &a[i][0], C);
+			}
+			return a;
+		}
 		for(unsigned i = 0; i < R; ++i)
 		{
 			for(unsigned j = 0; j < C; ++j)
@@ -189,124 +554,394 @@ public:
 		return a;
 	}
 
-	template<unsigned N>
-	operator Vector<N, T>(void) const
+	/* Copies the single row or column, the elements past it being zero
+	 */
+	template <int N>
+	constexpr operator Vector<N, T>(void) const
 	{
 		static_assert(R == 1 || C == 1, "Matrix width or height needs to be equal to 1 to enable casting to vector");
 
-		if constexpr(R == 1)
-			return (Vector<N, T>)(this->_elem[0]);
-		else
-			return (Vector<N, T>)(this->transpose()._elem[0]);
+		Vector<N, T> v{};
+		for(unsigned i = 0; i < (unsigned)N && i < R * C; ++i)
+		{
+			v[i] = R == 1 ? this->_elem[0][i] : this->_elem[i][0];
+		}
+		return v;
 	}
 
-	inline Matrix operator +(void) const
+	constexpr inline Matrix operator +(void) const
 	{
 		return (*this);
 	}
 
-	inline Matrix operator -(void) const
+	constexpr inline Matrix operator ~(void) const
 	{
-		return (*this) * (-1);
+		return this->reciprocal();
 	}
 
-	inline Matrix operator +(const Matrix &a) const
+	constexpr inline bool operator ==(const Matrix &a) const
 	{
-		return ((Matrix)(*this)).add(a);
+		return this->equals(a);
 	}
 
-	inline Matrix operator -(const Matrix &a) const
+	constexpr inline bool operator !=(const Matrix &a) const
 	{
-		return ((Matrix)(*this)).subtract(a);
+		return !this->equals(a);
 	}
 
-	inline Matrix operator *(const T &c) const
+	template <class E>
+	constexpr Matrix &operator +=(const MatrixExpression<E> &expression)
 	{
-		return ((Matrix)(*this)).multiply(c);
+		static_assert(E::rows == R && E::columns == C, "Matrix expressions need to have the same dimensions");
+
+		const E &e = expression.self();
+		for(unsigned i = 0; i < R; ++i)
+		{
+			for(unsigned j = 0; j < C; ++j)
+			{
+				this->_elem[i][j] += e.elem(i, j);
+			}
+		}
+		return (*this);
 	}
 
-	inline Matrix operator /(const T &c) const
+	template <class E>
+	constexpr Matrix &operator -=(const MatrixExpression<E> &expression)
 	{
-		return ((Matrix)(*this)).divide(c);
+		static_assert(E::rows == R && E::columns == C, "Matrix expressions need to have the same dimensions");
+
+		const E &e = expression.self();
+		for(unsigned i = 0; i < R; ++i)
+		{
+			for(unsigned j = 0; j < C; ++j)
+			{
+				this->_elem[i][j] -= e.elem(i, j);
+			}
+		}
+		return (*this);
 	}
 
-	template <unsigned N, unsigned M>
-	Matrix<R, M, T> operator *(const Matrix<N, M, T> &a) const
+	constexpr inline Matrix &operator *=(const T &c)
 	{
-		return ((Matrix)(*this)).multiply(a);
+		return this->multiply(c);
 	}
 
 	template <unsigned N>
-	Matrix<N, 1, T> operator *(const Vector<N, T> &v)
+	constexpr inline Matrix &operator *=(const Matrix<N, N, T> &a)
 	{
-		return ((Matrix)(*this)).multiply((Matrix<N, 1, T>)v);
+		return (*this) = this->multiply(a);
 	}
 
-	template <unsigned N>
-	inline Matrix operator ~(void) const
+	constexpr inline Matrix &operator /=(T const &c)
 	{
-		return this->reciprocal();
+		return this->divide(c);
 	}
+private:
+	T _elem[R][C];
 
-	inline bool operator ==(const Matrix &a) const
+	static constexpr T determinant(const Matrix<2, 2, T> &a)
 	{
-		return this->equals(a);
+		return (a.elem(0, 0)*a.elem(1, 1)) - (a.elem(1, 0)*a.elem(0, 1));
 	}
 
-	inline bool operator !=(const Matrix &a) const
+	static constexpr T determinant(const Matrix<3, 3, T> &a)
 	{
-		return !this->equals(a);
+		T det = 0;
+		det += a.elem(0,0) * ((a.elem(1,1)*a.elem(2,2)) - (a.elem(1,2)*a.elem(2,1)));
+		det -= a.elem(0,1) * ((a.elem(1,0)*a.elem(2,2)) - (a.elem(1,2)*a.elem(2,0)));
+		det += a.elem(0,2) * ((a.elem(1,0)*a.elem(2,1)) - (a.elem(1,1)*a.elem(2,0)));
+		return det;
 	}
 
-	inline Matrix operator +=(const Matrix &a) 
+	static constexpr T determinant(const Matrix<4, 4, T> &a)
 	{
-		return this->add(a);
+		const T s0 = a.elem(0,0)*a.elem(1,1) - a.elem(1,0)*a.elem(0,1);
+		const T s1 = a.elem(0,0)*a.elem(1,2) - a.elem(1,0)*a.elem(0,2);
+		const T s2 = a.elem(0,0)*a.elem(1,3) - a.elem(1,0)*a.elem(0,3);
+		const T s3 = a.elem(0,1)*a.elem(1,2) - a.elem(1,1)*a.elem(0,2);
+		const T s4 = a.elem(0,1)*a.elem(1,3) - a.elem(1,1)*a.elem(0,3);
+		const T s5 = a.elem(0,2)*a.elem(1,3) - a.elem(1,2)*a.elem(0,3);
+		const T c5 = a.elem(2,2)*a.elem(3,3) - a.elem(3,2)*a.elem(2,3);
+		const T c4 = a.elem(2,1)*a.elem(3,3) - a.elem(3,1)*a.elem(2,3);
+		const T c3 = a.elem(2,1)*a.elem(3,2) - a.elem(3,1)*a.elem(2,2);
+		const T c2 = a.elem(2,0)*a.elem(3,3) - a.elem(3,0)*a.elem(2,3);
+		const T c1 = a.elem(2,0)*a.elem(3,2) - a.elem(3,0)*a.elem(2,2);
+		const T c0 = a.elem(2,0)*a.elem(3,1) - a.elem(3,0)*a.elem(2,1);
+		return s0*c5 - s1*c4 + s2*c3 + s3*c2 - s4*c1 + s5*c0;
 	}
 
-	inline Matrix operator -=(const Matrix &a) 
+	template <unsigned N>
+	static constexpr T determinant(const Matrix<N, N, T> &a)
 	{
-		return this->subtract(a);
+		if constexpr(N == 1)
+		{
+			return a.elem(0, 0);
+		}
+		else if constexpr(std::is_integral<T>::value)
+		{
+			/* Flat copy rather than a Matrix<N, N, long long>, constant
+			 * expressions cannot index across the rows of a 2D array
+			 */
+			long long b[N * N] = {};
+			for(unsigned i = 0; i < N; ++i)
+			{
+				for(unsigned j = 0; j < N; ++j)
+				{
+					b[i * N + j] = (long long)a.elem(i, j);
+				}
+			}
+			return (T)kernel::bareiss<long long>(N, b, N);
+		}
+		else
+		{
+			return LUDecomposition<N, T>(a).determinant();
+		}
 	}
 
-	inline Matrix operator *=(const T &c)
+	static constexpr Matrix<2, 2, T> adjugate(const Matrix<2, 2, T> &a)
 	{
-		return this->multiply(c);
+		Matrix<2, 2, T> b{};
+		b[0][0] =  a.elem(1,1);
+		b[0][1] = -a.elem(0,1);
+		b[1][0] = -a.elem(1,0);
+		b[1][1] =  a.elem(0,0);
+		return b;
+	}
+
+	static constexpr Matrix<3, 3, T> adjugate(const Matrix<3, 3, T> &a)
+	{
+		Matrix<3, 3, T> b{};
+		b[0][0] = a.elem(1,1)*a.elem(2,2) - a.elem(1,2)*a.elem(2,1);
+		b[0][1] = a.elem(0,2)*a.elem(2,1) - a.elem(0,1)*a.elem(2,2);
+		b[0][2] = a.elem(0,1)*a.elem(1,2) - a.elem(0,2)*a.elem(1,1);
+		b[1][0] = a.elem(1,2)*a.elem(2,0) - a.elem(1,0)*a.elem(2,2);
+		b[1][1] = a.elem(0,0)*a.elem(2,2) - a.elem(0,2)*a.elem(2,0);
+		b[1][2] = a.elem(0,2)*a.elem(1,0) - a.elem(0,0)*a.elem(1,2);
+		b[2][0] = a.elem(1,0)*a.elem(2,1) - a.elem(1,1)*a.elem(2,0);
+		b[2][1] = a.elem(0,1)*a.elem(2,0) - a.elem(0,0)*a.elem(2,1);
+		b[2][2] = a.elem(0,0)*a.elem(1,1) - a.elem(0,1)*a.elem(1,0);
+		return b;
+	}
+
+	/* Shares the 2x2 sub-determinants of the top and bottom row pairs
+	 */
+	static constexpr Matrix<4, 4, T> adjugate(const Matrix<4, 4, T> &a)
+	{
+		const T s0 = a.elem(0,0)*a.elem(1,1) - a.elem(1,0)*a.elem(0,1);
+		const T s1 = a.elem(0,0)*a.elem(1,2) - a.elem(1,0)*a.elem(0,2);
+		const T s2 = a.elem(0,0)*a.elem(1,3) - a.elem(1,0)*a.elem(0,3);
+		const T s3 = a.elem(0,1)*a.elem(1,2) - a.elem(1,1)*a.elem(0,2);
+		const T s4 = a.elem(0,1)*a.elem(1,3) - a.elem(1,1)*a.elem(0,3);
+		const T s5 = a.elem(0,2)*a.elem(1,3) - a.elem(1,2)*a.elem(0,3);
+		const T c5 = a.elem(2,2)*a.elem(3,3) - a.elem(3,2)*a.elem(2,3);
+		const T c4 = a.elem(2,1)*a.elem(3,3) - a.elem(3,1)*a.elem(2,3);
+		const T c3 = a.elem(2,1)*a.elem(3,2) - a.elem(3,1)*a.elem(2,2);
+		const T c2 = a.elem(2,0)*a.elem(3,3) - a.elem(3,0)*a.elem(2,3);
+		const T c1 = a.elem(2,0)*a.elem(3,2) - a.elem(3,0)*a.elem(2,2);
+		const T c0 = a.elem(2,0)*a.elem(3,1) - a.elem(3,0)*a.elem(2,1);
+
+		Matrix<4, 4, T> b{};
+		b[0][0] =  a.elem(1,1)*c5 - a.elem(1,2)*c4 + a.elem(1,3)*c3;
+		b[0][1] = -a.elem(0,1)*c5 + a.elem(0,2)*c4 - a.elem(0,3)*c3;
+		b[0][2] =  a.elem(3,1)*s5 - a.elem(3,2)*s4 + a.elem(3,3)*s3;
+		b[0][3] = -a.elem(2,1)*s5 + a.elem(2,2)*s4 - a.elem(2,3)*s3;
+		b[1][0] = -a.elem(1,0)*c5 + a.elem(1,2)*c2 - a.elem(1,3)*c1;
+		b[1][1] =  a.elem(0,0)*c5 - a.elem(0,2)*c2 + a.elem(0,3)*c1;
+		b[1][2] = -a.elem(3,0)*s5 + a.elem(3,2)*s2 - a.elem(3,3)*s1;
+		b[1][3] =  a.elem(2,0)*s5 - a.elem(2,2)*s2 + a.elem(2,3)*s1;
+		b[2][0] =  a.elem(1,0)*c4 - a.elem(1,1)*c2 + a.elem(1,3)*c0;
+		b[2][1] = -a.elem(0,0)*c4 + a.elem(0,1)*c2 - a.elem(0,3)*c0;
+		b[2][2] =  a.elem(3,0)*s4 - a.elem(3,1)*s2 + a.elem(3,3)*s0;
+		b[2][3] = -a.elem(2,0)*s4 + a.elem(2,1)*s2 - a.elem(2,3)*s0;
+		b[3][0] = -a.elem(1,0)*c3 + a.elem(1,1)*c1 - a.elem(1,2)*c0;
+		b[3][1] =  a.elem(0,0)*c3 - a.elem(0,1)*c1 + a.elem(0,2)*c0;
+		b[3][2] = -a.elem(3,0)*s3 + a.elem(3,1)*s1 - a.elem(3,2)*s0;
+		b[3][3] =  a.elem(2,0)*s3 - a.elem(2,1)*s1 + a.elem(2,2)*s0;
+		return b;
 	}
 
+	/* det(a) * a^-1 when a is invertible, otherwise every cofactor is
+	 * computed from its minor
+	 */
 	template <unsigned N>
-	inline Matrix<N, N, T> operator *=(const Matrix<N, N, T> &a)
+	static constexpr Matrix<N, N, T> adjugate(const Matrix<N, N, T> &a)
 	{
-		return (*this) = this->multiply(a);
+		Matrix<N, N, T> b{};
+		if constexpr(N == 1)
+		{
+			b[0][0] = T(1);
+			return b;
+		}
+		else
+		{
+			if constexpr(!std::is_integral<T>::value)
+			{
+				const LUDecomposition<N, T> lu(a);
+				if(!lu.singular())
+					return lu.reciprocal() * lu.determinant();
+			}
+			for(unsigned i = 0; i < N; ++i)
+			{
+				for(unsigned j = 0; j < N; ++j)
+				{
+					Matrix<N - 1, N - 1, T> minor{};
+					for(unsigned k = 0, r = 0; k < N; ++k)
+					{
+						if(k == j)
+							continue;
+						for(unsigned l = 0, c = 0; l < N; ++l)
+						{
+							if(l != i)
+								minor[r][c++] = a.elem(k, l);
+						}
+						++r;
+					}
+					const T det = minor.determinant();
+					b[i][j] = ((i + j) % 2 == 0) ? det : -det;
+				}
+			}
+			return b;
+		}
 	}
+};
+
+/* Reusable factorization P A = L U of a square matrix
+ * The O(N^3) factorization is done once by the constructor, every solve
+ * against it is then O(N^2) per right hand side.
+ */
+template <unsigned N, typename T>
+class LUDecomposition
+{
+public:
+	static_assert(!std::is_integral<T>::value, "LU decomposition requires a field type, use determinant() for integral matrices");
 
-	inline Matrix operator /=(T const &c)
+	LUDecomposition(const Matrix<N, N, T> &a)
+		: _lu(a)
 	{
-		return this->divide(c);
+		this->_parity = kernel::LU<T>::factor(N, this->_lu.data(), N, this->_pivot);
 	}
-private:
-	T _elem[R][C];
 
-	static T determinant(const Matrix<2, 2, T> &a)
+	bool singular(void) const
 	{
-		return (a.elem(0, 0)*a.elem(1, 1)) - (a.elem(1, 0)*a.elem(0, 1));
+		return this->_parity == 0;
 	}
 
-	static T determinant(const Matrix<3, 3, T> &a)
+	T determinant(void) const
 	{
-		T det = 0;
-		det += a.elem(0,0) * ((a.elem(1,1)*a.elem(2,2)) - (a.elem(1,2)*a.elem(2,1)));
-		det -= a.elem(0,1) * ((a.elem(1,0)*a.elem(2,2)) - (a.elem(1,2)*a.elem(2,0)));
-		det += a.elem(0,2) * ((a.elem(1,0)*a.elem(2,1)) - (a.elem(1,1)*a.elem(2,0)));
-		return det;
+		return kernel::LU<T>::determinant(N, this->_lu.data(), N, this->_parity);
 	}
 
-	template <unsigned N>
-	static T determinant(const Matrix<N, N, T> &a)
+	Vector<N, T> solve(const Vector<N, T> &b) const
 	{
-		return (T)0; // Not implemented 
+		Vector<N, T> x = b;
+		kernel::LU<T>::solve(N, this->_lu.data(), N, this->_pivot, &x[0], 1, 1);
+		return x;
 	}
+
+	template <unsigned M>
+	Matrix<N, M, T> solve(const Matrix<N, M, T> &b) const
+	{
+		Matrix<N, M, T> x = b;
+		kernel::LU<T>::solve(N, this->_lu.data(), N, this->_pivot, x.data(), M, M);
+		return x;
+	}
+
+	Matrix<N, N, T> reciprocal(void) const
+	{
+		return this->solve(Matrix<N, N, T>::identity());
+	}
+
+	/* L below the diagonal (unit diagonal implied) and U on and above it
+	 */
+	inline const Matrix<N, N, T> &factors(void) const
+	{
+		return this->_lu;
+	}
+
+	/* Row k was swapped with row pivot()[k] at step k
+	 */
+	inline const size_t *pivot(void) const
+	{
+		return this->_pivot;
+	}
+private:
+	Matrix<N, N, T> _lu;
+	size_t _pivot[N];
+	int _parity;
 };
 
+template <class E>
+constexpr inline MatrixScale<E> operator -(const MatrixExpression<E> &e)
+{
+	return {e.self(), typename E::scalar(-1)};
+}
+
+template <class L, class R>
+constexpr inline MatrixSum<L, R> operator +(const MatrixExpression<L> &l, const MatrixExpression<R> &r)
+{
+	return {l.self(), r.self()};
+}
+
+template <class L, class R>
+constexpr inline MatrixDifference<L, R> operator -(const MatrixExpression<L> &l, const MatrixExpression<R> &r)
+{
+	return {l.self(), r.self()};
+}
+
+template <class E>
+constexpr inline MatrixScale<E> operator *(const MatrixExpression<E> &e, const typename E::scalar &c)
+{
+	return {e.self(), c};
+}
+
+template <class E>
+constexpr inline MatrixQuotient<E> operator /(const MatrixExpression<E> &e, const typename E::scalar &c)
+{
+	return {e.self(), c};
+}
+
+/* Products are not elementwise, their operands are evaluated first
+ * (which is free when they already are matrices) and the result is a Matrix
+ */
+template <class L, class R>
+constexpr inline auto operator *(const MatrixExpression<L> &l, const MatrixExpression<R> &r)
+{
+	return l.self().eval().multiply(r.self().eval());
+}
+
+template <class L, class R>
+constexpr inline auto operator *(const MatrixExpression<L> &l, const VectorExpression<R> &r)
+{
+	return l.self().eval().transform(r.self().eval());
+}
+
+template <class L, class R>
+constexpr inline bool operator ==(const MatrixExpression<L> &l, const MatrixExpression<R> &r)
+{
+	return l.self().eval() == r.self().eval();
+}
+
+template <class L, class R>
+constexpr inline bool operator !=(const MatrixExpression<L> &l, const MatrixExpression<R> &r)
+{
+	return l.self().eval() != r.self().eval();
+}
+
+/* c[i] = a[i] * b[i] for i < count, independent products spread over the
+ * threads of policy, c may be a or b
+ */
+template <unsigned R, unsigned C, unsigned M, typename T>
+void multiply(const Matrix<R, C, T> *a, const Matrix<C, M, T> *b, Matrix<R, M, T> *c, size_t count,
+              const parallel::Policy &policy = parallel::seq)
+{
+	policy.range(count, 1024, [a, b, c](size_t begin, size_t end) {
+		for(size_t i = begin; i < end; ++i)
+		{
+			c[i] = a[i].multiply(b[i]);
+		}
+	});
+}
+
 typedef Matrix<2, 2, unsigned> Matrix2u;
 typedef Matrix<3, 3, unsigned> Matrix3u;
 typedef Matrix<4, 4, unsigned> Matrix4u;
@@ -319,5 +954,11 @@ typedef Matrix<4, 4, float>    Matrix4f;
 typedef Matrix<2, 2, double>   Matrix2lf;
 typedef Matrix<3, 3, double>   Matrix3lf;
 typedef Matrix<4, 4, double>   Matrix4lf;
+typedef Matrix<2, 2, Half>     Matrix2h;
+typedef Matrix<3, 3, Half>     Matrix3h;
+typedef Matrix<4, 4, Half>     Matrix4h;
+typedef Matrix<2, 2, BFloat16> Matrix2bf;
+typedef Matrix<3, 3, BFloat16> Matrix3bf;
+typedef Matrix<4, 4, BFloat16> Matrix4bf;
 
 #endif /* MATRIX_HH */
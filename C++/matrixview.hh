@@ -0,0 +1,536 @@
+/* matrixview.hh */
+#ifndef MATRIXVIEW_HH
+#define MATRIXVIEW_HH
+
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+#include "dynmatrix.hh"
+#include "gemm.hh"
+#include "lu.hh"
+#include "matrix.hh"
+#include "parallel.hh"
+#include "simd.hh"
+#include "transpose.hh"
+#include "vector.hh"
+
+/* Non-owning strided views of vectors and matrices
+ * Element i of a VectorView is data()[i * stride()], element (i, j) of a
+ * MatrixView is data()[i * row_stride() + j * column_stride()], so rows,
+ * columns, diagonals, sub-blocks and transposes of a Matrix, a DynMatrix,
+ * a Vector or any external buffer are all views of the same storage and
+ * cost nothing to make. A view of const T is read only, a view of T
+ * converts to it. Views are shallow: a const view still writes through to
+ * its elements, and it has to be outlived by the storage it points into.
+ * The kernels take views directly, the products and the LU factorization
+ * running the blocked kernels of Matrix and DynMatrix over the strides.
+ * Mismatched dimensions throw std::invalid_argument.
+ */
+template <typename T>
+class VectorView
+{
+public:
+	typedef typename std::remove_const<T>::type value_type;
+
+	VectorView(T *data = nullptr, size_t size = 0, size_t stride = 1)
+	{
+		this->_data   = data;
+		this->_size   = size;
+		this->_stride = stride;
+	}
+
+	template <int N>
+	VectorView(Vector<N, value_type> &v)
+		: VectorView(&v[0], N, 1)
+	{
+	}
+
+	template <int N, typename U = T, typename = typename std::enable_if<std::is_const<U>::value>::type>
+	VectorView(const Vector<N, value_type> &v)
+		: VectorView(&v[0], N, 1)
+	{
+	}
+
+	template <typename U, typename = typename std::enable_if<std::is_same<const U, T>::value && !std::is_same<U, T>::value>::type>
+	VectorView(const VectorView<U> &v)
+		: VectorView(v.data(), v.size(), v.stride())
+	{
+	}
+
+	inline T *data(void) const
+	{
+		return this->_data;
+	}
+
+	inline size_t size(void) const
+	{
+		return this->_size;
+	}
+
+	inline size_t stride(void) const
+	{
+		return this->_stride;
+	}
+
+	/* No bounds checking is done on the element accessor functions
+	 */
+	inline T &operator [](size_t i) const
+	{
+		return this->_data[i * this->_stride];
+	}
+
+	inline T &operator ()(size_t i) const
+	{
+		return this->_data[i * this->_stride];
+	}
+
+	/* Elements [begin, begin + size)
+	 */
+	inline VectorView segment(size_t begin, size_t size) const
+	{
+		return VectorView(this->_data + begin * this->_stride, size, this->_stride);
+	}
+
+	template <int N>
+	explicit operator Vector<N, value_type>(void) const
+	{
+		if(this->size() != (size_t)N)
+			throw std::invalid_argument("View and vector dimensions do not match");
+		Vector<N, value_type> v{};
+		for(int i = 0; i < N; ++i)
+		{
+			v[i] = (*this)[(size_t)i];
+		}
+		return v;
+	}
+
+	const VectorView &assign(const VectorView<const value_type> &v) const
+	{
+		this->check(v.size());
+		for(size_t i = 0; i < this->size(); ++i)
+		{
+			(*this)[i] = v[i];
+		}
+		return (*this);
+	}
+
+	const VectorView &fill(const value_type &c) const
+	{
+		for(size_t i = 0; i < this->size(); ++i)
+		{
+			(*this)[i] = c;
+		}
+		return (*this);
+	}
+
+	/* this += c * v
+	 */
+	const VectorView &add(const VectorView<const value_type> &v, const value_type &c = value_type(1)) const
+	{
+		this->check(v.size());
+		for(size_t i = 0; i < this->size(); ++i)
+		{
+			(*this)[i] += c * v[i];
+		}
+		return (*this);
+	}
+
+	const VectorView &multiply(const value_type &c) const
+	{
+		for(size_t i = 0; i < this->size(); ++i)
+		{
+			(*this)[i] *= c;
+		}
+		return (*this);
+	}
+
+	/* Registers over contiguous views, a plain loop otherwise
+	 */
+	value_type dot(const VectorView<const value_type> &v) const
+	{
+		typedef typename simd::Widest<value_type>::type Pack;
+		constexpr size_t W = simd::Widest<value_type>::width;
+
+		this->check(v.size());
+		size_t i = 0;
+		value_type s = value_type();
+		if constexpr(Pack::enabled)
+		{
+			if(this->stride() == 1 && v.stride() == 1 && this->size() >= W)
+			{
+				typename Pack::type a = Pack::set1(value_type());
+				for(; i + W <= this->size(); i += W)
+				{
+					a = Pack::madd(Pack::loadu(this->_data + i), Pack::loadu(v.data() + i), a);
+				}
+				s = Pack::hsum(a);
+			}
+		}
+		for(; i < this->size(); ++i)
+		{
+			s += (*this)[i] * v[i];
+		}
+		return s;
+	}
+private:
+	T *_data;
+	size_t _size;
+	size_t _stride;
+
+	void check(size_t size) const
+	{
+		if(size != this->size())
+			throw std::invalid_argument("Vector dimensions do not match");
+	}
+};
+
+template <typename T>
+class MatrixView
+{
+public:
+	typedef typename std::remove_const<T>::type value_type;
+
+	MatrixView(void)
+		: MatrixView(nullptr, 0, 0, 0, 1)
+	{
+	}
+
+	/* Dense row-major buffer, rows columns apart
+	 */
+	MatrixView(T *data, size_t rows, size_t columns)
+		: MatrixView(data, rows, columns, columns, 1)
+	{
+	}
+
+	MatrixView(T *data, size_t rows, size_t columns, size_t row_stride, size_t column_stride = 1)
+	{
+		this->_data          = data;
+		this->_rows          = rows;
+		this->_columns       = columns;
+		this->_row_stride    = row_stride;
+		this->_column_stride = column_stride;
+	}
+
+	template <unsigned R, unsigned C>
+	MatrixView(Matrix<R, C, value_type> &a)
+		: MatrixView(a.data(), R, C, C, 1)
+	{
+	}
+
+	template <unsigned R, unsigned C, typename U = T, typename = typename std::enable_if<std::is_const<U>::value>::type>
+	MatrixView(const Matrix<R, C, value_type> &a)
+		: MatrixView(a.data(), R, C, C, 1)
+	{
+	}
+
+	MatrixView(DynMatrix<value_type> &a)
+		: MatrixView(a.data(), a.rows(), a.columns(), a.row_stride(), a.column_stride())
+	{
+	}
+
+	template <typename U = T, typename = typename std::enable_if<std::is_const<U>::value>::type>
+	MatrixView(const DynMatrix<value_type> &a)
+		: MatrixView(a.data(), a.rows(), a.columns(), a.row_stride(), a.column_stride())
+	{
+	}
+
+	template <typename U, typename = typename std::enable_if<std::is_same<const U, T>::value && !std::is_same<U, T>::value>::type>
+	MatrixView(const MatrixView<U> &a)
+		: MatrixView(a.data(), a.rows(), a.columns(), a.row_stride(), a.column_stride())
+	{
+	}
+
+	inline T *data(void) const
+	{
+		return this->_data;
+	}
+
+	inline size_t rows(void) const
+	{
+		return this->_rows;
+	}
+
+	inline size_t columns(void) const
+	{
+		return this->_columns;
+	}
+
+	inline size_t row_stride(void) const
+	{
+		return this->_row_stride;
+	}
+
+	inline size_t column_stride(void) const
+	{
+		return this->_column_stride;
+	}
+
+	/* No bounds checking is done on the element accessor functions
+	 */
+	inline T &operator ()(size_t i, size_t j) const
+	{
+		return this->_data[i * this->_row_stride + j * this->_column_stride];
+	}
+
+	inline value_type elem(size_t i, size_t j) const
+	{
+		return (*this)(i, j);
+	}
+
+	inline VectorView<T> row(size_t i) const
+	{
+		return VectorView<T>(this->_data + i * this->_row_stride, this->_columns, this->_column_stride);
+	}
+
+	inline VectorView<T> column(size_t j) const
+	{
+		return VectorView<T>(this->_data + j * this->_column_stride, this->_rows, this->_row_stride);
+	}
+
+	/* Diagonal k, above the main one for k > 0 and below it for k < 0
+	 */
+	VectorView<T> diagonal(long k = 0) const
+	{
+		const size_t i = k < 0 ? (size_t)-k : 0, j = k < 0 ? 0 : (size_t)k;
+		if(i > this->_rows || j > this->_columns)
+			return VectorView<T>(this->_data, 0, this->_row_stride + this->_column_stride);
+		const size_t n = this->_rows - i < this->_columns - j ? this->_rows - i : this->_columns - j;
+		return VectorView<T>(&(*this)(i, j), n, this->_row_stride + this->_column_stride);
+	}
+
+	/* The rows x columns block with (i, j) at its top left
+	 */
+	inline MatrixView block(size_t i, size_t j, size_t rows, size_t columns) const
+	{
+		return MatrixView(this->_data + i * this->_row_stride + j * this->_column_stride, rows, columns, this->_row_stride, this->_column_stride);
+	}
+
+	/* Swaps the strides, no element moves
+	 */
+	inline MatrixView transpose(void) const
+	{
+		return MatrixView(this->_data, this->_columns, this->_rows, this->_column_stride, this->_row_stride);
+	}
+
+	template <unsigned R, unsigned C>
+	explicit operator Matrix<R, C, value_type>(void) const
+	{
+		Matrix<R, C, value_type> a{};
+		MatrixView<value_type>(a).assign(*this);
+		return a;
+	}
+
+	explicit operator DynMatrix<value_type>(void) const
+	{
+		DynMatrix<value_type> a(this->rows(), this->columns());
+		MatrixView<value_type>(a).assign(*this);
+		return a;
+	}
+
+	/* A view transposed against this, a Matrix view of a column-major
+	 * DynMatrix say, is copied by the blocked transpose kernel
+	 */
+	const MatrixView &assign(const MatrixView<const value_type> &a) const
+	{
+		this->check(a);
+		if(this->_column_stride == 1 && a.row_stride() == 1 && a.column_stride() != 1)
+		{
+			kernel::transpose(a.columns(), a.rows(), a.data(), a.column_stride(), this->_data, this->_row_stride);
+			return (*this);
+		}
+		this->apply(a, [](T &x, const value_type &y) { x = y; });
+		return (*this);
+	}
+
+	const MatrixView &fill(const value_type &c) const
+	{
+		this->apply([c](T &x) { x = c; });
+		return (*this);
+	}
+
+	/* this += c * a
+	 */
+	const MatrixView &add(const MatrixView<const value_type> &a, const value_type &c = value_type(1)) const
+	{
+		this->check(a);
+		this->apply(a, [c](T &x, const value_type &y) { x += c * y; });
+		return (*this);
+	}
+
+	const MatrixView &multiply(const value_type &c) const
+	{
+		this->apply([c](T &x) { x *= c; });
+		return (*this);
+	}
+
+	/* y = this * x
+	 */
+	void transform(const VectorView<const value_type> &x, const VectorView<value_type> &y) const
+	{
+		if(x.size() != this->columns() || y.size() != this->rows())
+			throw std::invalid_argument("Matrix and vector dimensions do not match");
+		for(size_t i = 0; i < this->rows(); ++i)
+		{
+			y[i] = this->row(i).dot(x);
+		}
+	}
+
+	/* c += a * b, c not overlapping a or b
+	 * The blocked GEMM kernel takes any strides for a and b and a unit
+	 * column stride for c, a c with unit row stride is computed as
+	 * c^T += b^T a^T instead. Products below the blocking threshold, or into
+	 * c with neither, are plain loops.
+	 */
+	static void multiply(const MatrixView<const value_type> &a, const MatrixView<const value_type> &b, const MatrixView<value_type> &c,
+	                     const parallel::Policy &policy = parallel::seq)
+	{
+		typedef kernel::Gemm<value_type> Gemm;
+
+		if(a.columns() != b.rows() || c.rows() != a.rows() || c.columns() != b.columns())
+			throw std::invalid_argument("Matrix dimensions do not match");
+
+		const size_t m = a.rows(), n = b.columns(), k = a.columns();
+		if(Gemm::blocked(m, n, k) && c.column_stride() == 1)
+		{
+			Gemm::multiply(m, n, k, a.data(), a.row_stride(), a.column_stride(), b.data(), b.row_stride(), b.column_stride(),
+			               c.data(), c.row_stride(), policy);
+			return;
+		}
+		if(Gemm::blocked(n, m, k) && c.row_stride() == 1)
+		{
+			Gemm::multiply(n, m, k, b.data(), b.column_stride(), b.row_stride(), a.data(), a.column_stride(), a.row_stride(),
+			               c.data(), c.column_stride(), policy);
+			return;
+		}
+		for(size_t i = 0; i < m; ++i)
+		{
+			for(size_t j = 0; j < n; ++j)
+			{
+				value_type s = c(i, j);
+				for(size_t p = 0; p < k; ++p)
+				{
+					s += a(i, p) * b(p, j);
+				}
+				c(i, j) = s;
+			}
+		}
+	}
+
+	/* Factors a square view with unit column stride in place, as
+	 * LUDecomposition does, returning the parity of the pivots or 0 when
+	 * singular
+	 */
+	int factor(size_t *pivot) const
+	{
+		static_assert(!std::is_integral<value_type>::value, "LU decomposition requires a field type");
+
+		this->square();
+		return kernel::LU<value_type>::factor(this->rows(), this->_data, this->_row_stride, pivot);
+	}
+
+	/* Overwrites b with the solution of a x = b, this holding the factors
+	 * and pivot the pivots of factor(), b having a unit column stride
+	 */
+	void solve(const size_t *pivot, const MatrixView<value_type> &b) const
+	{
+		this->square();
+		if(b.rows() != this->rows() || (b.column_stride() != 1 && b.columns() > 1))
+			throw std::invalid_argument("Right hand sides need as many rows as the matrix and a unit column stride");
+		kernel::LU<value_type>::solve(this->rows(), this->_data, this->_row_stride, pivot, b.data(), b.columns(), b.row_stride());
+	}
+private:
+	T *_data;
+	size_t _rows;
+	size_t _columns;
+	size_t _row_stride;
+	size_t _column_stride;
+
+	void check(const MatrixView<const value_type> &a) const
+	{
+		if(this->rows() != a.rows() || this->columns() != a.columns())
+			throw std::invalid_argument("Matrix dimensions do not match");
+	}
+
+	void square(void) const
+	{
+		if(this->rows() != this->columns() || (this->_column_stride != 1 && this->columns() > 1))
+			throw std::invalid_argument("LU needs a square view with unit column stride");
+	}
+
+	/* Calls f(this(i, j), a(i, j)), along rows when this is stored by row
+	 * and along columns otherwise
+	 */
+	template <class F>
+	void apply(const MatrixView<const value_type> &a, F f) const
+	{
+		if(this->_column_stride <= this->_row_stride)
+		{
+			for(size_t i = 0; i < this->_rows; ++i)
+			{
+				for(size_t j = 0; j < this->_columns; ++j)
+				{
+					f((*this)(i, j), a(i, j));
+				}
+			}
+			return;
+		}
+		for(size_t j = 0; j < this->_columns; ++j)
+		{
+			for(size_t i = 0; i < this->_rows; ++i)
+			{
+				f((*this)(i, j), a(i, j));
+			}
+		}
+	}
+
+	template <class F>
+	void apply(F f) const
+	{
+		this->apply(*this, [&f](T &x, const value_type &) { f(x); });
+	}
+};
+
+/* Views over the whole of a container, read only for const ones
+ */
+template <int N, typename T>
+inline VectorView<T> view(Vector<N, T> &v)
+{
+	return VectorView<T>(v);
+}
+
+template <int N, typename T>
+inline VectorView<const T> view(const Vector<N, T> &v)
+{
+	return VectorView<const T>(v);
+}
+
+template <unsigned R, unsigned C, typename T>
+inline MatrixView<T> view(Matrix<R, C, T> &a)
+{
+	return MatrixView<T>(a);
+}
+
+template <unsigned R, unsigned C, typename T>
+inline MatrixView<const T> view(const Matrix<R, C, T> &a)
+{
+	return MatrixView<const T>(a);
+}
+
+template <typename T>
+inline MatrixView<T> view(DynMatrix<T> &a)
+{
+	return MatrixView<T>(a);
+}
+
+template <typename T>
+inline MatrixView<const T> view(const DynMatrix<T> &a)
+{
+	return MatrixView<const T>(a);
+}
+
+typedef VectorView<float>  VectorViewf;
+typedef VectorView<double> VectorViewlf;
+typedef MatrixView<float>  MatrixViewf;
+typedef MatrixView<double> MatrixViewlf;
+
+#endif /* MATRIXVIEW_HH */
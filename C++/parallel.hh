@@ -0,0 +1,314 @@
+/* parallel.hh */
+#ifndef PARALLEL_HH
+#define PARALLEL_HH
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Execution support for the matrix kernels, which needs linking with -pthread
+ */
+namespace parallel
+{
+
+/* Work stealing thread pool
+ * Every worker owns a queue, popping its own tasks from the back and stealing
+ * from the front of the others when it runs dry. The thread calling run()
+ * counts as one of size() threads and executes tasks until its batch is done,
+ * so run() may be called from inside a task.
+ */
+class Pool
+{
+public:
+    explicit Pool(unsigned threads = Pool::concurrency())
+    {
+        this->_pending = 0;
+        this->_stop    = false;
+        for(unsigned i = 1; i < threads; ++i)
+        {
+            this->_queues.emplace_back(new Queue);
+        }
+        for(size_t i = 0; i < this->_queues.size(); ++i)
+        {
+            this->_threads.emplace_back([this, i] { this->work(i); });
+        }
+    }
+
+    Pool(const Pool &) = delete;
+    Pool &operator =(const Pool &) = delete;
+
+    ~Pool(void)
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->_sleep);
+            this->_stop = true;
+        }
+        this->_wake.notify_all();
+        for(std::thread &t : this->_threads)
+        {
+            t.join();
+        }
+    }
+
+    /* Pool shared by everything that asks for parallel::par()
+     */
+    static Pool &shared(void)
+    {
+        static Pool pool;
+        return pool;
+    }
+
+    static unsigned concurrency(void)
+    {
+        const unsigned n = std::thread::hardware_concurrency();
+        return n > 0 ? n : 1;
+    }
+
+    inline unsigned size(void) const
+    {
+        return (unsigned)this->_queues.size() + 1;
+    }
+
+    /* Calls f(i) for i in [0, count) and returns once all calls have
+     * finished, rethrowing the first exception thrown by any of them
+     */
+    template <class F>
+    void run(size_t count, const F &f)
+    {
+        if(count == 0)
+            return;
+        if(this->_queues.empty() || count == 1)
+        {
+            for(size_t i = 0; i < count; ++i)
+            {
+                f(i);
+            }
+            return;
+        }
+
+        Group group;
+        group.remaining = count;
+        const auto call = [](const void *p, size_t i) { (*static_cast<const F *>(p))(i); };
+
+        {
+            std::lock_guard<std::mutex> lock(this->_sleep);
+            this->_pending += count;
+        }
+        const size_t n = this->_queues.size();
+        for(size_t q = 0; q < n; ++q)
+        {
+            std::lock_guard<std::mutex> lock(this->_queues[q]->lock);
+            for(size_t i = q; i < count; i += n)
+            {
+                this->_queues[q]->tasks.push_back(Task{call, &f, i, &group});
+            }
+        }
+        this->_wake.notify_all();
+
+        Task t;
+        while(group.remaining.load(std::memory_order_acquire) != 0)
+        {
+            if(this->pop(t, n))
+            {
+                this->execute(t);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(group.lock);
+            group.done.wait(lock, [&group] { return group.remaining.load(std::memory_order_acquire) == 0; });
+        }
+
+        /* The last task signals while holding the lock, which has to be
+         * released before group goes out of scope
+         */
+        std::lock_guard<std::mutex> lock(group.lock);
+        if(group.error)
+            std::rethrow_exception(group.error);
+    }
+private:
+    struct Group
+    {
+        std::atomic<size_t> remaining;
+        std::mutex lock;
+        std::condition_variable done;
+        std::exception_ptr error;
+    };
+
+    struct Task
+    {
+        void (*call)(const void *, size_t);
+        const void *f;
+        size_t index;
+        Group *group;
+    };
+
+    struct Queue
+    {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> _queues;
+    std::vector<std::thread> _threads;
+    std::atomic<size_t> _pending;
+    std::mutex _sleep;
+    std::condition_variable _wake;
+    bool _stop;
+
+    /* Own queue first (newest task), then the others (oldest task)
+     * self is the queue count for a thread without a queue of its own
+     */
+    bool pop(Task &t, size_t self)
+    {
+        const size_t n = this->_queues.size();
+        if(self < n)
+        {
+            Queue &q = *this->_queues[self];
+            std::lock_guard<std::mutex> lock(q.lock);
+            if(!q.tasks.empty())
+            {
+                t = q.tasks.back();
+                q.tasks.pop_back();
+                this->_pending.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        for(size_t k = 1; k <= n; ++k)
+        {
+            Queue &q = *this->_queues[(self + k) % n];
+            std::lock_guard<std::mutex> lock(q.lock);
+            if(!q.tasks.empty())
+            {
+                t = q.tasks.front();
+                q.tasks.pop_front();
+                this->_pending.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void execute(const Task &t)
+    {
+        Group &group = *t.group;
+        try
+        {
+            t.call(t.f, t.index);
+        }
+        catch(...)
+        {
+            std::lock_guard<std::mutex> lock(group.lock);
+            if(!group.error)
+                group.error = std::current_exception();
+        }
+
+        std::lock_guard<std::mutex> lock(group.lock);
+        if(group.remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            group.done.notify_all();
+    }
+
+    void work(size_t self)
+    {
+        Task t;
+        for(;;)
+        {
+            if(this->pop(t, self))
+            {
+                this->execute(t);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(this->_sleep);
+            this->_wake.wait(lock, [this] { return this->_stop || this->_pending.load(std::memory_order_relaxed) != 0; });
+            if(this->_stop && this->_pending.load(std::memory_order_relaxed) == 0)
+                return;
+        }
+    }
+};
+
+/* Execution policy taken by the parallel overloads
+ * A default constructed policy runs on the calling thread, one constructed
+ * from a pool spreads the work over its threads.
+ */
+class Policy
+{
+public:
+    constexpr Policy(void)
+        : _pool(nullptr)
+    {
+    }
+
+    constexpr Policy(Pool &pool)
+        : _pool(&pool)
+    {
+    }
+
+    inline Pool *pool(void) const
+    {
+        return this->_pool;
+    }
+
+    inline unsigned concurrency(void) const
+    {
+        return this->_pool != nullptr ? this->_pool->size() : 1;
+    }
+
+    /* Calls f(i) for i in [0, count)
+     */
+    template <class F>
+    void run(size_t count, const F &f) const
+    {
+        if(this->_pool != nullptr)
+        {
+            this->_pool->run(count, f);
+            return;
+        }
+        for(size_t i = 0; i < count; ++i)
+        {
+            f(i);
+        }
+    }
+
+    /* Calls f(begin, end) over consecutive chunks of [0, n), chunks being at
+     * least grain long and a few per thread for the stealing to balance
+     */
+    template <class F>
+    void range(size_t n, size_t grain, const F &f) const
+    {
+        if(n == 0)
+            return;
+        if(grain == 0)
+            grain = 1;
+        const size_t most   = 4 * (size_t)this->concurrency();
+        const size_t chunks = (n + grain - 1) / grain < most ? (n + grain - 1) / grain : most;
+        if(chunks <= 1)
+        {
+            f(size_t(0), n);
+            return;
+        }
+        const size_t size = (n + chunks - 1) / chunks;
+        this->run(chunks, [&f, n, size](size_t i) {
+            const size_t begin = i * size;
+            const size_t end   = begin + size < n ? begin + size : n;
+            if(begin < end)
+                f(begin, end);
+        });
+    }
+private:
+    Pool *_pool;
+};
+
+inline constexpr Policy seq{};
+
+inline Policy par(void)
+{
+    return Policy(Pool::shared());
+}
+
+} /* namespace parallel */
+
+#endif /* PARALLEL_HH */
@@ -0,0 +1,360 @@
+/* quaternion.hh */
+#ifndef QUATERNION_HH
+#define QUATERNION_HH
+
+#include <cmath>
+#include "matrix.hh"
+#include "vector.hh"
+
+/* x i + y j + z k + w, held as the Vector<4, T> (x, y, z, w)
+ * Sums, scalings, dot products and normalization are those of the
+ * underlying vector and take its register paths. Rotations are expected
+ * to be unit quaternions, the product of two costing 16 multiplies and
+ * 12 additions where composing 3 x 3 rotation matrices costs 27 and 18.
+ */
+template <class T>
+class Quaternion
+{
+public:
+    typedef T scalar;
+
+    constexpr Quaternion(void);
+    constexpr Quaternion(const T&, const T&, const T&, const T&);
+    constexpr explicit Quaternion(const Vector<4, T>&);
+    constexpr Quaternion(const Vector<3, T>&, const T&);
+    explicit Quaternion(const Matrix<3, 3, T>&);
+    explicit Quaternion(const Matrix<4, 4, T>&);
+    constexpr explicit operator Matrix<3, 3, T>(void) const;
+    constexpr explicit operator Matrix<4, 4, T>(void) const;
+
+    /* Rotation by angle radians around the unit vector axis
+     */
+    static Quaternion axis_angle(const Vector<3, T>&, const T&);
+
+    constexpr inline const T& x(void) const;
+    constexpr inline const T& y(void) const;
+    constexpr inline const T& z(void) const;
+    constexpr inline const T& w(void) const;
+    constexpr inline const Vector<4, T>& coefficients(void) const;
+    constexpr inline Vector<3, T> vector(void) const;
+
+    constexpr T          dot(const Quaternion&) const;
+    constexpr T          norm(void) const;
+    auto                 magnitude(void) const;
+    Quaternion           normalize(void) const;
+    constexpr Quaternion conjugate(void) const;
+    constexpr Quaternion inverse(void) const;
+    constexpr Vector<3, T> rotate(const Vector<3, T>&) const;
+    void                 rotate(const Vector<3, T>*, Vector<3, T>*, size_t) const;
+
+    /* Interpolation along the shorter arc from a (t = 0) to b (t = 1)
+     * slerp moves at constant angular speed, nlerp normalizes the linear
+     * blend, which is cheaper and close for nearby rotations. slerp falls
+     * back to nlerp once the angle gets too small to divide by its sine.
+     */
+    static Quaternion slerp(const Quaternion&, const Quaternion&, const T&);
+    static Quaternion nlerp(const Quaternion&, const Quaternion&, const T&);
+
+    constexpr inline Quaternion operator +(void) const;
+    constexpr inline Quaternion operator -(void) const;
+    constexpr inline Quaternion operator +(const Quaternion&) const;
+    constexpr inline Quaternion operator -(const Quaternion&) const;
+    constexpr inline Quaternion operator *(const Quaternion&) const;
+    constexpr inline Quaternion operator *(const T&) const;
+    constexpr inline bool       operator ==(const Quaternion&) const;
+    constexpr inline bool       operator !=(const Quaternion&) const;
+    constexpr inline Quaternion& operator *=(const Quaternion&);
+    constexpr inline Quaternion& operator *=(const T&);
+private:
+    Vector<4, T> _q;
+};
+
+/* The identity rotation
+ */
+template <class T>
+constexpr Quaternion<T>::Quaternion(void)
+    : _q{T(), T(), T(), T(1)}
+{
+}
+
+template <class T>
+constexpr Quaternion<T>::Quaternion(const T& x, const T& y, const T& z, const T& w)
+    : _q{x, y, z, w}
+{
+}
+
+template <class T>
+constexpr Quaternion<T>::Quaternion(const Vector<4, T>& q)
+    : _q(q)
+{
+}
+
+template <class T>
+constexpr Quaternion<T>::Quaternion(const Vector<3, T>& v, const T& w)
+    : _q{v[0], v[1], v[2], w}
+{
+}
+
+/* From a rotation matrix, taking the square root of the largest of the
+ * four diagonal combinations (Shepperd) so the division stays well
+ * conditioned
+ */
+template <class T>
+Quaternion<T>::Quaternion(const Matrix<3, 3, T>& m)
+{
+    const T trace = m[0][0] + m[1][1] + m[2][2];
+    if(trace > T())
+    {
+        const T s = std::sqrt(trace + T(1)) * T(2);
+        this->_q = Vector<4, T>{(m[2][1] - m[1][2]) / s, (m[0][2] - m[2][0]) / s, (m[1][0] - m[0][1]) / s, s / T(4)};
+    }
+    else if(m[0][0] > m[1][1] && m[0][0] > m[2][2])
+    {
+        const T s = std::sqrt(T(1) + m[0][0] - m[1][1] - m[2][2]) * T(2);
+        this->_q = Vector<4, T>{s / T(4), (m[0][1] + m[1][0]) / s, (m[0][2] + m[2][0]) / s, (m[2][1] - m[1][2]) / s};
+    }
+    else if(m[1][1] > m[2][2])
+    {
+        const T s = std::sqrt(T(1) + m[1][1] - m[0][0] - m[2][2]) * T(2);
+        this->_q = Vector<4, T>{(m[0][1] + m[1][0]) / s, s / T(4), (m[1][2] + m[2][1]) / s, (m[0][2] - m[2][0]) / s};
+    }
+    else
+    {
+        const T s = std::sqrt(T(1) + m[2][2] - m[0][0] - m[1][1]) * T(2);
+        this->_q = Vector<4, T>{(m[0][2] + m[2][0]) / s, (m[1][2] + m[2][1]) / s, s / T(4), (m[1][0] - m[0][1]) / s};
+    }
+}
+
+/* From the upper left 3 x 3 block, which has to be a rotation
+ */
+template <class T>
+Quaternion<T>::Quaternion(const Matrix<4, 4, T>& m)
+    : Quaternion(Matrix<3, 3, T>{
+        Vector<3, T>{m[0][0], m[0][1], m[0][2]},
+        Vector<3, T>{m[1][0], m[1][1], m[1][2]},
+        Vector<3, T>{m[2][0], m[2][1], m[2][2]}
+    })
+{
+}
+
+template <class T>
+constexpr Quaternion<T>::operator Matrix<3, 3, T>(void) const
+{
+    const T x = this->x(), y = this->y(), z = this->z(), w = this->w();
+    return Matrix<3, 3, T>{
+        Vector<3, T>{T(1) - T(2) * (y * y + z * z), T(2) * (x * y - z * w), T(2) * (x * z + y * w)},
+        Vector<3, T>{T(2) * (x * y + z * w), T(1) - T(2) * (x * x + z * z), T(2) * (y * z - x * w)},
+        Vector<3, T>{T(2) * (x * z - y * w), T(2) * (y * z + x * w), T(1) - T(2) * (x * x + y * y)}
+    };
+}
+
+template <class T>
+constexpr Quaternion<T>::operator Matrix<4, 4, T>(void) const
+{
+    const Matrix<3, 3, T> r = static_cast<Matrix<3, 3, T>>(*this);
+    return Matrix<4, 4, T>{
+        Vector<4, T>{r[0][0], r[0][1], r[0][2], T()},
+        Vector<4, T>{r[1][0], r[1][1], r[1][2], T()},
+        Vector<4, T>{r[2][0], r[2][1], r[2][2], T()},
+        Vector<4, T>{T(), T(), T(), T(1)}
+    };
+}
+
+template <class T>
+Quaternion<T> Quaternion<T>::axis_angle(const Vector<3, T>& axis, const T& angle)
+{
+    const T h = angle / T(2);
+    return Quaternion(axis * std::sin(h), std::cos(h));
+}
+
+template <class T>
+constexpr inline const T& Quaternion<T>::x(void) const
+{
+    return this->_q[0];
+}
+
+template <class T>
+constexpr inline const T& Quaternion<T>::y(void) const
+{
+    return this->_q[1];
+}
+
+template <class T>
+constexpr inline const T& Quaternion<T>::z(void) const
+{
+    return this->_q[2];
+}
+
+template <class T>
+constexpr inline const T& Quaternion<T>::w(void) const
+{
+    return this->_q[3];
+}
+
+template <class T>
+constexpr inline const Vector<4, T>& Quaternion<T>::coefficients(void) const
+{
+    return this->_q;
+}
+
+template <class T>
+constexpr inline Vector<3, T> Quaternion<T>::vector(void) const
+{
+    return Vector<3, T>{this->_q[0], this->_q[1], this->_q[2]};
+}
+
+template <class T>
+constexpr T Quaternion<T>::dot(const Quaternion<T>& q) const
+{
+    return this->_q.dot(q._q);
+}
+
+template <class T>
+constexpr T Quaternion<T>::norm(void) const
+{
+    return this->_q.norm();
+}
+
+template <class T>
+auto Quaternion<T>::magnitude(void) const
+{
+    return this->_q.magnitude();
+}
+
+template <class T>
+Quaternion<T> Quaternion<T>::normalize(void) const
+{
+    return Quaternion(this->_q.normalize());
+}
+
+template <class T>
+constexpr Quaternion<T> Quaternion<T>::conjugate(void) const
+{
+    return Quaternion(-this->x(), -this->y(), -this->z(), this->w());
+}
+
+template <class T>
+constexpr Quaternion<T> Quaternion<T>::inverse(void) const
+{
+    return Quaternion(Vector<4, T>(this->conjugate()._q / this->norm()));
+}
+
+/* q v q*, as v + w t + u x t with t = 2 u x v for the vector part u
+ */
+template <class T>
+constexpr Vector<3, T> Quaternion<T>::rotate(const Vector<3, T>& v) const
+{
+    const Vector<3, T> u = this->vector();
+    const Vector<3, T> t = u.cross(v) * T(2);
+    return v + t * this->w() + u.cross(t);
+}
+
+/* out[i] = rotate(in[i]) for i < count, out may be in
+ * Rotates with a copy, as out could otherwise alias this and force a
+ * reload on every iteration
+ */
+template <class T>
+void Quaternion<T>::rotate(const Vector<3, T>* in, Vector<3, T>* out, size_t count) const
+{
+    const Quaternion q = (*this);
+    for(size_t i = 0; i < count; ++i)
+    {
+        out[i] = q.rotate(in[i]);
+    }
+}
+
+template <class T>
+Quaternion<T> Quaternion<T>::slerp(const Quaternion<T>& a, const Quaternion<T>& b, const T& t)
+{
+    T c = a.dot(b);
+    const Vector<4, T> e = c < T() ? Vector<4, T>(-b._q) : b._q;
+    c = c < T() ? -c : c;
+    if(c > T(0.9995))
+        return Quaternion::nlerp(a, Quaternion(e), t);
+
+    const T theta = std::acos(c);
+    const T s     = std::sin(theta);
+    return Quaternion(Vector<4, T>(a._q * (std::sin((T(1) - t) * theta) / s) + e * (std::sin(t * theta) / s)));
+}
+
+template <class T>
+Quaternion<T> Quaternion<T>::nlerp(const Quaternion<T>& a, const Quaternion<T>& b, const T& t)
+{
+    const T k = a.dot(b) < T() ? -t : t;
+    return Quaternion(Vector<4, T>(a._q * (T(1) - t) + b._q * k).normalize());
+}
+
+template <class T>
+constexpr inline Quaternion<T> Quaternion<T>::operator +(void) const
+{
+    return (*this);
+}
+
+template <class T>
+constexpr inline Quaternion<T> Quaternion<T>::operator -(void) const
+{
+    return Quaternion(Vector<4, T>(-this->_q));
+}
+
+template <class T>
+constexpr inline Quaternion<T> Quaternion<T>::operator +(const Quaternion<T>& q) const
+{
+    return Quaternion(Vector<4, T>(this->_q + q._q));
+}
+
+template <class T>
+constexpr inline Quaternion<T> Quaternion<T>::operator -(const Quaternion<T>& q) const
+{
+    return Quaternion(Vector<4, T>(this->_q - q._q));
+}
+
+/* Hamilton product, this rotation applied after q
+ */
+template <class T>
+constexpr inline Quaternion<T> Quaternion<T>::operator *(const Quaternion<T>& q) const
+{
+    const Vector<4, T>& a = this->_q;
+    const Vector<4, T>& b = q._q;
+    return Quaternion(
+        a[3] * b[0] + a[0] * b[3] + a[1] * b[2] - a[2] * b[1],
+        a[3] * b[1] - a[0] * b[2] + a[1] * b[3] + a[2] * b[0],
+        a[3] * b[2] + a[0] * b[1] - a[1] * b[0] + a[2] * b[3],
+        a[3] * b[3] - a[0] * b[0] - a[1] * b[1] - a[2] * b[2]
+    );
+}
+
+template <class T>
+constexpr inline Quaternion<T> Quaternion<T>::operator *(const T& c) const
+{
+    return Quaternion(Vector<4, T>(this->_q * c));
+}
+
+template <class T>
+constexpr inline bool Quaternion<T>::operator ==(const Quaternion<T>& q) const
+{
+    return this->_q == q._q;
+}
+
+template <class T>
+constexpr inline bool Quaternion<T>::operator !=(const Quaternion<T>& q) const
+{
+    return this->_q != q._q;
+}
+
+template <class T>
+constexpr inline Quaternion<T>& Quaternion<T>::operator *=(const Quaternion<T>& q)
+{
+    return (*this) = (*this) * q;
+}
+
+template <class T>
+constexpr inline Quaternion<T>& Quaternion<T>::operator *=(const T& c)
+{
+    this->_q *= c;
+    return (*this);
+}
+
+typedef Quaternion<float>  Quaternionf;
+typedef Quaternion<double> Quaternionlf;
+
+#endif /* QUATERNION_HH */
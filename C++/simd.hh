@@ -0,0 +1,839 @@
+/* simd.hh */
+#ifndef SIMD_HH
+#define SIMD_HH
+
+/* Thin wrappers around the SSE/AVX and NEON registers used by the
+ * fixed size containers. Every kernel has a plain scalar fallback, so
+ * defining NO_SIMD (or building for a target without any of the
+ * instruction sets below) always yields the generic loops.
+ */
+#include <cmath>
+#include <type_traits>
+
+#if !defined(NO_SIMD)
+#   if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#       define SIMD_SSE 1
+#       include <immintrin.h>
+#       if defined(__AVX__)
+#           define SIMD_AVX 1
+#       endif
+#       if defined(__AVX2__)
+#           define SIMD_AVX2 1
+#       endif
+#       if defined(__FMA__)
+#           define SIMD_FMA 1
+#       endif
+#       if defined(__AVX512F__)
+#           define SIMD_AVX512 1
+#       endif
+#       if defined(__F16C__)
+#           define SIMD_F16C 1
+#       endif
+#   elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#       define SIMD_NEON 1
+#       include <arm_neon.h>
+#       if defined(__aarch64__)
+#           define SIMD_NEON64 1
+#       endif
+#   endif
+#endif
+
+namespace simd
+{
+
+/* True while the compiler evaluates a constant expression
+ * Intrinsics cannot run at compile time, so the constexpr members of the
+ * containers take their scalar loops whenever this holds. Compilers
+ * without the builtin only get the scalar loops when NO_SIMD is defined.
+ */
+constexpr inline bool constant(void)
+{
+#if defined(__cpp_lib_is_constant_evaluated)
+    return std::is_constant_evaluated();
+#elif (defined(__GNUC__) && __GNUC__ >= 9) || (defined(__clang_major__) && __clang_major__ >= 9)
+    return __builtin_is_constant_evaluated();
+#else
+    return false;
+#endif
+}
+
+/* Pack<T, W> describes a register holding W lanes of T.
+ * enabled is false when no native register exists, in which case callers
+ * are expected to take their scalar path.
+ *
+ * less(a, b) returns a mask with every lane where a < b set, all bits of the
+ * lane, false when either is NaN. blend(m, a, b) takes b in the lanes set
+ * in m and a elsewhere, bits(m) packs the mask into bit i for lane i.
+ * min(a, b) and max(a, b) return b when either lane is NaN, like minps,
+ * maxps and simd::Scalar, except on NEON where the NaN propagates.
+ *
+ * cmul(a, b) and cmulc(a, b) treat the lanes as interleaved (re, im) pairs
+ * and return a * b and a * conj(b) pair by pair. pairsum(a, b) sums
+ * neighbouring lanes, those of a in the low half followed by those of b.
+ */
+template <class T, int W>
+struct Pack
+{
+    static constexpr bool enabled = false;
+    static constexpr int  align   = alignof(T);
+};
+
+#if defined(SIMD_SSE)
+template <>
+struct Pack<float, 4>
+{
+    static constexpr bool enabled = true;
+    static constexpr int  align   = 16;
+    typedef __m128 type;
+
+    static inline type load(const float *p)          { return _mm_load_ps(p); }
+    static inline void store(float *p, type a)       { _mm_store_ps(p, a); }
+    static inline type loadu(const float *p)         { return _mm_loadu_ps(p); }
+    static inline void storeu(float *p, type a)      { _mm_storeu_ps(p, a); }
+    static inline type set1(float c)                 { return _mm_set1_ps(c); }
+    static inline type set(float x, float y, float z, float w) { return _mm_setr_ps(x, y, z, w); }
+    static inline type add(type a, type b)           { return _mm_add_ps(a, b); }
+    static inline type sub(type a, type b)           { return _mm_sub_ps(a, b); }
+    static inline type mul(type a, type b)           { return _mm_mul_ps(a, b); }
+    static inline type div(type a, type b)           { return _mm_div_ps(a, b); }
+    static inline type sqrt(type a)                  { return _mm_sqrt_ps(a); }
+#if defined(SIMD_FMA)
+    static inline type madd(type a, type b, type c)  { return _mm_fmadd_ps(a, b, c); }
+#else
+    static inline type madd(type a, type b, type c)  { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+#endif
+
+    /* 1 / sqrt(a), the 12 bit estimate refined by one Newton step to about
+     * 23 bits; zero lanes give NaN
+     */
+    static inline type rsqrt(type a)
+    {
+        const type y = _mm_rsqrt_ps(a);
+        const type h = _mm_mul_ps(_mm_mul_ps(a, _mm_set1_ps(0.5f)), _mm_mul_ps(y, y));
+        return _mm_mul_ps(y, _mm_sub_ps(_mm_set1_ps(1.5f), h));
+    }
+
+    static inline type min(type a, type b)           { return _mm_min_ps(a, b); }
+    static inline type max(type a, type b)           { return _mm_max_ps(a, b); }
+    static inline type less(type a, type b)          { return _mm_cmplt_ps(a, b); }
+    static inline type blend(type m, type a, type b) { return _mm_or_ps(_mm_and_ps(m, b), _mm_andnot_ps(m, a)); }
+    static inline unsigned bits(type m)              { return (unsigned)_mm_movemask_ps(m); }
+
+    static inline type cmul(type a, type b)
+    {
+        const type t = _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 3, 1, 1)));
+        return madd(a, _mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 2, 0, 0)), _mm_xor_ps(t, _mm_setr_ps(-0.0f, 0.0f, -0.0f, 0.0f)));
+    }
+
+    static inline type cmulc(type a, type b)
+    {
+        const type t = _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 3, 1, 1)));
+        return madd(a, _mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 2, 0, 0)), _mm_xor_ps(t, _mm_setr_ps(0.0f, -0.0f, 0.0f, -0.0f)));
+    }
+
+    static inline type pairsum(type a, type b)
+    {
+        return _mm_add_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+
+    static inline float hsum(type a)
+    {
+        __m128 s = _mm_add_ps(a, _mm_movehl_ps(a, a));
+        s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 0x55));
+        return _mm_cvtss_f32(s);
+    }
+
+    /* (y, z, x, w) and (z, x, y, w) lane rotations used by cross()
+     */
+    static inline type yzx(type a) { return _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1)); }
+    static inline type zxy(type a) { return _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 1, 0, 2)); }
+
+    /* Rows of a 4x4 block in, columns out
+     */
+    static inline void transpose(type &a, type &b, type &c, type &d)
+    {
+        _MM_TRANSPOSE4_PS(a, b, c, d);
+    }
+};
+
+#if defined(SIMD_AVX)
+template <>
+struct Pack<float, 8>
+{
+    static constexpr bool enabled = true;
+    static constexpr int  align   = 32;
+    typedef __m256 type;
+
+    static inline type load(const float *p)          { return _mm256_load_ps(p); }
+    static inline void store(float *p, type a)       { _mm256_store_ps(p, a); }
+    static inline type loadu(const float *p)         { return _mm256_loadu_ps(p); }
+    static inline void storeu(float *p, type a)      { _mm256_storeu_ps(p, a); }
+    static inline type set1(float c)                 { return _mm256_set1_ps(c); }
+    static inline type add(type a, type b)           { return _mm256_add_ps(a, b); }
+    static inline type sub(type a, type b)           { return _mm256_sub_ps(a, b); }
+    static inline type mul(type a, type b)           { return _mm256_mul_ps(a, b); }
+    static inline type div(type a, type b)           { return _mm256_div_ps(a, b); }
+    static inline type sqrt(type a)                  { return _mm256_sqrt_ps(a); }
+#if defined(SIMD_FMA)
+    static inline type madd(type a, type b, type c)  { return _mm256_fmadd_ps(a, b, c); }
+#else
+    static inline type madd(type a, type b, type c)  { return _mm256_add_ps(_mm256_mul_ps(a, b), c); }
+#endif
+
+    static inline type rsqrt(type a)
+    {
+        const type y = _mm256_rsqrt_ps(a);
+        const type h = _mm256_mul_ps(_mm256_mul_ps(a, _mm256_set1_ps(0.5f)), _mm256_mul_ps(y, y));
+        return _mm256_mul_ps(y, _mm256_sub_ps(_mm256_set1_ps(1.5f), h));
+    }
+
+    static inline type min(type a, type b)           { return _mm256_min_ps(a, b); }
+    static inline type max(type a, type b)           { return _mm256_max_ps(a, b); }
+    static inline type less(type a, type b)          { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static inline type blend(type m, type a, type b) { return _mm256_blendv_ps(a, b, m); }
+    static inline unsigned bits(type m)              { return (unsigned)_mm256_movemask_ps(m); }
+
+    /* fmaddsub folds the product and the alternating add under FMA
+     */
+    static inline type cmul(type a, type b)
+    {
+        const type t = _mm256_mul_ps(_mm256_permute_ps(a, _MM_SHUFFLE(2, 3, 0, 1)), _mm256_movehdup_ps(b));
+#if defined(SIMD_FMA)
+        return _mm256_fmaddsub_ps(a, _mm256_moveldup_ps(b), t);
+#else
+        return _mm256_addsub_ps(_mm256_mul_ps(a, _mm256_moveldup_ps(b)), t);
+#endif
+    }
+
+    static inline type cmulc(type a, type b)
+    {
+        const type t = _mm256_mul_ps(_mm256_permute_ps(a, _MM_SHUFFLE(2, 3, 0, 1)), _mm256_movehdup_ps(b));
+#if defined(SIMD_FMA)
+        return _mm256_fmsubadd_ps(a, _mm256_moveldup_ps(b), t);
+#else
+        return madd(a, _mm256_moveldup_ps(b), _mm256_xor_ps(t, _mm256_setr_ps(0.0f, -0.0f, 0.0f, -0.0f, 0.0f, -0.0f, 0.0f, -0.0f)));
+#endif
+    }
+
+    static inline type pairsum(type a, type b)
+    {
+        const type lo = _mm256_permute2f128_ps(a, b, 0x20), hi = _mm256_permute2f128_ps(a, b, 0x31);
+        return _mm256_add_ps(_mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)), _mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+
+    static inline float hsum(type a)
+    {
+        return Pack<float, 4>::hsum(_mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1)));
+    }
+
+    /* Rows of an 8x8 block in r[0 .. 8), columns out
+     */
+    static inline void transpose(type *r)
+    {
+        const __m256 t0 = _mm256_unpacklo_ps(r[0], r[1]);
+        const __m256 t1 = _mm256_unpackhi_ps(r[0], r[1]);
+        const __m256 t2 = _mm256_unpacklo_ps(r[2], r[3]);
+        const __m256 t3 = _mm256_unpackhi_ps(r[2], r[3]);
+        const __m256 t4 = _mm256_unpacklo_ps(r[4], r[5]);
+        const __m256 t5 = _mm256_unpackhi_ps(r[4], r[5]);
+        const __m256 t6 = _mm256_unpacklo_ps(r[6], r[7]);
+        const __m256 t7 = _mm256_unpackhi_ps(r[6], r[7]);
+        const __m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+        const __m256 s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+        const __m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+        const __m256 s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+        const __m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+        const __m256 s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+        const __m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+        const __m256 s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+        r[0] = _mm256_permute2f128_ps(s0, s4, 0x20);
+        r[1] = _mm256_permute2f128_ps(s1, s5, 0x20);
+        r[2] = _mm256_permute2f128_ps(s2, s6, 0x20);
+        r[3] = _mm256_permute2f128_ps(s3, s7, 0x20);
+        r[4] = _mm256_permute2f128_ps(s0, s4, 0x31);
+        r[5] = _mm256_permute2f128_ps(s1, s5, 0x31);
+        r[6] = _mm256_permute2f128_ps(s2, s6, 0x31);
+        r[7] = _mm256_permute2f128_ps(s3, s7, 0x31);
+    }
+};
+
+template <>
+struct Pack<double, 4>
+{
+    static constexpr bool enabled = true;
+    static constexpr int  align   = 32;
+    typedef __m256d type;
+
+    static inline type load(const double *p)         { return _mm256_load_pd(p); }
+    static inline void store(double *p, type a)      { _mm256_store_pd(p, a); }
+    static inline type loadu(const double *p)        { return _mm256_loadu_pd(p); }
+    static inline void storeu(double *p, type a)     { _mm256_storeu_pd(p, a); }
+    static inline type set1(double c)                { return _mm256_set1_pd(c); }
+    static inline type set(double x, double y, double z, double w) { return _mm256_setr_pd(x, y, z, w); }
+    static inline type add(type a, type b)           { return _mm256_add_pd(a, b); }
+    static inline type sub(type a, type b)           { return _mm256_sub_pd(a, b); }
+    static inline type mul(type a, type b)           { return _mm256_mul_pd(a, b); }
+    static inline type div(type a, type b)           { return _mm256_div_pd(a, b); }
+    static inline type sqrt(type a)                  { return _mm256_sqrt_pd(a); }
+    /* No double estimate below AVX-512, exact instead
+     */
+    static inline type rsqrt(type a)                 { return _mm256_div_pd(_mm256_set1_pd(1.0), _mm256_sqrt_pd(a)); }
+#if defined(SIMD_FMA)
+    static inline type madd(type a, type b, type c)  { return _mm256_fmadd_pd(a, b, c); }
+#else
+    static inline type madd(type a, type b, type c)  { return _mm256_add_pd(_mm256_mul_pd(a, b), c); }
+#endif
+
+    static inline type min(type a, type b)           { return _mm256_min_pd(a, b); }
+    static inline type max(type a, type b)           { return _mm256_max_pd(a, b); }
+    static inline type less(type a, type b)          { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+    static inline type blend(type m, type a, type b) { return _mm256_blendv_pd(a, b, m); }
+    static inline unsigned bits(type m)              { return (unsigned)_mm256_movemask_pd(m); }
+
+    /* fmaddsub folds the product and the alternating add under FMA
+     */
+    static inline type cmul(type a, type b)
+    {
+        const type t = _mm256_mul_pd(_mm256_permute_pd(a, 0x5), _mm256_permute_pd(b, 0xF));
+#if defined(SIMD_FMA)
+        return _mm256_fmaddsub_pd(a, _mm256_movedup_pd(b), t);
+#else
+        return _mm256_addsub_pd(_mm256_mul_pd(a, _mm256_movedup_pd(b)), t);
+#endif
+    }
+
+    static inline type cmulc(type a, type b)
+    {
+        const type t = _mm256_mul_pd(_mm256_permute_pd(a, 0x5), _mm256_permute_pd(b, 0xF));
+#if defined(SIMD_FMA)
+        return _mm256_fmsubadd_pd(a, _mm256_movedup_pd(b), t);
+#else
+        return madd(a, _mm256_movedup_pd(b), _mm256_xor_pd(t, _mm256_setr_pd(0.0, -0.0, 0.0, -0.0)));
+#endif
+    }
+
+    static inline type pairsum(type a, type b)
+    {
+        return _mm256_hadd_pd(_mm256_permute2f128_pd(a, b, 0x20), _mm256_permute2f128_pd(a, b, 0x31));
+    }
+
+    static inline double hsum(type a)
+    {
+        __m128d s = _mm_add_pd(_mm256_castpd256_pd128(a), _mm256_extractf128_pd(a, 1));
+        return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+    }
+
+#if defined(__AVX2__)
+    static inline type yzx(type a) { return _mm256_permute4x64_pd(a, _MM_SHUFFLE(3, 0, 2, 1)); }
+    static inline type zxy(type a) { return _mm256_permute4x64_pd(a, _MM_SHUFFLE(3, 1, 0, 2)); }
+#else
+    /* vpermpd needs AVX2, rotate through the two 128 bit halves instead
+     */
+    static inline type yzx(type a)
+    {
+        const __m128d lo = _mm256_castpd256_pd128(a), hi = _mm256_extractf128_pd(a, 1);
+        return _mm256_insertf128_pd(_mm256_castpd128_pd256(_mm_shuffle_pd(lo, hi, 0x1)), _mm_shuffle_pd(lo, hi, 0x2), 1);
+    }
+
+    static inline type zxy(type a)
+    {
+        const __m128d lo = _mm256_castpd256_pd128(a), hi = _mm256_extractf128_pd(a, 1);
+        return _mm256_insertf128_pd(_mm256_castpd128_pd256(_mm_unpacklo_pd(hi, lo)), _mm_shuffle_pd(lo, hi, 0x3), 1);
+    }
+#endif
+
+    static inline void transpose(type &a, type &b, type &c, type &d)
+    {
+        const __m256d t0 = _mm256_unpacklo_pd(a, b);
+        const __m256d t1 = _mm256_unpackhi_pd(a, b);
+        const __m256d t2 = _mm256_unpacklo_pd(c, d);
+        const __m256d t3 = _mm256_unpackhi_pd(c, d);
+        a = _mm256_permute2f128_pd(t0, t2, 0x20);
+        b = _mm256_permute2f128_pd(t1, t3, 0x20);
+        c = _mm256_permute2f128_pd(t0, t2, 0x31);
+        d = _mm256_permute2f128_pd(t1, t3, 0x31);
+    }
+};
+#else
+/* Without AVX a 4 lane double register is emulated with two SSE2 halves
+ */
+struct Double4
+{
+    __m128d lo;
+    __m128d hi;
+};
+
+template <>
+struct Pack<double, 4>
+{
+    static constexpr bool enabled = true;
+    static constexpr int  align   = 16;
+    typedef Double4 type;
+
+    static inline type load(const double *p)         { return {_mm_load_pd(p), _mm_load_pd(p + 2)}; }
+    static inline void store(double *p, type a)      { _mm_store_pd(p, a.lo); _mm_store_pd(p + 2, a.hi); }
+    static inline type loadu(const double *p)        { return {_mm_loadu_pd(p), _mm_loadu_pd(p + 2)}; }
+    static inline void storeu(double *p, type a)     { _mm_storeu_pd(p, a.lo); _mm_storeu_pd(p + 2, a.hi); }
+    static inline type set1(double c)                { return {_mm_set1_pd(c), _mm_set1_pd(c)}; }
+    static inline type set(double x, double y, double z, double w) { return {_mm_setr_pd(x, y), _mm_setr_pd(z, w)}; }
+    static inline type add(type a, type b)           { return {_mm_add_pd(a.lo, b.lo), _mm_add_pd(a.hi, b.hi)}; }
+    static inline type sub(type a, type b)           { return {_mm_sub_pd(a.lo, b.lo), _mm_sub_pd(a.hi, b.hi)}; }
+    static inline type mul(type a, type b)           { return {_mm_mul_pd(a.lo, b.lo), _mm_mul_pd(a.hi, b.hi)}; }
+    static inline type div(type a, type b)           { return {_mm_div_pd(a.lo, b.lo), _mm_div_pd(a.hi, b.hi)}; }
+    static inline type sqrt(type a)                  { return {_mm_sqrt_pd(a.lo), _mm_sqrt_pd(a.hi)}; }
+    static inline type rsqrt(type a)                 { return div(set1(1.0), sqrt(a)); }
+#if defined(SIMD_FMA)
+    static inline type madd(type a, type b, type c)  { return {_mm_fmadd_pd(a.lo, b.lo, c.lo), _mm_fmadd_pd(a.hi, b.hi, c.hi)}; }
+#else
+    static inline type madd(type a, type b, type c)  { return add(mul(a, b), c); }
+#endif
+
+    static inline type min(type a, type b)           { return {_mm_min_pd(a.lo, b.lo), _mm_min_pd(a.hi, b.hi)}; }
+    static inline type max(type a, type b)           { return {_mm_max_pd(a.lo, b.lo), _mm_max_pd(a.hi, b.hi)}; }
+    static inline type less(type a, type b)          { return {_mm_cmplt_pd(a.lo, b.lo), _mm_cmplt_pd(a.hi, b.hi)}; }
+    static inline type blend(type m, type a, type b)
+    {
+        return {_mm_or_pd(_mm_and_pd(m.lo, b.lo), _mm_andnot_pd(m.lo, a.lo)),
+                _mm_or_pd(_mm_and_pd(m.hi, b.hi), _mm_andnot_pd(m.hi, a.hi))};
+    }
+    static inline unsigned bits(type m)
+    {
+        return (unsigned)(_mm_movemask_pd(m.lo) | _mm_movemask_pd(m.hi) << 2);
+    }
+
+    static inline type cmul(type a, type b)
+    {
+        const __m128d sign = _mm_setr_pd(-0.0, 0.0);
+        return {pair(a.lo, b.lo, sign), pair(a.hi, b.hi, sign)};
+    }
+
+    static inline type cmulc(type a, type b)
+    {
+        const __m128d sign = _mm_setr_pd(0.0, -0.0);
+        return {pair(a.lo, b.lo, sign), pair(a.hi, b.hi, sign)};
+    }
+
+    static inline type pairsum(type a, type b)
+    {
+        return {_mm_add_pd(_mm_unpacklo_pd(a.lo, a.hi), _mm_unpackhi_pd(a.lo, a.hi)),
+                _mm_add_pd(_mm_unpacklo_pd(b.lo, b.hi), _mm_unpackhi_pd(b.lo, b.hi))};
+    }
+
+    /* One complex product, sign flipping the (im * im, re * im) terms
+     */
+    static inline __m128d pair(__m128d a, __m128d b, __m128d sign)
+    {
+        const __m128d t = _mm_mul_pd(_mm_shuffle_pd(a, a, 0x1), _mm_unpackhi_pd(b, b));
+        return _mm_add_pd(_mm_mul_pd(a, _mm_unpacklo_pd(b, b)), _mm_xor_pd(t, sign));
+    }
+
+    static inline double hsum(type a)
+    {
+        __m128d s = _mm_add_pd(a.lo, a.hi);
+        return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+    }
+
+    /* lo = (x, y), hi = (z, w)
+     */
+    static inline type yzx(type a) { return {_mm_shuffle_pd(a.lo, a.hi, 0x1), _mm_shuffle_pd(a.lo, a.hi, 0x2)}; }
+    static inline type zxy(type a) { return {_mm_unpacklo_pd(a.hi, a.lo), _mm_shuffle_pd(a.lo, a.hi, 0x3)}; }
+
+    static inline void transpose(type &a, type &b, type &c, type &d)
+    {
+        const type t0 = {_mm_unpacklo_pd(a.lo, b.lo), _mm_unpacklo_pd(c.lo, d.lo)};
+        const type t1 = {_mm_unpackhi_pd(a.lo, b.lo), _mm_unpackhi_pd(c.lo, d.lo)};
+        const type t2 = {_mm_unpacklo_pd(a.hi, b.hi), _mm_unpacklo_pd(c.hi, d.hi)};
+        const type t3 = {_mm_unpackhi_pd(a.hi, b.hi), _mm_unpackhi_pd(c.hi, d.hi)};
+        a = t0;
+        b = t1;
+        c = t2;
+        d = t3;
+    }
+};
+#endif
+
+#if defined(SIMD_AVX512)
+/* 16 float and 8 double lanes, for the kernels that ask for them by width
+ * Masks are kept in the vector registers like the narrower packs, lanes
+ * with the sign bit set counting as set, so that generic code written
+ * against less() and blend() runs unchanged.
+ */
+template <>
+struct Pack<float, 16>
+{
+    static constexpr bool enabled = true;
+    static constexpr int  align   = 64;
+    typedef __m512 type;
+
+    static inline type load(const float *p)          { return _mm512_load_ps(p); }
+    static inline void store(float *p, type a)       { _mm512_store_ps(p, a); }
+    static inline type loadu(const float *p)         { return _mm512_loadu_ps(p); }
+    static inline void storeu(float *p, type a)      { _mm512_storeu_ps(p, a); }
+    static inline type set1(float c)                 { return _mm512_set1_ps(c); }
+    static inline type add(type a, type b)           { return _mm512_add_ps(a, b); }
+    static inline type sub(type a, type b)           { return _mm512_sub_ps(a, b); }
+    static inline type mul(type a, type b)           { return _mm512_mul_ps(a, b); }
+    static inline type div(type a, type b)           { return _mm512_div_ps(a, b); }
+    /* The zero masked forms of sqrt, min and max, the plain ones tripping
+     * a false -Wmaybe-uninitialized in GCC 12
+     */
+    static inline type sqrt(type a)                  { return _mm512_maskz_sqrt_ps((__mmask16)-1, a); }
+    static inline type rsqrt(type a)                 { return _mm512_div_ps(_mm512_set1_ps(1.0f), sqrt(a)); }
+    static inline type madd(type a, type b, type c)  { return _mm512_fmadd_ps(a, b, c); }
+
+    static inline type min(type a, type b)           { return _mm512_maskz_min_ps((__mmask16)-1, a, b); }
+    static inline type max(type a, type b)           { return _mm512_maskz_max_ps((__mmask16)-1, a, b); }
+    static inline type less(type a, type b)
+    {
+        return _mm512_castsi512_ps(_mm512_maskz_set1_epi32(_mm512_cmp_ps_mask(a, b, _CMP_LT_OQ), -1));
+    }
+    static inline type blend(type m, type a, type b) { return _mm512_mask_blend_ps((__mmask16)bits(m), a, b); }
+    static inline unsigned bits(type m)
+    {
+        return (unsigned)_mm512_cmplt_epi32_mask(_mm512_castps_si512(m), _mm512_setzero_si512());
+    }
+
+    static inline float hsum(type a)                 { return _mm512_reduce_add_ps(a); }
+};
+
+template <>
+struct Pack<double, 8>
+{
+    static constexpr bool enabled = true;
+    static constexpr int  align   = 64;
+    typedef __m512d type;
+
+    static inline type load(const double *p)         { return _mm512_load_pd(p); }
+    static inline void store(double *p, type a)      { _mm512_store_pd(p, a); }
+    static inline type loadu(const double *p)        { return _mm512_loadu_pd(p); }
+    static inline void storeu(double *p, type a)     { _mm512_storeu_pd(p, a); }
+    static inline type set1(double c)                { return _mm512_set1_pd(c); }
+    static inline type add(type a, type b)           { return _mm512_add_pd(a, b); }
+    static inline type sub(type a, type b)           { return _mm512_sub_pd(a, b); }
+    static inline type mul(type a, type b)           { return _mm512_mul_pd(a, b); }
+    static inline type div(type a, type b)           { return _mm512_div_pd(a, b); }
+    /* Zero masked like Pack<float, 16>
+     */
+    static inline type sqrt(type a)                  { return _mm512_maskz_sqrt_pd((__mmask8)-1, a); }
+    static inline type rsqrt(type a)                 { return _mm512_div_pd(_mm512_set1_pd(1.0), sqrt(a)); }
+    static inline type madd(type a, type b, type c)  { return _mm512_fmadd_pd(a, b, c); }
+
+    static inline type min(type a, type b)           { return _mm512_maskz_min_pd((__mmask8)-1, a, b); }
+    static inline type max(type a, type b)           { return _mm512_maskz_max_pd((__mmask8)-1, a, b); }
+    static inline type less(type a, type b)
+    {
+        return _mm512_castsi512_pd(_mm512_maskz_set1_epi64(_mm512_cmp_pd_mask(a, b, _CMP_LT_OQ), -1));
+    }
+    static inline type blend(type m, type a, type b) { return _mm512_mask_blend_pd((__mmask8)bits(m), a, b); }
+    static inline unsigned bits(type m)
+    {
+        return (unsigned)_mm512_cmplt_epi64_mask(_mm512_castpd_si512(m), _mm512_setzero_si512());
+    }
+
+    static inline double hsum(type a)                { return _mm512_reduce_add_pd(a); }
+};
+#endif
+#endif /* SIMD_SSE */
+
+#if defined(SIMD_NEON)
+template <>
+struct Pack<float, 4>
+{
+    static constexpr bool enabled = true;
+    static constexpr int  align   = 16;
+    typedef float32x4_t type;
+
+    static inline type load(const float *p)          { return vld1q_f32(p); }
+    static inline void store(float *p, type a)       { vst1q_f32(p, a); }
+    static inline type loadu(const float *p)         { return vld1q_f32(p); }
+    static inline void storeu(float *p, type a)      { vst1q_f32(p, a); }
+    static inline type set1(float c)                 { return vdupq_n_f32(c); }
+    static inline type set(float x, float y, float z, float w)
+    {
+        const float v[4] = {x, y, z, w};
+        return vld1q_f32(v);
+    }
+    static inline type add(type a, type b)           { return vaddq_f32(a, b); }
+    static inline type sub(type a, type b)           { return vsubq_f32(a, b); }
+    static inline type mul(type a, type b)           { return vmulq_f32(a, b); }
+#if defined(SIMD_NEON64)
+    static inline type madd(type a, type b, type c)  { return vfmaq_f32(c, a, b); }
+#else
+    static inline type madd(type a, type b, type c)  { return vmlaq_f32(c, a, b); }
+#endif
+#if defined(SIMD_NEON64)
+    static inline type div(type a, type b)           { return vdivq_f32(a, b); }
+    static inline type sqrt(type a)                  { return vsqrtq_f32(a); }
+#else
+    /* ARMv7 has no vector divide, refine the reciprocal estimate twice
+     */
+    static inline type div(type a, type b)
+    {
+        float32x4_t r = vrecpeq_f32(b);
+        r = vmulq_f32(vrecpsq_f32(b, r), r);
+        r = vmulq_f32(vrecpsq_f32(b, r), r);
+        return vmulq_f32(a, r);
+    }
+
+    static inline type sqrt(type a)
+    {
+        float v[4];
+        vst1q_f32(v, a);
+        return set(std::sqrt(v[0]), std::sqrt(v[1]), std::sqrt(v[2]), std::sqrt(v[3]));
+    }
+#endif
+
+    /* The estimate and one vrsqrts Newton step
+     */
+    static inline type rsqrt(type a)
+    {
+        const float32x4_t y = vrsqrteq_f32(a);
+        return vmulq_f32(y, vrsqrtsq_f32(vmulq_f32(a, y), y));
+    }
+
+    /* vminq and vmaxq propagate NaN rather than returning b
+     */
+    static inline type min(type a, type b)           { return vminq_f32(a, b); }
+    static inline type max(type a, type b)           { return vmaxq_f32(a, b); }
+    static inline type less(type a, type b)          { return vreinterpretq_f32_u32(vcltq_f32(a, b)); }
+    static inline type blend(type m, type a, type b) { return vbslq_f32(vreinterpretq_u32_f32(m), b, a); }
+    static inline unsigned bits(type m)
+    {
+        const uint32x4_t u = vshrq_n_u32(vreinterpretq_u32_f32(m), 31);
+        return vgetq_lane_u32(u, 0) | vgetq_lane_u32(u, 1) << 1 | vgetq_lane_u32(u, 2) << 2 | vgetq_lane_u32(u, 3) << 3;
+    }
+
+    static inline type cmul(type a, type b)
+    {
+        const float32x4x2_t t = vtrnq_f32(b, b);
+        return madd(vrev64q_f32(a), vmulq_f32(t.val[1], set(-1.0f, 1.0f, -1.0f, 1.0f)), vmulq_f32(a, t.val[0]));
+    }
+
+    static inline type cmulc(type a, type b)
+    {
+        const float32x4x2_t t = vtrnq_f32(b, b);
+        return madd(vrev64q_f32(a), vmulq_f32(t.val[1], set(1.0f, -1.0f, 1.0f, -1.0f)), vmulq_f32(a, t.val[0]));
+    }
+
+    static inline type pairsum(type a, type b)
+    {
+        return vcombine_f32(vpadd_f32(vget_low_f32(a), vget_high_f32(a)), vpadd_f32(vget_low_f32(b), vget_high_f32(b)));
+    }
+
+    static inline float hsum(type a)
+    {
+#if defined(SIMD_NEON64)
+        return vaddvq_f32(a);
+#else
+        float32x2_t s = vadd_f32(vget_low_f32(a), vget_high_f32(a));
+        return vget_lane_f32(vpadd_f32(s, s), 0);
+#endif
+    }
+
+    static inline type yzx(type a)
+    {
+        /* (x, y, z, w) -> (y, z, w, x) -> (y, z, x, w) */
+        float32x4_t r = vextq_f32(a, a, 1);
+        return vsetq_lane_f32(vgetq_lane_f32(a, 3), vsetq_lane_f32(vgetq_lane_f32(a, 0), r, 2), 3);
+    }
+
+    static inline type zxy(type a)
+    {
+        return yzx(yzx(a));
+    }
+
+    static inline void transpose(type &a, type &b, type &c, type &d)
+    {
+        const float32x4x2_t ab = vtrnq_f32(a, b);
+        const float32x4x2_t cd = vtrnq_f32(c, d);
+        a = vcombine_f32(vget_low_f32(ab.val[0]),  vget_low_f32(cd.val[0]));
+        b = vcombine_f32(vget_low_f32(ab.val[1]),  vget_low_f32(cd.val[1]));
+        c = vcombine_f32(vget_high_f32(ab.val[0]), vget_high_f32(cd.val[0]));
+        d = vcombine_f32(vget_high_f32(ab.val[1]), vget_high_f32(cd.val[1]));
+    }
+};
+
+#if defined(SIMD_NEON64)
+struct Double4
+{
+    float64x2_t lo;
+    float64x2_t hi;
+};
+
+template <>
+struct Pack<double, 4>
+{
+    static constexpr bool enabled = true;
+    static constexpr int  align   = 16;
+    typedef Double4 type;
+
+    static inline type load(const double *p)         { return {vld1q_f64(p), vld1q_f64(p + 2)}; }
+    static inline void store(double *p, type a)      { vst1q_f64(p, a.lo); vst1q_f64(p + 2, a.hi); }
+    static inline type loadu(const double *p)        { return load(p); }
+    static inline void storeu(double *p, type a)     { store(p, a); }
+    static inline type set1(double c)                { return {vdupq_n_f64(c), vdupq_n_f64(c)}; }
+    static inline type set(double x, double y, double z, double w)
+    {
+        const double v[4] = {x, y, z, w};
+        return load(v);
+    }
+    static inline type add(type a, type b)           { return {vaddq_f64(a.lo, b.lo), vaddq_f64(a.hi, b.hi)}; }
+    static inline type sub(type a, type b)           { return {vsubq_f64(a.lo, b.lo), vsubq_f64(a.hi, b.hi)}; }
+    static inline type mul(type a, type b)           { return {vmulq_f64(a.lo, b.lo), vmulq_f64(a.hi, b.hi)}; }
+    static inline type div(type a, type b)           { return {vdivq_f64(a.lo, b.lo), vdivq_f64(a.hi, b.hi)}; }
+    static inline type sqrt(type a)                  { return {vsqrtq_f64(a.lo), vsqrtq_f64(a.hi)}; }
+    static inline type rsqrt(type a)                 { return div(set1(1.0), sqrt(a)); }
+    static inline type madd(type a, type b, type c)  { return {vfmaq_f64(c.lo, a.lo, b.lo), vfmaq_f64(c.hi, a.hi, b.hi)}; }
+
+    /* vminq and vmaxq propagate NaN rather than returning b
+     */
+    static inline type min(type a, type b)           { return {vminq_f64(a.lo, b.lo), vminq_f64(a.hi, b.hi)}; }
+    static inline type max(type a, type b)           { return {vmaxq_f64(a.lo, b.lo), vmaxq_f64(a.hi, b.hi)}; }
+    static inline type less(type a, type b)
+    {
+        return {vreinterpretq_f64_u64(vcltq_f64(a.lo, b.lo)), vreinterpretq_f64_u64(vcltq_f64(a.hi, b.hi))};
+    }
+    static inline type blend(type m, type a, type b)
+    {
+        return {vbslq_f64(vreinterpretq_u64_f64(m.lo), b.lo, a.lo), vbslq_f64(vreinterpretq_u64_f64(m.hi), b.hi, a.hi)};
+    }
+    static inline unsigned bits(type m)
+    {
+        const uint64x2_t lo = vshrq_n_u64(vreinterpretq_u64_f64(m.lo), 63), hi = vshrq_n_u64(vreinterpretq_u64_f64(m.hi), 63);
+        return (unsigned)(vgetq_lane_u64(lo, 0) | vgetq_lane_u64(lo, 1) << 1 | vgetq_lane_u64(hi, 0) << 2 | vgetq_lane_u64(hi, 1) << 3);
+    }
+
+    static inline type cmul(type a, type b)
+    {
+        const double sign[2] = {-1.0, 1.0};
+        return {pair(a.lo, b.lo, vld1q_f64(sign)), pair(a.hi, b.hi, vld1q_f64(sign))};
+    }
+
+    static inline type cmulc(type a, type b)
+    {
+        const double sign[2] = {1.0, -1.0};
+        return {pair(a.lo, b.lo, vld1q_f64(sign)), pair(a.hi, b.hi, vld1q_f64(sign))};
+    }
+
+    static inline type pairsum(type a, type b)
+    {
+        return {vpaddq_f64(a.lo, a.hi), vpaddq_f64(b.lo, b.hi)};
+    }
+
+    static inline float64x2_t pair(float64x2_t a, float64x2_t b, float64x2_t sign)
+    {
+        return vfmaq_f64(vmulq_f64(a, vdupq_laneq_f64(b, 0)), vextq_f64(a, a, 1), vmulq_f64(vdupq_laneq_f64(b, 1), sign));
+    }
+
+    static inline double hsum(type a)
+    {
+        return vaddvq_f64(vaddq_f64(a.lo, a.hi));
+    }
+
+    static inline type yzx(type a) { return {vextq_f64(a.lo, a.hi, 1), vcombine_f64(vget_low_f64(a.lo), vget_high_f64(a.hi))}; }
+    static inline type zxy(type a) { return {vzip1q_f64(a.hi, a.lo), vzip2q_f64(a.lo, a.hi)}; }
+
+    static inline void transpose(type &a, type &b, type &c, type &d)
+    {
+        const type t0 = {vzip1q_f64(a.lo, b.lo), vzip1q_f64(c.lo, d.lo)};
+        const type t1 = {vzip2q_f64(a.lo, b.lo), vzip2q_f64(c.lo, d.lo)};
+        const type t2 = {vzip1q_f64(a.hi, b.hi), vzip1q_f64(c.hi, d.hi)};
+        const type t3 = {vzip2q_f64(a.hi, b.hi), vzip2q_f64(c.hi, d.hi)};
+        a = t0;
+        b = t1;
+        c = t2;
+        d = t3;
+    }
+};
+#endif
+#endif /* SIMD_NEON */
+
+/* Widest register available for T, used by the array kernels
+ */
+template <class T>
+struct Widest
+{
+#if defined(SIMD_AVX)
+    static constexpr int width = sizeof(T) == 4 ? 8 : 4;
+#else
+    static constexpr int width = 4;
+#endif
+    typedef Pack<T, width> type;
+};
+
+/* Gather<T> loads the width lanes base[index[0]], ..., base[index[width - 1]]
+ * of a Widest<T> register, indices below 2^31. Only AVX2 has the instruction,
+ * enabled is false elsewhere.
+ */
+template <class T>
+struct Gather
+{
+    static constexpr bool enabled = false;
+    static constexpr int  width   = 1;
+};
+
+#if defined(SIMD_AVX2)
+template <>
+struct Gather<float>
+{
+    static constexpr bool enabled = true;
+    static constexpr int  width   = 8;
+    typedef Pack<float, 8> pack;
+
+    static inline pack::type load(const float *base, const unsigned *index)
+    {
+        return _mm256_i32gather_ps(base, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(index)), 4);
+    }
+};
+
+template <>
+struct Gather<double>
+{
+    static constexpr bool enabled = true;
+    static constexpr int  width   = 4;
+    typedef Pack<double, 4> pack;
+
+    static inline pack::type load(const double *base, const unsigned *index)
+    {
+        /* The masked form, the plain one leaving its source undefined */
+        const __m256d zero = _mm256_setzero_pd();
+        return _mm256_mask_i32gather_pd(zero, base, _mm_loadu_si128(reinterpret_cast<const __m128i *>(index)),
+                                        _mm256_cmp_pd(zero, zero, _CMP_EQ_OQ), 8);
+    }
+};
+#endif
+
+/* Storage layout of a Vector<N, T>
+ * 3 and 4 element float/double vectors are padded to a full register and
+ * aligned to it, so that every operation is one aligned load and store.
+ * The padding lane is always kept at zero.
+ */
+template <int N, class T>
+struct Layout
+{
+    static constexpr bool vector = (N == 3 || N == 4) && Pack<T, 4>::enabled;
+    static constexpr int  size   = vector ? 4 : N;
+    static constexpr int  align  = vector ? Pack<T, 4>::align : alignof(T);
+};
+
+/* 1 / sqrt(x) of a single value, through the float register estimate
+ * when there is one and the exact quotient otherwise
+ */
+template <class T>
+inline T rsqrt(T x)
+{
+    if constexpr(std::is_same<T, float>::value && Pack<T, 4>::enabled)
+    {
+        alignas(Pack<T, 4>::align) T r[4];
+        Pack<T, 4>::store(r, Pack<T, 4>::rsqrt(Pack<T, 4>::set1(x)));
+        return r[0];
+    }
+    else
+    {
+        return T(1) / std::sqrt(x);
+    }
+}
+
+} /* namespace simd */
+
+#endif /* SIMD_HH */
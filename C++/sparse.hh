@@ -0,0 +1,722 @@
+/* sparse.hh */
+#ifndef SPARSE_HH
+#define SPARSE_HH
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "dynmatrix.hh"
+#include "instrument.hh"
+#include "matrix.hh"
+#include "parallel.hh"
+#include "simd.hh"
+#include "vector.hh"
+
+/* Entry (row, column) = value of a matrix in coordinate form
+ */
+template <typename T>
+struct Triplet
+{
+	size_t row;
+	size_t column;
+	T value;
+};
+
+/* Outcome of SparseMatrix::solve, residual being |b - a x| / |b| after the
+ * given number of iterations
+ */
+template <typename T>
+struct Convergence
+{
+	size_t iterations;
+	T residual;
+	bool converged;
+};
+
+/* Compressed sparse matrix, CSR in row-major order and CSC in column-major
+ * The nonzeros of outer line o (row o in CSR, column o in CSC) are
+ * values()[offsets()[o] .. offsets()[o + 1]), their inner coordinates in
+ * indices() being sorted and unique. Coordinates are 32 bit, which keeps
+ * the index traffic of the products at half that of size_t and fits the
+ * gather instructions, so both dimensions stay below 2^31.
+ * The products take an optional parallel::Policy. CSR products split the
+ * rows into chunks of equal nonzero counts, each row being summed by one
+ * thread, so results do not depend on the number of threads.
+ * Mismatched dimensions throw std::invalid_argument.
+ */
+template <typename T>
+class SparseMatrix
+{
+public:
+	typedef Triplet<T> triplet;
+
+	/* Zero matrix
+	 */
+	SparseMatrix(size_t rows = 0, size_t columns = 0, MatrixOrder order = MatrixOrder::RowMajor)
+	{
+		SparseMatrix::bound(rows, columns);
+		this->_rows    = rows;
+		this->_columns = columns;
+		this->_order   = order;
+		this->_offsets.assign(this->outer() + 1, 0);
+	}
+
+	/* From count triplets in any order, duplicates being summed
+	 */
+	SparseMatrix(size_t rows, size_t columns, const Triplet<T> *t, size_t count, MatrixOrder order = MatrixOrder::RowMajor)
+		: SparseMatrix(rows, columns, order)
+	{
+		this->assemble(t, count);
+	}
+
+	SparseMatrix(size_t rows, size_t columns, const std::vector<Triplet<T>> &t, MatrixOrder order = MatrixOrder::RowMajor)
+		: SparseMatrix(rows, columns, t.data(), t.size(), order)
+	{
+	}
+
+	/* The nonzero elements of a dense matrix
+	 */
+	explicit SparseMatrix(const DynMatrix<T> &a, MatrixOrder order = MatrixOrder::RowMajor)
+		: SparseMatrix(a.rows(), a.columns(), order)
+	{
+		const bool rows = order == MatrixOrder::RowMajor;
+		for(size_t o = 0; o < this->outer(); ++o)
+		{
+			for(size_t i = 0; i < this->inner(); ++i)
+			{
+				const T v = rows ? a.elem(o, i) : a.elem(i, o);
+				if(v != T())
+				{
+					this->_indices.push_back((unsigned)i);
+					this->_values.push_back(v);
+				}
+			}
+			this->_offsets[o + 1] = this->_indices.size();
+		}
+	}
+
+	template <unsigned R, unsigned C>
+	explicit SparseMatrix(const Matrix<R, C, T> &a, MatrixOrder order = MatrixOrder::RowMajor)
+		: SparseMatrix(DynMatrix<T>(a), order)
+	{
+	}
+
+	inline size_t rows(void) const
+	{
+		return this->_rows;
+	}
+
+	inline size_t columns(void) const
+	{
+		return this->_columns;
+	}
+
+	inline size_t nonzeros(void) const
+	{
+		return this->_values.size();
+	}
+
+	inline MatrixOrder order(void) const
+	{
+		return this->_order;
+	}
+
+	/* The compressed arrays, offsets() holding one entry per outer line and
+	 * one past the last. The values may be changed in place, the structure
+	 * may not.
+	 */
+	inline const size_t *offsets(void) const
+	{
+		return this->_offsets.data();
+	}
+
+	inline const unsigned *indices(void) const
+	{
+		return this->_indices.data();
+	}
+
+	inline const T *values(void) const
+	{
+		return this->_values.data();
+	}
+
+	inline T *values(void)
+	{
+		return this->_values.data();
+	}
+
+	/* Element (i, j), zero when it is not stored, by binary search within
+	 * its line. No bounds checking is done.
+	 */
+	T elem(size_t i, size_t j) const
+	{
+		const size_t o = this->_order == MatrixOrder::RowMajor ? i : j;
+		const unsigned k = (unsigned)(this->_order == MatrixOrder::RowMajor ? j : i);
+		const unsigned *begin = this->_indices.data() + this->_offsets[o];
+		const unsigned *end   = this->_indices.data() + this->_offsets[o + 1];
+		const unsigned *p     = std::lower_bound(begin, end, k);
+		return p != end && *p == k ? this->_values[(size_t)(p - this->_indices.data())] : T();
+	}
+
+	DynMatrix<T> dense(MatrixOrder order = MatrixOrder::RowMajor) const
+	{
+		DynMatrix<T> a(this->rows(), this->columns(), order);
+		const bool rows = this->_order == MatrixOrder::RowMajor;
+		for(size_t o = 0; o < this->outer(); ++o)
+		{
+			for(size_t p = this->_offsets[o]; p < this->_offsets[o + 1]; ++p)
+			{
+				(rows ? a(o, this->_indices[p]) : a(this->_indices[p], o)) = this->_values[p];
+			}
+		}
+		return a;
+	}
+
+	/* The CSR form of a is the CSC form of a^T, so this only swaps the
+	 * dimensions and the order around a copy of the arrays
+	 */
+	SparseMatrix transpose(void) const
+	{
+		SparseMatrix a(*this);
+		std::swap(a._rows, a._columns);
+		a._order = this->_order == MatrixOrder::RowMajor ? MatrixOrder::ColumnMajor : MatrixOrder::RowMajor;
+		return a;
+	}
+
+	/* Copy of this compressed in the given order, by one counting pass over
+	 * the nonzeros
+	 */
+	SparseMatrix reorder(MatrixOrder order) const
+	{
+		if(order == this->_order)
+			return (*this);
+
+		SparseMatrix a(this->rows(), this->columns(), order);
+		for(size_t p = 0; p < this->nonzeros(); ++p)
+		{
+			++a._offsets[(size_t)this->_indices[p] + 1];
+		}
+		for(size_t o = 0; o < a.outer(); ++o)
+		{
+			a._offsets[o + 1] += a._offsets[o];
+		}
+		a._indices.resize(this->nonzeros());
+		a._values.resize(this->nonzeros());
+
+		std::vector<size_t> next(a._offsets.begin(), a._offsets.end() - 1);
+		for(size_t o = 0; o < this->outer(); ++o)
+		{
+			for(size_t p = this->_offsets[o]; p < this->_offsets[o + 1]; ++p)
+			{
+				const size_t q = next[this->_indices[p]]++;
+				a._indices[q] = (unsigned)o;
+				a._values[q]  = this->_values[p];
+			}
+		}
+		return a;
+	}
+
+	/* y = this * x, x holding columns() elements and y rows(), which may
+	 * not overlap
+	 * CSR takes one dot product per row, gathering x in Gather<T>::width
+	 * lanes where the target has a gather. CSC scatters the columns into
+	 * y, and into one partial result per extra chunk when run in parallel.
+	 */
+	void multiply(const T *x, T *y, const parallel::Policy &policy = parallel::seq) const
+	{
+		const instrument::Scope scope(instrument::Kernel::SparseMultiply, 2 * (uint64_t)this->nonzeros());
+		const size_t chunks = this->chunks(policy);
+		if(this->_order == MatrixOrder::RowMajor)
+		{
+			policy.run(chunks, [this, x, y, chunks](size_t i) {
+				const size_t end = this->split(i + 1, chunks);
+				for(size_t r = this->split(i, chunks); r < end; ++r)
+				{
+					const size_t p = this->_offsets[r];
+					y[r] = SparseMatrix::dot(this->_values.data() + p, this->_indices.data() + p, this->_offsets[r + 1] - p, x);
+				}
+			});
+			return;
+		}
+
+		std::fill(y, y + this->rows(), T());
+		if(chunks <= 1)
+		{
+			this->scatter(0, this->columns(), x, y);
+			return;
+		}
+		const size_t n = this->rows();
+		std::vector<T> partial((chunks - 1) * n, T());
+		policy.run(chunks, [this, x, y, n, chunks, &partial](size_t i) {
+			this->scatter(this->split(i, chunks), this->split(i + 1, chunks), x, i == 0 ? y : partial.data() + (i - 1) * n);
+		});
+		policy.range(n, 4096, [y, n, chunks, &partial](size_t begin, size_t end) {
+			for(size_t k = 1; k < chunks; ++k)
+			{
+				const T *z = partial.data() + (k - 1) * n;
+				for(size_t r = begin; r < end; ++r)
+				{
+					y[r] += z[r];
+				}
+			}
+		});
+	}
+
+	template <int M, int N>
+	void multiply(const Vector<N, T> &x, Vector<M, T> &y, const parallel::Policy &policy = parallel::seq) const
+	{
+		if(this->rows() != (size_t)M || this->columns() != (size_t)N)
+			throw std::invalid_argument("Matrix and vector dimensions do not match");
+		this->multiply(&x[0], &y[0], policy);
+	}
+
+	/* The result takes the order of b
+	 */
+	DynMatrix<T> multiply(const DynMatrix<T> &b, const parallel::Policy &policy = parallel::seq) const
+	{
+		DynMatrix<T> c(this->rows(), b.columns(), b.order());
+		SparseMatrix::multiply(*this, b, c, policy);
+		return c;
+	}
+
+	/* c += a * b
+	 * Row-major b and c are walked a row of c at a time, up to 4 registers
+	 * of it staying in registers while the rows of b selected by the
+	 * nonzeros stream past. CSC operands are compressed to CSR first, one
+	 * pass over the nonzeros next to the columns() passes of the product,
+	 * and column-major dense operands are reordered around it. A single
+	 * column takes the matrix-vector product.
+	 */
+	static void multiply(const SparseMatrix &a, const DynMatrix<T> &b, DynMatrix<T> &c,
+	                     const parallel::Policy &policy = parallel::seq)
+	{
+		if(a.columns() != b.rows() || c.rows() != a.rows() || c.columns() != b.columns())
+			throw std::invalid_argument("Matrix dimensions do not match");
+
+		if(b.columns() == 1)
+		{
+			std::vector<T> x(b.rows()), y(c.rows());
+			for(size_t i = 0; i < x.size(); ++i)
+			{
+				x[i] = b(i, 0);
+			}
+			a.multiply(x.data(), y.data(), policy);
+			for(size_t i = 0; i < y.size(); ++i)
+			{
+				c(i, 0) += y[i];
+			}
+			return;
+		}
+		if(a.order() != MatrixOrder::RowMajor)
+		{
+			SparseMatrix::multiply(a.reorder(MatrixOrder::RowMajor), b, c, policy);
+			return;
+		}
+		if(b.order() != MatrixOrder::RowMajor)
+		{
+			SparseMatrix::multiply(a, b.reorder(MatrixOrder::RowMajor), c, policy);
+			return;
+		}
+		if(c.order() != MatrixOrder::RowMajor)
+		{
+			DynMatrix<T> r = c.reorder(MatrixOrder::RowMajor);
+			SparseMatrix::multiply(a, b, r, policy);
+			c = r.reorder(MatrixOrder::ColumnMajor);
+			return;
+		}
+
+		const instrument::Scope scope(instrument::Kernel::SparseMultiply, 2 * (uint64_t)a.nonzeros() * b.columns());
+		const size_t chunks = a.chunks(policy);
+		policy.run(chunks, [&a, &b, &c, chunks](size_t i) {
+			const size_t end = a.split(i + 1, chunks);
+			for(size_t r = a.split(i, chunks); r < end; ++r)
+			{
+				const size_t p = a._offsets[r];
+				SparseMatrix::row(a._values.data() + p, a._indices.data() + p, a._offsets[r + 1] - p,
+				                  b.columns(), b.data(), b.ld(), c.data() + r * c.ld());
+			}
+		});
+	}
+
+	inline DynMatrix<T> operator *(const DynMatrix<T> &b) const
+	{
+		return this->multiply(b);
+	}
+
+	/* Solves this * x = b by conjugate gradients, this being symmetric
+	 * positive definite, with x holding the initial guess on entry
+	 * The residual is preconditioned by the inverse diagonal (Jacobi), which
+	 * costs one product per element and evens out badly scaled rows. Stops
+	 * once |b - this x| <= tolerance |b| or after limit iterations, rows()
+	 * when 0. Every step is one matrix-vector product and three passes over
+	 * the vectors, the reductions being summed in fixed chunks so that the
+	 * iterates do not depend on the number of threads.
+	 */
+	Convergence<T> solve(const T *b, T *x, T tolerance = std::sqrt(std::numeric_limits<T>::epsilon()), size_t limit = 0,
+	                     const parallel::Policy &policy = parallel::seq) const
+	{
+		static_assert(!std::is_integral<T>::value, "Conjugate gradients require a field type");
+
+		if(this->rows() != this->columns())
+			throw std::invalid_argument("Conjugate gradients are only defined for square matrices");
+
+		const instrument::Scope scope(instrument::Kernel::SparseSolve);
+
+		const size_t n = this->rows();
+		if(limit == 0)
+			limit = n;
+
+		std::vector<T> d(n), r(n), z(n), p(n), q(n);
+		for(size_t i = 0; i < n; ++i)
+		{
+			const T e = this->elem(i, i);
+			d[i] = e != T() ? T(1) / e : T(1);
+		}
+
+		const T bb = SparseMatrix::reduce<1>(n, policy, [b](size_t begin, size_t end) {
+			return std::array<T, 1>{SparseMatrix::dot(b + begin, b + begin, end - begin)};
+		})[0];
+		if(bb == T())
+		{
+			std::fill(x, x + n, T());
+			return Convergence<T>{0, T(), true};
+		}
+
+		this->multiply(x, q.data(), policy);
+		std::array<T, 2> s = SparseMatrix::reduce<2>(n, policy, [&](size_t begin, size_t end) {
+			for(size_t i = begin; i < end; ++i)
+			{
+				r[i] = b[i] - q[i];
+				z[i] = d[i] * r[i];
+				p[i] = z[i];
+			}
+			return std::array<T, 2>{
+				SparseMatrix::dot(r.data() + begin, r.data() + begin, end - begin),
+				SparseMatrix::dot(r.data() + begin, z.data() + begin, end - begin)
+			};
+		});
+
+		const T goal = tolerance * tolerance * bb;
+		size_t k = 0;
+		while(goal < s[0] && k < limit)
+		{
+			this->multiply(p.data(), q.data(), policy);
+			const T pq = SparseMatrix::reduce<1>(n, policy, [&](size_t begin, size_t end) {
+				return std::array<T, 1>{SparseMatrix::dot(p.data() + begin, q.data() + begin, end - begin)};
+			})[0];
+			if(!(pq > T()))
+				break;
+
+			const T alpha = s[1] / pq;
+			const std::array<T, 2> t = SparseMatrix::reduce<2>(n, policy, [&](size_t begin, size_t end) {
+				return SparseMatrix::step(alpha, p.data(), q.data(), d.data(), x, r.data(), z.data(), begin, end);
+			});
+			const T beta = t[1] / s[1];
+			s = t;
+			++k;
+
+			if(!(goal < s[0]))
+				break;
+			policy.range(n, 16384, [&](size_t begin, size_t end) {
+				for(size_t i = begin; i < end; ++i)
+				{
+					p[i] = z[i] + beta * p[i];
+				}
+			});
+		}
+		const T residual = std::sqrt(s[0] / bb);
+		return Convergence<T>{k, residual, !(goal < s[0])};
+	}
+
+	template <int N>
+	Convergence<T> solve(const Vector<N, T> &b, Vector<N, T> &x, T tolerance = std::sqrt(std::numeric_limits<T>::epsilon()),
+	                     size_t limit = 0, const parallel::Policy &policy = parallel::seq) const
+	{
+		if(this->rows() != (size_t)N)
+			throw std::invalid_argument("Matrix and vector dimensions do not match");
+		return this->solve(&b[0], &x[0], tolerance, limit, policy);
+	}
+
+	/* b and x being single columns
+	 */
+	Convergence<T> solve(const DynMatrix<T> &b, DynMatrix<T> &x, T tolerance = std::sqrt(std::numeric_limits<T>::epsilon()),
+	                     size_t limit = 0, const parallel::Policy &policy = parallel::seq) const
+	{
+		if(b.columns() != 1 || x.columns() != 1 || b.rows() != this->rows() || x.rows() != this->rows())
+			throw std::invalid_argument("Solve takes single columns matching the matrix");
+
+		std::vector<T> u(b.rows()), v(x.rows());
+		for(size_t i = 0; i < u.size(); ++i)
+		{
+			u[i] = b(i, 0);
+			v[i] = x(i, 0);
+		}
+		const Convergence<T> c = this->solve(u.data(), v.data(), tolerance, limit, policy);
+		for(size_t i = 0; i < v.size(); ++i)
+		{
+			x(i, 0) = v[i];
+		}
+		return c;
+	}
+private:
+	typedef typename simd::Widest<T>::type Pack;
+
+	static constexpr size_t W = simd::Widest<T>::width;
+
+	/* Nonzeros per parallel chunk, below which a chunk costs more to hand out
+	 * than to run
+	 */
+	static constexpr size_t grain = 16384;
+
+	std::vector<size_t> _offsets;
+	std::vector<unsigned> _indices;
+	std::vector<T> _values;
+	size_t _rows;
+	size_t _columns;
+	MatrixOrder _order;
+
+	static void bound(size_t rows, size_t columns)
+	{
+		const size_t most = (size_t)std::numeric_limits<int>::max();
+		if(rows > most || columns > most)
+			throw std::length_error("SparseMatrix dimensions are limited to 2^31 - 1");
+	}
+
+	inline size_t outer(void) const
+	{
+		return this->_order == MatrixOrder::RowMajor ? this->_rows : this->_columns;
+	}
+
+	inline size_t inner(void) const
+	{
+		return this->_order == MatrixOrder::RowMajor ? this->_columns : this->_rows;
+	}
+
+	/* Buckets the triplets by outer line, then sorts every line by inner
+	 * coordinate, summing duplicates in the order they were given
+	 */
+	void assemble(const Triplet<T> *t, size_t count)
+	{
+		const bool rows = this->_order == MatrixOrder::RowMajor;
+		std::vector<size_t> start(this->outer() + 1, 0);
+		for(size_t k = 0; k < count; ++k)
+		{
+			if(t[k].row >= this->rows() || t[k].column >= this->columns())
+				throw std::invalid_argument("Triplet outside of the matrix");
+			++start[(rows ? t[k].row : t[k].column) + 1];
+		}
+		for(size_t o = 0; o < this->outer(); ++o)
+		{
+			start[o + 1] += start[o];
+		}
+
+		std::vector<std::pair<unsigned, T>> e(count);
+		std::vector<size_t> next(start.begin(), start.end() - 1);
+		for(size_t k = 0; k < count; ++k)
+		{
+			e[next[rows ? t[k].row : t[k].column]++] = std::make_pair((unsigned)(rows ? t[k].column : t[k].row), t[k].value);
+		}
+
+		this->_indices.reserve(count);
+		this->_values.reserve(count);
+		for(size_t o = 0; o < this->outer(); ++o)
+		{
+			std::stable_sort(e.begin() + start[o], e.begin() + start[o + 1], [](const std::pair<unsigned, T> &a, const std::pair<unsigned, T> &b) {
+				return a.first < b.first;
+			});
+			for(size_t k = start[o]; k < start[o + 1]; ++k)
+			{
+				if(this->_indices.size() > this->_offsets[o] && this->_indices.back() == e[k].first)
+				{
+					this->_values.back() += e[k].second;
+					continue;
+				}
+				this->_indices.push_back(e[k].first);
+				this->_values.push_back(e[k].second);
+			}
+			this->_offsets[o + 1] = this->_indices.size();
+		}
+	}
+
+	/* Chunks of about grain nonzeros, a few per thread
+	 */
+	size_t chunks(const parallel::Policy &policy) const
+	{
+		const size_t most = 4 * (size_t)policy.concurrency();
+		const size_t n    = this->nonzeros() / grain;
+		return policy.concurrency() <= 1 || n <= 1 ? 1 : n < most ? n : most;
+	}
+
+	/* First outer line of chunk i of chunks, the chunks splitting the
+	 * nonzeros evenly
+	 */
+	size_t split(size_t i, size_t chunks) const
+	{
+		if(i >= chunks)
+			return this->outer();
+		const size_t target = i * this->nonzeros() / chunks;
+		return (size_t)(std::lower_bound(this->_offsets.begin(), this->_offsets.end(), target) - this->_offsets.begin());
+	}
+
+	/* y += the columns [begin, end) of a CSC matrix times x
+	 */
+	void scatter(size_t begin, size_t end, const T *x, T *y) const
+	{
+		for(size_t j = begin; j < end; ++j)
+		{
+			const T c = x[j];
+			for(size_t p = this->_offsets[j]; p < this->_offsets[j + 1]; ++p)
+			{
+				y[this->_indices[p]] += this->_values[p] * c;
+			}
+		}
+	}
+
+	/* Sum of v[p] * x[index[p]] for p < n
+	 */
+	static T dot(const T *v, const unsigned *index, size_t n, const T *x)
+	{
+		size_t p = 0;
+		T s = T();
+		if constexpr(simd::Gather<T>::enabled)
+		{
+			typedef simd::Gather<T> G;
+			typedef typename G::pack P;
+			if(n >= (size_t)G::width)
+			{
+				typename P::type a = P::set1(T());
+				for(; p + G::width <= n; p += G::width)
+				{
+					a = P::madd(P::loadu(v + p), G::load(x, index + p), a);
+				}
+				s = P::hsum(a);
+			}
+		}
+		for(; p < n; ++p)
+		{
+			s += v[p] * x[index[p]];
+		}
+		return s;
+	}
+
+	/* Sum of a[i] * b[i] for i < n
+	 */
+	static T dot(const T *a, const T *b, size_t n)
+	{
+		size_t i = 0;
+		T s = T();
+		if constexpr(Pack::enabled)
+		{
+			typename Pack::type s0 = Pack::set1(T()), s1 = Pack::set1(T());
+			for(; i + 2 * W <= n; i += 2 * W)
+			{
+				s0 = Pack::madd(Pack::loadu(a + i), Pack::loadu(b + i), s0);
+				s1 = Pack::madd(Pack::loadu(a + i + W), Pack::loadu(b + i + W), s1);
+			}
+			s = Pack::hsum(Pack::add(s0, s1));
+		}
+		for(; i < n; ++i)
+		{
+			s += a[i] * b[i];
+		}
+		return s;
+	}
+
+	/* c[0 .. n) += the sum of v[p] times row index[p] of b, for p < count
+	 */
+	static void row(const T *v, const unsigned *index, size_t count, size_t n, const T *b, size_t ldb, T *c)
+	{
+		size_t j = 0;
+		if constexpr(Pack::enabled)
+		{
+			for(; j + 4 * W <= n; j += 4 * W)
+			{
+				typename Pack::type c0 = Pack::loadu(c + j);
+				typename Pack::type c1 = Pack::loadu(c + j + W);
+				typename Pack::type c2 = Pack::loadu(c + j + 2 * W);
+				typename Pack::type c3 = Pack::loadu(c + j + 3 * W);
+				for(size_t p = 0; p < count; ++p)
+				{
+					const typename Pack::type a = Pack::set1(v[p]);
+					const T *r = b + (size_t)index[p] * ldb + j;
+					c0 = Pack::madd(a, Pack::loadu(r), c0);
+					c1 = Pack::madd(a, Pack::loadu(r + W), c1);
+					c2 = Pack::madd(a, Pack::loadu(r + 2 * W), c2);
+					c3 = Pack::madd(a, Pack::loadu(r + 3 * W), c3);
+				}
+				Pack::storeu(c + j, c0);
+				Pack::storeu(c + j + W, c1);
+				Pack::storeu(c + j + 2 * W, c2);
+				Pack::storeu(c + j + 3 * W, c3);
+			}
+			for(; j + W <= n; j += W)
+			{
+				typename Pack::type c0 = Pack::loadu(c + j);
+				for(size_t p = 0; p < count; ++p)
+				{
+					c0 = Pack::madd(Pack::set1(v[p]), Pack::loadu(b + (size_t)index[p] * ldb + j), c0);
+				}
+				Pack::storeu(c + j, c0);
+			}
+		}
+		for(; j < n; ++j)
+		{
+			T s = c[j];
+			for(size_t p = 0; p < count; ++p)
+			{
+				s += v[p] * b[(size_t)index[p] * ldb + j];
+			}
+			c[j] = s;
+		}
+	}
+
+	/* One fused pass of the solver over [begin, end): x += alpha p,
+	 * r -= alpha q and z = d r, returning r.r and r.z
+	 */
+	static std::array<T, 2> step(T alpha, const T *p, const T *q, const T *d, T *x, T *r, T *z, size_t begin, size_t end)
+	{
+		for(size_t i = begin; i < end; ++i)
+		{
+			x[i] += alpha * p[i];
+			r[i] -= alpha * q[i];
+			z[i]  = d[i] * r[i];
+		}
+		return std::array<T, 2>{
+			SparseMatrix::dot(r + begin, r + begin, end - begin),
+			SparseMatrix::dot(r + begin, z + begin, end - begin)
+		};
+	}
+
+	/* The K sums returned by f(begin, end) over fixed chunks of [0, n),
+	 * added in chunk order whatever the policy
+	 */
+	template <size_t K, class F>
+	static std::array<T, K> reduce(size_t n, const parallel::Policy &policy, const F &f)
+	{
+		const size_t chunks = n / grain > 1 ? n / grain : 1;
+		std::vector<std::array<T, K>> partial(chunks);
+		policy.run(chunks, [n, chunks, &f, &partial](size_t i) {
+			partial[i] = f(i * n / chunks, (i + 1) * n / chunks);
+		});
+		std::array<T, K> s{};
+		for(const std::array<T, K> &a : partial)
+		{
+			for(size_t k = 0; k < K; ++k)
+			{
+				s[k] += a[k];
+			}
+		}
+		return s;
+	}
+};
+
+typedef SparseMatrix<float>  SparseMatrixf;
+typedef SparseMatrix<double> SparseMatrixlf;
+
+#endif /* SPARSE_HH */
@@ -0,0 +1,313 @@
+/* spatial.hh */
+#ifndef SPATIAL_HH
+#define SPATIAL_HH
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+#include "parallel.hh"
+
+/* Query state shared by the spatial indices
+ * A search offers every candidate to take() and skips the parts of the
+ * index whose lower bound exceeds bound(), both in squared distances.
+ */
+namespace spatial
+{
+
+inline constexpr size_t npos = ~size_t(0);
+
+template <class T>
+struct Neighbour
+{
+	size_t index;
+	T quadrance;
+};
+
+template <class T>
+inline bool closer(const Neighbour<T> &a, const Neighbour<T> &b)
+{
+	return a.quadrance < b.quadrance;
+}
+
+/* The single closest candidate
+ */
+template <class T>
+struct Closest
+{
+	Neighbour<T> best{npos, std::numeric_limits<T>::infinity()};
+
+	inline T bound(void) const
+	{
+		return this->best.quadrance;
+	}
+
+	inline void take(size_t index, T d)
+	{
+		if(d < this->best.quadrance)
+			this->best = Neighbour<T>{index, d};
+	}
+};
+
+/* The k closest candidates, kept in heap as a max heap until finish()
+ * sorts them nearest first
+ */
+template <class T>
+struct Nearest
+{
+	size_t k;
+	std::vector<Neighbour<T>> &heap;
+
+	inline T bound(void) const
+	{
+		return this->heap.size() < this->k ? std::numeric_limits<T>::infinity() : this->heap.front().quadrance;
+	}
+
+	inline void take(size_t index, T d)
+	{
+		if(this->heap.size() < this->k)
+		{
+			this->heap.push_back(Neighbour<T>{index, d});
+			std::push_heap(this->heap.begin(), this->heap.end(), closer<T>);
+		}
+		else if(d < this->heap.front().quadrance)
+		{
+			std::pop_heap(this->heap.begin(), this->heap.end(), closer<T>);
+			this->heap.back() = Neighbour<T>{index, d};
+			std::push_heap(this->heap.begin(), this->heap.end(), closer<T>);
+		}
+	}
+
+	inline void finish(void)
+	{
+		std::sort_heap(this->heap.begin(), this->heap.end(), closer<T>);
+	}
+};
+
+/* Every candidate within a squared distance r
+ */
+template <class T>
+struct Radius
+{
+	T r;
+	std::vector<Neighbour<T>> &out;
+
+	inline T bound(void) const
+	{
+		return this->r;
+	}
+
+	inline void take(size_t index, T d)
+	{
+		if(!(this->r < d))
+			this->out.push_back(Neighbour<T>{index, d});
+	}
+};
+
+/* Layout shared by the trees of the spatial indices
+ * A tree over n entries is one depth first array of nodes, a left child
+ * directly following its parent, halved at n / 2 until at most Leaf entries
+ * remain, so that its shape is fixed by n alone and the subtrees below the
+ * top levels can be built in parallel. index holds the index of every entry
+ * in leaf order. Derived stores the rest through allocate(n), writes a leaf
+ * over e[begin .. end) in fill(e, node, begin, end) and an inner node in
+ * divide(e, node, begin, mid, end, right), which also partitions e at mid,
+ * and hands entry i back through entry(i).
+ */
+template <class Derived, class Entry, class Node, size_t Leaf>
+struct Tree
+{
+	std::vector<Node> nodes;
+	std::vector<size_t> index;
+
+	inline size_t size(void) const
+	{
+		return this->index.size();
+	}
+
+	/* Nodes of a tree over n entries
+	 */
+	static size_t count(size_t n)
+	{
+		return n <= Leaf ? 1 : 1 + Tree::count(n / 2) + Tree::count(n - n / 2);
+	}
+
+	/* Builds over entries, which are reordered
+	 * The top levels are split on the calling thread until there are a
+	 * few subtrees per thread, which are then built by the policy.
+	 */
+	void build(std::vector<Entry> &entries, const parallel::Policy &policy)
+	{
+		const size_t n = entries.size();
+		if(n > std::numeric_limits<unsigned>::max())
+			throw std::length_error("spatial::Tree holds at most 2^32 - 1 entries");
+
+		this->nodes.resize(Tree::count(n));
+		this->index.resize(n);
+		this->self().allocate(n);
+
+		std::vector<Task> tasks;
+		const size_t spread = 4 * (size_t)policy.concurrency();
+		this->split(entries.data(), 0, 0, n, spread, spread > 4 ? &tasks : nullptr);
+		policy.run(tasks.size(), [this, &entries, &tasks](size_t i) {
+			this->split(entries.data(), tasks[i].node, tasks[i].begin, tasks[i].end, 1, nullptr);
+		});
+	}
+
+	/* Appends the entries of the tree to entries
+	 */
+	void gather(std::vector<Entry> &entries) const
+	{
+		for(size_t i = 0; i < this->size(); ++i)
+		{
+			entries.push_back(this->self().entry(i));
+		}
+	}
+private:
+	struct Task
+	{
+		size_t node;
+		size_t begin;
+		size_t end;
+	};
+
+	inline Derived &self(void)
+	{
+		return static_cast<Derived &>(*this);
+	}
+
+	inline const Derived &self(void) const
+	{
+		return static_cast<const Derived &>(*this);
+	}
+
+	void split(Entry *e, size_t node, size_t begin, size_t end, size_t spread, std::vector<Task> *tasks)
+	{
+		const size_t n = end - begin;
+		if(n <= Leaf)
+		{
+			this->self().fill(e, node, begin, end);
+			for(size_t i = begin; i < end; ++i)
+			{
+				this->index[i] = e[i].index;
+			}
+			return;
+		}
+		if(tasks != nullptr && spread <= 1)
+		{
+			tasks->push_back(Task{node, begin, end});
+			return;
+		}
+
+		const size_t mid   = begin + n / 2;
+		const size_t right = node + 1 + Tree::count(n / 2);
+		this->self().divide(e, node, begin, mid, end, right);
+		this->split(e, node + 1, begin, mid, spread / 2, tasks);
+		this->split(e, right, mid, end, spread - spread / 2, tasks);
+	}
+};
+
+/* Dynamic index over trees of entries
+ * Entries inserted after a build go to a buffer that becomes a tree of its
+ * own once it holds Buffer of them, trees of similar size being rebuilt as
+ * one. That keeps about log2(size() / Buffer) trees of decreasing size, so
+ * insertion is amortized O(log^2 size()) and queries stay logarithmic as
+ * well. Entry carries its index and quadrance(q), Tree is a spatial::Tree
+ * with a search(q, s) of its own.
+ */
+template <class Tree, class Entry, size_t Buffer>
+class Forest
+{
+public:
+	Forest(void)
+	{
+		this->_size = 0;
+	}
+
+	/* Replaces the contents with one tree over entries, which are reordered
+	 */
+	void build(std::vector<Entry> &entries, const parallel::Policy &policy)
+	{
+		this->clear();
+		if(entries.empty())
+			return;
+
+		this->_trees.emplace_back();
+		this->_trees.back().build(entries, policy);
+		this->_size = entries.size();
+	}
+
+	/* Adds entry, whose index has to be size(), and returns that index
+	 */
+	size_t insert(const Entry &entry)
+	{
+		this->_pending.push_back(entry);
+		if(this->_pending.size() == Buffer)
+			this->merge();
+		return this->_size++;
+	}
+
+	void clear(void)
+	{
+		this->_trees.clear();
+		this->_pending.clear();
+		this->_size = 0;
+	}
+
+	inline size_t size(void) const
+	{
+		return this->_size;
+	}
+
+	inline const std::vector<Tree> &trees(void) const
+	{
+		return this->_trees;
+	}
+
+	/* Entries not in a tree yet
+	 */
+	inline const std::vector<Entry> &pending(void) const
+	{
+		return this->_pending;
+	}
+
+	/* Runs the search of every tree, then offers the buffered entries
+	 */
+	template <class Q, class S>
+	void search(const Q &q, S &s) const
+	{
+		for(const Tree &tree : this->_trees)
+		{
+			tree.search(q, s);
+		}
+		for(const Entry &e : this->_pending)
+		{
+			s.take(e.index, e.quadrance(q));
+		}
+	}
+private:
+	std::vector<Tree> _trees;
+	std::vector<Entry> _pending;
+	size_t _size;
+
+	/* Turns the full buffer into a tree, absorbing the trees no larger than
+	 * what it has collected so far so that sizes keep decreasing
+	 */
+	void merge(void)
+	{
+		std::vector<Entry> entries;
+		entries.swap(this->_pending);
+		while(!this->_trees.empty() && this->_trees.back().size() <= entries.size())
+		{
+			this->_trees.back().gather(entries);
+			this->_trees.pop_back();
+		}
+		this->_trees.emplace_back();
+		this->_trees.back().build(entries, parallel::seq);
+	}
+};
+
+} /* namespace spatial */
+
+#endif /* SPATIAL_HH */
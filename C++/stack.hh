@@ -5,147 +5,178 @@
 #include <cstddef>
 #include <cstring>
 #include <exception>
+#include <memory>
+#include <memory_resource>
+#include <new>
 #include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include "instrument.hh"
 
-template <typename T>
-class Stack
+/* What push() and emplace() do on a full stack
+ * Grow reallocates to capacity() * growth(), Throw raises std::overflow_error
+ */
+enum class StackOverflow
+{
+	Grow,
+	Throw
+};
+
+/* Forth word set shared by Stack and InlineStack, over the storage of
+ * Derived, which provides
+ *   allocate(size)        resizing the storage, keeping the bottom elements
+ *   construct(p, args...) building an element at p
+ *   destruct(p)           destroying the element at p
+ * The words, the overflow policy and the relocation of elements live here,
+ * so the two stacks only differ in where their elements are kept.
+ */
+template <class Derived, typename T>
+class StackWords
 {
 public:
-	Stack(size_t size = 0)
+	/* Grows the capacity to atleast size, never shrinks it
+	 */
+	void reserve(size_t size)
 	{
-		this->_base     = nullptr;
-		this->_pointer  = nullptr;
-		this->_capacity = 0;
-		this->allocate(size);
+		if(size > this->capacity())
+			this->self().allocate(size);
 	}
-	
-	Stack(const Stack &stack)
+
+	void clear(void)
 	{
-		(*this) = stack;
+		this->destroy(this->_base, this->_pointer);
+		this->_pointer = this->_base;
 	}
 
-	void operator =(const Stack &stack)
+	size_t size(void) const
 	{
-		if(this->_base != nullptr)
-			delete[] this->_base;
-		Stack copy      = stack.copy();
-		this->_base     = copy._base;
-		this->_pointer  = copy._pointer;
-		this->_capacity = copy._capacity;
+		return (size_t)(this->_pointer - this->_base);
 	}
 
-	~Stack(void)
+	size_t capacity(void) const
 	{
-		delete[] this->_base;
+		return this->_capacity;
 	}
 
-	/* Constructs a new stack with identical capacity and data
-	 */
-	Stack copy(void) const
+	StackOverflow overflow(void) const
 	{
-		Stack stack(this->capacity());
-		std::memcpy(stack._base, this->_base, this->capacity() * sizeof(T));
-		stack._pointer += this->size();
-		return stack;
+		return this->_overflow;
 	}
-	
-	/* Allocates size * sizeof(T) bytes to the stack
-	 * If memory already allocated, the old data is copied to the resized stack
-	 * If the new size is smaller than the already allocated size, the data is copied
-	 * from the bottom of the stack up to the new size
+
+	void overflow(StackOverflow overflow)
+	{
+		this->_overflow = overflow;
+	}
+
+	double growth(void) const
+	{
+		return this->_growth;
+	}
+
+	/* Factors below 1.5 are raised to 1.5 so that growth stays geometric
 	 */
-	void allocate(size_t size)
+	void growth(double factor)
 	{
-		T *memory     = new T[size];
-		size_t offset = this->size();
+		this->_growth = factor < 1.5 ? 1.5 : factor;
+	}
 
-		if(this->_base != nullptr)
-		{
-			std::memcpy(
-				memory, 
-				this->_base, 
-				(this->_capacity > size ? size : this->_capacity) * sizeof(T)
-			);
-			delete[] this->_base;
-		}
+	void push(const T &x)
+	{
+		this->emplace(x);
+	}
 
-		this->_base     = memory;
-		this->_pointer  = this->_base + offset;
-		this->_capacity = size;
+	void push(T &&x)
+	{
+		this->emplace(std::move(x));
 	}
-	
-	void clear(void)
+
+	/* Constructs the new top in place from args
+	 */
+	template <class... Args>
+	T &emplace(Args &&...args)
 	{
-		this->_pointer = this->_base;
+		if(this->size() >= this->capacity())
+			return this->full(std::forward<Args>(args)...);
+		return this->emplace_unsafe(std::forward<Args>(args)...);
 	}
 
-	size_t size(void) const
+	/* Constructs the new top in place without checking the capacity
+	 */
+	template <class... Args>
+	inline T &emplace_unsafe(Args &&...args)
 	{
-		return (size_t)(this->_pointer - this->_base);
+		T *p = this->_pointer;
+		this->self().construct(p, std::forward<Args>(args)...);
+		++this->_pointer;
+		instrument::maximum(instrument::Counter::StackHighWater, this->size());
+		return *p;
 	}
-	
-	size_t capacity(void) const
+
+	inline void push_unsafe(const T &x)
 	{
-		return this->_capacity;
+		this->emplace_unsafe(x);
 	}
 
-	void push(const T &x)
+	inline void push_unsafe(T &&x)
 	{
-		if(this->size() >= this->capacity())
-			throw std::overflow_error("Stack overflow");
-		*(this->_pointer++) = x;
+		this->emplace_unsafe(std::move(x));
 	}
-	
+
 	T pop(void)
 	{
 		if(this->size() <= 0)
-			throw std::underflow_error("Stack underflow");
-		return *(--this->_pointer);
+			StackWords::underflow();
+		return this->pop_unsafe();
 	}
-	
+
+	/* ( xn .. x0 -- xn .. x0 xn )
+	 */
 	void pick(size_t n)
 	{
 		if(this->size() <= n)
-			throw std::underflow_error("Stack underflow");
-		this->push(this->_pointer[-(int)(n+1)]);
-	} 
+			StackWords::underflow();
+		this->push(this->_pointer[-(long long)(n+1)]);
+	}
 
+	/* ( xn .. x0 -- xn-1 .. x0 xn )
+	 */
 	void roll(size_t n)
 	{
-		this->pick(n);
-		for(long long i = -(long long)(n+2); i <= -2; ++i)
-		{
-			this->_pointer[i] = this->_pointer[i+1];
-		}
-		this->drop();
+		if(this->size() <= n)
+			StackWords::underflow();
+		this->roll_unsafe(n);
 	}
-	
-	inline T peek(void)
+
+	inline T peek(void) const
 	{
-		const T x = this->pop();
-		this->push(x);
-		return x;
+		if(this->size() <= 0)
+			StackWords::underflow();
+		return this->_pointer[-1];
 	}
-	
+
 	/* ( n1 n2 -- n1 n2 n2 )
 	 */
 	inline void dup(void)
 	{
 		this->pick(0);
 	}
-	
+
 	/* ( n1 n2 -- n1 )
 	 */
 	inline void drop(void)
 	{
-		this->pop();
+		if(this->size() <= 0)
+			StackWords::underflow();
+		this->drop_unsafe();
 	}
 
 	/* ( n1 n2 n3 -- n1 n3 n2 )
 	 */
 	inline void swap(void)
 	{
-		this->roll(1);
+		if(this->size() < 2)
+			StackWords::underflow();
+		this->swap_unsafe();
 	}
 
 	/* ( n1 n2 -- n1 n2 n1 )
@@ -159,28 +190,454 @@ public:
 	 */
 	inline void rot(void)
 	{
-		this->roll(2);
+		if(this->size() < 3)
+			StackWords::underflow();
+		this->rot_unsafe();
 	}
 
 	/* ( n1 n2 n3 -- n1 n3 )
 	 */
-	inline void nip(void) 
+	inline void nip(void)
 	{
-		this->swap();
-		this->drop();
+		if(this->size() < 2)
+			StackWords::underflow();
+		this->nip_unsafe();
 	}
-	
+
 	/* ( n1 n2 n3 -- n1 n3 n2 n3 )
 	 */
 	inline void tuck(void)
 	{
-		this->swap();
-		this->over();
+		if(this->size() < 2)
+			StackWords::underflow();
+		if(this->size() >= this->capacity())
+			this->grow();
+		this->tuck_unsafe();
 	}
-private:
+
+	/* The *_unsafe words check nothing, the caller guarantees the depth and,
+	 * for words that push, that there is room (see reserve())
+	 */
+	inline T pop_unsafe(void)
+	{
+		T *p = --this->_pointer;
+		T x(std::move(*p));
+		this->self().destruct(p);
+		return x;
+	}
+
+	inline void pick_unsafe(size_t n)
+	{
+		this->emplace_unsafe(this->_pointer[-(long long)(n+1)]);
+	}
+
+	/* One memmove for trivially copyable types, a loop of moves otherwise
+	 */
+	inline void roll_unsafe(size_t n)
+	{
+		T *top = this->_pointer - 1;
+		T *bottom = top - n;
+		if constexpr(std::is_trivially_copyable<T>::value)
+		{
+			T x(*bottom);
+			std::memmove((void *)bottom, (const void *)(bottom + 1), n * sizeof(T));
+			*top = x;
+		}
+		else
+		{
+			T x(std::move(*bottom));
+			for(T *p = bottom; p != top; ++p)
+			{
+				p[0] = std::move(p[1]);
+			}
+			*top = std::move(x);
+		}
+	}
+
+	inline const T &peek_unsafe(void) const
+	{
+		return this->_pointer[-1];
+	}
+
+	/* Element n below the top, peek_unsafe(0) being the top
+	 */
+	inline T &peek_unsafe(size_t n)
+	{
+		return this->_pointer[-(long long)(n+1)];
+	}
+
+	inline const T &peek_unsafe(size_t n) const
+	{
+		return this->_pointer[-(long long)(n+1)];
+	}
+
+	inline void dup_unsafe(void)
+	{
+		this->pick_unsafe(0);
+	}
+
+	inline void drop_unsafe(void)
+	{
+		this->self().destruct(--this->_pointer);
+	}
+
+	inline void swap_unsafe(void)
+	{
+		T *p = this->_pointer;
+		T x(std::move(p[-1]));
+		p[-1] = std::move(p[-2]);
+		p[-2] = std::move(x);
+	}
+
+	inline void over_unsafe(void)
+	{
+		this->pick_unsafe(1);
+	}
+
+	inline void rot_unsafe(void)
+	{
+		T *p = this->_pointer;
+		T x(std::move(p[-3]));
+		p[-3] = std::move(p[-2]);
+		p[-2] = std::move(p[-1]);
+		p[-1] = std::move(x);
+	}
+
+	inline void nip_unsafe(void)
+	{
+		T *p = this->_pointer;
+		p[-2] = std::move(p[-1]);
+		this->drop_unsafe();
+	}
+
+	inline void tuck_unsafe(void)
+	{
+		T *p = this->_pointer;
+		this->self().construct(p, p[-1]);
+		p[-1] = std::move(p[-2]);
+		p[-2] = p[0];
+		++this->_pointer;
+	}
+protected:
 	T *_base;
 	T *_pointer;
 	size_t _capacity;
+	StackOverflow _overflow;
+	double _growth;
+
+	StackWords(T *base, size_t capacity, StackOverflow overflow, double growth)
+	{
+		this->_base     = base;
+		this->_pointer  = base;
+		this->_capacity = capacity;
+		this->_overflow = overflow;
+		this->growth(growth);
+	}
+
+	~StackWords(void) = default;
+
+	inline Derived &self(void)
+	{
+		return static_cast<Derived &>(*this);
+	}
+
+	/* Reallocates to capacity() * growth(), or throws under StackOverflow::Throw
+	 */
+	void grow(void)
+	{
+		if(this->_overflow == StackOverflow::Throw)
+		{
+			instrument::count(instrument::Counter::Overflows);
+			throw std::overflow_error("Stack overflow");
+		}
+
+		const size_t grown = (size_t)((double)this->capacity() * this->_growth);
+		this->self().allocate(grown > this->capacity() ? grown : this->capacity() + 1);
+	}
+
+	[[noreturn]] static void underflow(void)
+	{
+		instrument::count(instrument::Counter::Underflows);
+		throw std::underflow_error("Stack underflow");
+	}
+
+	/* Slow path of emplace(), the new element is built before growing since
+	 * args may refer to an element of the stack
+	 */
+	template <class... Args>
+	T &full(Args &&...args)
+	{
+		if(this->_overflow == StackOverflow::Throw)
+		{
+			instrument::count(instrument::Counter::Overflows);
+			throw std::overflow_error("Stack overflow");
+		}
+
+		T x(std::forward<Args>(args)...);
+		this->grow();
+		return this->emplace_unsafe(std::move(x));
+	}
+
+	/* Copy constructs [begin, end) on top of this, which has the room
+	 */
+	void append(const T *begin, const T *end)
+	{
+		for(; begin != end; ++begin)
+		{
+			this->self().construct(this->_pointer, *begin);
+			++this->_pointer;
+		}
+	}
+
+	/* Moves count elements from source into uninitialized storage at target,
+	 * leaving the moved from elements to be destroyed. If one throws, those
+	 * already built at target are destroyed again and source is untouched
+	 * (elements without a noexcept move being copied).
+	 */
+	void relocate(T *source, size_t count, T *target)
+	{
+		if constexpr(std::is_trivially_copyable<T>::value)
+		{
+			if(count > 0)
+				std::memcpy((void *)target, (const void *)source, count * sizeof(T));
+		}
+		else
+		{
+			size_t i = 0;
+			try
+			{
+				for(; i < count; ++i)
+				{
+					this->self().construct(target + i, std::move_if_noexcept(source[i]));
+				}
+			}
+			catch(...)
+			{
+				this->destroy(target, target + i);
+				throw;
+			}
+		}
+	}
+
+	void destroy(T *begin, T *end)
+	{
+		if constexpr(!std::is_trivially_destructible<T>::value)
+		{
+			for(; begin != end; ++begin)
+			{
+				this->self().destruct(begin);
+			}
+		}
+	}
+};
+
+/* Storage comes from Allocator, pmr::Stack<T> takes any std::pmr::memory_resource
+ * such as the Arena and FixedPool of arena.hh
+ */
+template <typename T, class Allocator = std::allocator<T>>
+class Stack : public StackWords<Stack<T, Allocator>, T>
+{
+	typedef std::allocator_traits<Allocator> Traits;
+	typedef StackWords<Stack<T, Allocator>, T> Words;
+
+	friend Words;
+
+	static_assert(std::is_same<typename Traits::value_type, T>::value, "Allocator::value_type must be T");
+public:
+	typedef Allocator allocator_type;
+
+	Stack(size_t size = 0, StackOverflow overflow = StackOverflow::Grow, double growth = 2.0,
+	      const Allocator &allocator = Allocator())
+		: Words(nullptr, 0, overflow, growth), _allocator(allocator)
+	{
+		this->allocate(size);
+	}
+
+	explicit Stack(const Allocator &allocator)
+		: Stack(0, StackOverflow::Grow, 2.0, allocator)
+	{
+	}
+
+	Stack(size_t size, const Allocator &allocator)
+		: Stack(size, StackOverflow::Grow, 2.0, allocator)
+	{
+	}
+
+	Stack(const Stack &stack)
+		: Stack(stack, Traits::select_on_container_copy_construction(stack._allocator))
+	{
+	}
+
+	Stack(const Stack &stack, const Allocator &allocator)
+		: Stack(stack.capacity(), stack._overflow, stack._growth, allocator)
+	{
+		this->append(stack._base, stack._pointer);
+	}
+
+	Stack(Stack &&stack) noexcept
+		: Words(nullptr, 0, stack._overflow, stack._growth), _allocator(std::move(stack._allocator))
+	{
+		this->take(stack);
+	}
+
+	Stack &operator =(const Stack &stack)
+	{
+		if(this != &stack)
+		{
+			this->release();
+			if constexpr(Traits::propagate_on_container_copy_assignment::value)
+				this->_allocator = stack._allocator;
+			this->_overflow = stack._overflow;
+			this->_growth   = stack._growth;
+			this->allocate(stack.capacity());
+			this->append(stack._base, stack._pointer);
+		}
+		return (*this);
+	}
+
+	/* Elements are moved one by one when the allocators differ and do not
+	 * propagate, the only case that can throw
+	 */
+	Stack &operator =(Stack &&stack) noexcept(Traits::propagate_on_container_move_assignment::value ||
+	                                          Traits::is_always_equal::value)
+	{
+		if(this != &stack)
+		{
+			this->release();
+			if constexpr(Traits::propagate_on_container_move_assignment::value)
+			{
+				this->_allocator = std::move(stack._allocator);
+				this->take(stack);
+			}
+			else
+			{
+				if(this->_allocator == stack._allocator)
+				{
+					this->take(stack);
+					return (*this);
+				}
+				this->_overflow = stack._overflow;
+				this->_growth   = stack._growth;
+				this->allocate(stack.capacity());
+				for(T *p = stack._base; p != stack._pointer; ++p)
+				{
+					this->construct(this->_pointer, std::move(*p));
+					++this->_pointer;
+				}
+				stack.clear();
+			}
+		}
+		return (*this);
+	}
+
+	~Stack(void)
+	{
+		this->release();
+	}
+
+	/* Constructs a new stack with identical capacity and data
+	 */
+	Stack copy(void) const
+	{
+		return Stack(*this);
+	}
+
+	/* Allocates size * sizeof(T) bytes to the stack
+	 * If memory already allocated, the old data is moved to the resized stack
+	 * If the new size is smaller than the already allocated size, the data is kept
+	 * from the bottom of the stack up to the new size
+	 * The storage is left uninitialized, elements are only constructed by push()
+	 */
+	void allocate(size_t size)
+	{
+		T *memory     = this->acquire(size);
+		size_t offset = this->size() < size ? this->size() : size;
+
+		if(this->_base != nullptr)
+		{
+			instrument::count(instrument::Counter::Reallocations);
+			instrument::count(instrument::Counter::CopiedBytes, offset * sizeof(T));
+			try
+			{
+				this->relocate(this->_base, offset, memory);
+			}
+			catch(...)
+			{
+				this->dispose(memory, size);
+				throw;
+			}
+			this->destroy(this->_base, this->_pointer);
+			this->dispose(this->_base, this->_capacity);
+		}
+
+		this->_base     = memory;
+		this->_pointer  = this->_base + offset;
+		this->_capacity = size;
+	}
+
+	Allocator get_allocator(void) const
+	{
+		return this->_allocator;
+	}
+private:
+	Allocator _allocator;
+
+	template <class... Args>
+	inline void construct(T *p, Args &&...args)
+	{
+		Traits::construct(this->_allocator, p, std::forward<Args>(args)...);
+	}
+
+	inline void destruct(T *p)
+	{
+		Traits::destroy(this->_allocator, p);
+	}
+
+	T *acquire(size_t size)
+	{
+		if(size == 0)
+			return nullptr;
+		instrument::count(instrument::Counter::Allocations);
+		instrument::count(instrument::Counter::AllocatedBytes, size * sizeof(T));
+		return Traits::allocate(this->_allocator, size);
+	}
+
+	void dispose(T *memory, size_t size)
+	{
+		Traits::deallocate(this->_allocator, memory, size);
+	}
+
+	void release(void)
+	{
+		if(this->_base != nullptr)
+		{
+			this->destroy(this->_base, this->_pointer);
+			this->dispose(this->_base, this->_capacity);
+		}
+		this->_base     = nullptr;
+		this->_pointer  = nullptr;
+		this->_capacity = 0;
+	}
+
+	void take(Stack &stack)
+	{
+		this->_base     = stack._base;
+		this->_pointer  = stack._pointer;
+		this->_capacity = stack._capacity;
+		this->_overflow = stack._overflow;
+		this->_growth   = stack._growth;
+		stack._base     = nullptr;
+		stack._pointer  = nullptr;
+		stack._capacity = 0;
+	}
 };
 
+namespace pmr
+{
+
+template <typename T>
+using Stack = ::Stack<T, std::pmr::polymorphic_allocator<T>>;
+
+} /* namespace pmr */
+
 #endif
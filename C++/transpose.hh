@@ -0,0 +1,162 @@
+/* transpose.hh */
+#ifndef TRANSPOSE_HH
+#define TRANSPOSE_HH
+
+#include <cstddef>
+#include <utility>
+#include "simd.hh"
+
+namespace kernel
+{
+
+/* W x W block transposes done in registers, 8x8 for float with AVX and
+ * 4x4 otherwise, W being 1 for types without a register
+ * The blocked kernels below walk TB x TB tiles so that both the rows read
+ * and the rows written stay in L1 while a tile is being done.
+ */
+template <class T>
+struct Transpose
+{
+    typedef typename simd::Widest<T>::type Pack;
+
+    static constexpr size_t W  = Pack::enabled ? simd::Widest<T>::width : 1;
+    static constexpr size_t TB = 32;
+
+    /* b = a^T for the W x W blocks at a and b
+     */
+    static inline void copy(const T *a, size_t lda, T *b, size_t ldb)
+    {
+        if constexpr(W == 1)
+        {
+            b[0] = a[0];
+        }
+        else
+        {
+            typename Pack::type r[W];
+            for(size_t i = 0; i < W; ++i)
+            {
+                r[i] = Pack::loadu(a + i * lda);
+            }
+            Transpose::shuffle(r);
+            for(size_t i = 0; i < W; ++i)
+            {
+                Pack::storeu(b + i * ldb, r[i]);
+            }
+        }
+    }
+
+    /* Replaces the W x W blocks at a and b with each other's transpose,
+     * a may be b for a block on the diagonal
+     */
+    static inline void swap(T *a, T *b, size_t ld)
+    {
+        if constexpr(W == 1)
+        {
+            std::swap(a[0], b[0]);
+        }
+        else
+        {
+            typename Pack::type x[W], y[W];
+            for(size_t i = 0; i < W; ++i)
+            {
+                x[i] = Pack::loadu(a + i * ld);
+                y[i] = Pack::loadu(b + i * ld);
+            }
+            Transpose::shuffle(x);
+            Transpose::shuffle(y);
+            for(size_t i = 0; i < W; ++i)
+            {
+                Pack::storeu(b + i * ld, x[i]);
+                Pack::storeu(a + i * ld, y[i]);
+            }
+        }
+    }
+private:
+    template <class V>
+    static inline void shuffle(V *r)
+    {
+        if constexpr(W == 8)
+            Pack::transpose(r);
+        else
+            Pack::transpose(r[0], r[1], r[2], r[3]);
+    }
+};
+
+/* b[j][i] = a[i][j] for a of size m x n, rows lda and ldb elements apart
+ * a and b must not overlap
+ */
+template <class T>
+void transpose(size_t m, size_t n, const T *a, size_t lda, T *b, size_t ldb)
+{
+    typedef Transpose<T> K;
+
+    for(size_t i0 = 0; i0 < m; i0 += K::TB)
+    {
+        const size_t i1 = (m - i0 < K::TB) ? m : i0 + K::TB;
+        for(size_t j0 = 0; j0 < n; j0 += K::TB)
+        {
+            const size_t j1 = (n - j0 < K::TB) ? n : j0 + K::TB;
+            size_t i = i0;
+            for(; i + K::W <= i1; i += K::W)
+            {
+                size_t j = j0;
+                for(; j + K::W <= j1; j += K::W)
+                {
+                    K::copy(a + i * lda + j, lda, b + j * ldb + i, ldb);
+                }
+                for(; j < j1; ++j)
+                {
+                    for(size_t r = i; r < i + K::W; ++r)
+                    {
+                        b[j * ldb + r] = a[r * lda + j];
+                    }
+                }
+            }
+            for(; i < i1; ++i)
+            {
+                for(size_t j = j0; j < j1; ++j)
+                {
+                    b[j * ldb + i] = a[i * lda + j];
+                }
+            }
+        }
+    }
+}
+
+/* In place transpose of the n x n matrix a, rows lda elements apart
+ * Tiles above the diagonal are exchanged with their mirror image block by
+ * block, the rows and columns past the last whole block element by element.
+ */
+template <class T>
+void transpose(size_t n, T *a, size_t lda)
+{
+    typedef Transpose<T> K;
+
+    const size_t e = n / K::W * K::W;
+    for(size_t i0 = 0; i0 < e; i0 += K::TB)
+    {
+        const size_t i1 = (e - i0 < K::TB) ? e : i0 + K::TB;
+        for(size_t j0 = i0; j0 < e; j0 += K::TB)
+        {
+            const size_t j1 = (e - j0 < K::TB) ? e : j0 + K::TB;
+            for(size_t i = i0; i < i1; i += K::W)
+            {
+                for(size_t j = (j0 == i0) ? i : j0; j < j1; j += K::W)
+                {
+                    K::swap(a + i * lda + j, a + j * lda + i, lda);
+                }
+            }
+        }
+    }
+    for(size_t i = 0; i < n; ++i)
+    {
+        for(size_t j = (e > i + 1) ? e : i + 1; j < n; ++j)
+        {
+            std::swap(a[i * lda + j], a[j * lda + i]);
+        }
+    }
+}
+
+} /* namespace kernel */
+
+#endif /* TRANSPOSE_HH */
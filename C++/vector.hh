@@ -3,75 +3,295 @@
 #define VECTOR_HH
 
 #include <cmath>
-#include <cstring>
 #include <initializer_list>
+#include <type_traits>
+#include "half.hh"
+#include "simd.hh"
 
 template <int N, class T>
-class Vector
+class Vector;
+
+/* Base of the lazily evaluated vector expressions
+ * An expression E provides scalar, size, leaf, operator[] and pack(), the
+ * latter only being called for register sized float/double vectors.
+ * Nothing is computed until the expression is assigned to a Vector, which
+ * then runs a single loop (or a handful of register operations) over the
+ * whole tree. Expressions reference their Vector operands, so they are
+ * meant to be consumed within the statement that builds them, not stored
+ * in an auto variable.
+ */
+template <class E>
+struct VectorExpression
+{
+    constexpr inline const E& self(void) const
+    {
+        return static_cast<const E&>(*this);
+    }
+
+    /* Evaluates into a Vector, Vector itself hides this with a reference to itself
+     */
+    constexpr inline auto eval(void) const
+    {
+        return Vector<E::size, typename E::scalar>(*this);
+    }
+
+    /* The read-only Vector members, each evaluating the expression once, so
+     * that (a - b).magnitude() and the like still compile
+     */
+    template <class V> constexpr auto dot(const V& v) const       { return this->eval().dot(v); }
+    template <class V> constexpr auto cross(const V& v) const     { return this->eval().cross(v); }
+    template <class V> constexpr auto quadrance(const V& v) const { return this->eval().quadrance(v); }
+    template <class V> auto           distance(const V& v) const  { return this->eval().distance(v); }
+    template <class V> constexpr auto proj(const V& v) const      { return this->eval().proj(v); }
+    template <class V> constexpr auto perp(const V& v) const      { return this->eval().perp(v); }
+    template <class V> auto           angle(const V& v) const     { return this->eval().angle(v); }
+    auto           normalize(void) const         { return this->eval().normalize(); }
+    auto           normalize_fast(void) const    { return this->eval().normalize_fast(); }
+    auto           normalize_or_zero(void) const { return this->eval().normalize_or_zero(); }
+    constexpr auto norm(void) const              { return this->eval().norm(); }
+    auto           magnitude(void) const         { return this->eval().magnitude(); }
+    auto           inv_magnitude(void) const     { return this->eval().inv_magnitude(); }
+};
+
+/* Vectors are held by reference, intermediate nodes by value
+ */
+template <class E>
+using VectorOperand = typename std::conditional<E::leaf, const E&, const E>::type;
+
+template <class L, class R>
+struct VectorSum : public VectorExpression<VectorSum<L, R>>
+{
+    static_assert(L::size == R::size, "Vector expressions need to have the same size");
+
+    typedef typename L::scalar scalar;
+    static constexpr int  size = L::size;
+    static constexpr bool leaf = false;
+
+    constexpr VectorSum(const L& l, const R& r) : l(l), r(r) {}
+
+    constexpr inline scalar operator[](int i) const
+    {
+        return this->l[i] + this->r[i];
+    }
+
+    inline auto pack(void) const
+    {
+        return simd::Pack<scalar, 4>::add(this->l.pack(), this->r.pack());
+    }
+
+    VectorOperand<L> l;
+    VectorOperand<R> r;
+};
+
+template <class L, class R>
+struct VectorDifference : public VectorExpression<VectorDifference<L, R>>
+{
+    static_assert(L::size == R::size, "Vector expressions need to have the same size");
+
+    typedef typename L::scalar scalar;
+    static constexpr int  size = L::size;
+    static constexpr bool leaf = false;
+
+    constexpr VectorDifference(const L& l, const R& r) : l(l), r(r) {}
+
+    constexpr inline scalar operator[](int i) const
+    {
+        return this->l[i] - this->r[i];
+    }
+
+    inline auto pack(void) const
+    {
+        return simd::Pack<scalar, 4>::sub(this->l.pack(), this->r.pack());
+    }
+
+    VectorOperand<L> l;
+    VectorOperand<R> r;
+};
+
+/* The padding lane of 3 element vectors is multiplied by zero and divided
+ * by one, so it stays zero whatever c is
+ */
+template <class E>
+struct VectorScale : public VectorExpression<VectorScale<E>>
+{
+    typedef typename E::scalar scalar;
+    static constexpr int  size = E::size;
+    static constexpr bool leaf = false;
+
+    constexpr VectorScale(const E& e, const scalar& c) : e(e), c(c) {}
+
+    constexpr inline scalar operator[](int i) const
+    {
+        return this->e[i] * this->c;
+    }
+
+    inline auto pack(void) const
+    {
+        typedef simd::Pack<scalar, 4> Pack;
+        const auto k = (size == 4) ? Pack::set1(this->c) : Pack::set(this->c, this->c, this->c, scalar(0));
+        return Pack::mul(this->e.pack(), k);
+    }
+
+    VectorOperand<E> e;
+    scalar c;
+};
+
+template <class E>
+struct VectorQuotient : public VectorExpression<VectorQuotient<E>>
+{
+    typedef typename E::scalar scalar;
+    static constexpr int  size = E::size;
+    static constexpr bool leaf = false;
+
+    constexpr VectorQuotient(const E& e, const scalar& c) : e(e), c(c) {}
+
+    constexpr inline scalar operator[](int i) const
+    {
+        return this->e[i] / this->c;
+    }
+
+    inline auto pack(void) const
+    {
+        typedef simd::Pack<scalar, 4> Pack;
+        const auto k = (size == 4) ? Pack::set1(this->c) : Pack::set(this->c, this->c, this->c, scalar(1));
+        return Pack::div(this->e.pack(), k);
+    }
+
+    VectorOperand<E> e;
+    scalar c;
+};
+
+template <int N, class T>
+class Vector : public VectorExpression<Vector<N, T>>
 {
 public:
-    Vector(void);
-    Vector(const T *);
-    Vector(const std::initializer_list<T>&);
+    typedef T scalar;
+    static constexpr int  size = N;
+    static constexpr bool leaf = true;
+
+    constexpr Vector(void);
+    constexpr Vector(const T *);
+    constexpr Vector(const std::initializer_list<T>&);
+    template <class E>
+    constexpr Vector(const VectorExpression<E>&);
+    template <class E>
+    constexpr Vector& operator =(const VectorExpression<E>&);
     template <class U>
-    operator Vector<N, U>(void) const;
+    constexpr operator Vector<N, U>(void) const;
     template <int M, class U>
-    explicit operator Vector<M, U>(void) const;
-    inline const T& operator[](int) const;
-    inline       T& operator[](int);
-
-    T      dot(const Vector&) const;
-    Vector cross(const Vector&) const;
-    T      quadrance(const Vector&) const;
-    auto   distance(const Vector&) const;
-    Vector proj(const Vector&) const;
-    Vector perp(const Vector&) const;
-    Vector normalize(void) const;
-    T      norm(void) const;
-    auto   magnitude(void) const;
-    auto   angle(const Vector&) const;
-
-    inline Vector operator +(void) const;
-    inline Vector operator -(void) const;
-    inline Vector operator +(const Vector&) const;
-    inline Vector operator -(const Vector&) const;
-    inline Vector operator *(const T&) const;
-    inline Vector operator /(const T&) const;
-    inline bool   operator ==(const Vector&) const;
-    inline bool   operator !=(const Vector&) const;
-    Vector operator +=(const Vector&);
-    Vector operator -=(const Vector&);
-    Vector operator *=(const T&);
-    Vector operator /=(const T&);
+    constexpr explicit operator Vector<M, U>(void) const;
+    constexpr inline const T& operator[](int) const;
+    constexpr inline       T& operator[](int);
+    inline auto               pack(void) const;
+    constexpr inline const Vector& eval(void) const;
+
+    constexpr T      dot(const Vector&) const;
+    constexpr Vector cross(const Vector&) const;
+    constexpr T      quadrance(const Vector&) const;
+    auto             distance(const Vector&) const;
+    constexpr Vector proj(const Vector&) const;
+    constexpr Vector perp(const Vector&) const;
+    Vector           normalize(void) const;
+    Vector           normalize_fast(void) const;
+    Vector           normalize_or_zero(void) const;
+    constexpr T      norm(void) const;
+    auto             magnitude(void) const;
+    auto             inv_magnitude(void) const;
+    auto             angle(const Vector&) const;
+
+    constexpr inline Vector operator +(void) const;
+    constexpr inline bool   operator ==(const Vector&) const;
+    constexpr inline bool   operator !=(const Vector&) const;
+    template <class E>
+    constexpr Vector& operator +=(const VectorExpression<E>&);
+    template <class E>
+    constexpr Vector& operator -=(const VectorExpression<E>&);
+    constexpr Vector& operator *=(const T&);
+    constexpr Vector& operator /=(const T&);
 private:
-    T _element[N];
+    typedef simd::Layout<N, T> Layout;
+    typedef simd::Pack<T, 4>   Pack;
+
+    /* Padded to a full register for the 3 and 4 element float/double vectors,
+     * elements past N are always zero
+     */
+    alignas(Layout::align) T _element[Layout::size];
 };
 
 template <int N, class T>
-Vector<N, T>::Vector(void)
+constexpr Vector<N, T>::Vector(void)
+    : _element{}
 {
-    std::memset(this->_element, T(), N * sizeof(T));
 }
 
 template <int N, class T>
-Vector<N, T>::Vector(const T *element)
+constexpr Vector<N, T>::Vector(const T *element)
+    : _element{}
 {
-    std::memcpy(this->_element, element, N * sizeof(T));
+    for(int i = 0; i < N; ++i)
+    {
+        this->_element[i] = element[i];
+    }
 }
 
 template <int N, class T>
-Vector<N, T>::Vector(const std::initializer_list<T> &aggregate)
+constexpr Vector<N, T>::Vector(const std::initializer_list<T> &aggregate)
+    : _element{}
 {
-    auto iter = aggregate.begin();
-    for(int i = 0; i < N; ++i)
+    const T *a = aggregate.begin();
+    const size_t n = aggregate.size() < (size_t)N ? aggregate.size() : (size_t)N;
+    if constexpr(Layout::vector)
+    {
+        /* One register store, element stores followed by the register load
+         * of the next operation would miss store forwarding
+         */
+        if(!simd::constant())
+        {
+            Pack::store(this->_element, Pack::set(
+                n > 0 ? a[0] : T(), n > 1 ? a[1] : T(), n > 2 ? a[2] : T(), n > 3 ? a[3] : T()
+            ));
+            return;
+        }
+    }
+    for(size_t i = 0; i < n; ++i)
+    {
+        this->_element[i] = a[i];
+    }
+}
+
+template <int N, class T>
+template <class E>
+constexpr Vector<N, T>::Vector(const VectorExpression<E> &expression)
+    : _element{}
+{
+    (*this) = expression;
+}
+
+template <int N, class T>
+template <class E>
+constexpr Vector<N, T>& Vector<N, T>::operator =(const VectorExpression<E> &expression)
+{
+    static_assert(E::size == N, "Vector expressions need to have the same size");
+
+    const E &e = expression.self();
+    if constexpr(Layout::vector)
+    {
+        if(!simd::constant())
+        {
+            Pack::store(this->_element, e.pack());
+            return (*this);
+        }
+    }
+    for(int i = 0; i < Layout::size; ++i)
     {
-        this->_element[i] = (iter != aggregate.end()) ? *(iter++) : T();
+        this->_element[i] = (i < N) ? e[i] : T();
     }
+    return (*this);
 }
 
 template <int N, class T>
 template <class U>
-Vector<N, T>::operator Vector<N, U>(void) const
+constexpr Vector<N, T>::operator Vector<N, U>(void) const
 {
     Vector<N, U> v{};
     for(int i = 0; i < N; ++i)
@@ -83,7 +303,7 @@ Vector<N, T>::operator Vector<N, U>(void) const
 
 template <int N, class T>
 template <int M, class U>
-Vector<N, T>::operator Vector<M, U>(void) const
+constexpr Vector<N, T>::operator Vector<M, U>(void) const
 {
     Vector<M, U> v{};
     for(int i = 0; i < N && i < M; ++i)
@@ -94,20 +314,37 @@ Vector<N, T>::operator Vector<M, U>(void) const
 }
 
 template <int N, class T>
-inline const T& Vector<N, T>::operator[](int index) const
+constexpr inline const T& Vector<N, T>::operator[](int index) const
 {
     return this->_element[index];
 }
 
 template <int N, class T>
-inline T& Vector<N, T>::operator[](int index)
+constexpr inline T& Vector<N, T>::operator[](int index)
 {
     return this->_element[index];
 }
 
 template <int N, class T>
-T Vector<N, T>::dot(const Vector<N, T>& v) const
+inline auto Vector<N, T>::pack(void) const
+{
+    return Pack::load(this->_element);
+}
+
+template <int N, class T>
+constexpr inline const Vector<N, T>& Vector<N, T>::eval(void) const
+{
+    return (*this);
+}
+
+template <int N, class T>
+constexpr T Vector<N, T>::dot(const Vector<N, T>& v) const
 {
+    if constexpr(Layout::vector)
+    {
+        if(!simd::constant())
+            return Pack::hsum(Pack::mul(Pack::load(this->_element), Pack::load(v._element)));
+    }
     T p = T();
     for(int i = 0; i < N; ++i)
     {
@@ -119,37 +356,66 @@ T Vector<N, T>::dot(const Vector<N, T>& v) const
  /* Defined only when N = 3
   */
 template <int N, class T>
-Vector<N, T> Vector<N, T>::cross(const Vector<N, T>& v) const
+constexpr Vector<N, T> Vector<N, T>::cross(const Vector<N, T>& v) const
 {
     Vector<3, T> u{};
+    if constexpr(N == 3 && Layout::vector)
+    {
+        if(!simd::constant())
+        {
+            const auto a = Pack::load(this->_element);
+            const auto b = Pack::load(v._element);
+            Pack::store(u._element, Pack::sub(
+                Pack::mul(Pack::yzx(a), Pack::zxy(b)),
+                Pack::mul(Pack::zxy(a), Pack::yzx(b))
+            ));
+            return u;
+        }
+    }
     u[0] = (*this)[1] * v[2] - (*this)[2] * v[1];
     u[1] = (*this)[2] * v[0] - (*this)[0] * v[2];
     u[2] = (*this)[0] * v[1] - (*this)[1] * v[0];
     return u;
 }
 
+/* Summed in one pass, without building the difference vector
+ */
 template <int N, class T>
-T Vector<N, T>::quadrance(const Vector<N, T>& v) const
+constexpr T Vector<N, T>::quadrance(const Vector<N, T>& v) const
 {
-    return ((*this) - v).norm();
+    if constexpr(Layout::vector)
+    {
+        if(!simd::constant())
+        {
+            const auto d = Pack::sub(Pack::load(this->_element), Pack::load(v._element));
+            return Pack::hsum(Pack::mul(d, d));
+        }
+    }
+    T p = T();
+    for(int i = 0; i < N; ++i)
+    {
+        const T d = (*this)[i] - v[i];
+        p += d * d;
+    }
+    return p;
 }
 
 template <int N, class T>
 auto Vector<N, T>::distance(const Vector<N, T>& v) const
 {
-    return ((*this) - v).magnitude();
+    return std::sqrt(this->quadrance(v));
 }
 
 /* Project v onto this
  */
 template <int N, class T>
-Vector<N, T> Vector<N, T>::proj(const Vector<N, T>& v) const
+constexpr Vector<N, T> Vector<N, T>::proj(const Vector<N, T>& v) const
 {
     return ((*this) * (this->dot(v))) / this->norm();
 }
 
 template <int N, class T>
-Vector<N, T> Vector<N, T>::perp(const Vector<N, T>& v) const
+constexpr Vector<N, T> Vector<N, T>::perp(const Vector<N, T>& v) const
 {
     return v - this->proj(v);
 }
@@ -160,95 +426,144 @@ Vector<N, T> Vector<N, T>::normalize(void) const
     return (*this) / this->magnitude();
 }
 
+/* Scaled by the rsqrt estimate refined by one Newton step for float,
+ * about 23 bits, and by the exact reciprocal for double. A zero vector
+ * gives NaN, use normalize_or_zero() where one can occur.
+ */
 template <int N, class T>
-auto Vector<N, T>::angle(const Vector<N, T>& v) const
+Vector<N, T> Vector<N, T>::normalize_fast(void) const
 {
-    return std::acos(this->dot(v) / (this->magnitude() * v.magnitude()));
-}
+    static_assert(std::is_floating_point<T>::value, "normalize_fast() needs a floating point type");
 
-template <int N, class T>
-T Vector<N, T>::norm(void) const
-{
-    return this->dot(*this);
+    const T n = this->norm();
+    if constexpr(Layout::vector)
+    {
+        /* The padding lane is scaled by rsqrt(1) so it stays zero
+         */
+        Vector<N, T> u;
+        const auto r = Pack::rsqrt(N == 4 ? Pack::set1(n) : Pack::set(n, n, n, T(1)));
+        Pack::store(u._element, Pack::mul(Pack::load(this->_element), r));
+        return u;
+    }
+    return (*this) * simd::rsqrt(n);
 }
 
+/* Zero vectors come back as zero, without dividing by their magnitude
+ */
 template <int N, class T>
-auto Vector<N, T>::magnitude(void) const
+Vector<N, T> Vector<N, T>::normalize_or_zero(void) const
 {
-    return std::sqrt(this->norm());
+    const T n = this->norm();
+    if(n == T())
+        return Vector<N, T>();
+    return (*this) / static_cast<T>(std::sqrt(n));
 }
 
 template <int N, class T>
-inline Vector<N, T> Vector<N, T>::operator +(void) const
+auto Vector<N, T>::angle(const Vector<N, T>& v) const
 {
-    return (*this);
+    return std::acos(this->dot(v) / (this->magnitude() * v.magnitude()));
 }
 
 template <int N, class T>
-inline Vector<N, T> Vector<N, T>::operator -(void) const
+constexpr T Vector<N, T>::norm(void) const
 {
-    return (*this) * (-1);
+    return this->dot(*this);
 }
 
 template <int N, class T>
-Vector<N, T> Vector<N, T>::operator +(const Vector<N, T>& v) const
+auto Vector<N, T>::magnitude(void) const
 {
-    return Vector<N, T>(*this) += v;
+    return std::sqrt(this->norm());
 }
 
 template <int N, class T>
-Vector<N, T> Vector<N, T>::operator -(const Vector<N, T>& v) const
+auto Vector<N, T>::inv_magnitude(void) const
 {
-    return Vector<N, T>(*this) -= v;
+    return 1 / this->magnitude();
 }
 
 template <int N, class T>
-Vector<N, T> Vector<N, T>::operator *(const T& c) const
+constexpr inline Vector<N, T> Vector<N, T>::operator +(void) const
 {
-    return Vector<N, T>(*this) *= c;
+    return (*this);
 }
 
 template <int N, class T>
-Vector<N, T> Vector<N, T>::operator /(const T& c) const
+constexpr inline bool Vector<N, T>::operator ==(const Vector<N, T>& v) const
 {
-    return Vector<N, T>(*this) /= c;
+    for(int i = 0; i < N; ++i)
+    {
+        if(!((*this)[i] == v[i]))
+            return false;
+    }
+    return true;
 }
 
 template <int N, class T>
-inline bool Vector<N, T>::operator ==(const Vector<N, T>& v) const
+constexpr inline bool Vector<N, T>::operator !=(const Vector<N, T>& v) const
 {
-    return std::memcmp(this->_element, v._element, N * sizeof(T)) == 0;
+    return !((*this) == v);
 }
 
 template <int N, class T>
-inline bool Vector<N, T>::operator !=(const Vector<N, T>& v) const
+template <class E>
+constexpr Vector<N, T>& Vector<N, T>::operator +=(const VectorExpression<E> &expression)
 {
-    return std::memcmp(this->_element, v._element, N * sizeof(T)) != 0;
-}
+    static_assert(E::size == N, "Vector expressions need to have the same size");
 
-template <int N, class T>
-Vector<N, T> Vector<N, T>::operator +=(const Vector<N, T>& v) 
-{
+    const E &e = expression.self();
+    if constexpr(Layout::vector)
+    {
+        if(!simd::constant())
+        {
+            Pack::store(this->_element, Pack::add(Pack::load(this->_element), e.pack()));
+            return (*this);
+        }
+    }
     for(int i = 0; i < N; ++i)
     {
-        (*this)[i] += v[i];
+        (*this)[i] += e[i];
     }
     return (*this);
 }
 
 template <int N, class T>
-Vector<N, T> Vector<N, T>::operator -=(const Vector<N, T>& v)
+template <class E>
+constexpr Vector<N, T>& Vector<N, T>::operator -=(const VectorExpression<E> &expression)
 {
+    static_assert(E::size == N, "Vector expressions need to have the same size");
+
+    const E &e = expression.self();
+    if constexpr(Layout::vector)
+    {
+        if(!simd::constant())
+        {
+            Pack::store(this->_element, Pack::sub(Pack::load(this->_element), e.pack()));
+            return (*this);
+        }
+    }
     for(int i = 0; i < N; ++i)
     {
-        (*this)[i] -= v[i];
+        (*this)[i] -= e[i];
     }
     return (*this);
 }
 
 template <int N, class T>
-Vector<N, T> Vector<N, T>::operator *=(const T& c)
+constexpr Vector<N, T>& Vector<N, T>::operator *=(const T& c)
 {
+    if constexpr(Layout::vector)
+    {
+        /* The padding lane is scaled by zero so an infinite c cannot turn it into NaN
+         */
+        if(!simd::constant())
+        {
+            const auto k = (N == 4) ? Pack::set1(c) : Pack::set(c, c, c, T(0));
+            Pack::store(this->_element, Pack::mul(Pack::load(this->_element), k));
+            return (*this);
+        }
+    }
     for(int i = 0; i < N; ++i)
     {
         (*this)[i] *= c;
@@ -257,8 +572,17 @@ Vector<N, T> Vector<N, T>::operator *=(const T& c)
 }
 
 template <int N, class T>
-Vector<N, T> Vector<N, T>::operator /=(const T& c)
+constexpr Vector<N, T>& Vector<N, T>::operator /=(const T& c)
 {
+    if constexpr(Layout::vector)
+    {
+        if(!simd::constant())
+        {
+            const auto k = (N == 4) ? Pack::set1(c) : Pack::set(c, c, c, T(1));
+            Pack::store(this->_element, Pack::div(Pack::load(this->_element), k));
+            return (*this);
+        }
+    }
     for(int i = 0; i < N; ++i)
     {
         (*this)[i] /= c;
@@ -266,6 +590,50 @@ Vector<N, T> Vector<N, T>::operator /=(const T& c)
     return (*this);
 }
 
+template <class E>
+constexpr inline VectorScale<E> operator -(const VectorExpression<E>& e)
+{
+    return {e.self(), typename E::scalar(-1)};
+}
+
+template <class L, class R>
+constexpr inline VectorSum<L, R> operator +(const VectorExpression<L>& l, const VectorExpression<R>& r)
+{
+    return {l.self(), r.self()};
+}
+
+template <class L, class R>
+constexpr inline VectorDifference<L, R> operator -(const VectorExpression<L>& l, const VectorExpression<R>& r)
+{
+    return {l.self(), r.self()};
+}
+
+template <class E>
+constexpr inline VectorScale<E> operator *(const VectorExpression<E>& e, const typename E::scalar& c)
+{
+    return {e.self(), c};
+}
+
+template <class E>
+constexpr inline VectorQuotient<E> operator /(const VectorExpression<E>& e, const typename E::scalar& c)
+{
+    return {e.self(), c};
+}
+
+/* Vector == Vector picks the member operators, these evaluate both sides first
+ */
+template <class L, class R>
+constexpr inline bool operator ==(const VectorExpression<L>& l, const VectorExpression<R>& r)
+{
+    return l.self().eval() == r.self().eval();
+}
+
+template <class L, class R>
+constexpr inline bool operator !=(const VectorExpression<L>& l, const VectorExpression<R>& r)
+{
+    return l.self().eval() != r.self().eval();
+}
+
 typedef Vector<2, unsigned> Vector2u;
 typedef Vector<3, unsigned> Vector3u;
 typedef Vector<4, unsigned> Vector4u;
@@ -278,5 +646,11 @@ typedef Vector<4, float>    Vector4f;
 typedef Vector<2, double>   Vector2lf;
 typedef Vector<3, double>   Vector3lf;
 typedef Vector<4, double>   Vector4lf;
+typedef Vector<2, Half>     Vector2h;
+typedef Vector<3, Half>     Vector3h;
+typedef Vector<4, Half>     Vector4h;
+typedef Vector<2, BFloat16> Vector2bf;
+typedef Vector<3, BFloat16> Vector3bf;
+typedef Vector<4, BFloat16> Vector4bf;
 
 #endif
@@ -0,0 +1,563 @@
+/* vectorarray.hh */
+#ifndef VECTORARRAY_HH
+#define VECTORARRAY_HH
+
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include "vector.hh"
+
+template <unsigned R, unsigned C, typename T>
+class Matrix;
+
+/* Structure of arrays container for Vector<N, T>
+ * Component j of every vector is stored contiguously in lane(j), each lane
+ * starting on a cache line, so batched operations run as straight loops over
+ * N arrays that the compiler can vectorize across vectors.
+ * Batched results are written to caller provided arrays of at least size()
+ * elements, output arrays may alias the inputs.
+ */
+template <int N, class T>
+class VectorArray
+{
+public:
+	static constexpr size_t alignment = 64;
+
+	VectorArray(size_t size = 0)
+	{
+		this->_data   = nullptr;
+		this->_size   = 0;
+		this->_stride = 0;
+		this->allocate(size);
+	}
+
+	VectorArray(const Vector<N, T> *vectors, size_t size)
+		: VectorArray(size)
+	{
+		this->load(vectors, size);
+	}
+
+	VectorArray(const VectorArray &array)
+		: VectorArray(array.size())
+	{
+		std::memcpy(this->_data, array._data, N * this->_stride * sizeof(T));
+	}
+
+	VectorArray(VectorArray &&array) noexcept
+	{
+		this->_data   = array._data;
+		this->_size   = array._size;
+		this->_stride = array._stride;
+		array._data   = nullptr;
+		array._size   = 0;
+		array._stride = 0;
+	}
+
+	VectorArray &operator =(const VectorArray &array)
+	{
+		if(this != &array)
+		{
+			this->allocate(array.size());
+			std::memcpy(this->_data, array._data, N * this->_stride * sizeof(T));
+		}
+		return (*this);
+	}
+
+	VectorArray &operator =(VectorArray &&array) noexcept
+	{
+		if(this != &array)
+		{
+			this->release();
+			this->_data   = array._data;
+			this->_size   = array._size;
+			this->_stride = array._stride;
+			array._data   = nullptr;
+			array._size   = 0;
+			array._stride = 0;
+		}
+		return (*this);
+	}
+
+	~VectorArray(void)
+	{
+		this->release();
+	}
+
+	/* Resizes the array to size vectors, new vectors are zero
+	 * Existing vectors up to the new size are kept
+	 */
+	void allocate(size_t size)
+	{
+		const size_t stride = VectorArray::round(size);
+		if(stride == this->_stride)
+		{
+			this->zero(size, this->_size);
+			this->_size = size;
+			return;
+		}
+
+		T *memory = nullptr;
+		if(stride != 0)
+		{
+			memory = static_cast<T *>(::operator new(N * stride * sizeof(T), std::align_val_t(alignment)));
+			std::memset(memory, 0, N * stride * sizeof(T));
+		}
+
+		if(this->_data != nullptr)
+		{
+			const size_t count = this->_size < size ? this->_size : size;
+			for(int j = 0; j < N; ++j)
+			{
+				std::memcpy(memory + j * stride, this->lane(j), count * sizeof(T));
+			}
+			this->release();
+		}
+
+		this->_data   = memory;
+		this->_size   = size;
+		this->_stride = stride;
+	}
+
+	/* Gathers vectors[0 .. size) into the lanes, size must not exceed size()
+	 */
+	void load(const Vector<N, T> *vectors, size_t size)
+	{
+		for(int j = 0; j < N; ++j)
+		{
+			T *a = this->lane(j);
+			for(size_t i = 0; i < size; ++i)
+			{
+				a[i] = vectors[i][j];
+			}
+		}
+	}
+
+	/* Scatters the lanes back into vectors, which holds at least size() elements
+	 */
+	void store(Vector<N, T> *vectors) const
+	{
+		for(int j = 0; j < N; ++j)
+		{
+			const T *a = this->lane(j);
+			for(size_t i = 0; i < this->size(); ++i)
+			{
+				vectors[i][j] = a[i];
+			}
+		}
+	}
+
+	inline size_t size(void) const
+	{
+		return this->_size;
+	}
+
+	/* Component j of every vector, padded with zeros to a multiple of
+	 * alignment bytes (alignment / sizeof(T) elements)
+	 */
+	inline const T *lane(int j) const
+	{
+		return this->_data + j * this->_stride;
+	}
+
+	inline T *lane(int j)
+	{
+		return this->_data + j * this->_stride;
+	}
+
+	/* No bounds checking is done on the element accessor functions
+	 */
+	Vector<N, T> get(size_t i) const
+	{
+		Vector<N, T> v{};
+		for(int j = 0; j < N; ++j)
+		{
+			v[j] = this->lane(j)[i];
+		}
+		return v;
+	}
+
+	void set(size_t i, const Vector<N, T> &v)
+	{
+		for(int j = 0; j < N; ++j)
+		{
+			this->lane(j)[i] = v[j];
+		}
+	}
+
+	inline Vector<N, T> operator [](size_t i) const
+	{
+		return this->get(i);
+	}
+
+	/* out[i] = this[i] . v[i]
+	 */
+	void dot(const VectorArray &v, T *out) const
+	{
+		const size_t n = this->size();
+		for(size_t i = 0; i < n; ++i)
+		{
+			T p = T();
+			for(int j = 0; j < N; ++j)
+			{
+				p += this->lane(j)[i] * v.lane(j)[i];
+			}
+			out[i] = p;
+		}
+	}
+
+	/* out[i] = this[i] . v
+	 */
+	void dot(const Vector<N, T> &v, T *out) const
+	{
+		const size_t n = this->size();
+		for(size_t i = 0; i < n; ++i)
+		{
+			T p = T();
+			for(int j = 0; j < N; ++j)
+			{
+				p += this->lane(j)[i] * v[j];
+			}
+			out[i] = p;
+		}
+	}
+
+	void norm(T *out) const
+	{
+		this->dot(*this, out);
+	}
+
+	void magnitude(T *out) const
+	{
+		this->norm(out);
+		VectorArray::sqrt(out, this->size());
+	}
+
+	void quadrance(const VectorArray &v, T *out) const
+	{
+		const size_t n = this->size();
+		for(size_t i = 0; i < n; ++i)
+		{
+			T p = T();
+			for(int j = 0; j < N; ++j)
+			{
+				const T d = this->lane(j)[i] - v.lane(j)[i];
+				p += d * d;
+			}
+			out[i] = p;
+		}
+	}
+
+	void quadrance(const Vector<N, T> &v, T *out) const
+	{
+		this->quadrance(v, 0, this->size(), out);
+	}
+
+	/* out[i - begin] = |this[i] - v|^2 for i in [begin, end)
+	 * The batched point test of the spatial indices, a register of vectors
+	 * at a time
+	 */
+	void quadrance(const Vector<N, T> &v, size_t begin, size_t end, T *out) const
+	{
+		typedef simd::Pack<T, 4> Pack;
+
+		size_t i = begin;
+		if constexpr(Pack::enabled)
+		{
+			typename Pack::type c[N];
+			for(int j = 0; j < N; ++j)
+			{
+				c[j] = Pack::set1(v[j]);
+			}
+			for(; i + 4 <= end; i += 4)
+			{
+				auto p = Pack::set1(T());
+				for(int j = 0; j < N; ++j)
+				{
+					const auto d = Pack::sub(Pack::loadu(this->lane(j) + i), c[j]);
+					p = Pack::madd(d, d, p);
+				}
+				Pack::storeu(out + (i - begin), p);
+			}
+		}
+		for(; i < end; ++i)
+		{
+			T p = T();
+			for(int j = 0; j < N; ++j)
+			{
+				const T d = this->lane(j)[i] - v[j];
+				p += d * d;
+			}
+			out[i - begin] = p;
+		}
+	}
+
+	void distance(const VectorArray &v, T *out) const
+	{
+		this->quadrance(v, out);
+		VectorArray::sqrt(out, this->size());
+	}
+
+	void distance(const Vector<N, T> &v, T *out) const
+	{
+		this->quadrance(v, out);
+		VectorArray::sqrt(out, this->size());
+	}
+
+	/* 1 / magnitude of every vector
+	 */
+	void inv_magnitude(T *out) const
+	{
+		typedef simd::Pack<T, 4> Pack;
+
+		this->norm(out);
+		const size_t n = this->size();
+		size_t i = 0;
+		if constexpr(Pack::enabled)
+		{
+			for(; i + 4 <= n; i += 4)
+			{
+				Pack::storeu(out + i, Pack::div(Pack::set1(T(1)), Pack::sqrt(Pack::loadu(out + i))));
+			}
+		}
+		for(; i < n; ++i)
+		{
+			out[i] = T(1) / std::sqrt(out[i]);
+		}
+	}
+
+	/* Normalizes every vector in place
+	 */
+	void normalize(void)
+	{
+		this->template scale<Exact>();
+	}
+
+	/* Normalizes every vector in place through the rsqrt estimate and one
+	 * Newton step, see Vector::normalize_fast()
+	 */
+	void normalize_fast(void)
+	{
+		this->template scale<Estimate>();
+	}
+
+	/* Normalizes every vector in place, leaving zero vectors at zero
+	 */
+	void normalize_or_zero(void)
+	{
+		this->template scale<OrZero>();
+	}
+
+	/* Projects v[i] onto this[i] and writes the result to out[i]
+	 * out needs to hold atleast size() vectors and may be v or this
+	 */
+	void proj(const VectorArray &v, VectorArray &out) const
+	{
+		const size_t n = this->size();
+		for(size_t i = 0; i < n; ++i)
+		{
+			T p = T(), q = T();
+			for(int j = 0; j < N; ++j)
+			{
+				p += this->lane(j)[i] * v.lane(j)[i];
+				q += this->lane(j)[i] * this->lane(j)[i];
+			}
+			const T c = p / q;
+			for(int j = 0; j < N; ++j)
+			{
+				out.lane(j)[i] = this->lane(j)[i] * c;
+			}
+		}
+	}
+
+	/* this[i] += a * x[i]
+	 */
+	void axpy(const T &a, const VectorArray &x)
+	{
+		const T      c = a;
+		const size_t n = this->size();
+		for(int j = 0; j < N; ++j)
+		{
+			T       *y = this->lane(j);
+			const T *b = x.lane(j);
+			for(size_t i = 0; i < n; ++i)
+			{
+				y[i] += c * b[i];
+			}
+		}
+	}
+
+	/* this[i] += a * x
+	 */
+	void axpy(const T &a, const Vector<N, T> &x)
+	{
+		const size_t n = this->size();
+		for(int j = 0; j < N; ++j)
+		{
+			T      *y = this->lane(j);
+			const T b = a * x[j];
+			for(size_t i = 0; i < n; ++i)
+			{
+				y[i] += b;
+			}
+		}
+	}
+	/* out[i] = a * this[i], out may be this when M == N
+	 */
+	template <unsigned M>
+	void transform(const Matrix<M, N, T> &a, VectorArray<(int)M, T> &out) const
+	{
+		T m[M][N];
+		for(unsigned r = 0; r < M; ++r)
+		{
+			for(int j = 0; j < N; ++j)
+			{
+				m[r][j] = a.elem(r, j);
+			}
+		}
+
+		const size_t n = this->size();
+		for(size_t i = 0; i < n; ++i)
+		{
+			T v[N];
+			for(int j = 0; j < N; ++j)
+			{
+				v[j] = this->lane(j)[i];
+			}
+			for(unsigned r = 0; r < M; ++r)
+			{
+				T p = T();
+				for(int j = 0; j < N; ++j)
+				{
+					p += m[r][j] * v[j];
+				}
+				out.lane(r)[i] = p;
+			}
+		}
+	}
+private:
+	T *_data;
+	size_t _size;
+	size_t _stride;
+
+	static inline size_t round(size_t size)
+	{
+		const size_t block = alignment / sizeof(T) > 0 ? alignment / sizeof(T) : 1;
+		return (size + block - 1) / block * block;
+	}
+
+	/* Reciprocal magnitudes from the squared ones, for scale()
+	 */
+	struct Exact
+	{
+		template <class P>
+		static inline typename P::type block(typename P::type p) { return P::div(P::set1(T(1)), P::sqrt(p)); }
+		static inline T tail(T p)                                 { return T(1) / std::sqrt(p); }
+	};
+
+	struct Estimate
+	{
+		template <class P>
+		static inline typename P::type block(typename P::type p) { return P::rsqrt(p); }
+		static inline T tail(T p)                                 { return simd::rsqrt(p); }
+	};
+
+	struct OrZero
+	{
+		template <class P>
+		static inline typename P::type block(typename P::type p)
+		{
+			const auto zero = P::set1(T());
+			return P::blend(P::less(zero, p), zero, P::div(P::set1(T(1)), P::sqrt(p)));
+		}
+		static inline T tail(T p)                                 { return p > T() ? T(1) / std::sqrt(p) : T(); }
+	};
+
+	/* Multiplies every vector by R's reciprocal of its magnitude
+	 */
+	template <class R>
+	void scale(void)
+	{
+		typedef simd::Pack<T, 4> Pack;
+
+		const size_t n = this->size();
+		size_t i = 0;
+		if constexpr(Pack::enabled)
+		{
+			/* Lanes are aligned and i is a multiple of 4, only whole blocks
+			 * are done here so the zero padding never turns into NaN
+			 */
+			for(; i + 4 <= n; i += 4)
+			{
+				auto p = Pack::set1(T());
+				for(int j = 0; j < N; ++j)
+				{
+					const auto a = Pack::load(this->lane(j) + i);
+					p = Pack::add(p, Pack::mul(a, a));
+				}
+				const auto r = R::template block<Pack>(p);
+				for(int j = 0; j < N; ++j)
+				{
+					Pack::store(this->lane(j) + i, Pack::mul(Pack::load(this->lane(j) + i), r));
+				}
+			}
+		}
+		for(; i < n; ++i)
+		{
+			T p = T();
+			for(int j = 0; j < N; ++j)
+			{
+				p += this->lane(j)[i] * this->lane(j)[i];
+			}
+			const T r = R::tail(p);
+			for(int j = 0; j < N; ++j)
+			{
+				this->lane(j)[i] *= r;
+			}
+		}
+	}
+
+	static inline void sqrt(T *a, size_t size)
+	{
+		typedef simd::Pack<T, 4> Pack;
+
+		size_t i = 0;
+		if constexpr(Pack::enabled)
+		{
+			for(; i + 4 <= size; i += 4)
+			{
+				Pack::storeu(a + i, Pack::sqrt(Pack::loadu(a + i)));
+			}
+		}
+		for(; i < size; ++i)
+		{
+			a[i] = std::sqrt(a[i]);
+		}
+	}
+
+	void zero(size_t begin, size_t end)
+	{
+		if(begin >= end)
+			return;
+		for(int j = 0; j < N; ++j)
+		{
+			std::memset(this->lane(j) + begin, 0, (end - begin) * sizeof(T));
+		}
+	}
+
+	void release(void)
+	{
+		if(this->_data != nullptr)
+			::operator delete(this->_data, std::align_val_t(alignment));
+		this->_data = nullptr;
+	}
+};
+
+typedef VectorArray<2, float>  VectorArray2f;
+typedef VectorArray<3, float>  VectorArray3f;
+typedef VectorArray<4, float>  VectorArray4f;
+typedef VectorArray<2, double> VectorArray2lf;
+typedef VectorArray<3, double> VectorArray3lf;
+typedef VectorArray<4, double> VectorArray4lf;
+
+#endif /* VECTORARRAY_HH */
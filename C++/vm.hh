@@ -0,0 +1,713 @@
+/* vm.hh */
+#ifndef VM_HH
+#define VM_HH
+
+#include <cctype>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "complex.hh"
+#include "matrix.hh"
+#include "stack.hh"
+#include "vector.hh"
+
+/* Bytecode evaluator for RPN expressions over a single operand type T
+ * (double, Complex, Vector, Matrix ...), built on the words of Stack<T>.
+ * Compiler turns text such as "x y + dup * x y 2 pick + * + sqrt" into a
+ * Program, checking the stack effect of every word as it goes, so Machine
+ * can run the result with the unchecked stack words and the top of the
+ * stack kept in a local. Dispatch is threaded through computed gotos on GCC and clang
+ * and a switch elsewhere (or when VM_SWITCH is defined).
+ */
+namespace vm
+{
+
+enum class Op : std::uint8_t
+{
+	Const,
+	Load,
+	Add,
+	Sub,
+	Mul,
+	Div,
+	Neg,
+	Dup,
+	Drop,
+	Swap,
+	Over,
+	Rot,
+	Nip,
+	Tuck,
+	Pick,
+	Roll,
+	Call1,
+	Call2,
+	Ret
+};
+
+struct Instruction
+{
+	Op op;
+	std::uint32_t arg;
+};
+
+/* Which arithmetic words T supports, through its compound assignments
+ */
+template <class T, class = void> struct Addable : std::false_type {};
+template <class T, class = void> struct Subtractable : std::false_type {};
+template <class T, class = void> struct Multipliable : std::false_type {};
+template <class T, class = void> struct Divisible : std::false_type {};
+template <class T, class = void> struct Negatable : std::false_type {};
+
+template <class T> struct Addable<T, std::void_t<decltype(std::declval<T &>() += std::declval<const T &>())>> : std::true_type {};
+template <class T> struct Subtractable<T, std::void_t<decltype(std::declval<T &>() -= std::declval<const T &>())>> : std::true_type {};
+template <class T> struct Multipliable<T, std::void_t<decltype(std::declval<T &>() *= std::declval<const T &>())>> : std::true_type {};
+template <class T> struct Divisible<T, std::void_t<decltype(std::declval<T &>() /= std::declval<const T &>())>> : std::true_type {};
+template <class T> struct Negatable<T, std::void_t<decltype(T(-std::declval<const T &>()))>> : std::true_type {};
+
+/* Parses a literal token into x, returning false if it is not one
+ * Numbers for arithmetic types, a trailing i for the imaginary part of a
+ * Complex ("2", "1.5i"), and bracketed lists of components for Vector and
+ * Matrix ("[1 2 3]", Matrix elements in row-major order).
+ */
+template <class T>
+struct Literal
+{
+	static bool parse(const std::string &token, T &x)
+	{
+		static_assert(std::is_arithmetic<T>::value, "No literal syntax for this operand type");
+
+		if(token.empty())
+			return false;
+		char *end = nullptr;
+		if constexpr(std::is_integral<T>::value)
+			x = (T)std::strtoll(token.c_str(), &end, 10);
+		else
+			x = (T)std::strtold(token.c_str(), &end);
+		return *end == '\0';
+	}
+};
+
+template <class T>
+struct Literal<Complex<T>>
+{
+	static bool parse(const std::string &token, Complex<T> &z)
+	{
+		if(token.empty())
+			return false;
+		const char last = token.back();
+		if(last != 'i' && last != 'j')
+		{
+			T x;
+			if(!Literal<T>::parse(token, x))
+				return false;
+			z.set(x, T());
+			return true;
+		}
+		T y = T(1);
+		if(token.size() > 1 && !Literal<T>::parse(token.substr(0, token.size() - 1), y))
+			return false;
+		z.set(T(), y);
+		return true;
+	}
+};
+
+/* Splits "[a b c]" (commas allowed) into exactly n components
+ */
+template <class T>
+bool components(const std::string &token, T *x, size_t n)
+{
+	if(token.size() < 2 || token.front() != '[' || token.back() != ']')
+		return false;
+	size_t count = 0;
+	std::string item;
+	for(size_t i = 1; i < token.size(); ++i)
+	{
+		const char c = token[i];
+		if(std::isspace((unsigned char)c) || c == ',' || c == ']')
+		{
+			if(!item.empty())
+			{
+				if(count == n || !Literal<T>::parse(item, x[count]))
+					return false;
+				++count;
+				item.clear();
+			}
+			continue;
+		}
+		item += c;
+	}
+	return count == n;
+}
+
+template <int N, class T>
+struct Literal<Vector<N, T>>
+{
+	static bool parse(const std::string &token, Vector<N, T> &v)
+	{
+		T x[N];
+		if(!components(token, x, N))
+			return false;
+		for(int i = 0; i < N; ++i)
+		{
+			v[i] = x[i];
+		}
+		return true;
+	}
+};
+
+template <unsigned R, unsigned C, class T>
+struct Literal<Matrix<R, C, T>>
+{
+	static bool parse(const std::string &token, Matrix<R, C, T> &a)
+	{
+		T x[R * C];
+		if(!components(token, x, R * C))
+			return false;
+		for(unsigned i = 0; i < R; ++i)
+		{
+			for(unsigned j = 0; j < C; ++j)
+			{
+				a[i][j] = x[i * C + j];
+			}
+		}
+		return true;
+	}
+};
+
+template <class T>
+class Compiler;
+
+template <class T>
+class Machine;
+
+/* Functions every Compiler<T> starts out with
+ */
+template <class T, class = void>
+struct Builtins
+{
+	static void install(Compiler<T> &)
+	{
+	}
+};
+
+template <class T>
+struct Builtins<T, typename std::enable_if<std::is_floating_point<T>::value>::type>
+{
+	static void install(Compiler<T> &c)
+	{
+		c.function("sqrt", [](const T &x) { return (T)std::sqrt(x); });
+		c.function("exp",  [](const T &x) { return (T)std::exp(x); });
+		c.function("log",  [](const T &x) { return (T)std::log(x); });
+		c.function("sin",  [](const T &x) { return (T)std::sin(x); });
+		c.function("cos",  [](const T &x) { return (T)std::cos(x); });
+		c.function("tan",  [](const T &x) { return (T)std::tan(x); });
+		c.function("abs",  [](const T &x) { return (T)std::fabs(x); });
+		c.function("pow",  [](const T &x, const T &y) { return (T)std::pow(x, y); });
+		c.function("min",  [](const T &x, const T &y) { return x < y ? x : y; });
+		c.function("max",  [](const T &x, const T &y) { return x < y ? y : x; });
+	}
+};
+
+template <class T>
+struct Builtins<Complex<T>>
+{
+	static void install(Compiler<Complex<T>> &c)
+	{
+		c.function("sqrt",  [](const Complex<T> &z) { return z.sqrt(); });
+		c.function("exp",   [](const Complex<T> &z) { return z.exp(); });
+		c.function("log",   [](const Complex<T> &z) { return z.log(); });
+		c.function("conj",  [](const Complex<T> &z) { return z.conjugate(); });
+		c.function("recip", [](const Complex<T> &z) { return z.reciprocal(); });
+		c.function("pow",   [](const Complex<T> &z, const Complex<T> &w) { return z.pow(w); });
+	}
+};
+
+template <int N, class T>
+struct Builtins<Vector<N, T>>
+{
+	static void install(Compiler<Vector<N, T>> &c)
+	{
+		c.function("normalize", [](const Vector<N, T> &v) { return v.normalize(); });
+		if constexpr(N == 3)
+			c.function("cross", [](const Vector<N, T> &u, const Vector<N, T> &v) { return u.cross(v); });
+	}
+};
+
+template <unsigned N, class T>
+struct Builtins<Matrix<N, N, T>>
+{
+	static void install(Compiler<Matrix<N, N, T>> &c)
+	{
+		c.function("transpose", [](const Matrix<N, N, T> &a) { return a.transpose(); });
+		if constexpr(std::is_floating_point<T>::value)
+			c.function("inv", [](const Matrix<N, N, T> &a) { return a.reciprocal(); });
+	}
+};
+
+/* Compiled expression, variables being read from the array given to Machine::run()
+ */
+template <class T>
+class Program
+{
+public:
+	typedef T (*Unary)(const T &);
+	typedef T (*Binary)(const T &, const T &);
+
+	inline const std::vector<Instruction> &code(void) const
+	{
+		return this->_code;
+	}
+
+	inline const std::vector<T> &constants(void) const
+	{
+		return this->_constants;
+	}
+
+	/* Most cells below the top at any point, which Machine reserves up front
+	 */
+	inline size_t depth(void) const
+	{
+		return this->_depth;
+	}
+
+	inline size_t variables(void) const
+	{
+		return this->_variables;
+	}
+private:
+	friend class Compiler<T>;
+	friend class Machine<T>;
+
+	std::vector<Instruction> _code;
+	std::vector<T> _constants;
+	std::vector<Unary> _unary;
+	std::vector<Binary> _binary;
+	size_t _depth = 0;
+	size_t _variables = 0;
+};
+
+/* RPN text to Program
+ * Words are + - * / neg dup drop swap over rot nip tuck, "n pick" and
+ * "n roll" with a plain integer n, the registered functions and the
+ * variables named on construction. ( ... ) is a comment. Errors, including
+ * stack underflow and words T has no operator for, throw
+ * std::invalid_argument.
+ */
+template <class T>
+class Compiler
+{
+public:
+	typedef typename Program<T>::Unary  Unary;
+	typedef typename Program<T>::Binary Binary;
+
+	Compiler(std::vector<std::string> variables = {})
+	{
+		this->_variables = std::move(variables);
+		Builtins<T>::install(*this);
+	}
+
+	void function(const std::string &name, Unary f)
+	{
+		this->_names.push_back(Name{name, f, nullptr});
+	}
+
+	void function(const std::string &name, Binary f)
+	{
+		this->_names.push_back(Name{name, nullptr, f});
+	}
+
+	Program<T> compile(const std::string &text) const
+	{
+		Program<T> p;
+		p._variables = this->_variables.size();
+
+		size_t depth = 0;
+		for(size_t i = 0; i < text.size();)
+		{
+			const std::string token = Compiler::next(text, i);
+			if(token.empty())
+				break;
+
+			if(token == "(")
+			{
+				while(i < text.size() && text[i] != ')')
+					++i;
+				if(i == text.size())
+					throw std::invalid_argument("Unterminated comment");
+				++i;
+				continue;
+			}
+
+			if(token == "pick" || token == "roll")
+				throw std::invalid_argument("'" + token + "' needs a literal depth in front of it");
+
+			/* The depth of pick and roll is a plain integer whatever T is,
+			 * so "1 pick" works where "1" is no literal of T
+			 */
+			const long long n = Compiler::integer(token);
+			if(n >= 0)
+			{
+				size_t j = i;
+				const std::string after = Compiler::next(text, j);
+				if(after == "pick" || after == "roll")
+				{
+					i = j;
+					Compiler::need(after, depth, (size_t)n + 1);
+					if(after == "pick")
+						Compiler::emit(p, depth, Op::Pick, (std::uint32_t)n, 1);
+					else
+						p._code.push_back(Instruction{Op::Roll, (std::uint32_t)n});
+					continue;
+				}
+			}
+
+			const Word *w = Compiler::word(token);
+			if(w != nullptr)
+			{
+				if(!w->supported)
+					throw std::invalid_argument("'" + token + "' is not defined for this operand type");
+				Compiler::need(token, depth, w->in);
+				depth -= w->in;
+				Compiler::emit(p, depth, w->op, 0, w->out);
+				continue;
+			}
+
+			size_t k = this->find(this->_variables, token);
+			if(k < this->_variables.size())
+			{
+				Compiler::emit(p, depth, Op::Load, (std::uint32_t)k, 1);
+				continue;
+			}
+
+			k = this->function(token);
+			if(k < this->_names.size())
+			{
+				const Name &f = this->_names[k];
+				const size_t in = f.unary != nullptr ? 1 : 2;
+				Compiler::need(token, depth, in);
+				if(f.unary != nullptr)
+				{
+					p._code.push_back(Instruction{Op::Call1, (std::uint32_t)p._unary.size()});
+					p._unary.push_back(f.unary);
+				}
+				else
+				{
+					p._code.push_back(Instruction{Op::Call2, (std::uint32_t)p._binary.size()});
+					p._binary.push_back(f.binary);
+					--depth;
+				}
+				continue;
+			}
+
+			T x{};
+			if(!Literal<T>::parse(token, x))
+				throw std::invalid_argument("Unknown word '" + token + "'");
+			Compiler::emit(p, depth, Op::Const, (std::uint32_t)p._constants.size(), 1);
+			p._constants.push_back(x);
+		}
+
+		if(depth != 1)
+			throw std::invalid_argument("Expression leaves " + std::to_string(depth) + " values on the stack instead of 1");
+		p._code.push_back(Instruction{Op::Ret, 0});
+		return p;
+	}
+private:
+	struct Word
+	{
+		const char *name;
+		Op op;
+		size_t in;
+		size_t out;
+		bool supported;
+	};
+
+	struct Name
+	{
+		std::string name;
+		Unary unary;
+		Binary binary;
+	};
+
+	std::vector<std::string> _variables;
+	std::vector<Name> _names;
+
+	static const Word *word(const std::string &token)
+	{
+		static const Word words[] = {
+			{"+",    Op::Add,  2, 1, Addable<T>::value},
+			{"-",    Op::Sub,  2, 1, Subtractable<T>::value},
+			{"*",    Op::Mul,  2, 1, Multipliable<T>::value},
+			{"/",    Op::Div,  2, 1, Divisible<T>::value},
+			{"neg",  Op::Neg,  1, 1, Negatable<T>::value},
+			{"dup",  Op::Dup,  1, 2, true},
+			{"drop", Op::Drop, 1, 0, true},
+			{"swap", Op::Swap, 2, 2, true},
+			{"over", Op::Over, 2, 3, true},
+			{"rot",  Op::Rot,  3, 3, true},
+			{"nip",  Op::Nip,  2, 1, true},
+			{"tuck", Op::Tuck, 2, 3, true}
+		};
+		for(const Word &w : words)
+		{
+			if(token == w.name)
+				return &w;
+		}
+		return nullptr;
+	}
+
+	static size_t find(const std::vector<std::string> &names, const std::string &token)
+	{
+		size_t k = 0;
+		while(k < names.size() && names[k] != token)
+			++k;
+		return k;
+	}
+
+	/* Latest registration wins, so builtins can be replaced
+	 */
+	size_t function(const std::string &token) const
+	{
+		for(size_t k = this->_names.size(); k-- > 0;)
+		{
+			if(this->_names[k].name == token)
+				return k;
+		}
+		return this->_names.size();
+	}
+
+	static void need(const std::string &token, size_t depth, size_t n)
+	{
+		if(depth < n)
+			throw std::invalid_argument("Stack underflow at '" + token + "'");
+	}
+
+	/* Appends op, depth being the stack depth once its inputs are consumed
+	 */
+	static void emit(Program<T> &p, size_t &depth, Op op, std::uint32_t arg, size_t out)
+	{
+		p._code.push_back(Instruction{op, arg});
+		depth += out;
+		if(depth > p._depth)
+			p._depth = depth;
+	}
+
+	static long long integer(const std::string &token)
+	{
+		if(token.empty() || token.size() > 9)
+			return -1;
+		for(const char c : token)
+		{
+			if(!std::isdigit((unsigned char)c))
+				return -1;
+		}
+		return std::atoll(token.c_str());
+	}
+
+	/* Whitespace separated token from i, a bracketed literal being one token
+	 */
+	static std::string next(const std::string &text, size_t &i)
+	{
+		while(i < text.size() && std::isspace((unsigned char)text[i]))
+			++i;
+		const size_t begin = i;
+		if(i < text.size() && text[i] == '[')
+		{
+			while(i < text.size() && text[i] != ']')
+				++i;
+			if(i == text.size())
+				throw std::invalid_argument("Unterminated literal");
+			++i;
+			return text.substr(begin, i - begin);
+		}
+		while(i < text.size() && !std::isspace((unsigned char)text[i]))
+			++i;
+		return text.substr(begin, i - begin);
+	}
+};
+
+/* Runs programs, reusing its stack across runs
+ */
+template <class T>
+class Machine
+{
+public:
+	T run(const Program<T> &program, const T *variables = nullptr)
+	{
+		if(program.variables() > 0 && variables == nullptr)
+			throw std::invalid_argument("Program reads variables but none were given");
+
+		Stack<T> &stack = this->_stack;
+		stack.clear();
+		stack.reserve(program.depth() + 1);
+
+		const Instruction *ip = program._code.data();
+		const T *constants = program._constants.data();
+		const typename Program<T>::Unary *unary = program._unary.data();
+		const typename Program<T>::Binary *binary = program._binary.data();
+
+		/* The top lives in tos and the stack holds the cells below it, the
+		 * first push spilling a dummy value
+		 */
+		T tos{};
+
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(VM_SWITCH)
+		/* Labels as values are a GNU extension, which -Wpedantic reports
+		 */
+#   pragma GCC diagnostic push
+#   pragma GCC diagnostic ignored "-Wpedantic"
+		static void *const labels[] = {
+			&&op_Const, &&op_Load, &&op_Add, &&op_Sub, &&op_Mul, &&op_Div, &&op_Neg,
+			&&op_Dup, &&op_Drop, &&op_Swap, &&op_Over, &&op_Rot, &&op_Nip, &&op_Tuck,
+			&&op_Pick, &&op_Roll, &&op_Call1, &&op_Call2, &&op_Ret
+		};
+#   define VM_CASE(op) op_##op
+#   define VM_NEXT     goto *labels[(size_t)(ip++)->op]
+#   define VM_BEGIN    VM_NEXT;
+#   define VM_END      _Pragma("GCC diagnostic pop")
+#else
+#   define VM_CASE(op) case Op::op
+#   define VM_NEXT     continue
+#   define VM_BEGIN    for(;;) { switch((ip++)->op) {
+#   define VM_END      } }
+#endif
+#define VM_ARG (ip[-1].arg)
+
+		VM_BEGIN
+		VM_CASE(Const):
+			stack.push_unsafe(std::move(tos));
+			tos = constants[VM_ARG];
+			VM_NEXT;
+		VM_CASE(Load):
+			stack.push_unsafe(std::move(tos));
+			tos = variables[VM_ARG];
+			VM_NEXT;
+		VM_CASE(Add):
+			if constexpr(Addable<T>::value)
+			{
+				T &a = stack.peek_unsafe(0);
+				a += tos;
+				tos = std::move(a);
+				stack.drop_unsafe();
+			}
+			VM_NEXT;
+		VM_CASE(Sub):
+			if constexpr(Subtractable<T>::value)
+			{
+				T &a = stack.peek_unsafe(0);
+				a -= tos;
+				tos = std::move(a);
+				stack.drop_unsafe();
+			}
+			VM_NEXT;
+		VM_CASE(Mul):
+			if constexpr(Multipliable<T>::value)
+			{
+				T &a = stack.peek_unsafe(0);
+				a *= tos;
+				tos = std::move(a);
+				stack.drop_unsafe();
+			}
+			VM_NEXT;
+		VM_CASE(Div):
+			if constexpr(Divisible<T>::value)
+			{
+				T &a = stack.peek_unsafe(0);
+				a /= tos;
+				tos = std::move(a);
+				stack.drop_unsafe();
+			}
+			VM_NEXT;
+		VM_CASE(Neg):
+			if constexpr(Negatable<T>::value)
+				tos = T(-tos);
+			VM_NEXT;
+		VM_CASE(Dup):
+			stack.push_unsafe(tos);
+			VM_NEXT;
+		VM_CASE(Drop):
+			tos = stack.pop_unsafe();
+			VM_NEXT;
+		VM_CASE(Swap):
+			std::swap(tos, stack.peek_unsafe(0));
+			VM_NEXT;
+		VM_CASE(Over):
+			{
+				T x = stack.peek_unsafe(0);
+				stack.push_unsafe(std::move(tos));
+				tos = std::move(x);
+			}
+			VM_NEXT;
+		VM_CASE(Rot):
+			{
+				T &a = stack.peek_unsafe(1);
+				T &b = stack.peek_unsafe(0);
+				T x = std::move(a);
+				a = std::move(b);
+				b = std::move(tos);
+				tos = std::move(x);
+			}
+			VM_NEXT;
+		VM_CASE(Nip):
+			stack.drop_unsafe();
+			VM_NEXT;
+		VM_CASE(Tuck):
+			stack.push_unsafe(tos);
+			std::swap(stack.peek_unsafe(0), stack.peek_unsafe(1));
+			VM_NEXT;
+		VM_CASE(Pick):
+			{
+				T x = VM_ARG == 0 ? tos : stack.peek_unsafe(VM_ARG - 1);
+				stack.push_unsafe(std::move(tos));
+				tos = std::move(x);
+			}
+			VM_NEXT;
+		VM_CASE(Roll):
+			if(VM_ARG > 0)
+			{
+				stack.push_unsafe(std::move(tos));
+				stack.roll_unsafe(VM_ARG);
+				tos = stack.pop_unsafe();
+			}
+			VM_NEXT;
+		VM_CASE(Call1):
+			tos = unary[VM_ARG](tos);
+			VM_NEXT;
+		VM_CASE(Call2):
+			{
+				T a = stack.pop_unsafe();
+				tos = binary[VM_ARG](a, tos);
+			}
+			VM_NEXT;
+		VM_CASE(Ret):
+			return tos;
+		VM_END
+
+#undef VM_ARG
+#undef VM_END
+#undef VM_BEGIN
+#undef VM_NEXT
+#undef VM_CASE
+	}
+private:
+	Stack<T> _stack;
+};
+
+/* Compiles and runs text in one go, for expressions evaluated once
+ */
+template <class T>
+T evaluate(const std::string &text, const std::vector<std::string> &names = {}, const T *variables = nullptr)
+{
+	Machine<T> machine;
+	return machine.run(Compiler<T>(names).compile(text), variables);
+}
+
+} /* namespace vm */
+
+#endif /* VM_HH */
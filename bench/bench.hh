@@ -0,0 +1,32 @@
+/* bench.hh
+ * Counters shared by the benchmarks, reported per second of CPU time
+ * next to the usual timings, and in the JSON output.
+ */
+#ifndef BENCH_HH
+#define BENCH_HH
+
+#include <cstddef>
+#include <benchmark/benchmark.h>
+
+/* flops floating point operations per iteration
+ */
+inline void flops(benchmark::State &state, double flops)
+{
+	state.counters["FLOP/s"] = benchmark::Counter(flops * (double)state.iterations(), benchmark::Counter::kIsRate);
+}
+
+/* bytes read and written per iteration, shown as bytes_per_second
+ */
+inline void bandwidth(benchmark::State &state, size_t bytes)
+{
+	state.SetBytesProcessed((int64_t)state.iterations() * (int64_t)bytes);
+}
+
+/* Elements processed per iteration, shown as items_per_second
+ */
+inline void items(benchmark::State &state, size_t count)
+{
+	state.SetItemsProcessed((int64_t)state.iterations() * (int64_t)count);
+}
+
+#endif /* BENCH_HH */
@@ -0,0 +1,113 @@
+/* binary.cc
+ * Writing, reading and mapping binary container files of n x n matrices,
+ * next to the text round trip they replace
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "bench.hh"
+#include "binary.hh"
+
+static const char *path = "bench_binary.tmp";
+
+static DynMatrixf matrix(size_t n)
+{
+	DynMatrixf a(n, n);
+	for(size_t i = 0; i < n; ++i)
+	{
+		for(size_t j = 0; j < n; ++j)
+		{
+			a(i, j) = (float)(i * n + j) * 0.25f;
+		}
+	}
+	return a;
+}
+
+static void save(const DynMatrixf &a)
+{
+	binary::Writer w(path);
+	w.write(a);
+	w.close();
+}
+
+static void binary_write(benchmark::State &state)
+{
+	const DynMatrixf a = matrix((size_t)state.range(0));
+	for(auto _ : state)
+	{
+		save(a);
+	}
+	bandwidth(state, a.rows() * a.ld() * sizeof(float));
+	std::remove(path);
+}
+
+static void binary_read(benchmark::State &state)
+{
+	save(matrix((size_t)state.range(0)));
+	for(auto _ : state)
+	{
+		binary::Reader r(path);
+		DynMatrixf a = r.matrix<float>(0);
+		benchmark::DoNotOptimize(a.data());
+	}
+	bandwidth(state, (size_t)(state.range(0) * state.range(0)) * sizeof(float));
+	std::remove(path);
+}
+
+/* Mapping and touching the first element of every row, the cost of a
+ * start that only looks at part of the data
+ */
+static void binary_map(benchmark::State &state)
+{
+	save(matrix((size_t)state.range(0)));
+	for(auto _ : state)
+	{
+		binary::Mapping m(path);
+		const DynMatrixf a = m.matrix<float>(0);
+		float s = 0.0f;
+		for(size_t i = 0; i < a.rows(); ++i)
+		{
+			s += a(i, 0);
+		}
+		benchmark::DoNotOptimize(s);
+	}
+	bandwidth(state, (size_t)(state.range(0) * state.range(0)) * sizeof(float));
+	std::remove(path);
+}
+
+static void text_read(benchmark::State &state)
+{
+	const DynMatrixf a = matrix((size_t)state.range(0));
+	std::FILE *f = std::fopen(path, "w");
+	for(size_t i = 0; i < a.rows(); ++i)
+	{
+		for(size_t j = 0; j < a.columns(); ++j)
+		{
+			std::fprintf(f, "%.9g ", a(i, j));
+		}
+		std::fputc('\n', f);
+	}
+	std::fclose(f);
+	for(auto _ : state)
+	{
+		std::FILE *g = std::fopen(path, "r");
+		DynMatrixf b(a.rows(), a.columns());
+		for(size_t i = 0; i < b.rows(); ++i)
+		{
+			for(size_t j = 0; j < b.columns(); ++j)
+			{
+				if(std::fscanf(g, "%f", &b(i, j)) != 1)
+					std::abort();
+			}
+		}
+		std::fclose(g);
+		benchmark::DoNotOptimize(b.data());
+	}
+	bandwidth(state, a.rows() * a.columns() * sizeof(float));
+	std::remove(path);
+}
+
+BENCHMARK(binary_write)->RangeMultiplier(4)->Range(256, 4096);
+BENCHMARK(binary_read)->RangeMultiplier(4)->Range(256, 4096);
+BENCHMARK(binary_map)->RangeMultiplier(4)->Range(256, 4096);
+BENCHMARK(text_read)->RangeMultiplier(4)->Range(256, 1024);
@@ -0,0 +1,168 @@
+/* complex.cc
+ * Complex<T> arithmetic and transcendentals elementwise over a block of
+ * numbers, plus the bulk ComplexArray kernels they compare against
+ */
+#include <vector>
+#include "bench.hh"
+#include "complex.hh"
+#include "complexarray.hh"
+
+static constexpr size_t count = 1024;
+
+template <class T>
+static std::vector<Complex<T>> numbers(size_t n, unsigned seed)
+{
+	std::vector<Complex<T>> z(n);
+	for(size_t i = 0; i < n; ++i)
+	{
+		const T re = (T)((i * 2654435761u + seed) % 23) / T(4) - T(2.75);
+		const T im = (T)((i * 40503u + seed * 7) % 29) / T(4) - T(3.5);
+		z[i] = Complex<T>(re == T() ? T(0.5) : re, im);
+	}
+	return z;
+}
+
+/* c[i] = f(a[i], b[i]) over the whole block
+ */
+template <class T, class F>
+static void binary(benchmark::State &state, const F &f, double flop)
+{
+	const std::vector<Complex<T>> a = numbers<T>(count, 1), b = numbers<T>(count, 2);
+	std::vector<Complex<T>> c(count);
+	for(auto _ : state)
+	{
+		for(size_t i = 0; i < count; ++i)
+		{
+			c[i] = f(a[i], b[i]);
+		}
+		benchmark::DoNotOptimize(c.data());
+		benchmark::ClobberMemory();
+	}
+	if(flop > 0)
+		flops(state, flop * count);
+	bandwidth(state, 3 * count * sizeof(Complex<T>));
+	items(state, count);
+}
+
+template <class T>
+static void multiply(benchmark::State &state)
+{
+	binary<T>(state, [](const Complex<T> &a, const Complex<T> &b) { return a * b; }, 6);
+}
+
+template <class T>
+static void divide(benchmark::State &state)
+{
+	binary<T>(state, [](const Complex<T> &a, const Complex<T> &b) { return a / b; }, 11);
+}
+
+template <class T>
+static void exp(benchmark::State &state)
+{
+	binary<T>(state, [](const Complex<T> &a, const Complex<T> &) { return a.exp(); }, 0);
+}
+
+template <class T>
+static void log(benchmark::State &state)
+{
+	binary<T>(state, [](const Complex<T> &a, const Complex<T> &) { return a.log(); }, 0);
+}
+
+template <class T>
+static void sqrt(benchmark::State &state)
+{
+	binary<T>(state, [](const Complex<T> &a, const Complex<T> &) { return a.sqrt(); }, 0);
+}
+
+template <class T>
+static void pow(benchmark::State &state)
+{
+	binary<T>(state, [](const Complex<T> &a, const Complex<T> &b) { return a.pow(b / T(8)); }, 0);
+}
+
+template <class T>
+static void pow_real(benchmark::State &state)
+{
+	binary<T>(state, [](const Complex<T> &a, const Complex<T> &) { return a.pow(T(2.5)); }, 0);
+}
+
+template <class T>
+static ComplexArray<T> array(size_t n, ComplexLayout layout, unsigned seed)
+{
+	const std::vector<Complex<T>> z = numbers<T>(n, seed);
+	ComplexArray<T> a(n, layout);
+	for(size_t i = 0; i < n; ++i)
+	{
+		a.set(i, z[i]);
+	}
+	return a;
+}
+
+template <class T>
+static void array_multiply(benchmark::State &state)
+{
+	const ComplexLayout layout = (ComplexLayout)state.range(0);
+	const ComplexArray<T> a = array<T>(count, layout, 1), b = array<T>(count, layout, 2);
+	ComplexArray<T> c(count, layout);
+	for(auto _ : state)
+	{
+		a.multiply(b, c);
+		c.multiply_conj(b, c);
+		benchmark::DoNotOptimize(c.real());
+		benchmark::ClobberMemory();
+	}
+	flops(state, 2.0 * 6 * count);
+	bandwidth(state, 2 * 3 * count * sizeof(Complex<T>));
+	items(state, 2 * count);
+}
+
+template <class T>
+static void array_phase(benchmark::State &state)
+{
+	const ComplexArray<T> a = array<T>(count, ComplexLayout::Split, 1);
+	const Precision precision = (Precision)state.range(0);
+	std::vector<T> phi(count);
+	for(auto _ : state)
+	{
+		a.phase(phi.data(), precision);
+		benchmark::DoNotOptimize(phi.data());
+		benchmark::ClobberMemory();
+	}
+	items(state, count);
+}
+
+template <class T>
+static void array_rotate(benchmark::State &state)
+{
+	ComplexArray<T> a = array<T>(count, ComplexLayout::Split, 1);
+	const Precision precision = (Precision)state.range(0);
+	std::vector<T> phi(count, T(1e-3));
+	for(auto _ : state)
+	{
+		a.rotate(phi.data(), precision);
+		benchmark::DoNotOptimize(a.real());
+		benchmark::ClobberMemory();
+	}
+	items(state, count);
+}
+
+BENCHMARK_TEMPLATE(multiply, float);
+BENCHMARK_TEMPLATE(multiply, double);
+BENCHMARK_TEMPLATE(divide, float);
+BENCHMARK_TEMPLATE(divide, double);
+BENCHMARK_TEMPLATE(exp, float);
+BENCHMARK_TEMPLATE(exp, double);
+BENCHMARK_TEMPLATE(log, double);
+BENCHMARK_TEMPLATE(sqrt, double);
+BENCHMARK_TEMPLATE(pow, float);
+BENCHMARK_TEMPLATE(pow, double);
+BENCHMARK_TEMPLATE(pow_real, double);
+
+/* Arguments are the ComplexLayout and Precision enumerators
+ */
+BENCHMARK_TEMPLATE(array_multiply, float)->Arg((int)ComplexLayout::Interleaved)->Arg((int)ComplexLayout::Split);
+BENCHMARK_TEMPLATE(array_multiply, double)->Arg((int)ComplexLayout::Interleaved)->Arg((int)ComplexLayout::Split);
+BENCHMARK_TEMPLATE(array_phase, float)->Arg((int)Precision::Precise)->Arg((int)Precision::Fast);
+BENCHMARK_TEMPLATE(array_phase, double)->Arg((int)Precision::Precise)->Arg((int)Precision::Fast);
+BENCHMARK_TEMPLATE(array_rotate, float)->Arg((int)Precision::Precise)->Arg((int)Precision::Fast);
+BENCHMARK_TEMPLATE(array_rotate, double)->Arg((int)Precision::Precise)->Arg((int)Precision::Fast);
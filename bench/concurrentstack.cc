@@ -0,0 +1,64 @@
+/* concurrentstack.cc
+ * Contention benchmark: ConcurrentStack against Stack behind a mutex
+ * Every thread alternates push and pop on one shared stack, the rate over
+ * all threads being reported as items_per_second.
+ */
+#include <mutex>
+#include <thread>
+#include "bench.hh"
+#include "concurrentstack.hh"
+#include "stack.hh"
+
+struct Locked
+{
+	std::mutex lock;
+	Stack<long> stack;
+
+	void push(long x)
+	{
+		std::lock_guard<std::mutex> guard(this->lock);
+		this->stack.push(x);
+	}
+
+	bool try_pop(long &x)
+	{
+		std::lock_guard<std::mutex> guard(this->lock);
+		if(this->stack.size() == 0)
+			return false;
+		x = this->stack.pop_unsafe();
+		return true;
+	}
+};
+
+/* Set up by thread 0 before and torn down after the timing loop, every
+ * thread waiting at both ends of it
+ */
+template <class S>
+static S *shared = nullptr;
+
+template <class S>
+static void contention(benchmark::State &state)
+{
+	if(state.thread_index() == 0)
+		shared<S> = new S();
+
+	long x = 0;
+	for(auto _ : state)
+	{
+		shared<S>->push(x);
+		shared<S>->try_pop(x);
+	}
+	benchmark::DoNotOptimize(x);
+	items(state, 2);
+
+	if(state.thread_index() == 0)
+	{
+		delete shared<S>;
+		shared<S> = nullptr;
+	}
+}
+
+static const int most = 2 * (int)(std::thread::hardware_concurrency() > 0 ? std::thread::hardware_concurrency() : 1);
+
+BENCHMARK_TEMPLATE(contention, ConcurrentStack<long>)->ThreadRange(1, most)->UseRealTime();
+BENCHMARK_TEMPLATE(contention, Locked)->ThreadRange(1, most)->UseRealTime();
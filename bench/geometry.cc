@@ -0,0 +1,267 @@
+/* geometry.cc
+ * Packets of rays against a list of triangles, spheres and boxes, next to
+ * the one ray at a time loop over Vector::cross and Vector::dot they
+ * replace, rays in the face planes of a box, and the batched point
+ * frustum cull
+ */
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <vector>
+#include "bench.hh"
+#include "geometry.hh"
+
+static constexpr size_t primitives = 64;
+
+static std::vector<Vector3f> points(size_t n, unsigned seed)
+{
+	std::mt19937 g(seed);
+	std::uniform_real_distribution<float> d(-1.0f, 1.0f);
+	std::vector<Vector3f> p(n);
+	for(Vector3f &v : p)
+	{
+		v = Vector3f{d(g), d(g), d(g)};
+	}
+	return p;
+}
+
+static void triangle_single(benchmark::State &state)
+{
+	const size_t n = (size_t)state.range(0);
+	const std::vector<Vector3f> o = points(n, 1), d = points(n, 2), v = points(3 * primitives, 3);
+	std::vector<float> t(n);
+	for(auto _ : state)
+	{
+		size_t hits = 0;
+		std::fill(t.begin(), t.end(), std::numeric_limits<float>::infinity());
+		for(size_t k = 0; k < primitives; ++k)
+		{
+			for(size_t i = 0; i < n; ++i)
+			{
+				hits += geometry::triangle(o[i], d[i], v[3 * k], v[3 * k + 1], v[3 * k + 2], t[i]);
+			}
+		}
+		benchmark::DoNotOptimize(hits);
+	}
+	items(state, n * primitives);
+}
+
+template <int W>
+static void triangle_packet(benchmark::State &state)
+{
+	const size_t n = (size_t)state.range(0);
+	const std::vector<Vector3f> o = points(n, 1), d = points(n, 2), v = points(3 * primitives, 3);
+	Raysf rays(o.data(), d.data(), n);
+	std::vector<geometry::Mask> hits(geometry::masks(n));
+	for(auto _ : state)
+	{
+		rays.reset();
+		for(size_t k = 0; k < primitives; ++k)
+		{
+			rays.triangle<W>(v[3 * k], v[3 * k + 1], v[3 * k + 2], hits.data());
+		}
+		benchmark::DoNotOptimize(hits.data());
+		benchmark::ClobberMemory();
+	}
+	items(state, n * primitives);
+}
+
+static void sphere_single(benchmark::State &state)
+{
+	const size_t n = (size_t)state.range(0);
+	const std::vector<Vector3f> o = points(n, 1), d = points(n, 2), c = points(primitives, 4);
+	std::vector<float> t(n);
+	for(auto _ : state)
+	{
+		size_t hits = 0;
+		std::fill(t.begin(), t.end(), std::numeric_limits<float>::infinity());
+		for(size_t k = 0; k < primitives; ++k)
+		{
+			for(size_t i = 0; i < n; ++i)
+			{
+				hits += geometry::sphere(o[i], d[i], c[k], 0.1f, t[i]);
+			}
+		}
+		benchmark::DoNotOptimize(hits);
+	}
+	items(state, n * primitives);
+}
+
+template <int W>
+static void sphere_packet(benchmark::State &state)
+{
+	const size_t n = (size_t)state.range(0);
+	const std::vector<Vector3f> o = points(n, 1), d = points(n, 2), c = points(primitives, 4);
+	Raysf rays(o.data(), d.data(), n);
+	std::vector<geometry::Mask> hits(geometry::masks(n));
+	for(auto _ : state)
+	{
+		rays.reset();
+		for(size_t k = 0; k < primitives; ++k)
+		{
+			rays.sphere<W>(c[k], 0.1f, hits.data());
+		}
+		benchmark::DoNotOptimize(hits.data());
+		benchmark::ClobberMemory();
+	}
+	items(state, n * primitives);
+}
+
+static void box_single(benchmark::State &state)
+{
+	const size_t n = (size_t)state.range(0);
+	const std::vector<Vector3f> o = points(n, 1), d = points(n, 2), c = points(primitives, 4);
+	std::vector<Vector3f> inverse(n);
+	for(size_t i = 0; i < n; ++i)
+	{
+		inverse[i] = Vector3f{1.0f / d[i][0], 1.0f / d[i][1], 1.0f / d[i][2]};
+	}
+	for(auto _ : state)
+	{
+		size_t hits = 0;
+		for(size_t k = 0; k < primitives; ++k)
+		{
+			const AABB3f b(c[k], c[k] + Vector3f{0.1f, 0.1f, 0.1f});
+			for(size_t i = 0; i < n; ++i)
+			{
+				hits += geometry::box(o[i], inverse[i], b, std::numeric_limits<float>::infinity());
+			}
+		}
+		benchmark::DoNotOptimize(hits);
+	}
+	items(state, n * primitives);
+}
+
+template <int W>
+static void box_packet(benchmark::State &state)
+{
+	const size_t n = (size_t)state.range(0);
+	const std::vector<Vector3f> o = points(n, 1), d = points(n, 2), c = points(primitives, 4);
+	const Raysf rays(o.data(), d.data(), n);
+	std::vector<geometry::Mask> hits(geometry::masks(n));
+	for(auto _ : state)
+	{
+		for(size_t k = 0; k < primitives; ++k)
+		{
+			rays.box<W>(AABB3f(c[k], c[k] + Vector3f{0.1f, 0.1f, 0.1f}), hits.data());
+			benchmark::DoNotOptimize(hits.data());
+		}
+		benchmark::ClobberMemory();
+	}
+	items(state, n * primitives);
+}
+
+/* Rays lying in the face planes of [-1, 1]^3, their 0 * inf = NaN slabs
+ * checked against geometry::box before timing, since the packet widths
+ * without a register fall back to simd::Scalar
+ */
+template <class T, int W>
+static void box_face(benchmark::State &state)
+{
+	const size_t n = (size_t)state.range(0);
+	std::mt19937 g(6);
+	std::uniform_int_distribution<int> step(-2, 2);
+	std::vector<Vector<3, T>> o(n), d(n);
+	for(size_t i = 0; i < n; ++i)
+	{
+		const int axis = (int)(i % 3);
+		for(int j = 0; j < 3; ++j)
+		{
+			o[i][j] = T(step(g)) / T(2);
+			d[i][j] = T(step(g));
+		}
+		o[i][axis] = (i / 3) % 2 ? T(1) : T(-1);
+		d[i][axis] = (i / 6) % 2 ? T(0) : -T(0);
+	}
+	const AABB<3, T> b(Vector<3, T>{-1, -1, -1}, Vector<3, T>{1, 1, 1});
+	const T t = T(10);
+	const geometry::Rays<T> rays(o.data(), d.data(), n, t);
+	std::vector<geometry::Mask> hits(geometry::masks(n));
+
+	rays.template box<W>(b, hits.data());
+	for(size_t i = 0; i < n; ++i)
+	{
+		const Vector<3, T> inverse{T(1) / d[i][0], T(1) / d[i][1], T(1) / d[i][2]};
+		if(geometry::box(o[i], inverse, b, t) != (bool)((hits[i / 64] >> (i % 64)) & 1))
+		{
+			state.SkipWithError("packet and scalar box tests disagree on a face plane ray");
+			return;
+		}
+	}
+
+	for(auto _ : state)
+	{
+		rays.template box<W>(b, hits.data());
+		benchmark::DoNotOptimize(hits.data());
+		benchmark::ClobberMemory();
+	}
+	items(state, n);
+}
+
+static Frustumf frustum(void)
+{
+	Matrix4f m{};
+	m[0][0] = 1.0f;
+	m[1][1] = 1.0f;
+	m[2][2] = -1.02f;
+	m[2][3] = -0.202f;
+	m[3][2] = -1.0f;
+	return Frustumf(m);
+}
+
+static void frustum_single(benchmark::State &state)
+{
+	const size_t n = (size_t)state.range(0);
+	const std::vector<Vector3f> p = points(n, 5);
+	const Frustumf f = frustum();
+	for(auto _ : state)
+	{
+		size_t inside = 0;
+		for(const Vector3f &x : p)
+		{
+			inside += f.contains(x);
+		}
+		benchmark::DoNotOptimize(inside);
+	}
+	items(state, n);
+}
+
+template <int W>
+static void frustum_packet(benchmark::State &state)
+{
+	const size_t n = (size_t)state.range(0);
+	const std::vector<Vector3f> p = points(n, 5);
+	const VectorArray3f a(p.data(), n);
+	const Frustumf f = frustum();
+	std::vector<geometry::Mask> inside(geometry::masks(n));
+	for(auto _ : state)
+	{
+		f.contains<W>(a, inside.data());
+		benchmark::DoNotOptimize(inside.data());
+		benchmark::ClobberMemory();
+	}
+	items(state, n);
+}
+
+BENCHMARK(triangle_single)->Range(1 << 8, 1 << 14);
+BENCHMARK_TEMPLATE(triangle_packet, 4)->Range(1 << 8, 1 << 14);
+BENCHMARK_TEMPLATE(triangle_packet, 8)->Range(1 << 8, 1 << 14);
+BENCHMARK_TEMPLATE(triangle_packet, 16)->Range(1 << 8, 1 << 14);
+BENCHMARK(sphere_single)->Range(1 << 8, 1 << 14);
+BENCHMARK_TEMPLATE(sphere_packet, 4)->Range(1 << 8, 1 << 14);
+BENCHMARK_TEMPLATE(sphere_packet, 8)->Range(1 << 8, 1 << 14);
+BENCHMARK_TEMPLATE(sphere_packet, 16)->Range(1 << 8, 1 << 14);
+BENCHMARK(box_single)->Range(1 << 8, 1 << 14);
+BENCHMARK_TEMPLATE(box_packet, 4)->Range(1 << 8, 1 << 14);
+BENCHMARK_TEMPLATE(box_packet, 8)->Range(1 << 8, 1 << 14);
+BENCHMARK_TEMPLATE(box_packet, 16)->Range(1 << 8, 1 << 14);
+BENCHMARK_TEMPLATE(box_face, float, 4)->Arg(1 << 10);
+BENCHMARK_TEMPLATE(box_face, float, 8)->Arg(1 << 10);
+BENCHMARK_TEMPLATE(box_face, float, 16)->Arg(1 << 10);
+BENCHMARK_TEMPLATE(box_face, double, 4)->Arg(1 << 10);
+BENCHMARK_TEMPLATE(box_face, double, 8)->Arg(1 << 10);
+BENCHMARK_TEMPLATE(box_face, double, 16)->Arg(1 << 10);
+BENCHMARK(frustum_single)->Range(1 << 10, 1 << 20);
+BENCHMARK_TEMPLATE(frustum_packet, 4)->Range(1 << 10, 1 << 20);
+BENCHMARK_TEMPLATE(frustum_packet, 8)->Range(1 << 10, 1 << 20);
+BENCHMARK_TEMPLATE(frustum_packet, 16)->Range(1 << 10, 1 << 20);
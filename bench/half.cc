@@ -0,0 +1,106 @@
+/* half.cc
+ * Bulk conversion between float and the 16 bit formats, against the
+ * element loop it replaces, and products of Half and BFloat16 matrices
+ * accumulating in float next to the float product
+ */
+#include <vector>
+#include "bench.hh"
+#include "dynmatrix.hh"
+
+template <class S>
+static void convert_narrow(benchmark::State &state)
+{
+	const size_t n = (size_t)state.range(0);
+	std::vector<float> in(n);
+	std::vector<S> out(n);
+	for(size_t i = 0; i < n; ++i)
+	{
+		in[i] = (float)i * 0.001f - 7.0f;
+	}
+	for(auto _ : state)
+	{
+		convert(in.data(), out.data(), n);
+		benchmark::DoNotOptimize(out.data());
+		benchmark::ClobberMemory();
+	}
+	items(state, n);
+	bandwidth(state, n * (sizeof(float) + sizeof(S)));
+}
+
+template <class S>
+static void convert_widen(benchmark::State &state)
+{
+	const size_t n = (size_t)state.range(0);
+	std::vector<S> in(n);
+	std::vector<float> out(n);
+	for(size_t i = 0; i < n; ++i)
+	{
+		in[i] = S((float)i * 0.001f - 7.0f);
+	}
+	for(auto _ : state)
+	{
+		convert(in.data(), out.data(), n);
+		benchmark::DoNotOptimize(out.data());
+		benchmark::ClobberMemory();
+	}
+	items(state, n);
+	bandwidth(state, n * (sizeof(float) + sizeof(S)));
+}
+
+/* The element by element loop of the generic casts
+ */
+template <class S>
+static void convert_scalar(benchmark::State &state)
+{
+	const size_t n = (size_t)state.range(0);
+	std::vector<float> in(n);
+	std::vector<S> out(n);
+	for(size_t i = 0; i < n; ++i)
+	{
+		in[i] = (float)i * 0.001f - 7.0f;
+	}
+	for(auto _ : state)
+	{
+		for(size_t i = 0; i < n; ++i)
+		{
+			out[i] = S(in[i]);
+		}
+		benchmark::DoNotOptimize(out.data());
+		benchmark::ClobberMemory();
+	}
+	items(state, n);
+	bandwidth(state, n * (sizeof(float) + sizeof(S)));
+}
+
+template <class S>
+static void multiply_mixed(benchmark::State &state)
+{
+	const size_t n = (size_t)state.range(0);
+	DynMatrix<S> a(n, n), b(n, n);
+	for(size_t i = 0; i < n; ++i)
+	{
+		for(size_t j = 0; j < n; ++j)
+		{
+			a(i, j) = S((float)((i * 7 + j) % 13) * 0.125f);
+			b(i, j) = S((float)((i + j * 5) % 11) * 0.25f);
+		}
+	}
+	DynMatrixf c(n, n);
+	for(auto _ : state)
+	{
+		DynMatrixf::multiply(a, b, c);
+		benchmark::DoNotOptimize(c.data());
+		benchmark::ClobberMemory();
+	}
+	flops(state, 2.0 * (double)n * (double)n * (double)n);
+}
+
+BENCHMARK_TEMPLATE(convert_narrow, Half)->Range(1 << 10, 1 << 22);
+BENCHMARK_TEMPLATE(convert_narrow, BFloat16)->Range(1 << 10, 1 << 22);
+BENCHMARK_TEMPLATE(convert_widen, Half)->Range(1 << 10, 1 << 22);
+BENCHMARK_TEMPLATE(convert_widen, BFloat16)->Range(1 << 10, 1 << 22);
+BENCHMARK_TEMPLATE(convert_scalar, Half)->Range(1 << 10, 1 << 22);
+BENCHMARK_TEMPLATE(convert_scalar, BFloat16)->Range(1 << 10, 1 << 22);
+BENCHMARK_TEMPLATE(multiply_mixed, float)->RangeMultiplier(2)->Range(256, 1024)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(multiply_mixed, Half)->RangeMultiplier(2)->Range(256, 1024)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(multiply_mixed, BFloat16)->RangeMultiplier(2)->Range(256, 1024)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,201 @@
+/* matrix.cc
+ * Matrix::multiply across sizes, from the closed form 4x4 kernel through
+ * the blocked GEMM, transpose and determinant
+ */
+#include <memory>
+#include "bench.hh"
+#include "dynmatrix.hh"
+#include "matrix.hh"
+#include "matrixview.hh"
+
+template <class T>
+static void fill(T *p, size_t n, unsigned seed)
+{
+	for(size_t i = 0; i < n; ++i)
+	{
+		p[i] = (T)((i * 2654435761u + seed) % 19) - T(9);
+	}
+}
+
+/* Kept on the heap, 256 x 256 doubles would not fit many stack frames
+ */
+template <unsigned R, unsigned C, class T>
+static std::unique_ptr<Matrix<R, C, T>> matrix(unsigned seed)
+{
+	auto a = std::make_unique<Matrix<R, C, T>>();
+	fill(a->data(), R * C, seed);
+	return a;
+}
+
+template <unsigned N, class T>
+static void multiply(benchmark::State &state)
+{
+	const auto a = matrix<N, N, T>(1), b = matrix<N, N, T>(2);
+	auto c = std::make_unique<Matrix<N, N, T>>();
+	for(auto _ : state)
+	{
+		*c = a->multiply(*b);
+		benchmark::DoNotOptimize(c->data());
+		benchmark::ClobberMemory();
+	}
+	flops(state, 2.0 * N * N * N);
+	bandwidth(state, 3 * sizeof(Matrix<N, N, T>));
+}
+
+/* Runtime sized, for the sizes a fixed Matrix is impractical at
+ */
+template <class T>
+static void multiply_dynamic(benchmark::State &state)
+{
+	const size_t n = (size_t)state.range(0);
+	DynMatrix<T> a(n, n), b(n, n), c;
+	for(size_t i = 0; i < n; ++i)
+	{
+		fill(&a(i, 0), n, 1 + (unsigned)i);
+		fill(&b(i, 0), n, 2 + (unsigned)i);
+	}
+	for(auto _ : state)
+	{
+		c = a.multiply(b);
+		benchmark::DoNotOptimize(c.data());
+		benchmark::ClobberMemory();
+	}
+	flops(state, 2.0 * (double)n * (double)n * (double)n);
+	bandwidth(state, 3 * n * n * sizeof(T));
+}
+
+/* c += a * b over the n x n blocks at (n / 2, n / 2) of 2n x 2n matrices,
+ * through views and through copies of the blocks
+ */
+template <class T>
+static void block_view(benchmark::State &state)
+{
+	const size_t n = (size_t)state.range(0), o = n / 2;
+	DynMatrix<T> a(2 * n, 2 * n), b(2 * n, 2 * n), c(2 * n, 2 * n);
+	for(size_t i = 0; i < 2 * n; ++i)
+	{
+		fill(&a(i, 0), 2 * n, 1 + (unsigned)i);
+		fill(&b(i, 0), 2 * n, 2 + (unsigned)i);
+	}
+	for(auto _ : state)
+	{
+		MatrixView<T>::multiply(view(a).block(o, o, n, n), view(b).block(o, o, n, n), view(c).block(o, o, n, n));
+		benchmark::DoNotOptimize(c.data());
+		benchmark::ClobberMemory();
+	}
+	flops(state, 2.0 * (double)n * (double)n * (double)n);
+}
+
+template <class T>
+static void block_copy(benchmark::State &state)
+{
+	const size_t n = (size_t)state.range(0), o = n / 2;
+	DynMatrix<T> a(2 * n, 2 * n), b(2 * n, 2 * n), c(2 * n, 2 * n);
+	for(size_t i = 0; i < 2 * n; ++i)
+	{
+		fill(&a(i, 0), 2 * n, 1 + (unsigned)i);
+		fill(&b(i, 0), 2 * n, 2 + (unsigned)i);
+	}
+	for(auto _ : state)
+	{
+		DynMatrix<T> x(n, n), y(n, n), z(n, n);
+		for(size_t i = 0; i < n; ++i)
+		{
+			for(size_t j = 0; j < n; ++j)
+			{
+				x(i, j) = a(o + i, o + j);
+				y(i, j) = b(o + i, o + j);
+				z(i, j) = c(o + i, o + j);
+			}
+		}
+		DynMatrix<T>::multiply(x, y, z);
+		for(size_t i = 0; i < n; ++i)
+		{
+			for(size_t j = 0; j < n; ++j)
+			{
+				c(o + i, o + j) = z(i, j);
+			}
+		}
+		benchmark::DoNotOptimize(c.data());
+		benchmark::ClobberMemory();
+	}
+	flops(state, 2.0 * (double)n * (double)n * (double)n);
+}
+
+template <unsigned R, unsigned C, class T>
+static void transpose(benchmark::State &state)
+{
+	const auto a = matrix<R, C, T>(1);
+	auto b = std::make_unique<Matrix<C, R, T>>();
+	for(auto _ : state)
+	{
+		*b = a->transpose();
+		benchmark::DoNotOptimize(b->data());
+		benchmark::ClobberMemory();
+	}
+	bandwidth(state, 2 * sizeof(Matrix<R, C, T>));
+}
+
+template <unsigned N, class T>
+static void transpose_in_place(benchmark::State &state)
+{
+	auto a = matrix<N, N, T>(1);
+	for(auto _ : state)
+	{
+		a->transpose_in_place();
+		benchmark::DoNotOptimize(a->data());
+		benchmark::ClobberMemory();
+	}
+	bandwidth(state, 2 * sizeof(Matrix<N, N, T>));
+}
+
+/* Diagonally dominant, so that LU never meets a tiny pivot
+ */
+template <unsigned N, class T>
+static void determinant(benchmark::State &state)
+{
+	auto a = matrix<N, N, T>(3);
+	for(unsigned i = 0; i < N; ++i)
+	{
+		(*a)[i][i] += T(4 * N);
+	}
+	for(auto _ : state)
+	{
+		T d = a->determinant();
+		benchmark::DoNotOptimize(d);
+	}
+	if constexpr(!std::is_integral<T>::value)
+		flops(state, N <= 4 ? (N == 4 ? 40.0 : 14.0) : 2.0 * N * N * N / 3.0);
+}
+
+BENCHMARK_TEMPLATE(multiply, 2, float);
+BENCHMARK_TEMPLATE(multiply, 3, float);
+BENCHMARK_TEMPLATE(multiply, 4, float);
+BENCHMARK_TEMPLATE(multiply, 4, double);
+BENCHMARK_TEMPLATE(multiply, 8, float);
+BENCHMARK_TEMPLATE(multiply, 16, float);
+BENCHMARK_TEMPLATE(multiply, 32, float);
+BENCHMARK_TEMPLATE(multiply, 64, float);
+BENCHMARK_TEMPLATE(multiply, 64, double);
+BENCHMARK_TEMPLATE(multiply, 128, float);
+BENCHMARK_TEMPLATE(multiply, 256, float);
+BENCHMARK_TEMPLATE(multiply, 256, double);
+BENCHMARK_TEMPLATE(multiply_dynamic, float)->RangeMultiplier(2)->Range(128, 1024)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(multiply_dynamic, double)->RangeMultiplier(2)->Range(128, 1024)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(block_view, float)->RangeMultiplier(4)->Range(16, 256);
+BENCHMARK_TEMPLATE(block_copy, float)->RangeMultiplier(4)->Range(16, 256);
+
+BENCHMARK_TEMPLATE(transpose, 4, 4, float);
+BENCHMARK_TEMPLATE(transpose, 16, 16, float);
+BENCHMARK_TEMPLATE(transpose, 64, 64, float);
+BENCHMARK_TEMPLATE(transpose, 256, 256, float);
+BENCHMARK_TEMPLATE(transpose, 256, 256, double);
+BENCHMARK_TEMPLATE(transpose, 100, 300, double);
+BENCHMARK_TEMPLATE(transpose_in_place, 64, float);
+BENCHMARK_TEMPLATE(transpose_in_place, 256, double);
+
+BENCHMARK_TEMPLATE(determinant, 3, double);
+BENCHMARK_TEMPLATE(determinant, 4, double);
+BENCHMARK_TEMPLATE(determinant, 8, double);
+BENCHMARK_TEMPLATE(determinant, 32, double);
+BENCHMARK_TEMPLATE(determinant, 6, int);
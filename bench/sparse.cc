@@ -0,0 +1,161 @@
+/* sparse.cc
+ * SparseMatrix products and conjugate gradients, on the 5 point Laplacian
+ * of a k x k grid and on random matrices, next to the dense products they
+ * replace
+ */
+#include <random>
+#include <vector>
+#include "bench.hh"
+#include "sparse.hh"
+
+static SparseMatrixf laplacian(size_t k, MatrixOrder order = MatrixOrder::RowMajor)
+{
+	std::vector<Triplet<float>> t;
+	for(size_t i = 0; i < k; ++i)
+	{
+		for(size_t j = 0; j < k; ++j)
+		{
+			const size_t r = i * k + j;
+			t.push_back(Triplet<float>{r, r, 4.0f});
+			if(i > 0)
+				t.push_back(Triplet<float>{r, r - k, -1.0f});
+			if(i + 1 < k)
+				t.push_back(Triplet<float>{r, r + k, -1.0f});
+			if(j > 0)
+				t.push_back(Triplet<float>{r, r - 1, -1.0f});
+			if(j + 1 < k)
+				t.push_back(Triplet<float>{r, r + 1, -1.0f});
+		}
+	}
+	return SparseMatrixf(k * k, k * k, t, order);
+}
+
+/* n x n with about 1% of the elements set
+ */
+static DynMatrixf random(size_t n, unsigned seed)
+{
+	std::mt19937 g(seed);
+	std::uniform_real_distribution<float> d(-1.0f, 1.0f);
+	DynMatrixf a(n, n);
+	for(size_t k = 0; k < n * n / 100; ++k)
+	{
+		a(g() % n, g() % n) = d(g);
+	}
+	return a;
+}
+
+static std::vector<float> values(size_t n, unsigned seed)
+{
+	std::mt19937 g(seed);
+	std::uniform_real_distribution<float> d(-1.0f, 1.0f);
+	std::vector<float> x(n);
+	for(float &v : x)
+	{
+		v = d(g);
+	}
+	return x;
+}
+
+static void spmv(benchmark::State &state, MatrixOrder order, const parallel::Policy &policy)
+{
+	const SparseMatrixf a = laplacian((size_t)state.range(0), order);
+	const std::vector<float> x = values(a.columns(), 1);
+	std::vector<float> y(a.rows());
+	for(auto _ : state)
+	{
+		a.multiply(x.data(), y.data(), policy);
+		benchmark::DoNotOptimize(y.data());
+	}
+	flops(state, 2.0 * (double)a.nonzeros());
+	bandwidth(state, a.nonzeros() * (sizeof(float) + sizeof(unsigned)) + (a.rows() + a.columns()) * sizeof(float));
+}
+
+static void spmv_csr(benchmark::State &state)
+{
+	spmv(state, MatrixOrder::RowMajor, parallel::seq);
+}
+
+static void spmv_csc(benchmark::State &state)
+{
+	spmv(state, MatrixOrder::ColumnMajor, parallel::seq);
+}
+
+static void spmv_csr_par(benchmark::State &state)
+{
+	spmv(state, MatrixOrder::RowMajor, parallel::par());
+}
+
+static void spmv_random(benchmark::State &state)
+{
+	const SparseMatrixf a(random((size_t)state.range(0), 1));
+	const std::vector<float> x = values(a.columns(), 2);
+	std::vector<float> y(a.rows());
+	for(auto _ : state)
+	{
+		a.multiply(x.data(), y.data());
+		benchmark::DoNotOptimize(y.data());
+	}
+	flops(state, 2.0 * (double)a.nonzeros());
+}
+
+/* The same random matrix times a single column as a dense product
+ */
+static void dense_mv(benchmark::State &state)
+{
+	const DynMatrixf a = random((size_t)state.range(0), 1);
+	DynMatrixf x(a.columns(), 1, MatrixOrder::ColumnMajor);
+	const std::vector<float> v = values(a.columns(), 2);
+	for(size_t i = 0; i < v.size(); ++i)
+	{
+		x(i, 0) = v[i];
+	}
+	for(auto _ : state)
+	{
+		DynMatrixf y = a * x;
+		benchmark::DoNotOptimize(y.data());
+	}
+	flops(state, 2.0 * (double)(a.rows() * a.columns()));
+}
+
+static void spmm(benchmark::State &state)
+{
+	const SparseMatrixf a = laplacian((size_t)state.range(0));
+	DynMatrixf b(a.columns(), 16), c(a.rows(), 16);
+	const std::vector<float> v = values(a.columns() * 16, 3);
+	for(size_t i = 0; i < b.rows(); ++i)
+	{
+		for(size_t j = 0; j < 16; ++j)
+		{
+			b(i, j) = v[i * 16 + j];
+		}
+	}
+	for(auto _ : state)
+	{
+		SparseMatrixf::multiply(a, b, c);
+		benchmark::DoNotOptimize(c.data());
+	}
+	flops(state, 2.0 * 16.0 * (double)a.nonzeros());
+}
+
+static void cg(benchmark::State &state)
+{
+	const SparseMatrixf a = laplacian((size_t)state.range(0));
+	const std::vector<float> b = values(a.rows(), 4);
+	std::vector<float> x(a.rows());
+	size_t iterations = 0;
+	for(auto _ : state)
+	{
+		std::fill(x.begin(), x.end(), 0.0f);
+		iterations = a.solve(b.data(), x.data(), 1e-4f, 100).iterations;
+		benchmark::DoNotOptimize(x.data());
+	}
+	state.counters["iterations"] = (double)iterations;
+}
+
+BENCHMARK(spmv_csr)->RangeMultiplier(4)->Range(64, 1024);
+BENCHMARK(spmv_csc)->RangeMultiplier(4)->Range(64, 1024);
+BENCHMARK(spmv_csr_par)->RangeMultiplier(4)->Range(64, 1024);
+BENCHMARK(spmv_random)->RangeMultiplier(4)->Range(256, 4096);
+BENCHMARK(dense_mv)->RangeMultiplier(4)->Range(256, 4096);
+BENCHMARK(spmm)->RangeMultiplier(4)->Range(64, 512);
+BENCHMARK(cg)->RangeMultiplier(4)->Range(64, 256);
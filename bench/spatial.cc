@@ -0,0 +1,156 @@
+/* spatial.cc
+ * KdTree and BVH construction and queries over uniform random points,
+ * next to the brute force loop over Vector::quadrance they replace
+ */
+#include <random>
+#include <vector>
+#include "bench.hh"
+#include "bvh.hh"
+#include "kdtree.hh"
+
+static constexpr size_t queries = 1024;
+
+static std::vector<Vector3f> points(size_t n, unsigned seed)
+{
+	std::mt19937 g(seed);
+	std::uniform_real_distribution<float> d(0.0f, 1.0f);
+	std::vector<Vector3f> p(n);
+	for(Vector3f &v : p)
+	{
+		v = Vector3f{d(g), d(g), d(g)};
+	}
+	return p;
+}
+
+static std::vector<AABB3f> boxes(size_t n, unsigned seed)
+{
+	const std::vector<Vector3f> p = points(n, seed);
+	std::vector<AABB3f> b(n);
+	for(size_t i = 0; i < n; ++i)
+	{
+		b[i] = AABB3f(p[i], p[i] + Vector3f{0.01f, 0.01f, 0.01f});
+	}
+	return b;
+}
+
+static void brute_force(benchmark::State &state)
+{
+	const std::vector<Vector3f> p = points((size_t)state.range(0), 1), q = points(queries, 2);
+	for(auto _ : state)
+	{
+		size_t s = 0;
+		for(const Vector3f &x : q)
+		{
+			size_t best = 0;
+			float d = p[0].quadrance(x);
+			for(size_t i = 1; i < p.size(); ++i)
+			{
+				const float e = p[i].quadrance(x);
+				if(e < d)
+				{
+					d    = e;
+					best = i;
+				}
+			}
+			s += best;
+		}
+		benchmark::DoNotOptimize(s);
+	}
+	items(state, queries);
+}
+
+static void kdtree_build(benchmark::State &state)
+{
+	const std::vector<Vector3f> p = points((size_t)state.range(0), 1);
+	for(auto _ : state)
+	{
+		KdTree3f tree(p.data(), p.size());
+		benchmark::DoNotOptimize(tree.size());
+	}
+	items(state, p.size());
+}
+
+static void kdtree_build_par(benchmark::State &state)
+{
+	const std::vector<Vector3f> p = points((size_t)state.range(0), 1);
+	for(auto _ : state)
+	{
+		KdTree3f tree(p.data(), p.size(), parallel::par());
+		benchmark::DoNotOptimize(tree.size());
+	}
+	items(state, p.size());
+}
+
+static void kdtree_nearest(benchmark::State &state)
+{
+	const std::vector<Vector3f> p = points((size_t)state.range(0), 1), q = points(queries, 2);
+	const KdTree3f tree(p.data(), p.size());
+	for(auto _ : state)
+	{
+		size_t s = 0;
+		for(const Vector3f &x : q)
+		{
+			s += tree.nearest(x).index;
+		}
+		benchmark::DoNotOptimize(s);
+	}
+	items(state, queries);
+}
+
+static void kdtree_knn(benchmark::State &state)
+{
+	const std::vector<Vector3f> p = points((size_t)state.range(0), 1), q = points(queries, 2);
+	const KdTree3f tree(p.data(), p.size());
+	std::vector<KdTree3f::Neighbour> out;
+	for(auto _ : state)
+	{
+		for(const Vector3f &x : q)
+		{
+			tree.nearest(x, 8, out);
+			benchmark::DoNotOptimize(out.data());
+		}
+	}
+	items(state, queries);
+}
+
+/* Points added one at a time, so the buffer and the merges are measured
+ */
+static void kdtree_insert(benchmark::State &state)
+{
+	const std::vector<Vector3f> p = points((size_t)state.range(0), 1);
+	for(auto _ : state)
+	{
+		KdTree3f tree;
+		for(const Vector3f &x : p)
+		{
+			tree.insert(x);
+		}
+		benchmark::DoNotOptimize(tree.size());
+	}
+	items(state, p.size());
+}
+
+static void bvh_nearest(benchmark::State &state)
+{
+	const std::vector<AABB3f> b = boxes((size_t)state.range(0), 1);
+	const std::vector<Vector3f> q = points(queries, 2);
+	const BVH3f bvh(b.data(), b.size());
+	for(auto _ : state)
+	{
+		size_t s = 0;
+		for(const Vector3f &x : q)
+		{
+			s += bvh.nearest(x).index;
+		}
+		benchmark::DoNotOptimize(s);
+	}
+	items(state, queries);
+}
+
+BENCHMARK(brute_force)->RangeMultiplier(16)->Range(1 << 10, 1 << 18);
+BENCHMARK(kdtree_build)->RangeMultiplier(16)->Range(1 << 10, 1 << 18);
+BENCHMARK(kdtree_build_par)->RangeMultiplier(16)->Range(1 << 10, 1 << 18);
+BENCHMARK(kdtree_nearest)->RangeMultiplier(16)->Range(1 << 10, 1 << 18);
+BENCHMARK(kdtree_knn)->RangeMultiplier(16)->Range(1 << 10, 1 << 18);
+BENCHMARK(kdtree_insert)->RangeMultiplier(16)->Range(1 << 10, 1 << 18);
+BENCHMARK(bvh_nearest)->RangeMultiplier(16)->Range(1 << 10, 1 << 18);
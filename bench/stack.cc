@@ -0,0 +1,125 @@
+/* stack.cc
+ * Stack and InlineStack push, pop and roll, checked and unchecked
+ */
+#include "bench.hh"
+#include "inlinestack.hh"
+#include "stack.hh"
+
+static constexpr size_t count = 4096;
+
+/* count pushes followed by count pops
+ */
+template <class S>
+static void push_pop(benchmark::State &state)
+{
+	S stack(count);
+	for(auto _ : state)
+	{
+		for(size_t i = 0; i < count; ++i)
+		{
+			stack.push((long)i);
+		}
+		long s = 0;
+		for(size_t i = 0; i < count; ++i)
+		{
+			s += stack.pop();
+		}
+		benchmark::DoNotOptimize(s);
+	}
+	bandwidth(state, 2 * count * sizeof(long));
+	items(state, 2 * count);
+}
+
+template <class S>
+static void push_pop_unsafe(benchmark::State &state)
+{
+	S stack(count);
+	for(auto _ : state)
+	{
+		for(size_t i = 0; i < count; ++i)
+		{
+			stack.push_unsafe((long)i);
+		}
+		long s = 0;
+		for(size_t i = 0; i < count; ++i)
+		{
+			s += stack.pop_unsafe();
+		}
+		benchmark::DoNotOptimize(s);
+	}
+	bandwidth(state, 2 * count * sizeof(long));
+	items(state, 2 * count);
+}
+
+/* Starting empty every time, so that the reallocations are measured
+ */
+template <class S>
+static void push_grow(benchmark::State &state)
+{
+	for(auto _ : state)
+	{
+		S stack;
+		for(size_t i = 0; i < count; ++i)
+		{
+			stack.push((long)i);
+		}
+		benchmark::DoNotOptimize(stack.peek());
+	}
+	items(state, count);
+}
+
+/* roll(n) moves n elements, the depth being the benchmark argument
+ */
+template <class S>
+static void roll(benchmark::State &state)
+{
+	const size_t n = (size_t)state.range(0);
+	S stack(n + 1);
+	for(size_t i = 0; i <= n; ++i)
+	{
+		stack.push((long)i);
+	}
+	for(auto _ : state)
+	{
+		stack.roll(n);
+		benchmark::DoNotOptimize(stack.peek());
+	}
+	bandwidth(state, 2 * n * sizeof(long));
+	items(state, 1);
+}
+
+/* ( a b c -- ) words as an interpreter would issue them
+ */
+template <class S>
+static void words(benchmark::State &state)
+{
+	S stack(64);
+	for(auto _ : state)
+	{
+		stack.push(1);
+		stack.push(2);
+		stack.push(3);
+		stack.rot();
+		stack.swap();
+		stack.over();
+		stack.tuck();
+		stack.nip();
+		stack.drop();
+		stack.drop();
+		stack.drop();
+		stack.drop();
+		benchmark::DoNotOptimize(stack.size());
+	}
+	items(state, 12);
+}
+
+BENCHMARK_TEMPLATE(push_pop, Stack<long>);
+BENCHMARK_TEMPLATE(push_pop, InlineStack<long, count>);
+BENCHMARK_TEMPLATE(push_pop_unsafe, Stack<long>);
+BENCHMARK_TEMPLATE(push_pop_unsafe, InlineStack<long, count>);
+BENCHMARK_TEMPLATE(push_grow, Stack<long>);
+BENCHMARK_TEMPLATE(push_grow, InlineStack<long, 64>);
+BENCHMARK_TEMPLATE(roll, Stack<long>)->RangeMultiplier(8)->Range(1, 4096);
+BENCHMARK_TEMPLATE(roll, InlineStack<long, 64>)->RangeMultiplier(8)->Range(1, 4096);
+BENCHMARK_TEMPLATE(words, Stack<long>);
+BENCHMARK_TEMPLATE(words, InlineStack<long>);
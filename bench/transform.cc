@@ -0,0 +1,124 @@
+/* transform.cc
+ * Composing scene graph transforms as Matrix<4, 4, T> products against
+ * Transform and Quaternion products, and rotating points either way
+ */
+#include <random>
+#include <vector>
+#include "bench.hh"
+#include "transform.hh"
+
+static constexpr size_t count = 1024;
+
+template <class T>
+static std::vector<Transform<T>> transforms(size_t n, unsigned seed)
+{
+	std::mt19937 g(seed);
+	std::uniform_real_distribution<T> d(T(-1), T(1));
+	std::vector<Transform<T>> t(n);
+	for(Transform<T> &x : t)
+	{
+		x = Transform<T>(Quaternion<T>(d(g), d(g), d(g), d(g)).normalize(), Vector<3, T>{d(g), d(g), d(g)}, T(1) + d(g) / 2);
+	}
+	return t;
+}
+
+template <class T>
+static void compose_matrix(benchmark::State &state)
+{
+	const std::vector<Transform<T>> a = transforms<T>(count, 1), b = transforms<T>(count, 2);
+	std::vector<Matrix<4, 4, T>> ma(count), mb(count), mc(count);
+	for(size_t i = 0; i < count; ++i)
+	{
+		ma[i] = static_cast<Matrix<4, 4, T>>(a[i]);
+		mb[i] = static_cast<Matrix<4, 4, T>>(b[i]);
+	}
+	for(auto _ : state)
+	{
+		multiply(ma.data(), mb.data(), mc.data(), count);
+		benchmark::DoNotOptimize(mc.data());
+		benchmark::ClobberMemory();
+	}
+	flops(state, (double)count * 112);
+	items(state, count);
+}
+
+template <class T>
+static void compose_transform(benchmark::State &state)
+{
+	const std::vector<Transform<T>> a = transforms<T>(count, 1), b = transforms<T>(count, 2);
+	std::vector<Transform<T>> c(count);
+	for(auto _ : state)
+	{
+		multiply(a.data(), b.data(), c.data(), count);
+		benchmark::DoNotOptimize(c.data());
+		benchmark::ClobberMemory();
+	}
+	flops(state, (double)count * 65);
+	items(state, count);
+}
+
+template <class T>
+static void compose_quaternion(benchmark::State &state)
+{
+	const std::vector<Transform<T>> a = transforms<T>(count, 1), b = transforms<T>(count, 2);
+	std::vector<Quaternion<T>> c(count);
+	for(auto _ : state)
+	{
+		for(size_t i = 0; i < count; ++i)
+		{
+			c[i] = a[i].rotation() * b[i].rotation();
+		}
+		benchmark::DoNotOptimize(c.data());
+		benchmark::ClobberMemory();
+	}
+	flops(state, (double)count * 28);
+	items(state, count);
+}
+
+template <class T>
+static void rotate_matrix(benchmark::State &state)
+{
+	const std::vector<Transform<T>> a = transforms<T>(count, 1), b = transforms<T>(count, 2);
+	const Matrix<3, 3, T> m = static_cast<Matrix<3, 3, T>>(a[0].rotation());
+	std::vector<Vector<3, T>> p(count), q(count);
+	for(size_t i = 0; i < count; ++i)
+	{
+		p[i] = b[i].translation();
+	}
+	for(auto _ : state)
+	{
+		m.transform(p.data(), q.data(), count);
+		benchmark::DoNotOptimize(q.data());
+		benchmark::ClobberMemory();
+	}
+	flops(state, (double)count * 15);
+	items(state, count);
+}
+
+template <class T>
+static void rotate_quaternion(benchmark::State &state)
+{
+	const std::vector<Transform<T>> a = transforms<T>(count, 1), b = transforms<T>(count, 2);
+	std::vector<Vector<3, T>> p(count), q(count);
+	for(size_t i = 0; i < count; ++i)
+	{
+		p[i] = b[i].translation();
+	}
+	for(auto _ : state)
+	{
+		a[0].rotation().rotate(p.data(), q.data(), count);
+		benchmark::DoNotOptimize(q.data());
+		benchmark::ClobberMemory();
+	}
+	flops(state, (double)count * 30);
+	items(state, count);
+}
+
+BENCHMARK_TEMPLATE(compose_matrix, float);
+BENCHMARK_TEMPLATE(compose_matrix, double);
+BENCHMARK_TEMPLATE(compose_transform, float);
+BENCHMARK_TEMPLATE(compose_transform, double);
+BENCHMARK_TEMPLATE(compose_quaternion, float);
+BENCHMARK_TEMPLATE(compose_quaternion, double);
+BENCHMARK_TEMPLATE(rotate_matrix, float);
+BENCHMARK_TEMPLATE(rotate_quaternion, float);
@@ -0,0 +1,163 @@
+/* vector.cc
+ * Vector<N, T> dot, cross, quadrance, normalize and fused expressions over a block
+ * of vectors small enough to stay in L1, so the arithmetic is measured
+ * rather than the memory system
+ */
+#include <vector>
+#include "bench.hh"
+#include "vector.hh"
+
+static constexpr size_t count = 1024;
+
+template <class V>
+static std::vector<V> vectors(size_t n, typename V::scalar offset)
+{
+	std::vector<V> v(n);
+	for(size_t i = 0; i < n; ++i)
+	{
+		for(int k = 0; k < V::size; ++k)
+		{
+			v[i][k] = (typename V::scalar)(1 + (i * 7 + (size_t)k * 3) % 17) + offset;
+		}
+	}
+	return v;
+}
+
+template <class V>
+static void dot(benchmark::State &state)
+{
+	typedef typename V::scalar T;
+	const std::vector<V> a = vectors<V>(count, T(0)), b = vectors<V>(count, T(1));
+	for(auto _ : state)
+	{
+		T s = T();
+		for(size_t i = 0; i < count; ++i)
+		{
+			s += a[i].dot(b[i]);
+		}
+		benchmark::DoNotOptimize(s);
+	}
+	flops(state, (double)count * 2 * V::size);
+	bandwidth(state, 2 * count * sizeof(V));
+	items(state, count);
+}
+
+template <class V>
+static void cross(benchmark::State &state)
+{
+	typedef typename V::scalar T;
+	const std::vector<V> a = vectors<V>(count, T(0)), b = vectors<V>(count, T(1));
+	std::vector<V> c(count);
+	for(auto _ : state)
+	{
+		for(size_t i = 0; i < count; ++i)
+		{
+			c[i] = a[i].cross(b[i]);
+		}
+		benchmark::DoNotOptimize(c.data());
+		benchmark::ClobberMemory();
+	}
+	flops(state, (double)count * 9);
+	bandwidth(state, 3 * count * sizeof(V));
+	items(state, count);
+}
+
+template <class V>
+static void normalize(benchmark::State &state)
+{
+	typedef typename V::scalar T;
+	const std::vector<V> a = vectors<V>(count, T(0));
+	std::vector<V> c(count);
+	for(auto _ : state)
+	{
+		for(size_t i = 0; i < count; ++i)
+		{
+			c[i] = a[i].normalize();
+		}
+		benchmark::DoNotOptimize(c.data());
+		benchmark::ClobberMemory();
+	}
+	/* dot, square root and division by the magnitude
+	 */
+	flops(state, (double)count * (3 * V::size + 1));
+	bandwidth(state, 2 * count * sizeof(V));
+	items(state, count);
+}
+
+template <class V>
+static void normalize_fast(benchmark::State &state)
+{
+	typedef typename V::scalar T;
+	const std::vector<V> a = vectors<V>(count, T(0));
+	std::vector<V> c(count);
+	for(auto _ : state)
+	{
+		for(size_t i = 0; i < count; ++i)
+		{
+			c[i] = a[i].normalize_fast();
+		}
+		benchmark::DoNotOptimize(c.data());
+		benchmark::ClobberMemory();
+	}
+	flops(state, (double)count * (3 * V::size + 1));
+	bandwidth(state, 2 * count * sizeof(V));
+	items(state, count);
+}
+
+template <class V>
+static void quadrance(benchmark::State &state)
+{
+	typedef typename V::scalar T;
+	const std::vector<V> a = vectors<V>(count, T(0)), b = vectors<V>(count, T(1));
+	for(auto _ : state)
+	{
+		T s = T();
+		for(size_t i = 0; i < count; ++i)
+		{
+			s += a[i].quadrance(b[i]);
+		}
+		benchmark::DoNotOptimize(s);
+	}
+	flops(state, (double)count * 3 * V::size);
+	bandwidth(state, 2 * count * sizeof(V));
+	items(state, count);
+}
+
+/* c = a + b * k - c / k, one pass through the expression templates
+ */
+template <class V>
+static void expression(benchmark::State &state)
+{
+	typedef typename V::scalar T;
+	const std::vector<V> a = vectors<V>(count, T(0)), b = vectors<V>(count, T(1));
+	std::vector<V> c = vectors<V>(count, T(2));
+	const T k = T(2);
+	for(auto _ : state)
+	{
+		for(size_t i = 0; i < count; ++i)
+		{
+			c[i] = a[i] + b[i] * k - c[i] / k;
+		}
+		benchmark::DoNotOptimize(c.data());
+		benchmark::ClobberMemory();
+	}
+	flops(state, (double)count * 4 * V::size);
+	bandwidth(state, 4 * count * sizeof(V));
+	items(state, count);
+}
+
+BENCHMARK_TEMPLATE(dot, Vector3f);
+BENCHMARK_TEMPLATE(dot, Vector4f);
+BENCHMARK_TEMPLATE(dot, Vector4lf);
+BENCHMARK_TEMPLATE(dot, Vector2i);
+BENCHMARK_TEMPLATE(cross, Vector3f);
+BENCHMARK_TEMPLATE(cross, Vector3lf);
+BENCHMARK_TEMPLATE(normalize, Vector3f);
+BENCHMARK_TEMPLATE(normalize, Vector4f);
+BENCHMARK_TEMPLATE(normalize, Vector4lf);
+BENCHMARK_TEMPLATE(normalize_fast, Vector3f);
+BENCHMARK_TEMPLATE(normalize_fast, Vector4f);
+BENCHMARK_TEMPLATE(quadrance, Vector3f);
+BENCHMARK_TEMPLATE(quadrance, Vector4lf);
+BENCHMARK_TEMPLATE(expression, Vector3f);
+BENCHMARK_TEMPLATE(expression, Vector4lf);
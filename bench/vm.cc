@@ -0,0 +1,41 @@
+/* vm.cc
+ * Compiled RPN expressions run by vm::Machine, over scalars and vectors.
+ * bench_vm dispatches through computed gotos, bench_vm_switch is the same
+ * source built with VM_SWITCH.
+ */
+#include <string>
+#include <vector>
+#include "bench.hh"
+#include "vm.hh"
+
+template <class T>
+static void run(benchmark::State &state, const std::string &text, const std::vector<T> &variables)
+{
+	const vm::Program<T> program = vm::Compiler<T>({"x", "y"}).compile(text);
+	vm::Machine<T> machine;
+	for(auto _ : state)
+	{
+		T r = machine.run(program, variables.data());
+		benchmark::DoNotOptimize(r);
+	}
+	items(state, program.code().size());
+}
+
+static void scalar(benchmark::State &state)
+{
+	run<double>(state, "x y + dup * x y 2 pick + * + sqrt", {3.0, 4.0});
+}
+
+static void words(benchmark::State &state)
+{
+	run<double>(state, "x y over over swap rot tuck nip 3 roll 2 pick + + + +", {3.0, 4.0});
+}
+
+static void vector(benchmark::State &state)
+{
+	run<Vector3lf>(state, "x y + y x - 1 pick cross + normalize", {Vector3lf{1, 2, 3}, Vector3lf{4, 5, 6}});
+}
+
+BENCHMARK(scalar);
+BENCHMARK(words);
+BENCHMARK(vector);